@@ -0,0 +1,232 @@
+
+// Checks for things you can't see by looking at the picture, like the SSE2 paths giving exactly the same bytes as
+// the plain C++ they were written from
+// Nothing here needs a window or OpenGL, so it's its own little program
+// Building it runs it, and a failure fails the build
+
+#include "MipChain.h"
+#include "BlockCompressor.h"
+#include "TextureFile.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Counts what's been checked and what failed, and says which
+class TestResults
+{
+public:
+
+	TestResults() : _checks( 0 ), _failures( 0 ) {}
+
+	void Check( bool passed, const char *what, unsigned int width, unsigned int height )
+	{
+		_checks++;
+		if( !passed )
+		{
+			_failures++;
+			std::cerr<<"SELF TEST FAILED: "<<what<<" ("<<width<<"x"<<height<<")"<<std::endl;
+		}
+	}
+
+	unsigned int GetChecks() const { return _checks; }
+	unsigned int GetFailures() const { return _failures; }
+
+protected:
+
+	unsigned int _checks, _failures;
+};
+
+// Sizes that catch the awkward cases: a single pixel, a single row or column, odd sides and long thin images
+static const unsigned int TEST_SIZES[][2] = { { 1, 1 }, { 1, 7 }, { 3, 1 }, { 5, 5 }, { 7, 3 }, { 33, 17 }, { 2, 130 }, { 67, 45 } };
+static const size_t NUM_TEST_SIZES = sizeof( TEST_SIZES ) / sizeof( TEST_SIZES[0] );
+
+// Noise, the same every run so a failure can be repeated
+static std::vector<unsigned char> MakeTestImage( unsigned int width, unsigned int height )
+{
+	std::vector<unsigned char> rgba( (size_t) width * height * 4 );
+	unsigned int state = width * 7919u + height;
+	for( size_t i = 0; i < rgba.size(); i++ )
+	{
+		state = state * 1664525u + 1013904223u;
+		rgba[i] = (unsigned char) ( state >> 24 );
+	}
+	return rgba;
+}
+
+static bool SameData( const MipChain &a, const MipChain &b )
+{
+	return a.dataSize == b.dataSize && a.levels.size() == b.levels.size() && memcmp( a.data, b.data, a.dataSize ) == 0;
+}
+
+// The SSE2 filter against the scalar one, and threaded against not, which must all give the same bytes
+static void TestMipChains( TestResults &results )
+{
+	for( size_t s = 0; s < NUM_TEST_SIZES; s++ )
+	{
+		unsigned int width = TEST_SIZES[s][0], height = TEST_SIZES[s][1];
+		std::vector<unsigned char> image = MakeTestImage( width, height );
+		MipChain scalar, simd, threaded;
+		scalar.Build( &image[0], width, height, 1, false );
+		simd.Build( &image[0], width, height, 1, true );
+		threaded.Build( &image[0], width, height, 0, true );
+		results.Check( SameData( scalar, simd ), "mip chain SSE2 matches scalar", width, height );
+		results.Check( SameData( scalar, threaded ), "mip chain threaded matches single thread", width, height );
+	}
+
+	// The last column of an odd sized level has to make it into the level below
+	const unsigned char blackBlackWhite[] = { 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255, 255 };
+	MipChain odd;
+	odd.Build( blackBlackWhite, 3, 1, 1, true );
+	const unsigned char *bottom = odd.GetLevelData( 1 );
+	results.Check( odd.levels.size() == 2 && bottom[0] > 0 && bottom[0] < 255, "odd column is filtered in", 3, 1 );
+}
+
+// Every block format's SSE2 encoder against the scalar one, on sizes that leave partial blocks at the edges
+static void TestBlockCompressor( TestResults &results )
+{
+	const TextureFormat formats[] = { TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC3, TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_BC7 };
+	for( size_t s = 0; s < NUM_TEST_SIZES; s++ )
+	{
+		unsigned int width = TEST_SIZES[s][0], height = TEST_SIZES[s][1];
+		std::vector<unsigned char> image = MakeTestImage( width, height );
+		MipChain source;
+		source.Build( &image[0], width, height, 1, false );
+		for( size_t f = 0; f < sizeof( formats ) / sizeof( formats[0] ); f++ )
+		{
+			MipChain scalar, simd;
+			CompressMipChain( source, formats[f], scalar, 1, false );
+			CompressMipChain( source, formats[f], simd, 0, true );
+			std::string what = std::string( GetTextureFormatName( formats[f] ) ) + " SSE2 matches scalar";
+			results.Check( SameData( scalar, simd ), what.c_str(), width, height );
+		}
+	}
+}
+
+// Reads the first length bytes as a DDS or a KTX2, straight from memory so nothing is left lying around on disk
+static bool ReadTestFile( const std::vector<unsigned char> &bytes, size_t length, bool dds, MipChain &chain )
+{
+	const char *data = (const char*) &bytes[0];
+	return dds ? TextureFile::ReadDDS( data, length, chain ) : TextureFile::ReadKTX2( data, length, chain );
+}
+
+// Little endian, as the files are
+static void AppendUint( std::vector<unsigned char> &bytes, unsigned long long value, unsigned int size )
+{
+	for( unsigned int i = 0; i < size; i++ )
+	{
+		bytes.push_back( (unsigned char) ( value >> ( i * 8 ) ) );
+	}
+}
+
+// A 4x4 texture with one level, a single BC1 block
+// dx10 names the format in the extra header rather than as a FourCC
+static std::vector<unsigned char> MakeTestDDS( bool dx10 )
+{
+	const char *fourCC = dx10 ? "DX10" : "DXT1";
+	std::vector<unsigned char> bytes( "DDS ", "DDS " + 4 );
+	// size, flags, height, width, pitchOrLinearSize, depth, mipMapCount, reserved1[11]
+	AppendUint( bytes, 124, 4 );
+	AppendUint( bytes, 0x1007, 4 );
+	AppendUint( bytes, 4, 4 );
+	AppendUint( bytes, 4, 4 );
+	AppendUint( bytes, 8, 4 );
+	AppendUint( bytes, 0, 4 );
+	AppendUint( bytes, 1, 4 );
+	bytes.resize( bytes.size() + 11 * 4, 0 );
+	// Pixel format: size, flags (FourCC), FourCC, bit count and masks
+	AppendUint( bytes, 32, 4 );
+	AppendUint( bytes, 0x4, 4 );
+	bytes.insert( bytes.end(), fourCC, fourCC + 4 );
+	bytes.resize( bytes.size() + 5 * 4, 0 );
+	// caps[4], reserved2
+	AppendUint( bytes, 0x1000, 4 );
+	bytes.resize( bytes.size() + 4 * 4, 0 );
+	if( dx10 )
+	{
+		// BC1_UNORM, 2D, no flags, one layer
+		AppendUint( bytes, 71, 4 );
+		AppendUint( bytes, 3, 4 );
+		AppendUint( bytes, 0, 4 );
+		AppendUint( bytes, 1, 4 );
+		AppendUint( bytes, 0, 4 );
+	}
+	for( unsigned int i = 0; i < 8; i++ )
+	{
+		bytes.push_back( (unsigned char) ( i + 1 ) );
+	}
+	return bytes;
+}
+
+// The same texture as a KTX2, the block placed by the level index
+static std::vector<unsigned char> MakeTestKTX2()
+{
+	const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	std::vector<unsigned char> bytes( identifier, identifier + 12 );
+	// vkFormat (BC1_RGB_UNORM_BLOCK), typeSize, width, height, depth, layers, faces, levels, supercompression
+	AppendUint( bytes, 131, 4 );
+	AppendUint( bytes, 1, 4 );
+	AppendUint( bytes, 4, 4 );
+	AppendUint( bytes, 4, 4 );
+	AppendUint( bytes, 0, 4 );
+	AppendUint( bytes, 0, 4 );
+	AppendUint( bytes, 1, 4 );
+	AppendUint( bytes, 1, 4 );
+	AppendUint( bytes, 0, 4 );
+	// No descriptive blocks
+	bytes.resize( bytes.size() + 4 * 4 + 2 * 8, 0 );
+	// The one level's offset, length and uncompressed length, the block goes straight after
+	AppendUint( bytes, bytes.size() + 24, 8 );
+	AppendUint( bytes, 8, 8 );
+	AppendUint( bytes, 8, 8 );
+	for( unsigned int i = 0; i < 8; i++ )
+	{
+		bytes.push_back( (unsigned char) ( i + 1 ) );
+	}
+	return bytes;
+}
+
+// Good files read as the block they hold, cut off or broken ones are turned away
+static void TestTextureFiles( TestResults &results )
+{
+	const std::vector<unsigned char> files[3] = { MakeTestDDS( false ), MakeTestDDS( true ), MakeTestKTX2() };
+	const std::string names[3] = { "DDS", "DDS DX10", "KTX2" };
+	const bool dds[3] = { true, true, false };
+	for( int f = 0; f < 3; f++ )
+	{
+		const std::vector<unsigned char> &bytes = files[f];
+		MipChain chain;
+		bool ok = ReadTestFile( bytes, bytes.size(), dds[f], chain );
+		results.Check( ok && chain.format == TEXTURE_FORMAT_BC1 && chain.levels.size() == 1 && chain.width == 4 && chain.height == 4,
+			( names[f] + " reads" ).c_str(), 4, 4 );
+
+		// Empty, cut off in the header, half way, and short of the block
+		size_t lengths[] = { 0, 4, 16, bytes.size() / 2, bytes.size() - 8, bytes.size() - 1 };
+		for( size_t l = 0; l < sizeof( lengths ) / sizeof( lengths[0] ); l++ )
+		{
+			results.Check( !ReadTestFile( bytes, lengths[l], dds[f], chain ), ( names[f] + " cut off is rejected" ).c_str(), 4, 4 );
+		}
+	}
+
+	// A level offset big enough to wrap round when its length is added
+	std::vector<unsigned char> wrapped = files[2];
+	size_t offsetAt = wrapped.size() - 8 - 24;
+	for( unsigned int i = 0; i < 8; i++ )
+	{
+		wrapped[offsetAt + i] = 0xFF;
+	}
+	MipChain chain;
+	results.Check( !ReadTestFile( wrapped, wrapped.size(), false, chain ), "KTX2 with a huge level offset is rejected", 4, 4 );
+}
+
+int main()
+{
+	TestResults results;
+	TestMipChains( results );
+	TestBlockCompressor( results );
+	TestTextureFiles( results );
+
+	std::cout<<"INFO: Self tests: "<<results.GetChecks() - results.GetFailures()<<" of "<<results.GetChecks()<<" passed"<<std::endl;
+	return results.GetFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+
+#include "AssetRegistry.h"
+#include "Hash.h"
+#include "ProgramCache.h"
+#include "TextureStreamer.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cctype>
+#include <chrono>
+#include <thread>
+
+
+AssetRegistry::AssetRegistry()
+{
+	_numRequests = 0;
+	_numShared = 0;
+}
+
+std::string AssetRegistry::NormalizePath( const std::string &path )
+{
+	// Split into folder names, dropping empty parts and '.'
+	// A '..' cancels out the folder before it, unless there's nothing left to cancel
+	std::vector<std::string> parts;
+	std::string part;
+	for( size_t i = 0; i <= path.size(); i++ )
+	{
+		char c = ( i < path.size() ) ? path[i] : '/';
+		if( c != '/' && c != '\\' )
+		{
+#ifdef _WIN32
+			c = (char) tolower( (unsigned char) c );
+#endif
+			part += c;
+			continue;
+		}
+
+		if( part == ".." && !parts.empty() && parts.back() != ".." )
+		{
+			parts.pop_back();
+		}
+		else if( !part.empty() && part != "." )
+		{
+			parts.push_back( part );
+		}
+		part.clear();
+	}
+
+	std::string result;
+	if( !path.empty() && ( path[0] == '/' || path[0] == '\\' ) )
+	{
+		result = "/";
+	}
+	for( size_t i = 0; i < parts.size(); i++ )
+	{
+		if( i > 0 )
+		{
+			result += '/';
+		}
+		result += parts[i];
+	}
+	return result;
+}
+
+template<class T>
+std::shared_ptr<T> AssetRegistry::Find( std::map< std::string, std::weak_ptr<T> > &assets, const std::string &key )
+{
+	_numRequests++;
+
+	typename std::map< std::string, std::weak_ptr<T> >::iterator found = assets.find( key );
+	if( found == assets.end() )
+	{
+		return std::shared_ptr<T>();
+	}
+
+	std::shared_ptr<T> asset = found->second.lock();
+	if( asset )
+	{
+		_numShared++;
+	}
+	else
+	{
+		// Everything using it has gone, so forget about it
+		assets.erase( found );
+	}
+	return asset;
+}
+
+std::shared_ptr<Mesh> AssetRegistry::GetMesh( const std::string &filename, const MeshLoadOptions &options )
+{
+	std::ostringstream key;
+	key<<NormalizePath( filename )<<'#'<<std::hex<<options.GetSettingsHash();
+
+	std::shared_ptr<Mesh> mesh = Find( _meshes, key.str() );
+	if( !mesh )
+	{
+		mesh = std::make_shared<Mesh>();
+		mesh->LoadOBJ( filename, options );
+		_meshes[key.str()] = mesh;
+	}
+	return mesh;
+}
+
+std::shared_ptr<Texture> AssetRegistry::GetTexture( const std::string &filename, const TextureLoadOptions &options )
+{
+	std::ostringstream key;
+	key<<NormalizePath( filename )<<'#'<<std::hex<<options.GetSettingsHash();
+
+	std::shared_ptr<Texture> texture = Find( _textures, key.str() );
+	if( !texture )
+	{
+		texture = std::make_shared<Texture>();
+		if( options.streamer )
+		{
+			// Whether it loads isn't known until later, a texture that doesn't keeps the placeholder
+			options.streamer->Request( texture, filename, options );
+		}
+		else if( !texture->Load( filename, options ) )
+		{
+			return std::shared_ptr<Texture>();
+		}
+		_textures[key.str()] = texture;
+	}
+	return texture;
+}
+
+std::shared_ptr<ShaderProgram> AssetRegistry::GetShaderProgram( const std::string &vertFilename, const std::string &fragFilename, const ShaderDefines &defines )
+{
+	// The sources are cheap to read compared to compiling them, and hashing them means an edited shader is never mistaken for the old one
+	// Preprocessing first means the hash covers the included files and the defines as well
+	std::string vertSource, fragSource;
+	if( !PreprocessShader( vertFilename, defines, vertSource ) || !PreprocessShader( fragFilename, defines, fragSource ) )
+	{
+		return std::shared_ptr<ShaderProgram>();
+	}
+
+	std::string variant = JoinShaderDefines( defines );
+	std::ostringstream key;
+	key<<NormalizePath( vertFilename )<<'|'<<NormalizePath( fragFilename )<<'['<<variant<<']'<<'#'<<std::hex<<HashString( fragSource, HashString( vertSource ) );
+
+	std::shared_ptr<ShaderProgram> program = Find( _shaderPrograms, key.str() );
+	if( !program )
+	{
+		program = std::make_shared<ShaderProgram>();
+		std::string name = vertFilename + " + " + fragFilename + ( variant.empty() ? "" : " [" + variant + "]" );
+		program->Submit( vertSource, fragSource, name, ProgramCache::GetCachePath( vertFilename, fragFilename, variant ) );
+		_shaderPrograms[key.str()] = program;
+		_pendingPrograms.push_back( program );
+	}
+	return program;
+}
+
+void AssetRegistry::ResolveShaderPrograms()
+{
+	if( _pendingPrograms.empty() )
+	{
+		return;
+	}
+
+	// Time from the first submit, so the timeline shows how the compiles overlapped
+	std::chrono::high_resolution_clock::time_point startTime = _pendingPrograms[0]->GetSubmitTime();
+	std::chrono::high_resolution_clock::time_point submittedTime = std::chrono::high_resolution_clock::now();
+	std::ostringstream timeline;
+	timeline<<"INFO: Shader timeline: "<<_pendingPrograms.size()<<" programs submitted by "
+		<<std::chrono::duration<double>( submittedTime - startTime ).count() * 1000.0<<" ms"
+		<<( ShaderProgram::IsParallelCompileSupported() ? " (compiling in parallel)" : " (compiling one at a time)" );
+
+	// Take whichever programs are finished, and only wait on one when none of them are
+	while( !_pendingPrograms.empty() )
+	{
+		size_t next = 0;
+		while( next < _pendingPrograms.size() && _pendingPrograms[next]->IsCompiling() )
+		{
+			next++;
+		}
+		if( next == _pendingPrograms.size() )
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::shared_ptr<ShaderProgram> program = _pendingPrograms[next];
+		_pendingPrograms.erase( _pendingPrograms.begin() + next );
+		bool ok = program->Resolve();
+		timeline<<"\n    "<<std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count() * 1000.0<<" ms: "
+			<<program->GetName()<<( ok ? " ready" : " FAILED" );
+
+		// Whoever asked still has it, but nobody else should be handed a broken program
+		if( !ok )
+		{
+			for( std::map< std::string, std::weak_ptr<ShaderProgram> >::iterator i = _shaderPrograms.begin(); i != _shaderPrograms.end(); ++i )
+			{
+				if( i->second.lock() == program )
+				{
+					_shaderPrograms.erase( i );
+					break;
+				}
+			}
+		}
+	}
+	std::cout<<timeline.str()<<std::endl;
+}
+
+void AssetRegistry::PrintStats() const
+{
+	std::cout<<"INFO: Assets loaded: "<<_meshes.size()<<" meshes, "<<_textures.size()<<" textures, "<<_shaderPrograms.size()<<" shader programs"
+		<<" ("<<_numShared<<" of "<<_numRequests<<" requests shared an existing asset)"<<std::endl;
+}
@@ -0,0 +1,71 @@
+
+#ifndef __ASSET_REGISTRY__
+#define __ASSET_REGISTRY__
+
+#include "Mesh.h"
+#include "Texture.h"
+#include "ShaderProgram.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Hands out shared meshes, textures and shader programs, so each one is only loaded once
+// however many objects use it
+// Assets are reference counted: the registry only keeps a weak reference, so an asset is freed
+// as soon as the last object using it lets go, and loaded again if it's asked for after that
+class AssetRegistry
+{
+public:
+
+	AssetRegistry();
+
+	// Meshes are shared by file and by the load options that change what ends up on the GPU
+	std::shared_ptr<Mesh> GetMesh( const std::string &filename, const MeshLoadOptions &options = MeshLoadOptions() );
+
+	// Textures are shared by file and by the load options, so the same image can be asked for compressed and not
+	// A compressed .ktx2 or .dds next to the image is loaded in its place when there is one (see Texture::Load)
+	// Returns NULL if the image could not be loaded
+	// With a streamer in the options the texture comes back straight away showing a placeholder, and loads in the background
+	std::shared_ptr<Texture> GetTexture( const std::string &filename, const TextureLoadOptions &options = TextureLoadOptions() );
+
+	// Programs are shared by file, defines and by the contents of the files (includes too),
+	// so editing a shader and asking for it again builds a new program
+	// Each set of defines is its own variant of the program, see ShaderPreprocessor.h
+	// New programs are only submitted to the driver, so ask for all of them and then call ResolveShaderPrograms
+	// Returns NULL if the shader files could not be read
+	// Whether it compiled and linked is only known once it's resolved, so check IsReady() after ResolveShaderPrograms
+	std::shared_ptr<ShaderProgram> GetShaderProgram( const std::string &vertFilename, const std::string &fragFilename, const ShaderDefines &defines = ShaderDefines() );
+
+	// Waits for every submitted program to finish, taking them in whatever order the driver finishes them
+	// Prints a timeline of when each was ready, to show how much the driver managed to do at once
+	// Programs that failed are dropped from the registry, so asking for them again (after fixing the shader) tries again
+	void ResolveShaderPrograms();
+
+	// Turns different ways of writing the same path into one key
+	// e.g. "Resources\\Sub/../Maxwell.obj" and "./Resources/Maxwell.obj" both become "Resources/Maxwell.obj"
+	// On Windows the key is also lower case, as the file system doesn't care
+	static std::string NormalizePath( const std::string &path );
+
+	// Prints how many assets are loaded and how many requests were saved by sharing
+	void PrintStats() const;
+
+protected:
+
+	// Returns the live asset for the key, or NULL if it was never loaded or has since been freed
+	template<class T>
+	std::shared_ptr<T> Find( std::map< std::string, std::weak_ptr<T> > &assets, const std::string &key );
+
+	std::map< std::string, std::weak_ptr<Mesh> > _meshes;
+	std::map< std::string, std::weak_ptr<Texture> > _textures;
+	std::map< std::string, std::weak_ptr<ShaderProgram> > _shaderPrograms;
+
+	// Programs submitted since the last ResolveShaderPrograms
+	std::vector< std::shared_ptr<ShaderProgram> > _pendingPrograms;
+
+	// Every Get call, and the ones answered with an asset that was already loaded
+	unsigned int _numRequests;
+	unsigned int _numShared;
+};
+
+#endif
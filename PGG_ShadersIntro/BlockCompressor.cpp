@@ -0,0 +1,837 @@
+
+#include "BlockCompressor.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// SSE2 is always there on 64-bit x86, and on 32-bit builds that ask for it
+#if defined( _M_X64 ) || defined( _M_AMD64 ) || defined( __SSE2__ ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define BLOCK_COMPRESSOR_SSE2
+#endif
+
+
+// The 16 pixels of a block, one array per channel so four pixels fit in a register
+struct BlockPixels
+{
+	float channels[4][16];
+};
+
+// Puts each pixel of a block on the line from end0 to end1, as a whole step from 0 to maxIndex
+// Only the listed channels count, with the endpoints given for just those
+typedef void (*ProjectFunction)( const BlockPixels &block, const int *channels, int numChannels, const float *end0, const float *end1, int maxIndex, unsigned char *indices );
+
+// BC7's interpolation weights for 4-bit indices, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Bytes in one block of each format, RGBA8 has no blocks
+static const size_t BLOCK_BYTES[TEXTURE_FORMAT_COUNT] = { 0, 8, 16, 16, 16 };
+
+
+static void LoadBlock( const unsigned char *rgba, unsigned int width, unsigned int height, unsigned int blockX, unsigned int blockY, BlockPixels &block )
+{
+	for( unsigned int y = 0; y < 4; y++ )
+	{
+		// Blocks hanging off the edge of the level repeat its last row and column
+		const unsigned char *row = rgba + (size_t) std::min( blockY * 4 + y, height - 1 ) * width * 4;
+		for( unsigned int x = 0; x < 4; x++ )
+		{
+			const unsigned char *pixel = row + std::min( blockX * 4 + x, width - 1 ) * 4;
+			for( int c = 0; c < 4; c++ )
+			{
+				block.channels[c][y * 4 + x] = pixel[c];
+			}
+		}
+	}
+}
+
+// Scalar reference for ProjectIndicesSSE2
+static void ProjectIndicesScalar( const BlockPixels &block, const int *channels, int numChannels, const float *end0, const float *end1, int maxIndex, unsigned char *indices )
+{
+	float direction[4];
+	float lengthSquared = 0.0f;
+	for( int j = 0; j < numChannels; j++ )
+	{
+		direction[j] = end1[j] - end0[j];
+		lengthSquared += direction[j] * direction[j];
+	}
+	// Equal endpoints put every pixel at index 0
+	float scale = lengthSquared > 0.0f ? maxIndex / lengthSquared : 0.0f;
+	float limit = (float) maxIndex;
+
+	for( int i = 0; i < 16; i++ )
+	{
+		float t = 0.0f;
+		for( int j = 0; j < numChannels; j++ )
+		{
+			t += ( block.channels[channels[j]][i] - end0[j] ) * direction[j];
+		}
+		t = std::min( std::max( t * scale + 0.5f, 0.0f ), limit );
+		indices[i] = (unsigned char) (int) t;
+	}
+}
+
+#ifdef BLOCK_COMPRESSOR_SSE2
+
+// Same sums in the same order as ProjectIndicesScalar, four pixels at a time
+static void ProjectIndicesSSE2( const BlockPixels &block, const int *channels, int numChannels, const float *end0, const float *end1, int maxIndex, unsigned char *indices )
+{
+	float direction[4];
+	float lengthSquared = 0.0f;
+	for( int j = 0; j < numChannels; j++ )
+	{
+		direction[j] = end1[j] - end0[j];
+		lengthSquared += direction[j] * direction[j];
+	}
+	const __m128 scale = _mm_set1_ps( lengthSquared > 0.0f ? maxIndex / lengthSquared : 0.0f );
+	const __m128 limit = _mm_set1_ps( (float) maxIndex );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	const __m128 zero = _mm_setzero_ps();
+
+	for( int i = 0; i < 16; i += 4 )
+	{
+		__m128 t = _mm_setzero_ps();
+		for( int j = 0; j < numChannels; j++ )
+		{
+			__m128 offset = _mm_sub_ps( _mm_loadu_ps( &block.channels[channels[j]][i] ), _mm_set1_ps( end0[j] ) );
+			t = _mm_add_ps( t, _mm_mul_ps( offset, _mm_set1_ps( direction[j] ) ) );
+		}
+		t = _mm_min_ps( _mm_max_ps( _mm_add_ps( _mm_mul_ps( t, scale ), half ), zero ), limit );
+
+		// Four 32-bit indices down to four bytes
+		__m128i whole = _mm_cvttps_epi32( t );
+		whole = _mm_packs_epi32( whole, whole );
+		whole = _mm_packus_epi16( whole, whole );
+		int packed = _mm_cvtsi128_si32( whole );
+		memcpy( indices + i, &packed, 4 );
+	}
+}
+
+#endif
+
+// Ends of the line that best fits the block's colours, the principal axis of their spread
+// The endpoints are where the furthest pixels either way project onto it, end0 at the high end
+static void FitEndpoints( const BlockPixels &block, const int *channels, int numChannels, float *end0, float *end1 )
+{
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for( int j = 0; j < numChannels; j++ )
+	{
+		for( int i = 0; i < 16; i++ )
+		{
+			mean[j] += block.channels[channels[j]][i];
+		}
+		mean[j] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for( int i = 0; i < 16; i++ )
+	{
+		for( int j = 0; j < numChannels; j++ )
+		{
+			for( int k = 0; k < numChannels; k++ )
+			{
+				covariance[j][k] += ( block.channels[channels[j]][i] - mean[j] ) * ( block.channels[channels[k]][i] - mean[k] );
+			}
+		}
+	}
+
+	// Power iteration, starting from the row of the channel that varies most, homes in on the axis in a few steps
+	int widest = 0;
+	for( int j = 1; j < numChannels; j++ )
+	{
+		widest = covariance[j][j] > covariance[widest][widest] ? j : widest;
+	}
+	float axis[4];
+	for( int j = 0; j < numChannels; j++ )
+	{
+		axis[j] = covariance[widest][j];
+	}
+	for( int iteration = 0; iteration < 8; iteration++ )
+	{
+		float next[4];
+		float largest = 0.0f;
+		for( int j = 0; j < numChannels; j++ )
+		{
+			next[j] = 0.0f;
+			for( int k = 0; k < numChannels; k++ )
+			{
+				next[j] += covariance[j][k] * axis[k];
+			}
+			largest = std::max( largest, std::fabs( next[j] ) );
+		}
+		if( largest <= 0.0f )
+		{
+			break;
+		}
+		for( int j = 0; j < numChannels; j++ )
+		{
+			axis[j] = next[j] / largest;
+		}
+	}
+
+	float axisLengthSquared = 0.0f;
+	for( int j = 0; j < numChannels; j++ )
+	{
+		axisLengthSquared += axis[j] * axis[j];
+	}
+	if( axisLengthSquared <= 0.0f )
+	{
+		// Every pixel is the same
+		for( int j = 0; j < numChannels; j++ )
+		{
+			end0[j] = end1[j] = mean[j];
+		}
+		return;
+	}
+
+	float lowest = std::numeric_limits<float>::max(), highest = -std::numeric_limits<float>::max();
+	for( int i = 0; i < 16; i++ )
+	{
+		float t = 0.0f;
+		for( int j = 0; j < numChannels; j++ )
+		{
+			t += ( block.channels[channels[j]][i] - mean[j] ) * axis[j];
+		}
+		lowest = std::min( lowest, t );
+		highest = std::max( highest, t );
+	}
+	for( int j = 0; j < numChannels; j++ )
+	{
+		end0[j] = std::min( std::max( mean[j] + axis[j] * highest / axisLengthSquared, 0.0f ), 255.0f );
+		end1[j] = std::min( std::max( mean[j] + axis[j] * lowest / axisLengthSquared, 0.0f ), 255.0f );
+	}
+}
+
+// Least squares endpoints for indices that are already chosen, weights[index] being how far from end0 to end1 each index is
+// Returns false if every pixel has the same weight, which leaves nothing to solve for
+static bool RefitEndpoints( const BlockPixels &block, const int *channels, int numChannels, const unsigned char *indices, const float *weights, float *end0, float *end1 )
+{
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float x[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, y[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for( int i = 0; i < 16; i++ )
+	{
+		float w = weights[indices[i]];
+		float v = 1.0f - w;
+		a += v * v;
+		b += v * w;
+		c += w * w;
+		for( int j = 0; j < numChannels; j++ )
+		{
+			x[j] += v * block.channels[channels[j]][i];
+			y[j] += w * block.channels[channels[j]][i];
+		}
+	}
+
+	float determinant = a * c - b * b;
+	if( std::fabs( determinant ) < 1e-6f )
+	{
+		return false;
+	}
+	for( int j = 0; j < numChannels; j++ )
+	{
+		end0[j] = std::min( std::max( ( c * x[j] - b * y[j] ) / determinant, 0.0f ), 255.0f );
+		end1[j] = std::min( std::max( ( a * y[j] - b * x[j] ) / determinant, 0.0f ), 255.0f );
+	}
+	return true;
+}
+
+// Squared error of the block drawn from the palette with the given indices
+static float PaletteError( const BlockPixels &block, const int *channels, int numChannels, const float (*palette)[4], const unsigned char *indices )
+{
+	float error = 0.0f;
+	for( int i = 0; i < 16; i++ )
+	{
+		for( int j = 0; j < numChannels; j++ )
+		{
+			float difference = block.channels[channels[j]][i] - palette[indices[i]][j];
+			error += difference * difference;
+		}
+	}
+	return error;
+}
+
+// Little-endian bits into a block, first value in the lowest bits
+struct BlockBitWriter
+{
+	BlockBitWriter() : position( 0 ) { bits[0] = bits[1] = 0; }
+
+	void Write( unsigned int value, unsigned int count )
+	{
+		for( unsigned int b = 0; b < count; b++, position++ )
+		{
+			bits[position / 64] |= (unsigned long long) ( ( value >> b ) & 1 ) << ( position % 64 );
+		}
+	}
+
+	void Store( unsigned char *output, unsigned int numBytes ) const
+	{
+		for( unsigned int b = 0; b < numBytes; b++ )
+		{
+			output[b] = (unsigned char) ( bits[b / 8] >> ( 8 * ( b % 8 ) ) );
+		}
+	}
+
+	unsigned long long bits[2];
+	unsigned int position;
+};
+
+struct BlockBitReader
+{
+	BlockBitReader( const unsigned char *input, unsigned int numBytes ) : position( 0 )
+	{
+		bits[0] = bits[1] = 0;
+		for( unsigned int b = 0; b < numBytes; b++ )
+		{
+			bits[b / 8] |= (unsigned long long) input[b] << ( 8 * ( b % 8 ) );
+		}
+	}
+
+	unsigned int Read( unsigned int count )
+	{
+		unsigned int value = 0;
+		for( unsigned int b = 0; b < count; b++, position++ )
+		{
+			value |= (unsigned int) ( ( bits[position / 64] >> ( position % 64 ) ) & 1 ) << b;
+		}
+		return value;
+	}
+
+	unsigned long long bits[2];
+	unsigned int position;
+};
+
+
+// BC1 - two RGB565 endpoints and 2-bit indices
+
+static unsigned short PackRGB565( const float *colour )
+{
+	unsigned int r = (unsigned int) ( colour[0] * ( 31.0f / 255.0f ) + 0.5f );
+	unsigned int g = (unsigned int) ( colour[1] * ( 63.0f / 255.0f ) + 0.5f );
+	unsigned int b = (unsigned int) ( colour[2] * ( 31.0f / 255.0f ) + 0.5f );
+	return (unsigned short) ( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+// Expanded to 8 bits the way the GPU does it, repeating the top bits in the bottom ones
+static void UnpackRGB565( unsigned int packed, int *colour )
+{
+	unsigned int r = ( packed >> 11 ) & 31, g = ( packed >> 5 ) & 63, b = packed & 31;
+	colour[0] = (int) ( ( r << 3 ) | ( r >> 2 ) );
+	colour[1] = (int) ( ( g << 2 ) | ( g >> 4 ) );
+	colour[2] = (int) ( ( b << 3 ) | ( b >> 2 ) );
+}
+
+struct ColourBlockFit
+{
+	unsigned short colour0, colour1;
+	// From 0 at colour0 to 3 at colour1, in order along the line rather than BC1's own order
+	unsigned char indices[16];
+	float error;
+};
+
+static void FitColourBlock( const BlockPixels &block, const float *end0, const float *end1, ProjectFunction project, ColourBlockFit &fit )
+{
+	static const int rgb[3] = { 0, 1, 2 };
+
+	fit.colour0 = PackRGB565( end0 );
+	fit.colour1 = PackRGB565( end1 );
+
+	// Indices are picked against the colours the GPU will actually see
+	int colour0[3], colour1[3];
+	UnpackRGB565( fit.colour0, colour0 );
+	UnpackRGB565( fit.colour1, colour1 );
+	float palette[4][4];
+	for( int j = 0; j < 3; j++ )
+	{
+		palette[0][j] = (float) colour0[j];
+		palette[1][j] = ( 2.0f * colour0[j] + colour1[j] ) / 3.0f;
+		palette[2][j] = ( colour0[j] + 2.0f * colour1[j] ) / 3.0f;
+		palette[3][j] = (float) colour1[j];
+	}
+	project( block, rgb, 3, palette[0], palette[3], 3, fit.indices );
+	fit.error = PaletteError( block, rgb, 3, palette, fit.indices );
+}
+
+static void CompressColourBlock( const BlockPixels &block, ProjectFunction project, unsigned char *output )
+{
+	static const int rgb[3] = { 0, 1, 2 };
+	static const float weights[4] = { 0.0f, 1.0f / 3.0f, 2.0f / 3.0f, 1.0f };
+
+	float end0[3], end1[3];
+	FitEndpoints( block, rgb, 3, end0, end1 );
+	ColourBlockFit best;
+	FitColourBlock( block, end0, end1, project, best );
+
+	// Now the indices are known, least squares usually finds better endpoints for them
+	if( RefitEndpoints( block, rgb, 3, best.indices, weights, end0, end1 ) )
+	{
+		ColourBlockFit refit;
+		FitColourBlock( block, end0, end1, project, refit );
+		if( refit.error < best.error )
+		{
+			best = refit;
+		}
+	}
+
+	// The four colour mode needs colour0 above colour1, swapping the ends reverses the indices
+	if( best.colour0 < best.colour1 )
+	{
+		std::swap( best.colour0, best.colour1 );
+		for( int i = 0; i < 16; i++ )
+		{
+			best.indices[i] = (unsigned char) ( 3 - best.indices[i] );
+		}
+	}
+	// Equal ends can't be put in order, but every pixel is then the same colour anyway
+	if( best.colour0 == best.colour1 )
+	{
+		memset( best.indices, 0, sizeof( best.indices ) );
+	}
+
+	// BC1 keeps the two in-between colours after the endpoints
+	static const unsigned int codes[4] = { 0, 2, 3, 1 };
+	BlockBitWriter writer;
+	writer.Write( best.colour0, 16 );
+	writer.Write( best.colour1, 16 );
+	for( int i = 0; i < 16; i++ )
+	{
+		writer.Write( codes[best.indices[i]], 2 );
+	}
+	writer.Store( output, 8 );
+}
+
+static void DecompressColourBlock( const unsigned char *input, bool alwaysFourColours, unsigned char *rgba )
+{
+	BlockBitReader reader( input, 8 );
+	unsigned int colour0 = reader.Read( 16 ), colour1 = reader.Read( 16 );
+
+	int palette[4][4];
+	UnpackRGB565( colour0, palette[0] );
+	UnpackRGB565( colour1, palette[1] );
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	for( int j = 0; j < 3; j++ )
+	{
+		if( colour0 > colour1 || alwaysFourColours )
+		{
+			palette[2][j] = ( 2 * palette[0][j] + palette[1][j] ) / 3;
+			palette[3][j] = ( palette[0][j] + 2 * palette[1][j] ) / 3;
+		}
+		else
+		{
+			// Three colours and transparent black
+			palette[2][j] = ( palette[0][j] + palette[1][j] ) / 2;
+			palette[3][j] = 0;
+		}
+	}
+	palette[3][3] = ( colour0 > colour1 || alwaysFourColours ) ? 255 : 0;
+
+	for( int i = 0; i < 16; i++ )
+	{
+		unsigned int index = reader.Read( 2 );
+		for( int c = 0; c < 4; c++ )
+		{
+			rgba[i * 4 + c] = (unsigned char) palette[index][c];
+		}
+	}
+}
+
+
+// BC4 - one channel with two 8-bit endpoints and 3-bit indices, BC3's alpha and both halves of BC5
+
+struct ChannelBlockFit
+{
+	unsigned char end0, end1;
+	// From 0 at end0 to 7 at end1, in order along the line
+	unsigned char indices[16];
+	float error;
+};
+
+static void FitChannelBlock( const BlockPixels &block, int channel, float end0, float end1, ProjectFunction project, ChannelBlockFit &fit )
+{
+	fit.end0 = (unsigned char) ( end0 + 0.5f );
+	fit.end1 = (unsigned char) ( end1 + 0.5f );
+
+	float palette[8][4];
+	for( int t = 0; t < 8; t++ )
+	{
+		palette[t][0] = ( ( 7 - t ) * fit.end0 + t * fit.end1 ) / 7.0f;
+	}
+	project( block, &channel, 1, palette[0], palette[7], 7, fit.indices );
+	fit.error = PaletteError( block, &channel, 1, palette, fit.indices );
+}
+
+static void CompressChannelBlock( const BlockPixels &block, int channel, ProjectFunction project, unsigned char *output )
+{
+	static const float weights[8] = { 0.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f, 1.0f };
+
+	float end0, end1;
+	FitEndpoints( block, &channel, 1, &end0, &end1 );
+	ChannelBlockFit best;
+	FitChannelBlock( block, channel, end0, end1, project, best );
+
+	if( RefitEndpoints( block, &channel, 1, best.indices, weights, &end0, &end1 ) )
+	{
+		ChannelBlockFit refit;
+		FitChannelBlock( block, channel, end0, end1, project, refit );
+		if( refit.error < best.error )
+		{
+			best = refit;
+		}
+	}
+
+	// The eight value mode needs end0 above end1
+	if( best.end0 < best.end1 )
+	{
+		std::swap( best.end0, best.end1 );
+		for( int i = 0; i < 16; i++ )
+		{
+			best.indices[i] = (unsigned char) ( 7 - best.indices[i] );
+		}
+	}
+	if( best.end0 == best.end1 )
+	{
+		memset( best.indices, 0, sizeof( best.indices ) );
+	}
+
+	// BC4 keeps the six in-between values after the endpoints
+	BlockBitWriter writer;
+	writer.Write( best.end0, 8 );
+	writer.Write( best.end1, 8 );
+	for( int i = 0; i < 16; i++ )
+	{
+		unsigned int t = best.indices[i];
+		writer.Write( t == 0 ? 0 : ( t == 7 ? 1 : t + 1 ), 3 );
+	}
+	writer.Store( output, 8 );
+}
+
+static void DecompressChannelBlock( const unsigned char *input, int channel, unsigned char *rgba )
+{
+	BlockBitReader reader( input, 8 );
+	int end0 = (int) reader.Read( 8 ), end1 = (int) reader.Read( 8 );
+
+	int palette[8];
+	palette[0] = end0;
+	palette[1] = end1;
+	if( end0 > end1 )
+	{
+		for( int t = 1; t < 7; t++ )
+		{
+			palette[t + 1] = ( ( 7 - t ) * end0 + t * end1 ) / 7;
+		}
+	}
+	else
+	{
+		// Four in-between values, then the ends of the range
+		for( int t = 1; t < 5; t++ )
+		{
+			palette[t + 1] = ( ( 5 - t ) * end0 + t * end1 ) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	for( int i = 0; i < 16; i++ )
+	{
+		rgba[i * 4 + channel] = (unsigned char) palette[reader.Read( 3 )];
+	}
+}
+
+
+// BC7 mode 6 - two RGBA endpoints of 7 bits each plus a low bit shared by the endpoint's channels, and 4-bit indices
+
+struct BC7BlockFit
+{
+	unsigned char end0[4], end1[4];
+	unsigned int pbit0, pbit1;
+	unsigned char indices[16];
+	float error;
+};
+
+// Nearest 7-bit colour to an endpoint, trying both values of the shared low bit
+static void QuantizeBC7Endpoint( const float *colour, unsigned char *quantized, unsigned int &pbit )
+{
+	float bestError = std::numeric_limits<float>::max();
+	for( unsigned int p = 0; p < 2; p++ )
+	{
+		unsigned char candidate[4];
+		float error = 0.0f;
+		for( int c = 0; c < 4; c++ )
+		{
+			int value = std::min( std::max( (int) ( ( colour[c] - p ) * 0.5f + 0.5f ), 0 ), 127 );
+			candidate[c] = (unsigned char) value;
+			float difference = (float) ( value * 2 + (int) p ) - colour[c];
+			error += difference * difference;
+		}
+		if( error < bestError )
+		{
+			bestError = error;
+			memcpy( quantized, candidate, 4 );
+			pbit = p;
+		}
+	}
+}
+
+static void FitBC7Block( const BlockPixels &block, const float *end0, const float *end1, ProjectFunction project, BC7BlockFit &fit )
+{
+	static const int rgba[4] = { 0, 1, 2, 3 };
+
+	QuantizeBC7Endpoint( end0, fit.end0, fit.pbit0 );
+	QuantizeBC7Endpoint( end1, fit.end1, fit.pbit1 );
+
+	float palette[16][4];
+	for( int c = 0; c < 4; c++ )
+	{
+		int colour0 = fit.end0[c] * 2 + (int) fit.pbit0;
+		int colour1 = fit.end1[c] * 2 + (int) fit.pbit1;
+		for( int t = 0; t < 16; t++ )
+		{
+			palette[t][c] = (float) ( ( ( 64 - BC7_WEIGHTS[t] ) * colour0 + BC7_WEIGHTS[t] * colour1 + 32 ) >> 6 );
+		}
+	}
+	project( block, rgba, 4, palette[0], palette[15], 15, fit.indices );
+	fit.error = PaletteError( block, rgba, 4, palette, fit.indices );
+}
+
+static void CompressBC7Block( const BlockPixels &block, ProjectFunction project, unsigned char *output )
+{
+	static const int rgba[4] = { 0, 1, 2, 3 };
+	float weights[16];
+	for( int t = 0; t < 16; t++ )
+	{
+		weights[t] = BC7_WEIGHTS[t] / 64.0f;
+	}
+
+	float end0[4], end1[4];
+	FitEndpoints( block, rgba, 4, end0, end1 );
+	BC7BlockFit best;
+	FitBC7Block( block, end0, end1, project, best );
+
+	if( RefitEndpoints( block, rgba, 4, best.indices, weights, end0, end1 ) )
+	{
+		BC7BlockFit refit;
+		FitBC7Block( block, end0, end1, project, refit );
+		if( refit.error < best.error )
+		{
+			best = refit;
+		}
+	}
+
+	// The first index is stored with one bit fewer, so it has to be in the bottom half
+	// The weights are symmetrical, so swapping the ends and flipping every index draws the same block
+	if( best.indices[0] >= 8 )
+	{
+		std::swap( best.end0, best.end1 );
+		std::swap( best.pbit0, best.pbit1 );
+		for( int i = 0; i < 16; i++ )
+		{
+			best.indices[i] = (unsigned char) ( 15 - best.indices[i] );
+		}
+	}
+
+	// The mode is the position of the first set bit
+	BlockBitWriter writer;
+	writer.Write( 1 << 6, 7 );
+	for( int c = 0; c < 4; c++ )
+	{
+		writer.Write( best.end0[c], 7 );
+		writer.Write( best.end1[c], 7 );
+	}
+	writer.Write( best.pbit0, 1 );
+	writer.Write( best.pbit1, 1 );
+	writer.Write( best.indices[0], 3 );
+	for( int i = 1; i < 16; i++ )
+	{
+		writer.Write( best.indices[i], 4 );
+	}
+	writer.Store( output, 16 );
+}
+
+static void DecompressBC7Block( const unsigned char *input, unsigned char *rgba )
+{
+	BlockBitReader reader( input, 16 );
+	if( reader.Read( 7 ) != ( 1 << 6 ) )
+	{
+		// Not mode 6, which is all CompressBC7Block makes
+		for( int i = 0; i < 16; i++ )
+		{
+			rgba[i * 4 + 0] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = 0;
+			rgba[i * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	int end0[4], end1[4];
+	for( int c = 0; c < 4; c++ )
+	{
+		end0[c] = (int) reader.Read( 7 );
+		end1[c] = (int) reader.Read( 7 );
+	}
+	int pbit0 = (int) reader.Read( 1 ), pbit1 = (int) reader.Read( 1 );
+	for( int c = 0; c < 4; c++ )
+	{
+		end0[c] = end0[c] * 2 + pbit0;
+		end1[c] = end1[c] * 2 + pbit1;
+	}
+
+	for( int i = 0; i < 16; i++ )
+	{
+		int weight = BC7_WEIGHTS[reader.Read( i == 0 ? 3 : 4 )];
+		for( int c = 0; c < 4; c++ )
+		{
+			rgba[i * 4 + c] = (unsigned char) ( ( ( 64 - weight ) * end0[c] + weight * end1[c] + 32 ) >> 6 );
+		}
+	}
+}
+
+
+static void CompressBlock( const BlockPixels &block, TextureFormat format, ProjectFunction project, unsigned char *output )
+{
+	switch( format )
+	{
+	case TEXTURE_FORMAT_BC1:
+		CompressColourBlock( block, project, output );
+		break;
+	case TEXTURE_FORMAT_BC3:
+		CompressChannelBlock( block, 3, project, output );
+		CompressColourBlock( block, project, output + 8 );
+		break;
+	case TEXTURE_FORMAT_BC5:
+		CompressChannelBlock( block, 0, project, output );
+		CompressChannelBlock( block, 1, project, output + 8 );
+		break;
+	case TEXTURE_FORMAT_BC7:
+		CompressBC7Block( block, project, output );
+		break;
+	default:
+		break;
+	}
+}
+
+static void DecompressBlock( const unsigned char *input, TextureFormat format, unsigned char *rgba )
+{
+	switch( format )
+	{
+	case TEXTURE_FORMAT_BC1:
+		DecompressColourBlock( input, false, rgba );
+		break;
+	case TEXTURE_FORMAT_BC3:
+		DecompressColourBlock( input + 8, true, rgba );
+		DecompressChannelBlock( input, 3, rgba );
+		break;
+	case TEXTURE_FORMAT_BC5:
+		for( int i = 0; i < 16; i++ )
+		{
+			rgba[i * 4 + 2] = 0;
+			rgba[i * 4 + 3] = 255;
+		}
+		DecompressChannelBlock( input, 0, rgba );
+		DecompressChannelBlock( input + 8, 1, rgba );
+		break;
+	case TEXTURE_FORMAT_BC7:
+		DecompressBC7Block( input, rgba );
+		break;
+	default:
+		break;
+	}
+}
+
+
+void CompressMipChain( const MipChain &source, TextureFormat format, MipChain &compressed, unsigned int numThreads, bool useSimd )
+{
+	compressed.pixels.resize( compressed.Layout( source.width, source.height, format, (unsigned int) source.levels.size() ) );
+	compressed.data = compressed.pixels.empty() ? NULL : &compressed.pixels[0];
+	if( format == TEXTURE_FORMAT_RGBA8 || source.format != TEXTURE_FORMAT_RGBA8 )
+	{
+		// Nothing to compress, or nothing to compress from
+		if( source.format == format && source.dataSize == compressed.dataSize && compressed.data != NULL )
+		{
+			memcpy( &compressed.pixels[0], source.data, source.dataSize );
+		}
+		return;
+	}
+
+#ifdef BLOCK_COMPRESSOR_SSE2
+	ProjectFunction project = useSimd ? ProjectIndicesSSE2 : ProjectIndicesScalar;
+#else
+	ProjectFunction project = ProjectIndicesScalar;
+#endif
+
+	// Every row of blocks in every level is independent of the rest, so they all go in one list for the threads to share
+	std::vector< std::pair<unsigned int, unsigned int> > blockRows;
+	for( unsigned int l = 0; l < source.levels.size(); l++ )
+	{
+		for( unsigned int y = 0; y < ( source.levels[l].height + 3 ) / 4; y++ )
+		{
+			blockRows.push_back( std::make_pair( l, y ) );
+		}
+	}
+
+	size_t blockBytes = BLOCK_BYTES[format];
+	ThreadPool pool( numThreads );
+	pool.ParallelFor( (unsigned int) blockRows.size(), [&]( unsigned int r )
+	{
+		unsigned int level = blockRows[r].first, blockY = blockRows[r].second;
+		const MipLevel &sourceLevel = source.levels[level];
+		unsigned int blocksWide = ( sourceLevel.width + 3 ) / 4;
+		unsigned char *output = &compressed.pixels[compressed.levels[level].offset + (size_t) blockY * blocksWide * blockBytes];
+
+		BlockPixels block;
+		for( unsigned int blockX = 0; blockX < blocksWide; blockX++, output += blockBytes )
+		{
+			LoadBlock( source.GetLevelData( level ), sourceLevel.width, sourceLevel.height, blockX, blockY, block );
+			CompressBlock( block, format, project, output );
+		}
+	} );
+}
+
+void DecompressLevel( const MipChain &chain, unsigned int level, std::vector<unsigned char> &rgba )
+{
+	const MipLevel &mipLevel = chain.levels[level];
+	rgba.resize( (size_t) mipLevel.width * mipLevel.height * 4 );
+	if( chain.format == TEXTURE_FORMAT_RGBA8 )
+	{
+		memcpy( &rgba[0], chain.GetLevelData( level ), rgba.size() );
+		return;
+	}
+
+	size_t blockBytes = BLOCK_BYTES[chain.format];
+	const unsigned char *input = chain.GetLevelData( level );
+	for( unsigned int blockY = 0; blockY < ( mipLevel.height + 3 ) / 4; blockY++ )
+	{
+		for( unsigned int blockX = 0; blockX < ( mipLevel.width + 3 ) / 4; blockX++, input += blockBytes )
+		{
+			unsigned char block[16 * 4];
+			DecompressBlock( input, chain.format, block );
+
+			// Only the part of the block that's inside the level
+			for( unsigned int y = 0; y < 4 && blockY * 4 + y < mipLevel.height; y++ )
+			{
+				for( unsigned int x = 0; x < 4 && blockX * 4 + x < mipLevel.width; x++ )
+				{
+					memcpy( &rgba[( (size_t) ( blockY * 4 + y ) * mipLevel.width + blockX * 4 + x ) * 4], &block[( y * 4 + x ) * 4], 4 );
+				}
+			}
+		}
+	}
+}
+
+double MeasurePSNR( const unsigned char *original, const unsigned char *decoded, size_t numPixels, unsigned int numChannels )
+{
+	double squaredError = 0.0;
+	for( size_t i = 0; i < numPixels; i++ )
+	{
+		for( unsigned int c = 0; c < numChannels; c++ )
+		{
+			double difference = (double) original[i * 4 + c] - decoded[i * 4 + c];
+			squaredError += difference * difference;
+		}
+	}
+	if( squaredError == 0.0 || numPixels == 0 )
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+	double meanSquaredError = squaredError / ( (double) numPixels * numChannels );
+	return 10.0 * std::log10( 255.0 * 255.0 / meanSquaredError );
+}
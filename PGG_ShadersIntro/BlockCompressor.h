@@ -0,0 +1,29 @@
+
+#ifndef __BLOCK_COMPRESSOR__
+#define __BLOCK_COMPRESSOR__
+
+#include "MipChain.h"
+#include <vector>
+
+// Block compression stores each 4x4 block of pixels as two endpoint colours and, for every pixel, a short index
+// saying where it sits on the line between them. The GPU decodes blocks as it samples, so compressed textures stay
+// compressed in video memory and take a quarter (BC3, BC5, BC7) or an eighth (BC1) of the bandwidth of RGBA8
+//
+// The encoders here go for speed over the last fraction of a dB:
+// - endpoints are the ends of the block's principal axis, then refit by least squares to the chosen indices
+// - indices come from projecting each pixel onto the endpoint line, four pixels at a time with SSE2
+// - BC7 only uses mode 6 (one pair of RGBA endpoints, 16 steps between them), which suits most colour textures
+
+// Compresses every level of an RGBA8 chain, spreading the blocks of all levels across threads
+// numThreads of 0 uses one thread per core, useSimd false runs the plain C++ version, which gives exactly the same blocks
+void CompressMipChain( const MipChain &source, TextureFormat format, MipChain &compressed, unsigned int numThreads = 0, bool useSimd = true );
+
+// Decodes one level of a chain made by CompressMipChain back to RGBA8, for measuring what compression lost
+// BC5 decodes to red and green with blue 0 and alpha 255, BC7 blocks in modes other than 6 come out black
+void DecompressLevel( const MipChain &chain, unsigned int level, std::vector<unsigned char> &rgba );
+
+// Peak signal to noise ratio between two RGBA8 images over their first numChannels channels, in dB
+// Higher is better: above about 40 dB the difference is hard to see, identical images give infinity
+double MeasurePSNR( const unsigned char *original, const unsigned char *decoded, size_t numPixels, unsigned int numChannels );
+
+#endif
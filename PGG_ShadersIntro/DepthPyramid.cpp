@@ -0,0 +1,120 @@
+
+#include "DepthPyramid.h"
+#include "GLState.h"
+#include <algorithm>
+
+
+// Texture unit the source level is read from while building
+static const GLuint PYRAMID_SOURCE_UNIT = 2;
+// Matches local_size in Resources/depthPyramidCompShader.txt
+static const unsigned int PYRAMID_GROUP_SIZE = 8;
+
+
+DepthPyramid::DepthPyramid()
+{
+	_sourceLocation = -1;
+	_sourceLevelLocation = -1;
+	_depthCopy = 0;
+	_pyramid = 0;
+	_width = 0;
+	_height = 0;
+	_numLevels = 0;
+	_viewProj = glm::mat4( 1.0f );
+	_built = false;
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	Release();
+}
+
+void DepthPyramid::Release()
+{
+	GLState::ForgetTexture( _depthCopy );
+	GLState::ForgetTexture( _pyramid );
+	glDeleteTextures( 1, &_depthCopy );
+	glDeleteTextures( 1, &_pyramid );
+	_depthCopy = 0;
+	_pyramid = 0;
+	_built = false;
+}
+
+bool DepthPyramid::Init()
+{
+	if( !_program.LoadCompute( "Resources/depthPyramidCompShader.txt" ) )
+	{
+		return false;
+	}
+	_sourceLocation = _program.GetUniformLocation( "source" );
+	_sourceLevelLocation = _program.GetUniformLocation( "sourceLevel" );
+	return true;
+}
+
+void DepthPyramid::Resize( unsigned int width, unsigned int height )
+{
+	Release();
+	_width = width;
+	_height = height;
+
+	// Halving until both sides are one texel
+	_numLevels = 1;
+	while( ( std::max( width, height ) >> _numLevels ) > 0 )
+	{
+		_numLevels++;
+	}
+
+	// Fixed size storage, as the shader writes levels through images
+	glGenTextures( 1, &_depthCopy );
+	GLState::BindTexture( PYRAMID_SOURCE_UNIT, GL_TEXTURE_2D, _depthCopy );
+	glTexStorage2D( GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+	// Nearest filtering, as blending texels together would make the furthest depth nearer than it is
+	glGenTextures( 1, &_pyramid );
+	GLState::BindTexture( PYRAMID_SOURCE_UNIT, GL_TEXTURE_2D, _pyramid );
+	glTexStorage2D( GL_TEXTURE_2D, _numLevels, GL_R32F, width, height );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+}
+
+void DepthPyramid::Build( unsigned int width, unsigned int height, const glm::mat4 &viewProj )
+{
+	if( !_program.IsReady() || width == 0 || height == 0 )
+	{
+		return;
+	}
+	if( width != _width || height != _height || _pyramid == 0 )
+	{
+		Resize( width, height );
+	}
+
+	// A depth texture takes the depth buffer when copying, rather than the colour
+	GLState::BindTexture( PYRAMID_SOURCE_UNIT, GL_TEXTURE_2D, _depthCopy );
+	glCopyTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height );
+
+	GLState::UseProgram( _program.GetHandle() );
+	GLState::Uniform( _sourceLocation, (int) PYRAMID_SOURCE_UNIT );
+
+	// The first level copies the depth, every level after that reduces the one before it
+	unsigned int levelWidth = width, levelHeight = height;
+	for( unsigned int level = 0; level < _numLevels; level++ )
+	{
+		GLState::BindTexture( PYRAMID_SOURCE_UNIT, GL_TEXTURE_2D, level == 0 ? _depthCopy : _pyramid );
+		GLState::Uniform( _sourceLevelLocation, level == 0 ? 0 : (int) level - 1 );
+		glBindImageTexture( 0, _pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+
+		glDispatchCompute( ( levelWidth + PYRAMID_GROUP_SIZE - 1 ) / PYRAMID_GROUP_SIZE, ( levelHeight + PYRAMID_GROUP_SIZE - 1 ) / PYRAMID_GROUP_SIZE, 1 );
+		// The next level reads what this one wrote
+		glMemoryBarrier( GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
+
+		levelWidth = std::max( levelWidth / 2, 1u );
+		levelHeight = std::max( levelHeight / 2, 1u );
+	}
+	glBindImageTexture( 0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+
+	_viewProj = viewProj;
+	_built = true;
+}
@@ -0,0 +1,59 @@
+
+#ifndef __DEPTH_PYRAMID__
+#define __DEPTH_PYRAMID__
+
+#include "glew.h"
+#include "ShaderProgram.h"
+#include <GLM/glm.hpp>
+
+// A frame's depth buffer, reduced level by level like a mipmap, but keeping the furthest depth instead of the average
+// A texel at any level is as far as anything in the area it covers, so an object nearer than none of it is hidden
+// That lets the GPU test a whole object against a few texels (see GpuCuller)
+class DepthPyramid
+{
+public:
+
+	DepthPyramid();
+	~DepthPyramid();
+
+	// Loads the compute shader that builds the levels
+	// Returns false if it failed to build
+	bool Init();
+
+	// Copies the depth buffer of the framebuffer being read from and builds every level from it
+	// viewProj is the camera the depth was drawn with, the culler needs it to find objects in the pyramid
+	void Build( unsigned int width, unsigned int height, const glm::mat4 &viewProj );
+
+	// False until the first Build, there's nothing to test against before then
+	bool IsBuilt() const { return _built; }
+
+	GLuint GetTexture() const { return _pyramid; }
+	const glm::mat4& GetViewProjection() const { return _viewProj; }
+
+protected:
+
+	// The textures can't be shared between pyramids
+	DepthPyramid( const DepthPyramid & );
+	DepthPyramid& operator=( const DepthPyramid & );
+
+	// Makes the textures for a new size
+	void Resize( unsigned int width, unsigned int height );
+
+	// Frees the textures
+	void Release();
+
+	ShaderProgram _program;
+	GLint _sourceLocation, _sourceLevelLocation;
+
+	// Copy of the depth buffer, as the screen's own can't be read by a shader
+	GLuint _depthCopy;
+	// Every level, one float each texel
+	GLuint _pyramid;
+	unsigned int _width, _height;
+	unsigned int _numLevels;
+
+	glm::mat4 _viewProj;
+	bool _built;
+};
+
+#endif
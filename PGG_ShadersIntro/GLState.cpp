@@ -0,0 +1,362 @@
+
+#include "GLState.h"
+#include <GLM/gtc/type_ptr.hpp>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+// Handle we never get from OpenGL, used to mean "don't know what's bound"
+static const GLuint UNKNOWN_HANDLE = 0xFFFFFFFF;
+
+// Texture units we keep track of, binds to units above this always go through
+static const unsigned int MAX_TRACKED_UNITS = 32;
+
+// Texture targets we keep track of, each unit has a separate binding for every target
+static const GLenum TRACKED_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D };
+static const unsigned int NUM_TRACKED_TARGETS = sizeof( TRACKED_TARGETS ) / sizeof( TRACKED_TARGETS[0] );
+
+// Last value given to one uniform location, type is 0 if we don't know it
+struct CachedUniform
+{
+	GLenum type;
+	float values[16];
+};
+
+static GLuint _currentProgram = UNKNOWN_HANDLE;
+static GLuint _currentVertexArray = UNKNOWN_HANDLE;
+static unsigned int _activeTextureUnit = UNKNOWN_HANDLE;
+static GLuint _boundTextures[MAX_TRACKED_UNITS][NUM_TRACKED_TARGETS];
+static bool _texturesKnown = false;
+static std::map<GLenum, bool> _capabilities;
+
+// Uniform values for each program, and a pointer to the current program's so we don't look it up for every uniform
+static std::map<GLuint, std::vector<CachedUniform> > _programUniforms;
+static std::vector<CachedUniform> *_currentUniforms = NULL;
+
+static GLStateCounters _frameCounters;
+static GLStateCounters _lastFrameCounters;
+
+
+static void CountCall( GLStateCall call, bool issued )
+{
+	if( issued )
+	{
+		_frameCounters.issued[call]++;
+	}
+	else
+	{
+		_frameCounters.skipped[call]++;
+	}
+}
+
+static int GetTargetIndex( GLenum target )
+{
+	for( unsigned int i = 0; i < NUM_TRACKED_TARGETS; i++ )
+	{
+		if( TRACKED_TARGETS[i] == target )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void ForgetTextureBindings()
+{
+	for( unsigned int unit = 0; unit < MAX_TRACKED_UNITS; unit++ )
+	{
+		for( unsigned int i = 0; i < NUM_TRACKED_TARGETS; i++ )
+		{
+			_boundTextures[unit][i] = UNKNOWN_HANDLE;
+		}
+	}
+	_texturesKnown = true;
+}
+
+// Returns true if the uniform needs setting, and remembers the new value
+// Values are compared as raw bytes, which is all we need to know whether OpenGL would see a change
+static bool UpdateUniform( GLint location, GLenum type, const void *values, size_t size )
+{
+	if( _currentUniforms == NULL )
+	{
+		return true;
+	}
+	if( (size_t) location >= _currentUniforms->size() )
+	{
+		CachedUniform unknown;
+		memset( &unknown, 0, sizeof( unknown ) );
+		_currentUniforms->resize( location + 1, unknown );
+	}
+	CachedUniform &cached = ( *_currentUniforms )[location];
+	if( cached.type == type && memcmp( cached.values, values, size ) == 0 )
+	{
+		return false;
+	}
+	cached.type = type;
+	memcpy( cached.values, values, size );
+	return true;
+}
+
+
+void GLState::UseProgram( GLuint program )
+{
+	bool changed = program != _currentProgram;
+	CountCall( GL_STATE_PROGRAM, changed );
+	if( !changed )
+	{
+		return;
+	}
+	glUseProgram( program );
+	_currentProgram = program;
+	_currentUniforms = ( program == 0 ) ? NULL : &_programUniforms[program];
+}
+
+void GLState::BindVertexArray( GLuint vertexArray )
+{
+	bool changed = vertexArray != _currentVertexArray;
+	CountCall( GL_STATE_VERTEX_ARRAY, changed );
+	if( !changed )
+	{
+		return;
+	}
+	glBindVertexArray( vertexArray );
+	_currentVertexArray = vertexArray;
+}
+
+void GLState::BindTexture( unsigned int unit, GLenum target, GLuint texture )
+{
+	if( !_texturesKnown )
+	{
+		ForgetTextureBindings();
+	}
+
+	int targetIndex = GetTargetIndex( target );
+	bool tracked = unit < MAX_TRACKED_UNITS && targetIndex >= 0;
+	bool changed = !tracked || _boundTextures[unit][targetIndex] != texture;
+	CountCall( GL_STATE_TEXTURE, changed );
+	if( !changed )
+	{
+		return;
+	}
+
+	// Changing the active unit is only needed when we actually bind something
+	if( unit != _activeTextureUnit )
+	{
+		glActiveTexture( GL_TEXTURE0 + unit );
+		_activeTextureUnit = unit;
+	}
+	glBindTexture( target, texture );
+	if( tracked )
+	{
+		_boundTextures[unit][targetIndex] = texture;
+	}
+}
+
+void GLState::SetEnabled( GLenum capability, bool enabled )
+{
+	std::map<GLenum, bool>::iterator known = _capabilities.find( capability );
+	bool changed = known == _capabilities.end() || known->second != enabled;
+	CountCall( GL_STATE_CAPABILITY, changed );
+	if( !changed )
+	{
+		return;
+	}
+	if( enabled )
+	{
+		glEnable( capability );
+	}
+	else
+	{
+		glDisable( capability );
+	}
+	_capabilities[capability] = enabled;
+}
+
+void GLState::Uniform( GLint location, int value )
+{
+	// OpenGL quietly ignores location -1, so there's no call to make or count
+	if( location < 0 )
+	{
+		return;
+	}
+	bool changed = UpdateUniform( location, GL_INT, &value, sizeof( value ) );
+	CountCall( GL_STATE_UNIFORM, changed );
+	if( changed )
+	{
+		glUniform1i( location, value );
+	}
+}
+
+void GLState::Uniform( GLint location, float value )
+{
+	if( location < 0 )
+	{
+		return;
+	}
+	bool changed = UpdateUniform( location, GL_FLOAT, &value, sizeof( value ) );
+	CountCall( GL_STATE_UNIFORM, changed );
+	if( changed )
+	{
+		glUniform1f( location, value );
+	}
+}
+
+void GLState::Uniform( GLint location, const glm::vec2 &value )
+{
+	if( location < 0 )
+	{
+		return;
+	}
+	bool changed = UpdateUniform( location, GL_FLOAT_VEC2, glm::value_ptr( value ), sizeof( value ) );
+	CountCall( GL_STATE_UNIFORM, changed );
+	if( changed )
+	{
+		glUniform2fv( location, 1, glm::value_ptr( value ) );
+	}
+}
+
+void GLState::Uniform( GLint location, const glm::vec3 &value )
+{
+	if( location < 0 )
+	{
+		return;
+	}
+	bool changed = UpdateUniform( location, GL_FLOAT_VEC3, glm::value_ptr( value ), sizeof( value ) );
+	CountCall( GL_STATE_UNIFORM, changed );
+	if( changed )
+	{
+		glUniform3fv( location, 1, glm::value_ptr( value ) );
+	}
+}
+
+void GLState::Uniform( GLint location, const glm::vec4 &value )
+{
+	if( location < 0 )
+	{
+		return;
+	}
+	bool changed = UpdateUniform( location, GL_FLOAT_VEC4, glm::value_ptr( value ), sizeof( value ) );
+	CountCall( GL_STATE_UNIFORM, changed );
+	if( changed )
+	{
+		glUniform4fv( location, 1, glm::value_ptr( value ) );
+	}
+}
+
+void GLState::Uniform( GLint location, const glm::mat4 &value )
+{
+	if( location < 0 )
+	{
+		return;
+	}
+	bool changed = UpdateUniform( location, GL_FLOAT_MAT4, glm::value_ptr( value ), sizeof( value ) );
+	CountCall( GL_STATE_UNIFORM, changed );
+	if( changed )
+	{
+		glUniformMatrix4fv( location, 1, GL_FALSE, glm::value_ptr( value ) );
+	}
+}
+
+void GLState::ForgetProgram( GLuint program )
+{
+	// Deleting the current program doesn't unbind it, but its handle can be given out again, so stop trusting it
+	if( program == _currentProgram )
+	{
+		_currentProgram = UNKNOWN_HANDLE;
+		_currentUniforms = NULL;
+	}
+	_programUniforms.erase( program );
+}
+
+void GLState::ForgetVertexArray( GLuint vertexArray )
+{
+	// Deleting the bound vertex array binds 0 instead
+	if( vertexArray == _currentVertexArray )
+	{
+		_currentVertexArray = 0;
+	}
+}
+
+void GLState::ForgetTexture( GLuint texture )
+{
+	// Deleting a bound texture binds 0 in its place, on every unit it was bound to
+	if( !_texturesKnown )
+	{
+		return;
+	}
+	for( unsigned int unit = 0; unit < MAX_TRACKED_UNITS; unit++ )
+	{
+		for( unsigned int i = 0; i < NUM_TRACKED_TARGETS; i++ )
+		{
+			if( _boundTextures[unit][i] == texture )
+			{
+				_boundTextures[unit][i] = 0;
+			}
+		}
+	}
+}
+
+void GLState::Invalidate()
+{
+	_currentProgram = UNKNOWN_HANDLE;
+	_currentVertexArray = UNKNOWN_HANDLE;
+	_activeTextureUnit = UNKNOWN_HANDLE;
+	_texturesKnown = false;
+	_capabilities.clear();
+	_programUniforms.clear();
+	_currentUniforms = NULL;
+}
+
+bool GLState::IsExtensionSupported( const char *name )
+{
+	static std::set<std::string> extensions;
+	static bool read = false;
+	if( !read )
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv( GL_NUM_EXTENSIONS, &numExtensions );
+		for( GLint i = 0; i < numExtensions; i++ )
+		{
+			const char *extension = (const char*) glGetStringi( GL_EXTENSIONS, i );
+			if( extension != NULL )
+			{
+				extensions.insert( extension );
+			}
+		}
+		read = true;
+	}
+	return extensions.count( name ) > 0;
+}
+
+void GLState::BeginFrame()
+{
+	_lastFrameCounters = _frameCounters;
+	memset( &_frameCounters, 0, sizeof( _frameCounters ) );
+}
+
+const GLStateCounters& GLState::GetLastFrameCounters()
+{
+	return _lastFrameCounters;
+}
+
+const char* GLState::GetCallName( GLStateCall call )
+{
+	switch( call )
+	{
+	case GL_STATE_PROGRAM:
+		return "programs";
+	case GL_STATE_VERTEX_ARRAY:
+		return "vertex arrays";
+	case GL_STATE_TEXTURE:
+		return "textures";
+	case GL_STATE_UNIFORM:
+		return "uniforms";
+	case GL_STATE_CAPABILITY:
+		return "enables";
+	default:
+		return "";
+	}
+}
@@ -0,0 +1,76 @@
+
+#ifndef __GL_STATE__
+#define __GL_STATE__
+
+#include "glew.h"
+#include <GLM/glm.hpp>
+
+// The kinds of state GLState looks after, for its counters
+enum GLStateCall
+{
+	GL_STATE_PROGRAM,
+	GL_STATE_VERTEX_ARRAY,
+	GL_STATE_TEXTURE,
+	GL_STATE_UNIFORM,
+	GL_STATE_CAPABILITY,
+	GL_STATE_CALL_COUNT
+};
+
+// How many calls of each kind were passed on to OpenGL, and how many were dropped because nothing would have changed
+struct GLStateCounters
+{
+	unsigned int issued[GL_STATE_CALL_COUNT];
+	unsigned int skipped[GL_STATE_CALL_COUNT];
+};
+
+// Keeps a copy of the OpenGL state we set most often, and only calls OpenGL when a value actually changes
+// Every call into the driver costs CPU time even when it does nothing, and with lots of objects those add up
+// For this to work, everything that changes this state has to go through here
+// If something else changes it (e.g. a library), call Invalidate afterwards
+class GLState
+{
+public:
+
+	// glUseProgram
+	static void UseProgram( GLuint program );
+
+	// glBindVertexArray
+	static void BindVertexArray( GLuint vertexArray );
+
+	// glActiveTexture followed by glBindTexture, where unit is 0 for GL_TEXTURE0 and so on
+	static void BindTexture( unsigned int unit, GLenum target, GLuint texture );
+
+	// glEnable / glDisable
+	static void SetEnabled( GLenum capability, bool enabled );
+
+	// glUniform* for the current program
+	// Values are remembered for each program, as that's where OpenGL keeps them too
+	static void Uniform( GLint location, int value );
+	static void Uniform( GLint location, float value );
+	static void Uniform( GLint location, const glm::vec2 &value );
+	static void Uniform( GLint location, const glm::vec3 &value );
+	static void Uniform( GLint location, const glm::vec4 &value );
+	static void Uniform( GLint location, const glm::mat4 &value );
+
+	// Call these before deleting an object, so a new object given the same handle isn't mistaken for it
+	static void ForgetProgram( GLuint program );
+	static void ForgetVertexArray( GLuint vertexArray );
+	static void ForgetTexture( GLuint texture );
+
+	// Forgets everything, so the next call of each kind always goes through to OpenGL
+	static void Invalidate();
+
+	// Whether the driver has an extension, e.g. "GL_ARB_buffer_storage"
+	// GLEW looks for extensions in a way core profiles don't allow, so its flags can't be trusted
+	// The list is read the first time this is called, which must be on the thread with the context
+	static bool IsExtensionSupported( const char *name );
+
+	// Starts counting a new frame, the counts so far become GetLastFrameCounters
+	static void BeginFrame();
+	static const GLStateCounters& GetLastFrameCounters();
+
+	// Short name for each kind of call, e.g. "uniforms"
+	static const char* GetCallName( GLStateCall call );
+};
+
+#endif
@@ -2,18 +2,22 @@
 #include <GLM/gtc/type_ptr.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 #include "GameObject.h"
+#include "Meshlets.h"
 
 GameObject::GameObject()
 {
 	// Initialise everything here
-	_mesh = NULL;
 	_material = NULL;
+	_lightMaterial = NULL;
+	_lodLevel = 0;
+	_lodThreshold = 1.0f;
+	_colour = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
 }
 
 GameObject::~GameObject()
 {
 	// Do any clean up here
-	delete _mesh;
+	// The mesh is shared, so it cleans itself up once nothing is using it
 }
 
 void GameObject::Update( float deltaTs )
@@ -22,64 +26,102 @@ void GameObject::Update( float deltaTs )
 	// Change the _position and _rotation to move the model
 }
 
-// Use this function for drawing the scene from camera's POV
-void GameObject::Draw(glm::mat4 viewMatrix, glm::mat4 projMatrix, glm::mat4 lightMatrix)
+void GameObject::UpdateModelMatrix()
+{
+	_modelMatrix = glm::translate(glm::mat4(1.0f), _position );
+	_modelMatrix = glm::rotate(_modelMatrix, _rotation.y, glm::vec3(0, 1, 0));
+	_modelMatrix = glm::rotate(_modelMatrix, _rotation.x, glm::vec3(1, 0, 0));
+	_modelMatrix = glm::rotate(_modelMatrix, _rotation.z, glm::vec3(0, 0, 1));
+	_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.y, glm::vec3(0, 1, 0));
+	_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.x, glm::vec3(1, 0, 0));
+	_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.z, glm::vec3(0, 0, 1));
+	_modelMatrix = glm::scale(_modelMatrix, _scale);
+}
+
+void GameObject::SelectLod(glm::mat4 viewMatrix, glm::mat4 projMatrix, float viewportHeight)
 {
-	if( _mesh != NULL )
+	_lodLevel = 0;
+	if( !_mesh || _mesh->GetNumLods() < 2 )
 	{
-		if( _material != NULL )
+		return;
+	}
+	UpdateModelMatrix();
+
+	// Measure from the nearest point of a sphere around the mesh, so no part of it is closer than we think
+	glm::vec3 centre = ( _mesh->GetBoundsMin() + _mesh->GetBoundsMax() ) * 0.5f;
+	float maxScale = glm::max( glm::abs( _scale.x ), glm::max( glm::abs( _scale.y ), glm::abs( _scale.z ) ) );
+	float radius = glm::length( _mesh->GetBoundsMax() - _mesh->GetBoundsMin() ) * 0.5f * maxScale;
+	glm::vec3 viewCentre = glm::vec3( viewMatrix * _modelMatrix * glm::vec4( centre, 1.0f ) );
+	float distance = glm::length( viewCentre ) - radius;
+	if( distance <= 0.0f )
+	{
+		// The camera is inside the bounds, so only full detail will do
+		return;
+	}
+
+	// How many pixels one model space unit covers at that distance
+	// projMatrix[1][1] is 1 / tan(fov / 2), which turns a view space height into a fraction of half the screen
+	float pixelsPerUnit = maxScale * projMatrix[1][1] * viewportHeight * 0.5f / distance;
+
+	// Lowest detail first, the first level that's good enough wins
+	for( unsigned int lod = _mesh->GetNumLods() - 1; lod > 0; lod-- )
+	{
+		if( _mesh->GetLod( lod ).error * pixelsPerUnit <= _lodThreshold )
 		{
-			
-			// Make sure matrices are up to date (if you don't change them elsewhere, you can put this in the update function)
-			_modelMatrix = glm::translate(glm::mat4(1.0f), _position );
-			_modelMatrix = glm::rotate(_modelMatrix, _rotation.y, glm::vec3(0, 1, 0));
-			_modelMatrix = glm::rotate(_modelMatrix, _rotation.x, glm::vec3(1, 0, 0));
-			_modelMatrix = glm::rotate(_modelMatrix, _rotation.z, glm::vec3(0, 0, 1));
-			_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.y, glm::vec3(0, 1, 0));
-			_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.x, glm::vec3(1, 0, 0));
-			_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.z, glm::vec3(0, 0, 1));
-			_modelMatrix = glm::scale(_modelMatrix, _scale);
-
-			// Give all the matrices to the material
-			// This makes sure they are sent to the shader
-			_material->SetMatrices(_modelMatrix, _invModelMatrix, viewMatrix, projMatrix, lightMatrix);
-			// This activates the shader
-			_material->Apply();
+			_lodLevel = lod;
+			return;
 		}
+	}
+}
 
-		// Sends the mesh data down the pipeline
-		_mesh->Draw();
+float GameObject::GetViewDepth(const glm::mat4 &viewMatrix)
+{
+	glm::vec3 centre = ( _mesh->GetBoundsMin() + _mesh->GetBoundsMax() ) * 0.5f;
+	return -( viewMatrix * _modelMatrix * glm::vec4( centre, 1.0f ) ).z;
+}
+
+bool GameObject::IsInView(const MeshletView &view)
+{
+	// The view's planes are in model space, so the bounds can be tested as they are
+	glm::vec3 centre = ( _mesh->GetBoundsMin() + _mesh->GetBoundsMax() ) * 0.5f;
+	float radius = glm::length( _mesh->GetBoundsMax() - _mesh->GetBoundsMin() ) * 0.5f;
+	return view.IsSphereVisible( centre, radius );
+}
+
+// Use this function for drawing the scene from camera's POV
+void GameObject::Draw(RenderQueue &queue, glm::mat4 viewMatrix, glm::mat4 projMatrix)
+{
+	if( _mesh && _material != NULL )
+	{
+		// Make sure matrices are up to date (if you don't change them elsewhere, you can put this in the update function)
+		UpdateModelMatrix();
+
+		// Meshlets outside the camera's view, or facing away from it, are skipped
+		// The camera pass culls back faces, so a meshlet that's all back faces wouldn't draw anything anyway
+		MeshletView view(_modelMatrix, viewMatrix, projMatrix, true);
+		// With GPU culling the cull shader tests the whole object instead
+		if( queue.IsGpuCulling() || IsInView(view) )
+		{
+			queue.Submit(RENDER_PASS_MAIN, _material, _mesh.get(), _lodLevel, _modelMatrix, _colour, view, GetViewDepth(viewMatrix));
+		}
 	}
 }
 
 
 // Use this function for drawing the scene from light's POV
-void GameObject::LightDraw(glm::mat4 viewMatrix, glm::mat4 projMatrix)
+void GameObject::LightDraw(RenderQueue &queue, glm::mat4 viewMatrix, glm::mat4 projMatrix)
 {
-	if (_mesh != NULL)
+	if (_mesh && _lightMaterial != NULL)
 	{
-		if (_lightMaterial != NULL)
-		{
+		// Make sure matrices are up to date (if you don't change them elsewhere, you can put this in the update function)
+		UpdateModelMatrix();
 
-			// Make sure matrices are up to date (if you don't change them elsewhere, you can put this in the update function)
-			_modelMatrix = glm::translate(glm::mat4(1.0f), _position);
-			_modelMatrix = glm::rotate(_modelMatrix, _rotation.y, glm::vec3(0, 1, 0));
-			_modelMatrix = glm::rotate(_modelMatrix, _rotation.x, glm::vec3(1, 0, 0));
-			_modelMatrix = glm::rotate(_modelMatrix, _rotation.z, glm::vec3(0, 0, 1));
-			_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.y, glm::vec3(0, 1, 0));
-			_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.x, glm::vec3(1, 0, 0));
-			_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.z, glm::vec3(0, 0, 1));
-			_modelMatrix = glm::scale(_modelMatrix, _scale);
-
-			// Give all the matrices to the material
-			// This makes sure they are sent to the shader
-			_lightMaterial->SetMatrices(_modelMatrix, _invModelMatrix, viewMatrix, projMatrix);
-			// This activates the shader
-			_lightMaterial->Apply();
+		// The depth pass only needs positions
+		// Both sides of every triangle go into the shadow map, so only meshlets outside the light's view are skipped
+		MeshletView view(_modelMatrix, viewMatrix, projMatrix, false);
+		if( queue.IsGpuCulling() || IsInView(view) )
+		{
+			queue.Submit(RENDER_PASS_SHADOW, _lightMaterial, _mesh.get(), _lodLevel, _modelMatrix, _colour, view, GetViewDepth(viewMatrix));
 		}
-
-		// Sends the mesh data down the pipeline
-		_mesh->Draw();
 	}
 }
-
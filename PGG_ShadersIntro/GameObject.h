@@ -3,6 +3,8 @@
 
 #include "Mesh.h"
 #include "Material.h"
+#include "RenderQueue.h"
+#include <memory>
 
 // The GameObject contains a mesh, a material and position / orientation information
 class GameObject
@@ -12,7 +14,8 @@ public:
 	GameObject();
 	~GameObject();
 
-	void SetMesh(Mesh *input) {_mesh = input;}
+	// The mesh may be shared with other objects, it's freed when the last one lets go
+	void SetMesh(std::shared_ptr<Mesh> input) {_mesh = input;}
 	void SetMaterial(Material *input) {_material = input;}
 
 	void SetLightMaterial(Material* input) { _lightMaterial = input; }
@@ -38,18 +41,45 @@ public:
     void AddScale(glm::vec3 value) { _scale += value; }
 	glm::vec3 GetScale() { return _scale; }
 
+	// Multiplies the lit colour of this object only, white leaves it as the material has it
+	// Objects sharing a mesh and material are still drawn together whatever their colours
+	void SetColour(glm::vec4 value) { _colour = value; }
+	glm::vec4 GetColour() { return _colour; }
+
 	void Update( float deltaTs );
 
+	// Picks the lowest level of detail whose error would cover no more than the threshold in pixels on screen
+	// Call once a frame before drawing, both passes then use the same level
+	void SelectLod(glm::mat4 viewMatrix, glm::mat4 projMatrix, float viewportHeight);
+
+	// How many pixels a level's error is allowed to cover, higher switches to lower detail sooner
+	void SetLodThreshold(float pixels) { _lodThreshold = pixels; }
+	unsigned int GetLod() { return _lodLevel; }
+
+	// Adds the object to the queue for the camera's pass, the queue draws it later (see RenderQueue)
+	// Objects completely outside the view aren't added at all
 	// Need to give it the camera's orientation and projection
-	void Draw(glm::mat4 viewMatrix, glm::mat4 projMatrix, glm::mat4 lightMatrix);
+	// These are only used to skip what can't be seen and sort by distance, the shaders get them from the scene's uniform buffers
+	void Draw(RenderQueue &queue, glm::mat4 viewMatrix, glm::mat4 projMatrix);
 
-	void LightDraw(glm::mat4 viewMatrix, glm::mat4 projMatrix);
+	// Same for the shadow pass, seen from the light
+	void LightDraw(RenderQueue &queue, glm::mat4 viewMatrix, glm::mat4 projMatrix);
 
 protected:
 
+	// Builds _modelMatrix and _invModelMatrix from the position, rotation and scale
+	void UpdateModelMatrix();
+
+	// Distance along the view direction to the middle of the mesh, for sorting
+	float GetViewDepth(const glm::mat4 &viewMatrix);
+
+	// True if any of the mesh's bounds are inside the view
+	bool IsInView(const MeshletView &view);
+
 	// The actual model geometry
-	Mesh *_mesh;
+	std::shared_ptr<Mesh> _mesh;
 	// The material contains the shader
+	// Materials belong to the scene, so the object doesn't delete them
 	Material *_material;
 	Material* _lightMaterial;
 
@@ -66,5 +96,11 @@ protected:
 	glm::vec3 _rotation;
 
 	glm::vec3 _scale;
+
+	glm::vec4 _colour;
+
+	// Level of detail chosen by SelectLod
+	unsigned int _lodLevel;
+	float _lodThreshold;
 };
 #endif
\ No newline at end of file
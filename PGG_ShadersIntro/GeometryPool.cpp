@@ -0,0 +1,153 @@
+
+#include "GeometryPool.h"
+#include "MeshCache.h"
+#include "GLState.h"
+#include <algorithm>
+#include <vector>
+
+
+// Buffers start this big, so a few small meshes don't each cause a reallocation
+static const size_t MIN_POOL_BYTES = 1024 * 1024;
+
+
+GeometryPool::GeometryPool()
+{
+	_created = false;
+	_VAO = 0;
+	_positionsOnlyVAO = 0;
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		_vertexBuffers[i] = 0;
+		_vertexCapacity[i] = 0;
+	}
+	_indexBuffer = 0;
+	_indexCapacity = 0;
+	_numVertices = 0;
+	_numIndices = 0;
+}
+
+GeometryPool::~GeometryPool()
+{
+	glDeleteBuffers( VERTEX_STREAM_COUNT, _vertexBuffers );
+	glDeleteBuffers( 1, &_indexBuffer );
+	GLState::ForgetVertexArray( _VAO );
+	GLState::ForgetVertexArray( _positionsOnlyVAO );
+	glDeleteVertexArrays( 1, &_VAO );
+	glDeleteVertexArrays( 1, &_positionsOnlyVAO );
+}
+
+void GeometryPool::Create( const VertexFormat &format )
+{
+	_format = format;
+	_created = true;
+
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		if( _format.GetStride( (VertexStream) i ) > 0 )
+		{
+			glGenBuffers( 1, &_vertexBuffers[i] );
+		}
+	}
+	glGenBuffers( 1, &_indexBuffer );
+
+	// The VAOs only remember buffer names, so they can be set up before there's anything in the buffers
+	glGenVertexArrays( 1, &_VAO );
+	GLState::BindVertexArray( _VAO );
+	_format.Apply( _vertexBuffers, false );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indexBuffer );
+
+	if( _format.HasSeparatePositions() )
+	{
+		glGenVertexArrays( 1, &_positionsOnlyVAO );
+		GLState::BindVertexArray( _positionsOnlyVAO );
+		_format.Apply( _vertexBuffers, true );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indexBuffer );
+	}
+
+	// Unbind VAO before the index buffer, otherwise the VAO would forget it
+	GLState::BindVertexArray( 0 );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+void GeometryPool::Reserve( GLuint buffer, size_t usedBytes, size_t &capacity, size_t neededBytes )
+{
+	if( neededBytes <= capacity )
+	{
+		return;
+	}
+	size_t newCapacity = std::max( std::max( neededBytes, capacity * 2 ), MIN_POOL_BYTES );
+
+	// The copy targets don't belong to any VAO, so using them here can't disturb a VAO's index buffer
+	// What's there is copied out to a temporary buffer and back again once the store is bigger
+	GLuint temporary = 0;
+	if( usedBytes > 0 )
+	{
+		glGenBuffers( 1, &temporary );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, temporary );
+		glBufferData( GL_COPY_WRITE_BUFFER, usedBytes, NULL, GL_STATIC_COPY );
+		glBindBuffer( GL_COPY_READ_BUFFER, buffer );
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes );
+	}
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, buffer );
+	glBufferData( GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW );
+
+	if( usedBytes > 0 )
+	{
+		glBindBuffer( GL_COPY_READ_BUFFER, temporary );
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes );
+		glDeleteBuffers( 1, &temporary );
+	}
+	glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+	capacity = newCapacity;
+}
+
+bool GeometryPool::Add( const PackedMesh &packedMesh, GLint &baseVertex, GLuint &firstIndex )
+{
+	if( !_created )
+	{
+		Create( packedMesh.format );
+	}
+	else if( !( packedMesh.format == _format ) )
+	{
+		return false;
+	}
+
+	baseVertex = (GLint) _numVertices;
+	firstIndex = _numIndices;
+
+	// Vertices go on the end of each stream
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		if( _vertexBuffers[i] == 0 || packedMesh.streamSizes[i] == 0 )
+		{
+			continue;
+		}
+		size_t stride = _format.GetStride( (VertexStream) i );
+		size_t usedBytes = _numVertices * stride;
+		Reserve( _vertexBuffers[i], usedBytes, _vertexCapacity[i], usedBytes + packedMesh.streamSizes[i] );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, _vertexBuffers[i] );
+		glBufferSubData( GL_COPY_WRITE_BUFFER, usedBytes, packedMesh.streamSizes[i], packedMesh.streamData[i] );
+	}
+
+	// Indices stay relative to the mesh's own vertices, baseVertex is added to them when drawing
+	std::vector<GLuint> widened;
+	const void *indexData = packedMesh.indexData;
+	if( packedMesh.indexType == GL_UNSIGNED_SHORT )
+	{
+		const GLushort *shortIndices = (const GLushort*) packedMesh.indexData;
+		widened.assign( shortIndices, shortIndices + packedMesh.numIndices );
+		indexData = widened.empty() ? NULL : &widened[0];
+	}
+	size_t usedBytes = _numIndices * sizeof( GLuint );
+	size_t indexBytes = packedMesh.numIndices * sizeof( GLuint );
+	Reserve( _indexBuffer, usedBytes, _indexCapacity, usedBytes + indexBytes );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, _indexBuffer );
+	glBufferSubData( GL_COPY_WRITE_BUFFER, usedBytes, indexBytes, indexData );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+	_numVertices += packedMesh.numVertices;
+	_numIndices += packedMesh.numIndices;
+	return true;
+}
@@ -0,0 +1,65 @@
+
+#ifndef __GEOMETRY_POOL__
+#define __GEOMETRY_POOL__
+
+#include "glew.h"
+#include "VertexFormat.h"
+
+struct PackedMesh;
+
+// One set of vertex buffers and one index buffer that many meshes are packed into
+// Every mesh in the pool is drawn through the same VAO, so draws of different meshes can go in one
+// glMultiDrawElementsIndirect, each picking its mesh with the baseVertex and firstIndex of its command
+// Meshes must all have the same vertex format, the first one added decides it
+// Space is handed out from the end and never given back, so the pool suits meshes loaded once at start-up
+class GeometryPool
+{
+public:
+
+	GeometryPool();
+	~GeometryPool();
+
+	// Copies the mesh's vertices and indices into the pool
+	// baseVertex and firstIndex say where they went, for the mesh's draw commands
+	// Indices are always stored as 32 bits, so 16-bit meshes are widened on the way in
+	// Returns false if the mesh has a different vertex format, it then needs buffers of its own
+	bool Add( const PackedMesh &packedMesh, GLint &baseVertex, GLuint &firstIndex );
+
+	// VAO reading every mesh in the pool, positionsOnly for depth-only passes
+	GLuint GetVertexArray( bool positionsOnly ) const { return ( positionsOnly && _positionsOnlyVAO ) ? _positionsOnlyVAO : _VAO; }
+
+	// Totals so far, for stats
+	unsigned int GetNumVertices() const { return _numVertices; }
+	unsigned int GetNumIndices() const { return _numIndices; }
+
+protected:
+
+	// The buffers can't be shared between pools
+	GeometryPool( const GeometryPool & );
+	GeometryPool& operator=( const GeometryPool & );
+
+	// Makes the buffers and VAOs for the first mesh's format
+	void Create( const VertexFormat &format );
+
+	// Makes room for at least the given number of bytes, keeping what's already there
+	// The buffer keeps its name, so the VAOs pointing at it don't need setting up again
+	static void Reserve( GLuint buffer, size_t usedBytes, size_t &capacity, size_t neededBytes );
+
+	VertexFormat _format;
+	bool _created;
+
+	GLuint _VAO;
+	GLuint _positionsOnlyVAO;
+
+	GLuint _vertexBuffers[VERTEX_STREAM_COUNT];
+	GLuint _indexBuffer;
+
+	// Bytes allocated for each buffer
+	size_t _vertexCapacity[VERTEX_STREAM_COUNT];
+	size_t _indexCapacity;
+
+	unsigned int _numVertices;
+	unsigned int _numIndices;
+};
+
+#endif
@@ -0,0 +1,150 @@
+
+#include "GpuCuller.h"
+#include "DepthPyramid.h"
+#include "GLState.h"
+#include <cstring>
+
+
+// Shader storage bindings of the buffers only the cull shader uses, see Resources/cullCompShader.txt
+static const GLuint DRAW_COMMAND_BUFFER_BINDING = 2;
+static const GLuint CULL_OBJECT_BUFFER_BINDING = 3;
+static const GLuint CULL_COUNTER_BUFFER_BINDING = 4;
+
+// Texture unit the depth pyramid is read from
+static const GLuint DEPTH_PYRAMID_UNIT = 2;
+
+// Matches local_size in the shader
+static const unsigned int CULL_GROUP_SIZE = 64;
+
+// Each pass's counts are a CullStats in the counter buffer
+static const unsigned int COUNTERS_PER_PASS = sizeof( CullStats ) / sizeof( unsigned int );
+
+
+GpuCuller::GpuCuller()
+{
+	_firstObjectLocation = -1;
+	_numObjectsLocation = -1;
+	_countersOffsetLocation = -1;
+	_viewProjLocation = -1;
+	_depthPyramidLocation = -1;
+	_useDepthPyramidLocation = -1;
+	_pyramidViewProjLocation = -1;
+
+	for( unsigned int i = 0; i < NUM_COUNTER_BUFFERS; i++ )
+	{
+		_counterBuffers[i] = 0;
+		_counterFences[i] = 0;
+	}
+	_frame = 0;
+	memset( _stats, 0, sizeof( _stats ) );
+}
+
+GpuCuller::~GpuCuller()
+{
+	glDeleteBuffers( NUM_COUNTER_BUFFERS, _counterBuffers );
+	for( unsigned int i = 0; i < NUM_COUNTER_BUFFERS; i++ )
+	{
+		glDeleteSync( _counterFences[i] );
+	}
+}
+
+bool GpuCuller::Init()
+{
+	if( !_program.LoadCompute( "Resources/cullCompShader.txt" ) )
+	{
+		return false;
+	}
+	_firstObjectLocation = _program.GetUniformLocation( "firstObject" );
+	_numObjectsLocation = _program.GetUniformLocation( "numObjects" );
+	_countersOffsetLocation = _program.GetUniformLocation( "countersOffset" );
+	_viewProjLocation = _program.GetUniformLocation( "viewProj" );
+	_depthPyramidLocation = _program.GetUniformLocation( "depthPyramid" );
+	_useDepthPyramidLocation = _program.GetUniformLocation( "useDepthPyramid" );
+	_pyramidViewProjLocation = _program.GetUniformLocation( "pyramidViewProj" );
+
+	// Room for every pass's counts, starting at zero
+	CullStats zeros[RENDER_PASS_COUNT];
+	memset( zeros, 0, sizeof( zeros ) );
+	glGenBuffers( NUM_COUNTER_BUFFERS, _counterBuffers );
+	for( unsigned int i = 0; i < NUM_COUNTER_BUFFERS; i++ )
+	{
+		glBindBuffer( GL_SHADER_STORAGE_BUFFER, _counterBuffers[i] );
+		glBufferData( GL_SHADER_STORAGE_BUFFER, sizeof( zeros ), zeros, GL_DYNAMIC_READ );
+	}
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+	return true;
+}
+
+void GpuCuller::BeginFrame()
+{
+	if( !_program.IsReady() )
+	{
+		return;
+	}
+
+	// Last frame's dispatches are all in, so its counts are done once the GPU gets past here
+	if( _frame > 0 )
+	{
+		unsigned int lastSlot = ( _frame - 1 ) % NUM_COUNTER_BUFFERS;
+		glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );
+		glDeleteSync( _counterFences[lastSlot] );
+		_counterFences[lastSlot] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	}
+
+	// This buffer was last written two frames ago
+	// Timeout of 0 just asks, it never waits. If the GPU is that far behind these counts are skipped
+	unsigned int slot = _frame % NUM_COUNTER_BUFFERS;
+	GLuint counters = _counterBuffers[slot];
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, counters );
+	if( _counterFences[slot] != 0 )
+	{
+		GLenum result = glClientWaitSync( _counterFences[slot], 0, 0 );
+		if( result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED )
+		{
+			glGetBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, sizeof( _stats ), _stats );
+		}
+		glDeleteSync( _counterFences[slot] );
+		_counterFences[slot] = 0;
+	}
+	CullStats zeros[RENDER_PASS_COUNT];
+	memset( zeros, 0, sizeof( zeros ) );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, sizeof( zeros ), zeros );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, CULL_COUNTER_BUFFER_BINDING, counters );
+	_frame++;
+}
+
+void GpuCuller::Cull( RenderQueue &queue, RenderPass pass, const glm::mat4 &viewProj, const DepthPyramid *pyramid )
+{
+	unsigned int firstObject, numObjects;
+	queue.GetPassRange( pass, firstObject, numObjects );
+	if( !_program.IsReady() || numObjects == 0 )
+	{
+		return;
+	}
+
+	// The instance and drawn instance buffers are already bound by the queue
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, DRAW_COMMAND_BUFFER_BINDING, queue.GetCommandBuffer() );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, CULL_OBJECT_BUFFER_BINDING, queue.GetCullObjectBuffer() );
+
+	GLState::UseProgram( _program.GetHandle() );
+	GLState::Uniform( _firstObjectLocation, (int) firstObject );
+	GLState::Uniform( _numObjectsLocation, (int) numObjects );
+	GLState::Uniform( _countersOffsetLocation, (int) ( pass * COUNTERS_PER_PASS ) );
+	GLState::Uniform( _viewProjLocation, viewProj );
+
+	bool useDepthPyramid = pyramid != NULL && pyramid->IsBuilt();
+	GLState::Uniform( _useDepthPyramidLocation, useDepthPyramid ? 1 : 0 );
+	if( useDepthPyramid )
+	{
+		GLState::BindTexture( DEPTH_PYRAMID_UNIT, GL_TEXTURE_2D, pyramid->GetTexture() );
+		GLState::Uniform( _depthPyramidLocation, (int) DEPTH_PYRAMID_UNIT );
+		GLState::Uniform( _pyramidViewProjLocation, pyramid->GetViewProjection() );
+	}
+
+	glDispatchCompute( ( numObjects + CULL_GROUP_SIZE - 1 ) / CULL_GROUP_SIZE, 1, 1 );
+
+	// The draws read the commands as indirect arguments, and the vertex shaders read the drawn instances
+	glMemoryBarrier( GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+}
@@ -0,0 +1,72 @@
+
+#ifndef __GPU_CULLER__
+#define __GPU_CULLER__
+
+#include "glew.h"
+#include "ShaderProgram.h"
+#include "RenderQueue.h"
+#include <GLM/glm.hpp>
+
+class DepthPyramid;
+
+// What happened to one pass's objects
+struct CullStats
+{
+	unsigned int tested;
+	unsigned int frustumCulled;
+	// Inside the frustum, but behind last frame's depth
+	unsigned int occluded;
+	unsigned int drawn;
+};
+
+// Culls whole objects on the GPU, after the render queue has sorted and uploaded them
+// A compute shader tests every object of a pass against the pass's frustum and, given a depth pyramid, against
+// last frame's depth, and adds the ones that survive to their draw commands (see Resources/cullCompShader.txt)
+// The CPU only issues one dispatch per pass, however many objects there are
+// Anything that was hidden last frame but not this one pops in a frame late, which is the price of not drawing depth first
+class GpuCuller
+{
+public:
+
+	GpuCuller();
+	~GpuCuller();
+
+	// Loads the cull shader
+	// Returns false if it failed to build
+	bool Init();
+
+	// Collects the counts from a couple of frames ago, if the GPU has finished them, and clears them for this one
+	// Call once a frame before any Cull
+	void BeginFrame();
+
+	// Culls one pass's objects, call after RenderQueue::Sort and before the pass is executed
+	// viewProj is the pass's camera, or the light for the shadow pass
+	// pyramid is last frame's depth from the same camera, NULL to only test against the frustum
+	void Cull( RenderQueue &queue, RenderPass pass, const glm::mat4 &viewProj, const DepthPyramid *pyramid );
+
+	// Counts for a pass, read back from the GPU two frames late so reading them never has to wait for it
+	// If the GPU is further behind than that, the last counts that did arrive are kept
+	const CullStats& GetStats( RenderPass pass ) const { return _stats[pass]; }
+
+protected:
+
+	// The buffers can't be shared between cullers
+	GpuCuller( const GpuCuller & );
+	GpuCuller& operator=( const GpuCuller & );
+
+	ShaderProgram _program;
+	GLint _firstObjectLocation, _numObjectsLocation, _countersOffsetLocation;
+	GLint _viewProjLocation;
+	GLint _depthPyramidLocation, _useDepthPyramidLocation, _pyramidViewProjLocation;
+
+	// Frames take turns with these, so the one being read back is the one the GPU finished with longest ago
+	static const unsigned int NUM_COUNTER_BUFFERS = 2;
+	GLuint _counterBuffers[NUM_COUNTER_BUFFERS];
+	// Signalled once the GPU is past the frame that last wrote each buffer
+	GLsync _counterFences[NUM_COUNTER_BUFFERS];
+	unsigned int _frame;
+
+	CullStats _stats[RENDER_PASS_COUNT];
+};
+
+#endif
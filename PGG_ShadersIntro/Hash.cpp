@@ -0,0 +1,48 @@
+
+#include "Hash.h"
+#include <cstring>
+
+
+unsigned long long HashBytes( const void *data, size_t size, unsigned long long seed )
+{
+	const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	unsigned long long hash = seed ^ ( size * m );
+
+	const unsigned char *bytes = (const unsigned char*) data;
+	const unsigned char *blocksEnd = bytes + ( size & ~(size_t) 7 );
+
+	for( ; bytes != blocksEnd; bytes += 8 )
+	{
+		// memcpy keeps this safe for unaligned data, compilers turn it into a plain load
+		unsigned long long k;
+		memcpy( &k, bytes, 8 );
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		hash ^= k;
+		hash *= m;
+	}
+
+	// Mix in the last few bytes
+	switch( size & 7 )
+	{
+	case 7: hash ^= (unsigned long long) bytes[6] << 48;
+	case 6: hash ^= (unsigned long long) bytes[5] << 40;
+	case 5: hash ^= (unsigned long long) bytes[4] << 32;
+	case 4: hash ^= (unsigned long long) bytes[3] << 24;
+	case 3: hash ^= (unsigned long long) bytes[2] << 16;
+	case 2: hash ^= (unsigned long long) bytes[1] << 8;
+	case 1: hash ^= (unsigned long long) bytes[0];
+		hash *= m;
+	}
+
+	hash ^= hash >> r;
+	hash *= m;
+	hash ^= hash >> r;
+
+	return hash;
+}
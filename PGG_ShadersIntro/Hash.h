@@ -0,0 +1,17 @@
+
+#ifndef __HASH__
+#define __HASH__
+
+#include <cstddef>
+#include <string>
+
+// 64-bit hash of a block of memory (MurmurHash64A), for spotting when cached data is out of date
+// Works through 8 bytes at a time, so hashing a file costs about as much as reading it
+unsigned long long HashBytes( const void *data, size_t size, unsigned long long seed = 0 );
+
+inline unsigned long long HashString( const std::string &text, unsigned long long seed = 0 )
+{
+	return HashBytes( text.data(), text.size(), seed );
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include "glew.h"
 
 #include "Scene.h"
+#include "GLState.h"
 
 // GUI system: https://github.com/ocornut/imgui
 // - prevent compile error by building with: WINDOWS_IGNORE_PACKING_MISMATCH
@@ -158,10 +159,11 @@ int main(int argc, char *argv[])
 	
 	// Enable the depth test to make sure triangles in front are always in front no matter the order they are drawn
 	// When you do this, don't forget to clear the depth buffer at the start of each frame - otherwise you just get an empty screen!
-	glEnable(GL_DEPTH_TEST);
+	GLState::SetEnabled(GL_DEPTH_TEST, true);
 
 
-	Scene myScene;
+	// The scene owns GL objects, so it's created on the heap and deleted before the GL context goes
+	Scene *myScene = new Scene();
 
 	// These are controlled by the states of key presses
 	// They will be used to control the camera
@@ -171,7 +173,7 @@ int main(int argc, char *argv[])
 
 	bool reset = false;
 
-	glm::vec3 backgroundColor = myScene.GetBackgroundColor();
+	glm::vec3 backgroundColor = myScene->GetBackgroundColor();
 
 	// Ok, hopefully finished with initialisation now
 	// Let's go and draw something!
@@ -185,14 +187,14 @@ int main(int argc, char *argv[])
 	//   * Update our world
 	//   * Draw our world
 	// We will come back to this in later lectures
-	myScene.m_maxwell->SetScale(glm::vec3(0.1f, 0.1f, 0.1f));
-	myScene.m_maxwell->SetPosition(glm::vec3(0.0f, 0.0f, 0.25f));
+	myScene->m_maxwell->SetScale(glm::vec3(0.1f, 0.1f, 0.1f));
+	myScene->m_maxwell->SetPosition(glm::vec3(0.0f, 0.0f, 0.25f));
 
-	myScene.m_flopp->SetScale(glm::vec3(0.1f, 0.1f, 0.1f));
-	myScene.m_flopp->SetPosition(glm::vec3(-1.0f, -1.9f, 0.0f));
+	myScene->m_flopp->SetScale(glm::vec3(0.1f, 0.1f, 0.1f));
+	myScene->m_flopp->SetPosition(glm::vec3(-1.0f, -1.9f, 0.0f));
 
-	myScene.m_plane->SetScale(glm::vec3(0.1f, 0.1f, 0.1f));
-	myScene.m_plane->SetPosition(glm::vec3(0.0f, -2.0f, 0.0f));
+	myScene->m_plane->SetScale(glm::vec3(0.1f, 0.1f, 0.1f));
+	myScene->m_plane->SetPosition(glm::vec3(0.0f, -2.0f, 0.0f));
 
 	bool go = true;
 	while( go )
@@ -353,76 +355,76 @@ int main(int argc, char *argv[])
 		// Control the camera based on our input commands
 		if (cmdRotateLeft && !cmdRotateRight)
 		{
-			myScene.ChangeCameraAngleY(1.0f * deltaTs);
+			myScene->ChangeCameraAngleY(1.0f * deltaTs);
 		}
 		else if (cmdRotateRight && !cmdRotateLeft)
 		{
-			myScene.ChangeCameraAngleY(-1.0f * deltaTs);
+			myScene->ChangeCameraAngleY(-1.0f * deltaTs);
 		}
 
 		if (cmdRotateUp && !cmdRotateDown)
 		{
-			myScene.ChangeCameraAngleX(1.0f * deltaTs);
+			myScene->ChangeCameraAngleX(1.0f * deltaTs);
 		}
 		else if (cmdRotateDown && !cmdRotateUp)
 		{
-			myScene.ChangeCameraAngleX(-1.0f * deltaTs);
+			myScene->ChangeCameraAngleX(-1.0f * deltaTs);
 		}
 
 		//Rotate the Cat
 		if (RotateCatNegativeY && !RotateCatY)
 		{
-			myScene.m_maxwell->AddRotation(glm::vec3(0.0f, -0.01f, 0.0f));
+			myScene->m_maxwell->AddRotation(glm::vec3(0.0f, -0.01f, 0.0f));
 		}
 		else if (!RotateCatNegativeY && RotateCatY)
 		{
-			myScene.m_maxwell->AddRotation(glm::vec3(0.0f, 0.01f, 0.0f));
+			myScene->m_maxwell->AddRotation(glm::vec3(0.0f, 0.01f, 0.0f));
 		}
 
 		if (RotateCatNegativeX && !RotateCatX)
 		{
-			myScene.m_maxwell->AddRotation(glm::vec3(-0.01f, 0.0f, 0.0f));
+			myScene->m_maxwell->AddRotation(glm::vec3(-0.01f, 0.0f, 0.0f));
 		}
 		else if (!RotateCatNegativeX && RotateCatX)
 		{
-			myScene.m_maxwell->AddRotation(glm::vec3(0.01f, 0.0f, 0.0f));
+			myScene->m_maxwell->AddRotation(glm::vec3(0.01f, 0.0f, 0.0f));
 		}
 
 		if (RotateCatNegativeZ && !RotateCatZ)
 		{
-			myScene.m_maxwell->AddRotation(glm::vec3(0.0f, 0.0f, -0.01f));
+			myScene->m_maxwell->AddRotation(glm::vec3(0.0f, 0.0f, -0.01f));
 		}
 		else if (!RotateCatNegativeZ && RotateCatZ)
 		{
-			myScene.m_maxwell->AddRotation(glm::vec3(0.0f, 0.0f, 0.01f));
+			myScene->m_maxwell->AddRotation(glm::vec3(0.0f, 0.0f, 0.01f));
 		}
 
 		//Move the Cat
 		if (MoveCatX && !MoveCatNegativeX)
 		{
-			myScene.m_maxwell->AddPosition(glm::vec3(0.03f, 0.0f, 0.0f));
+			myScene->m_maxwell->AddPosition(glm::vec3(0.03f, 0.0f, 0.0f));
 		}
 		else if (!MoveCatX && MoveCatNegativeX)
 		{
-			myScene.m_maxwell->AddPosition(glm::vec3(-0.03f, 0.0f, 0.0f));
+			myScene->m_maxwell->AddPosition(glm::vec3(-0.03f, 0.0f, 0.0f));
 		}
 
 		if (MoveCatZ && !MoveCatNegativeZ)
 		{
-			myScene.m_maxwell->AddPosition(glm::vec3(0.0f, 0.0f, 0.03f));
+			myScene->m_maxwell->AddPosition(glm::vec3(0.0f, 0.0f, 0.03f));
 		}
 		else if (!MoveCatZ && MoveCatNegativeZ)
 		{
-			myScene.m_maxwell->AddPosition(glm::vec3(0.0f, 0.0f, -0.03f));
+			myScene->m_maxwell->AddPosition(glm::vec3(0.0f, 0.0f, -0.03f));
 		}
 
 		if (reset)
 		{
-			myScene.m_maxwell->SetRotation(0.0f, 0.0f, 0.0f);
+			myScene->m_maxwell->SetRotation(0.0f, 0.0f, 0.0f);
 			reset = false;
 		}
 
-		myScene.Update(deltaTs);
+		myScene->Update(deltaTs);
 
 		// Draw our world
 		// --------------------------------------------
@@ -432,9 +434,14 @@ int main(int argc, char *argv[])
 		// This writes the above colour to the colour part of the framebuffer
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		//myScene.m_maxwell->AddRotation(vec3(0.01f, 0.0f, 0.01f));
+		//myScene->m_maxwell->AddRotation(vec3(0.01f, 0.0f, 0.01f));
 
-		myScene.Draw();
+		// The window can be resized, so draw at whatever size its framebuffer is now
+		SDL_GL_GetDrawableSize(window, &winWidth, &winHeight);
+		myScene->SetViewportSize(winWidth, winHeight);
+		// Count the GL calls made this frame, the GUI shows last frame's numbers
+		GLState::BeginFrame();
+		myScene->Draw();
 
 
 		// Draw GUI
@@ -468,6 +475,55 @@ int main(int argc, char *argv[])
 			ImGui::Text("Colour picker for Background");
 			ImGui::ColorEdit3("Background Colour", &(backgroundColor[0]));
 
+			// State changes the render queue asked for, after sorting the draws
+			const RenderQueueStats &renderStats = myScene->GetRenderStats();
+			ImGui::Text("Objects: %u in %u commands, %u multi-draw calls", renderStats.draws, renderStats.commands, renderStats.drawCalls);
+			ImGui::Text("  program switches: %u", renderStats.programSwitches);
+			ImGui::Text("  material switches: %u", renderStats.materialSwitches);
+			ImGui::Text("  VAO switches: %u", renderStats.vertexArraySwitches);
+
+			// Textures still on their way in, and how much of the upload budget the last frame used
+			const TextureStreamStats &streamStats = myScene->GetTextureStreamStats();
+			ImGui::Text("Textures: %u streaming, %u resident, %u failed", streamStats.pending, streamStats.resident, streamStats.failed);
+			ImGui::Text("  uploaded %u KB, ring %u / %u KB", (unsigned int)(streamStats.bytesLastFrame / 1024),
+				(unsigned int)(streamStats.ringBytesInUse / 1024), (unsigned int)(streamStats.ringSize / 1024));
+
+			// Tiles of the virtual textures in the atlas, and what the last frame's feedback brought in
+			bool virtualTexturing = myScene->IsVirtualTexturing();
+			if (ImGui::Checkbox("Virtual texturing", &virtualTexturing))
+			{
+				myScene->SetVirtualTexturing(virtualTexturing);
+			}
+			const VirtualTextureStats &virtualStats = myScene->GetVirtualTextureStats();
+			ImGui::Text("  %u / %u pages of %u tiles, %u KB", virtualStats.residentPages, virtualStats.numPages, virtualStats.numTiles,
+				(unsigned int)(myScene->GetVirtualTextureMemory() / 1024));
+			ImGui::Text("  %u pending, %u loaded, %u evicted", virtualStats.pendingTiles, virtualStats.tilesLoaded, virtualStats.tilesEvicted);
+
+			// What the cull shader threw away, these come back from the GPU a couple of frames late
+			bool gpuCulling = myScene->IsGpuCulling();
+			if (ImGui::Checkbox("GPU culling", &gpuCulling))
+			{
+				myScene->SetGpuCulling(gpuCulling);
+			}
+			if (gpuCulling)
+			{
+				const char *passNames[RENDER_PASS_COUNT] = { "Shadow", "Main" };
+				for (unsigned int pass = 0; pass < RENDER_PASS_COUNT; pass++)
+				{
+					const CullStats &cullStats = myScene->GetCullStats((RenderPass)pass);
+					ImGui::Text("  %s: %u drawn, %u culled (%u outside, %u occluded)", passNames[pass], cullStats.drawn,
+						cullStats.frustumCulled + cullStats.occluded, cullStats.frustumCulled, cullStats.occluded);
+				}
+			}
+
+			// How many state changes reached OpenGL last frame, and how many were skipped as they changed nothing
+			ImGui::Text("GL calls issued / skipped");
+			const GLStateCounters &glCounters = GLState::GetLastFrameCounters();
+			for (unsigned int i = 0; i < GL_STATE_CALL_COUNT; i++)
+			{
+				ImGui::Text("  %s: %u / %u", GLState::GetCallName((GLStateCall)i), glCounters.issued[i], glCounters.skipped[i]);
+			}
+
 			// We've finished adding stuff to the window
 			ImGui::End();
 		}
@@ -496,6 +552,7 @@ int main(int argc, char *argv[])
 	ImGui::DestroyContext();
 
 	// Our cleanup phase, hopefully fairly self-explanatory ;)
+	delete myScene;
 	SDL_GL_DeleteContext( glcontext );
 	SDL_DestroyWindow( window );
 	SDL_Quit();
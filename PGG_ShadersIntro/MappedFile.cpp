@@ -0,0 +1,160 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile()
+{
+	_data = NULL;
+	_size = 0;
+	_modifiedTime = 0;
+
+#ifdef _WIN32
+	_fileHandle = INVALID_HANDLE_VALUE;
+	_mappingHandle = NULL;
+#else
+	_fileDescriptor = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open( const std::string &filename )
+{
+	Close();
+
+	// We only ever read front to back, so let the OS know it can read ahead
+	_fileHandle = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if( _fileHandle == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if( !GetFileSizeEx( _fileHandle, &fileSize ) )
+	{
+		Close();
+		return false;
+	}
+	_size = (size_t) fileSize.QuadPart;
+
+	FILETIME lastWriteTime;
+	if( GetFileTime( _fileHandle, NULL, NULL, &lastWriteTime ) )
+	{
+		_modifiedTime = ( (unsigned long long) lastWriteTime.dwHighDateTime << 32 ) | lastWriteTime.dwLowDateTime;
+	}
+
+	// Windows refuses to map an empty file, but that's still a valid (empty) file
+	if( _size == 0 )
+	{
+		return true;
+	}
+
+	_mappingHandle = CreateFileMappingA( _fileHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( _mappingHandle == NULL )
+	{
+		Close();
+		return false;
+	}
+
+	_data = (const char*) MapViewOfFile( _mappingHandle, FILE_MAP_READ, 0, 0, 0 );
+	if( _data == NULL )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if( _data != NULL )
+	{
+		UnmapViewOfFile( _data );
+	}
+	if( _mappingHandle != NULL )
+	{
+		CloseHandle( _mappingHandle );
+	}
+	if( _fileHandle != INVALID_HANDLE_VALUE )
+	{
+		CloseHandle( _fileHandle );
+	}
+	_data = NULL;
+	_size = 0;
+	_modifiedTime = 0;
+	_mappingHandle = NULL;
+	_fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::Open( const std::string &filename )
+{
+	Close();
+
+	_fileDescriptor = open( filename.c_str(), O_RDONLY );
+	if( _fileDescriptor < 0 )
+	{
+		return false;
+	}
+
+	struct stat fileInfo;
+	if( fstat( _fileDescriptor, &fileInfo ) != 0 )
+	{
+		Close();
+		return false;
+	}
+	_size = (size_t) fileInfo.st_size;
+	_modifiedTime = (unsigned long long) fileInfo.st_mtime;
+
+	// mmap doesn't accept a zero length, but that's still a valid (empty) file
+	if( _size == 0 )
+	{
+		return true;
+	}
+
+	void *mapping = mmap( NULL, _size, PROT_READ, MAP_PRIVATE, _fileDescriptor, 0 );
+	if( mapping == MAP_FAILED )
+	{
+		Close();
+		return false;
+	}
+	// We only ever read front to back, so let the OS know it can read ahead
+	madvise( mapping, _size, MADV_SEQUENTIAL );
+
+	_data = (const char*) mapping;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if( _data != NULL )
+	{
+		munmap( (void*) _data, _size );
+	}
+	if( _fileDescriptor >= 0 )
+	{
+		close( _fileDescriptor );
+	}
+	_data = NULL;
+	_size = 0;
+	_modifiedTime = 0;
+	_fileDescriptor = -1;
+}
+
+#endif
@@ -0,0 +1,52 @@
+
+#ifndef __MAPPED_FILE__
+#define __MAPPED_FILE__
+
+#include <string>
+#include <cstddef>
+
+// Read-only view of a whole file, mapped into memory by the OS
+// This lets loaders work on the file contents in place instead of copying them through streams
+class MappedFile
+{
+public:
+
+	MappedFile();
+	~MappedFile();
+
+	// Maps the file into memory
+	// Returns false if the file could not be opened or mapped
+	bool Open( const std::string &filename );
+
+	// Unmaps the file - this is also done by the destructor
+	void Close();
+
+	// Start of the file contents and its size in bytes
+	// Data is NULL if nothing is mapped (or the file is empty)
+	const char* GetData() const { return _data; }
+	size_t GetSize() const { return _size; }
+
+	// When the file was last written, in the OS's own units
+	// Only useful for comparing against an earlier value for the same file
+	unsigned long long GetModifiedTime() const { return _modifiedTime; }
+
+protected:
+
+	// Mapping can't be shared between objects
+	MappedFile( const MappedFile & );
+	MappedFile& operator=( const MappedFile & );
+
+	const char *_data;
+	size_t _size;
+	unsigned long long _modifiedTime;
+
+#ifdef _WIN32
+	// Windows needs both the file handle and the mapping handle kept open
+	void *_fileHandle;
+	void *_mappingHandle;
+#else
+	int _fileDescriptor;
+#endif
+};
+
+#endif
@@ -1,32 +1,28 @@
 
 #include <iostream>
-#include <fstream>
-#include <SDL/SDL.h>
 #include <GLM/gtc/type_ptr.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 #include "Material.h"
+#include "GLState.h"
 
 
 Material::Material()
 {
 	// Initialise everything here
-	_shaderProgram = 0;
-
-	_shaderModelMatLocation = 0;
-	_shaderInvModelMatLocation = 0;
-	_shaderViewMatLocation = 0;
-	_shaderProjMatLocation = 0;
-	_shaderLightSpaceMatrixMatLocation = 0;
-
-	_shaderDiffuseColLocation = 0;
-	_shaderEmissiveColLocation = 0;
-	_shaderWSLightPosLocation = 0;
-	_shaderSpecularColLocation = 0;
-
-	_shaderTex1SamplerLocation = 0;
-	_shaderShadowMapSamplerLocation = 0;
-
-	_texture1 = 0;
+	// Texture units the samplers read from, see Apply
+	_parameters.Set( "tex1", 0 );
+	_parameters.Set( "shadowMap", 1 );
+	_parameters.Set( "tex1Array", 2 );
+	_parameters.Set( "virtualAtlas", 3 );
+	_usesTexture1 = false;
+	_usesShadowMap = false;
+	_usesTextureArray = false;
+	_usesVirtualTexture = false;
+
+	_shadowMap = 0;
+	_textureLayer = -1;
+	_virtualTextures = NULL;
+	_virtualTextureId = -1;
 }
 
 Material::~Material()
@@ -35,269 +31,98 @@ Material::~Material()
 }
 
 
-bool Material::LoadShaders( std::string vertFilename, std::string fragFilename )
+bool Material::SetShaders( std::shared_ptr<ShaderProgram> program )
 {
-	// OpenGL doesn't provide any functions for loading shaders from file
-
-	
-	std::ifstream vertFile( vertFilename );
-	char *vShaderText = NULL;
-
-	if( vertFile.is_open() )
-	{
-		// Find out how many characters are in the file
-		vertFile.seekg (0, vertFile.end);
-		int length = (int) vertFile.tellg();
-		vertFile.seekg (0, vertFile.beg);
-		
-		// Create our buffer
-		vShaderText = new char [length + 1];
-
-		// Transfer data from file to buffer
-		vertFile.read(vShaderText,length);
-
-		// Check it reached the end of the file
-		if( !vertFile.eof() )
-		{
-			vertFile.close();
-			std::cerr<<"WARNING: could not read vertex shader from file: "<<vertFilename<<std::endl;
-			return false;
-		}
-
-		// Find out how many characters were actually read
-		length = (int) vertFile.gcount();
-
-		// Needs to be NULL-terminated
-		vShaderText[length] = 0;
-		
-		vertFile.close();
-	}
-	else
+	_shaderProgram = program;
+	if( !_shaderProgram )
 	{
-		std::cerr<<"WARNING: could not open vertex shader from file: "<<vertFilename<<std::endl;
 		return false;
 	}
+	// Waits for the program if it's still compiling - ideally AssetRegistry::ResolveShaderPrograms has already done that
+	bool ready = _shaderProgram->Resolve();
 
-	
-	std::ifstream fragFile( fragFilename );
-	char *fShaderText = NULL;
-
-	if( fragFile.is_open() )
-	{
-		// Find out how many characters are in the file
-		fragFile.seekg (0, fragFile.end);
-		int length = (int) fragFile.tellg();
-		fragFile.seekg (0, fragFile.beg);
-		
-		// Create our buffer
-		fShaderText = new char [length + 1];
-		
-		// Transfer data from file to buffer
-		fragFile.read(fShaderText,length);
-		
-		// Check it reached the end of the file
-		if( !fragFile.eof() )
-		{
-			fragFile.close();
-			std::cerr<<"WARNING: could not read fragment shader from file: "<<fragFilename<<std::endl;
-			return false;
-		}
-		
-		// Find out how many characters were actually read
-		length = (int) fragFile.gcount();
-		
-		// Needs to be NULL-terminated
-		fShaderText[length] = 0;
-		
-		fragFile.close();
-	}
-	else
-	{
-		std::cerr<<"WARNING: could not open fragment shader from file: "<<fragFilename<<std::endl;
-		return false;
-	}
-
-
-
-	// The 'program' stores the shaders
-	_shaderProgram = glCreateProgram();
-
-	// Create the vertex shader
-	GLuint vShader = glCreateShader( GL_VERTEX_SHADER );
-	// Give GL the source for it
-	glShaderSource( vShader, 1, &vShaderText, NULL );
-	// Delete buffer
-	delete [] vShaderText;
-	// Compile the shader
-	glCompileShader( vShader );
-	// Check it compiled and give useful output if it didn't work!
-	if( !CheckShaderCompiled( vShader ) )
-	{
-		std::cerr<<"ERROR: failed to compile vertex shader"<<std::endl;
-		return false;
-	}
-	// This links the shader to the program
-	glAttachShader( _shaderProgram, vShader );
-
-	// Same for the fragment shader
-	GLuint fShader = glCreateShader( GL_FRAGMENT_SHADER );
-	glShaderSource( fShader, 1, &fShaderText, NULL );
-	// Delete buffer
-	delete [] fShaderText;
-	glCompileShader( fShader );
-	if( !CheckShaderCompiled( fShader ) )
-	{
-		std::cerr<<"ERROR: failed to compile fragment shader"<<std::endl;
-		return false;
-	}
-	glAttachShader( _shaderProgram, fShader );
-
-	// This makes sure the vertex and fragment shaders connect together
-	glLinkProgram( _shaderProgram );
-	// Check this worked
-	GLint linked;
-	glGetProgramiv( _shaderProgram, GL_LINK_STATUS, &linked );
-	if ( !linked )
-	{
-		GLsizei len;
-		glGetProgramiv( _shaderProgram, GL_INFO_LOG_LENGTH, &len );
-
-		GLchar* log = new GLchar[len+1];
-		glGetProgramInfoLog( _shaderProgram, len, &len, log );
-		std::cerr << "ERROR: Shader linking failed: " << log << std::endl;
-		delete [] log;
-
-		return false;
-	}
-
-
-	// We will define matrices which we will send to the shader
-	// To do this we need to retrieve the locations of the shader's matrix uniform variables
-	glUseProgram( _shaderProgram );
-	_shaderModelMatLocation = glGetUniformLocation( _shaderProgram, "modelMat" );
-	_shaderInvModelMatLocation = glGetUniformLocation( _shaderProgram, "invModelMat" );
-	_shaderViewMatLocation = glGetUniformLocation( _shaderProgram, "viewMat" );
-	_shaderProjMatLocation = glGetUniformLocation( _shaderProgram, "projMat" );
-	_shaderLightSpaceMatrixMatLocation = glGetUniformLocation(_shaderProgram, "lightSpaceMatrix");
-		
-	_shaderDiffuseColLocation = glGetUniformLocation( _shaderProgram, "diffuseColour" );
-	_shaderEmissiveColLocation = glGetUniformLocation( _shaderProgram, "emissiveColour" );
-	_shaderSpecularColLocation = glGetUniformLocation( _shaderProgram, "specularColour" );
-	_shaderWSLightPosLocation = glGetUniformLocation( _shaderProgram, "worldSpaceLightPos" );
+	// The program already knows which uniforms it has, so this doesn't need to ask OpenGL
+	// A program that failed to build has none, so it samples nothing
+	_usesTexture1 = _shaderProgram->FindParameter( "tex1" ) != NULL;
+	_usesShadowMap = _shaderProgram->FindParameter( "shadowMap" ) != NULL;
+	_usesTextureArray = _shaderProgram->FindParameter( "tex1Array" ) != NULL;
+	_usesVirtualTexture = _shaderProgram->FindParameter( "virtualAtlas" ) != NULL;
 
-	_shaderTex1SamplerLocation = glGetUniformLocation( _shaderProgram, "tex1" );
-	_shaderShadowMapSamplerLocation = glGetUniformLocation(_shaderProgram, "shadowMap");
-
-	return true;
+	return ready;
 }
 
-bool Material::CheckShaderCompiled( GLint shader )
+bool Material::SetTextureArray( std::shared_ptr<TextureArray> textureArray )
 {
-	GLint compiled;
-	glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
-	if ( !compiled )
-	{
-		GLsizei len;
-		glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &len );
-
-		// OpenGL will store an error message as a string that we can retrieve and print
-		GLchar* log = new GLchar[len+1];
-		glGetShaderInfoLog( shader, len, &len, log );
-		std::cerr << "ERROR: Shader compilation failed: " << log << std::endl;
-		delete [] log;
-
-		return false;
-	}
-	return true;
+	_textureArray = textureArray;
+	_textureLayer = _textureArray ? _textureArray->Add( _texture1 ) : -1;
+	return _textureLayer >= 0;
 }
 
-
-unsigned int Material::LoadTexture( std::string filename )
+int Material::GetTextureLayer() const
 {
-	// Load SDL surface
-	SDL_Surface *image = SDL_LoadBMP( filename.c_str() );
-
-	if( !image ) // Check it worked
+	if( _usesVirtualTexture )
 	{
-		std::cerr<<"WARNING: could not load BMP image: "<<filename<<std::endl;
-		return 0;
+		return _virtualTextures ? _virtualTextureId : -1;
 	}
-
-	// Create OpenGL texture
-	unsigned int texName = 0;
-	glGenTextures(1, &texName);
-
-
-	glBindTexture(GL_TEXTURE_2D, texName);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	// By default, OpenGL mag filter is linear
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	// By default, OpenGL min filter will use mipmaps
-	// We therefore either need to tell it to use linear or generate a mipmap
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	
-	// SDL loads images in BGR order
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image->w, image->h, 0, GL_BGR, GL_UNSIGNED_BYTE, image->pixels);
-
-	//glGenerateMipmap(GL_TEXTURE_2D);
-
-	SDL_FreeSurface(image);
-	
-	//glBindTexture(GL_TEXTURE_2D, 0);
-
-
-	return texName;
+	return _usesTextureArray && _textureArray && _textureArray->IsLayerReady( _textureLayer ) ? _textureLayer : -1;
 }
 
-
-
-
-// Use this function for drawing the scene from light's POV
-void Material::SetMatrices(glm::mat4 modelMatrix, glm::mat4 invModelMatrix, glm::mat4 viewMatrix, glm::mat4 projMatrix)
+int Material::UpdateTextureLayer()
 {
-	glUseProgram( _shaderProgram );
-	// Send matrices and uniforms
-	glm::mat4 lightSpaceMatrix = projMatrix * viewMatrix;
-	glUniformMatrix4fv(_shaderModelMatLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-	glUniformMatrix4fv(_shaderInvModelMatLocation, 1, GL_TRUE, glm::value_ptr(invModelMatrix));
-	glUniformMatrix4fv(_shaderViewMatLocation, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-	glUniformMatrix4fv(_shaderProjMatLocation, 1, GL_FALSE, glm::value_ptr(projMatrix));
-	glUniformMatrix4fv(_shaderLightSpaceMatrixMatLocation, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+	int layer = GetTextureLayer();
+	if( layer >= 0 )
+	{
+		_texture1.reset();
+	}
+	return layer;
 }
 
-// Use this function for drawing the scene from camera's POV
-void Material::SetMatrices(glm::mat4 modelMatrix, glm::mat4 invModelMatrix, glm::mat4 viewMatrix, glm::mat4 projMatrix, glm::mat4 lightMatrix)
+bool Material::SharesStateWith( const Material &other ) const
 {
-	glUseProgram(_shaderProgram);
-	// Send matrices and uniforms
-	glm::mat4 lightSpaceMatrix = projMatrix * viewMatrix;
-	glUniformMatrix4fv(_shaderModelMatLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-	glUniformMatrix4fv(_shaderInvModelMatLocation, 1, GL_TRUE, glm::value_ptr(invModelMatrix));
-	glUniformMatrix4fv(_shaderViewMatLocation, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-	glUniformMatrix4fv(_shaderProjMatLocation, 1, GL_FALSE, glm::value_ptr(projMatrix));
-	glUniformMatrix4fv(_shaderLightSpaceMatrixMatLocation, 1, GL_FALSE, glm::value_ptr(lightMatrix));
+	if( &other == this )
+	{
+		return true;
+	}
+	// Textures the program doesn't sample can be anything
+	// Once both are in layers of the same array or textures of the same pool, each object picks its own and the textures can differ
+	int layer = GetTextureLayer(), otherLayer = other.GetTextureLayer();
+	bool sameTextures = layer >= 0 && otherLayer >= 0
+		? ( _usesVirtualTexture ? _virtualTextures == other._virtualTextures : _textureArray == other._textureArray )
+		: ( layer < 0 && otherLayer < 0 && ( !_usesTexture1 || _texture1 == other._texture1 ) );
+	return _shaderProgram == other._shaderProgram
+		&& sameTextures
+		&& ( !_usesShadowMap || _shadowMap == other._shadowMap )
+		&& _parameters == other._parameters;
 }
-	
 
 void Material::Apply()
 {
-	glUseProgram( _shaderProgram );
+	GLState::UseProgram( _shaderProgram ? _shaderProgram->GetHandle() : 0 );
 
-	glUniform4fv( _shaderWSLightPosLocation, 1, glm::value_ptr(_lightPosition) );
+	if( !_shaderProgram )
+	{
+		return;
+	}
 
-	glUniform3fv( _shaderEmissiveColLocation, 1, glm::value_ptr(_emissiveColour) );
-	glUniform3fv( _shaderDiffuseColLocation, 1, glm::value_ptr(_diffuseColour) );
-	glUniform3fv( _shaderSpecularColLocation, 1, glm::value_ptr(_specularColour) );
+	// Colours, sampler units and anything else set on the material, but only the ones this program reads
+	_parameters.Apply( *_shaderProgram );
 	
-	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(_shaderTex1SamplerLocation, 0);
-	glBindTexture(GL_TEXTURE_2D, _texture1);
-
-	glActiveTexture(GL_TEXTURE1);
-	glUniform1i(_shaderShadowMapSamplerLocation, 1);
-	glBindTexture(GL_TEXTURE_2D, _shadowMap);
+	// Objects sharing a texture or the shadow map only bind it once, GLState skips the rest
+	// Programs that don't sample them, like the shadow pass, don't bind them at all
+	if( _usesTexture1 )
+	{
+		GLState::BindTexture( 0, GL_TEXTURE_2D, _texture1 ? _texture1->GetHandle() : 0 );
+	}
+	if( _usesShadowMap )
+	{
+		GLState::BindTexture( 1, GL_TEXTURE_2D, _shadowMap );
+	}
+	if( _usesTextureArray )
+	{
+		GLState::BindTexture( 2, GL_TEXTURE_2D_ARRAY, _textureArray ? _textureArray->GetHandle() : 0 );
+	}
+	if( _usesVirtualTexture )
+	{
+		GLState::BindTexture( 3, GL_TEXTURE_2D, _virtualTextures ? _virtualTextures->GetAtlas() : 0 );
+	}
 }
\ No newline at end of file
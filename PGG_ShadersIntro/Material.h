@@ -3,8 +3,14 @@
 #define __MATERIAL__
 
 #include <string>
+#include <memory>
 #include <GLM/glm.hpp>
 #include "glew.h"
+#include "ShaderProgram.h"
+#include "Texture.h"
+#include "TextureArray.h"
+#include "VirtualTexturePool.h"
+#include "MaterialParameters.h"
 
 // Encapsulates shaders and textures
 class Material
@@ -13,61 +19,74 @@ public:
 	Material();
 	~Material();
 
-	// Loads shaders from file
-	// Returns false if there was an error - it will also print out messages to console
-	bool LoadShaders( std::string vertFilename, std::string fragFilename );
+	// Sets the shader program, which may be shared with other materials
+	// Returns false if the program is missing or failed to build
+	bool SetShaders( std::shared_ptr<ShaderProgram> program );
+	const ShaderProgram* GetShaderProgram() const { return _shaderProgram.get(); }
+
+	// True if drawing with the other material needs nothing changed after applying this one
+	// Same program, textures and parameter values - the render queue draws such materials' objects together
+	// Each object's model matrix, vertex decode and texture layer are in the render queue's instance buffer, so they don't count
+	bool SharesStateWith( const Material &other ) const;
 
-	// For setting the standard matrices needed by the shader
-	void SetMatrices(glm::mat4 modelMatrix, glm::mat4 invModelMatrix, glm::mat4 viewMatrix, glm::mat4 projMatrix);
-	void SetMatrices(glm::mat4 modelMatrix, glm::mat4 invModelMatrix, glm::mat4 viewMatrix, glm::mat4 projMatrix, glm::mat4 lightMatrix);
-	
 	// For setting material properties
-	void SetEmissiveColour( glm::vec3 input ) { _emissiveColour = input;}
-	void SetDiffuseColour( glm::vec3 input ) { _diffuseColour = input;}
-	void SetSpecularColour( glm::vec3 input ) { _specularColour = input;}
+	// Shaders without these colours never get sent them
+	void SetEmissiveColour( glm::vec3 input ) { _parameters.Set( "emissiveColour", input ); }
+	void SetDiffuseColour( glm::vec3 input ) { _parameters.Set( "diffuseColour", input ); }
+	void SetSpecularColour( glm::vec3 input ) { _parameters.Set( "specularColour", input ); }
 
-	// Set light position in world space
-	void SetLightPosition( glm::vec3 input ) { _lightPosition = input;}
+	// Any other uniform the material's shader has, e.g. GetParameters().Set( "shininess", 20.0f )
+	MaterialParameters& GetParameters() { return _parameters; }
 
 	// Sets texture
 	// This applies to ambient, diffuse and specular colours
+	// Textures from AssetRegistry::GetTexture are already the compressed .ktx2 or .dds when there is one, or compressed on load
 	// If you want textures for anything else, you'll need to do that yourself ;) 
-	bool SetTexture( std::string filename ) { _texture1 = LoadTexture(filename); return _texture1>0; }
+	bool SetTexture( std::shared_ptr<Texture> texture ) { _texture1 = texture; return _texture1 && _texture1->GetHandle()>0; }
 	bool SetShadowMap( unsigned int value ) { _shadowMap = value;  return _shadowMap>0; }
 
+	// Adds the texture to a layer of the array, so this material can be drawn along with others using the same array
+	// The program needs the TEXTURE_ARRAY define (see Resources/fragShader.txt), and until the layer has been filled
+	// the material draws with its texture on its own as before
+	// Returns false if there's no texture yet or the array is full
+	bool SetTextureArray( std::shared_ptr<TextureArray> textureArray );
+
+	// Draws with a texture from the pool instead, id being what VirtualTexturePool::Load returned
+	// The program needs the VIRTUAL_TEXTURE define (see Resources/fragShader.txt), otherwise the material's own texture is used
+	// The pool must outlive the material
+	void SetVirtualTexture( VirtualTexturePool *pool, int id ) { _virtualTextures = pool; _virtualTextureId = id; }
+
+	// The array layer or virtual texture id each object drawn with this material reads, or -1 while it's drawn with its own texture
+	int GetTextureLayer() const;
+
+	// GetTextureLayer for the render queue, which also lets go of the material's own texture once there is a layer
+	// Only the array or virtual texture is sampled from then on, so keeping it would leave the image in video memory twice
+	int UpdateTextureLayer();
+
 	// Sets the material, applying the shaders
 	void Apply();
 
 protected:
 
-	// Utility function
-	bool CheckShaderCompiled( GLint shader );
-	
-	// The OpenGL shader program handle
-	int _shaderProgram;
-
-	// Locations of Uniforms in the vertex shader
-	int _shaderModelMatLocation;
-	int _shaderInvModelMatLocation;
-	int _shaderViewMatLocation;
-	int _shaderProjMatLocation;
-	int _shaderLightSpaceMatrixMatLocation;
-	int _shaderShadowMapSamplerLocation;
-
-	// Location of Uniforms in the fragment shader
-	int _shaderDiffuseColLocation, _shaderEmissiveColLocation, _shaderSpecularColLocation;
-	int _shaderWSLightPosLocation;
-	int _shaderTex1SamplerLocation;
+	// The shader program, shared between every material that uses the same shaders
+	std::shared_ptr<ShaderProgram> _shaderProgram;
 
 	// Local store of material properties to be sent to the shader
-	glm::vec3 _emissiveColour, _diffuseColour, _specularColour;
-	glm::vec3 _lightPosition;
-
-	// Loads a .bmp from file
-	unsigned int LoadTexture( std::string filename );
-	
-	// OpenGL handle for the texture
-	unsigned int _texture1;
+	MaterialParameters _parameters;
+
+	// The texture, shared between every material that uses the same image
+	std::shared_ptr<Texture> _texture1;
 	unsigned int _shadowMap;
+
+	// The array holding a copy of the texture, and which layer
+	std::shared_ptr<TextureArray> _textureArray;
+	int _textureLayer;
+
+	// The pool holding the texture's tiles, and which texture
+	VirtualTexturePool *_virtualTextures;
+	int _virtualTextureId;
+
+	// Whether the program samples each texture, so Apply can leave out binds it doesn't need
+	bool _usesTexture1, _usesShadowMap, _usesTextureArray, _usesVirtualTexture;
 };
 #endif
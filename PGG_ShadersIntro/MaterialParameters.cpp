@@ -0,0 +1,210 @@
+
+#include "MaterialParameters.h"
+#include "ShaderProgram.h"
+#include "GLState.h"
+#include <GLM/gtc/type_ptr.hpp>
+#include <cstring>
+#include <iostream>
+
+
+// True for the uniform types that are set with a texture unit
+static bool IsSamplerType( GLenum type )
+{
+	switch( type )
+	{
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// How many floats a value of the type takes in _values
+static unsigned int ValueSize( GLenum type )
+{
+	switch( type )
+	{
+	case GL_FLOAT_VEC2:
+		return 2;
+	case GL_FLOAT_VEC3:
+		return 3;
+	case GL_FLOAT_VEC4:
+		return 4;
+	case GL_FLOAT_MAT4:
+		return 16;
+	default:
+		return 1;
+	}
+}
+
+
+MaterialParameters::MaterialParameters()
+{
+	_boundProgram = 0;
+}
+
+float* MaterialParameters::FindValue( const std::string &name, GLenum type, unsigned int numFloats )
+{
+	for( size_t i = 0; i < _parameters.size(); i++ )
+	{
+		if( _parameters[i].name == name )
+		{
+			// Changing a parameter's type means it may no longer match the program, so leave it to Bind to decide
+			if( _parameters[i].type != type )
+			{
+				_parameters[i].type = type;
+				_parameters[i].offset = (unsigned int) _values.size();
+				_values.resize( _values.size() + numFloats, 0.0f );
+				_boundProgram = 0;
+			}
+			return &_values[_parameters[i].offset];
+		}
+	}
+
+	Parameter parameter;
+	parameter.name = name;
+	parameter.type = type;
+	parameter.offset = (unsigned int) _values.size();
+	_parameters.push_back( parameter );
+	_values.resize( _values.size() + numFloats, 0.0f );
+	_boundProgram = 0;
+	return &_values[parameter.offset];
+}
+
+void MaterialParameters::Set( const std::string &name, int value )
+{
+	memcpy( FindValue( name, GL_INT, 1 ), &value, sizeof( value ) );
+}
+
+void MaterialParameters::Set( const std::string &name, float value )
+{
+	*FindValue( name, GL_FLOAT, 1 ) = value;
+}
+
+void MaterialParameters::Set( const std::string &name, const glm::vec2 &value )
+{
+	memcpy( FindValue( name, GL_FLOAT_VEC2, 2 ), glm::value_ptr( value ), sizeof( value ) );
+}
+
+void MaterialParameters::Set( const std::string &name, const glm::vec3 &value )
+{
+	memcpy( FindValue( name, GL_FLOAT_VEC3, 3 ), glm::value_ptr( value ), sizeof( value ) );
+}
+
+void MaterialParameters::Set( const std::string &name, const glm::vec4 &value )
+{
+	memcpy( FindValue( name, GL_FLOAT_VEC4, 4 ), glm::value_ptr( value ), sizeof( value ) );
+}
+
+void MaterialParameters::Set( const std::string &name, const glm::mat4 &value )
+{
+	memcpy( FindValue( name, GL_FLOAT_MAT4, 16 ), glm::value_ptr( value ), sizeof( value ) );
+}
+
+bool MaterialParameters::operator==( const MaterialParameters &other ) const
+{
+	if( _parameters.size() != other._parameters.size() )
+	{
+		return false;
+	}
+	for( size_t i = 0; i < _parameters.size(); i++ )
+	{
+		const Parameter &mine = _parameters[i];
+		const Parameter *theirs = &other._parameters[i];
+		// Usually set in the same order, but look the name up when they weren't
+		if( theirs->name != mine.name )
+		{
+			theirs = NULL;
+			for( size_t j = 0; j < other._parameters.size(); j++ )
+			{
+				if( other._parameters[j].name == mine.name )
+				{
+					theirs = &other._parameters[j];
+					break;
+				}
+			}
+		}
+		if( theirs == NULL || theirs->type != mine.type )
+		{
+			return false;
+		}
+		if( memcmp( &_values[mine.offset], &other._values[theirs->offset], ValueSize( mine.type ) * sizeof( float ) ) != 0 )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void MaterialParameters::Bind( const ShaderProgram &program )
+{
+	_bindings.clear();
+	_boundProgram = program.GetHandle();
+
+	for( size_t i = 0; i < _parameters.size(); i++ )
+	{
+		const ShaderParameter *uniform = program.FindParameter( _parameters[i].name );
+		if( uniform == NULL )
+		{
+			// Not an error, the program just doesn't need this one
+			continue;
+		}
+
+		bool matches = uniform->type == _parameters[i].type || ( _parameters[i].type == GL_INT && IsSamplerType( uniform->type ) );
+		if( !matches )
+		{
+			std::cerr<<"WARNING: material parameter "<<_parameters[i].name<<" is the wrong type for program "<<program.GetName()<<", it won't be set"<<std::endl;
+			continue;
+		}
+
+		Binding binding;
+		binding.location = uniform->location;
+		binding.type = _parameters[i].type;
+		binding.offset = _parameters[i].offset;
+		_bindings.push_back( binding );
+	}
+}
+
+void MaterialParameters::Apply( const ShaderProgram &program )
+{
+	if( program.GetHandle() != _boundProgram )
+	{
+		Bind( program );
+	}
+
+	for( size_t i = 0; i < _bindings.size(); i++ )
+	{
+		const Binding &binding = _bindings[i];
+		const float *value = &_values[binding.offset];
+		switch( binding.type )
+		{
+		case GL_INT:
+			{
+				int intValue;
+				memcpy( &intValue, value, sizeof( intValue ) );
+				GLState::Uniform( binding.location, intValue );
+			}
+			break;
+		case GL_FLOAT:
+			GLState::Uniform( binding.location, value[0] );
+			break;
+		case GL_FLOAT_VEC2:
+			GLState::Uniform( binding.location, glm::make_vec2( value ) );
+			break;
+		case GL_FLOAT_VEC3:
+			GLState::Uniform( binding.location, glm::make_vec3( value ) );
+			break;
+		case GL_FLOAT_VEC4:
+			GLState::Uniform( binding.location, glm::make_vec4( value ) );
+			break;
+		case GL_FLOAT_MAT4:
+			GLState::Uniform( binding.location, glm::make_mat4( value ) );
+			break;
+		}
+	}
+}
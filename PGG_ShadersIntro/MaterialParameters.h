@@ -0,0 +1,75 @@
+
+#ifndef __MATERIAL_PARAMETERS__
+#define __MATERIAL_PARAMETERS__
+
+#include "glew.h"
+#include <GLM/glm.hpp>
+#include <string>
+#include <vector>
+
+class ShaderProgram;
+
+// A material's uniform values, by name, e.g. "diffuseColour" or "tex1"
+// Values are only uploaded to programs that actually have a uniform of that name and type,
+// so one block can be shared by shaders that use different parts of it and each only pays for what it reads
+// Anything not set keeps the default given in the shader
+class MaterialParameters
+{
+public:
+
+	MaterialParameters();
+
+	// Sets a value, adding the parameter if it's new
+	// Samplers are set with the texture unit they read from, as an int
+	void Set( const std::string &name, int value );
+	void Set( const std::string &name, float value );
+	void Set( const std::string &name, const glm::vec2 &value );
+	void Set( const std::string &name, const glm::vec3 &value );
+	void Set( const std::string &name, const glm::vec4 &value );
+	void Set( const std::string &name, const glm::mat4 &value );
+
+	// Uploads every parameter the program has, the program must be current
+	// The matching against the program's uniforms is done the first time and kept until the program or the parameter names change
+	void Apply( const ShaderProgram &program );
+
+	// Same parameters with the same values, so applying either to a program leaves it the same
+	bool operator==( const MaterialParameters &other ) const;
+
+	// How many parameters the last program given to Apply actually uses
+	unsigned int GetNumUsed() const { return (unsigned int) _bindings.size(); }
+
+protected:
+
+	// Finds or adds a parameter, returning where its value is kept
+	float* FindValue( const std::string &name, GLenum type, unsigned int numFloats );
+
+	// Works out which parameters the program uses, filling _bindings
+	void Bind( const ShaderProgram &program );
+
+	struct Parameter
+	{
+		std::string name;
+		GLenum type;
+		// Position of the value in _values
+		unsigned int offset;
+	};
+
+	// A parameter the bound program uses, and where it goes
+	struct Binding
+	{
+		GLint location;
+		GLenum type;
+		unsigned int offset;
+	};
+
+	std::vector<Parameter> _parameters;
+
+	// Every value back to back, ints are stored in a float's space
+	std::vector<float> _values;
+
+	std::vector<Binding> _bindings;
+	// The program _bindings were made for, 0 if they need making again
+	GLuint _boundProgram;
+};
+
+#endif
@@ -1,9 +1,18 @@
 
 #include "Mesh.h"
-#include <fstream>
+#include "MappedFile.h"
+#include "ObjParser.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+#include "MeshOptimiser.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "Hash.h"
+#include "GLState.h"
+#include "GeometryPool.h"
 #include <iostream>
-#include <sstream>
-#include <vector>
+#include <chrono>
+#include <algorithm>
 
 
 Mesh::Mesh()
@@ -14,202 +23,313 @@ Mesh::Mesh()
 		// Creates one VAO
 	glGenVertexArrays( 1, &_VAO );
 
+	_positionsOnlyVAO = 0;
+
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		_vertexBuffers[i] = 0;
+	}
+	_indexBuffer = 0;
+
+	_pool = NULL;
+	_inPool = false;
+	_baseVertex = 0;
+	_firstIndex = 0;
+
 	_numVertices = 0;
+	_numIndices = 0;
+	_indexType = GL_UNSIGNED_INT;
+
+	// Nothing to draw yet, but there's always a level
+	MeshLod fullDetail = { 0, 0, 0.0f, 0, 0 };
+	_lods.push_back( fullDetail );
+	_meshletsDrawn = 0;
+
+	_boundsMin = glm::vec3( 0.0f );
+	_boundsMax = glm::vec3( 0.0f );
 	
 }
 
 Mesh::~Mesh()
 {
 	// Clean up stuff here
+	ReleaseBuffers();
+	GLState::ForgetVertexArray( _VAO );
 	glDeleteVertexArrays( 1, &_VAO );
 }
 
+void Mesh::ReleaseBuffers()
+{
+	glDeleteBuffers( VERTEX_STREAM_COUNT, _vertexBuffers );
+	glDeleteBuffers( 1, &_indexBuffer );
+	GLState::ForgetVertexArray( _positionsOnlyVAO );
+	glDeleteVertexArrays( 1, &_positionsOnlyVAO );
+
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		_vertexBuffers[i] = 0;
+	}
+	_indexBuffer = 0;
+	_positionsOnlyVAO = 0;
+
+	// Pool space isn't given back, the mesh just stops using it
+	_inPool = false;
+}
 
-void Mesh::LoadOBJ( std::string filename )
+
+unsigned long long MeshLoadOptions::GetSettingsHash() const
+{
+	// The thread count doesn't change the result, so leave it out
+	unsigned char settings[] = { (unsigned char) separatePositions, (unsigned char) optimise, (unsigned char) quantize, (unsigned char) buildMeshlets };
+	unsigned long long hash = HashBytes( settings, sizeof( settings ) );
+	return lodRatios.empty() ? hash : HashBytes( &lodRatios[0], lodRatios.size() * sizeof( float ), hash );
+}
+
+
+void Mesh::LoadOBJ( std::string filename, const MeshLoadOptions &options )
 {
+	// Only a mesh uploaded from here goes in the pool, Upload on its own always gets its own buffers
+	_pool = options.geometryPool;
+
 	// Find file
-	std::ifstream inputFile( filename );
+	// The file is mapped into memory and parsed in place, rather than being read line by line through streams
+	MappedFile inputFile;
 
-	if( inputFile.is_open() )
+	if( inputFile.Open( filename ) )
 	{
-		// OBJ files can store texture coordinates, positions and normals
-		std::vector<glm::vec2> rawUVData;
-		std::vector<glm::vec3> rawPositionData;
-		std::vector<glm::vec3> rawNormalData;
-		
-		std::vector<glm::vec2> orderedUVData;
-		std::vector<glm::vec3> orderedPositionData;
-		std::vector<glm::vec3> orderedNormalData;
-
-		std::string currentLine;
-
-		while( std::getline( inputFile, currentLine ) )
+		std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+		// If there's an up to date cache, upload straight from it and skip the parse altogether
+		std::string cachePath = MeshCache::GetCachePath( filename );
+		if( options.useCache )
 		{
-			std::stringstream currentLineStream(currentLine);
-			//std::cout<< currentLine <<std::endl;
-			
-			if( !currentLine.substr(0,2).compare( 0, 2, "vt") )
-			{
-				std::string junk;
-				float x, y;
-				currentLineStream >> junk >> x >> y;
-				rawUVData.push_back(glm::vec2(x,y));
-			}
-			else if( !currentLine.substr(0,2).compare( 0, 2, "vn") )
+			MappedFile cacheFile;
+			PackedMesh cachedMesh;
+			if( MeshCache::Read( cachePath, inputFile, options.GetSettingsHash(), cacheFile, cachedMesh ) )
 			{
-				std::string junk;
-				float x, y, z;
-				currentLineStream >> junk >> x >> y >> z;
-				rawNormalData.push_back(glm::vec3(x,y,z));
+				UploadPacked( cachedMesh );
+
+				double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+				std::cout<<"INFO: Loaded "<<filename<<" from "<<cachePath<<" ("<<cacheFile.GetSize() / ( 1024.0 * 1024.0 )<<" MB) in "<<seconds * 1000.0<<" ms"<<std::endl;
+				return;
 			}
-			else if( !currentLine.substr(0,2).compare( 0, 1, "v") )
+		}
+
+		ObjMeshData objData;
+		if( !ObjParser::Parse( inputFile.GetData(), inputFile.GetData() + inputFile.GetSize(), objData, options.numThreads ) )
+		{
+			return;
+		}
+
+		// Report how quickly we got through the file
+		double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+		double megabytes = inputFile.GetSize() / ( 1024.0 * 1024.0 );
+		std::cout<<"INFO: Parsed "<<filename<<" ("<<megabytes<<" MB) in "<<seconds * 1000.0<<" ms, "<<( seconds > 0.0 ? megabytes / seconds : 0.0 )<<" MB/s"<<std::endl;
+
+		// Share every vertex that is used by more than one face corner
+		MeshData meshData;
+		WeldVertices( objData, meshData );
+		std::cout<<"INFO: Welded "<<objData.positions.size()<<" face corners into "<<meshData.positions.size()<<" vertices"<<std::endl;
+
+		// Lower detail levels are appended to the index buffer, before optimising so they get optimised too
+		if( !options.lodRatios.empty() )
+		{
+			GenerateLods( meshData, options.lodRatios );
+			for( size_t l = 1; l < meshData.lods.size(); l++ )
 			{
-				std::string junk;
-				float x, y, z;
-				currentLineStream >> junk >> x >> y >> z;
-				rawPositionData.push_back(glm::vec3(x,y,z));
+				std::cout<<"INFO: LOD "<<l<<" of "<<filename<<": "<<meshData.lods[l].indexCount / 3<<" triangles, error "<<meshData.lods[l].error<<std::endl;
 			}
-			else if( !currentLine.substr(0,2).compare( 0, 1,"f") )
-			{
-				std::string junk;
-				std::string verts[4];
-
-				currentLineStream >> junk >> verts[0] >> verts[1] >> verts[2] >> verts[3];
-
-				if( verts[3].empty() )
-				{
-					for( unsigned int i = 0; i < 3; i++ )
-					{
-						std::stringstream currentSection(verts[i]);
-
-						// There is just position data
-						unsigned int posID = 0;
-						unsigned int uvID = 0;
-						unsigned int normID = 0;
-
-						if( verts[i].find('/') == std::string::npos )
-						{
-							// No texcoords or normals
-							currentSection >> posID;
-						}
-						else if( verts[i].find("//") != std::string::npos )
-						{
-							// No texcoords
-							char junk;
-							currentSection >> posID >> junk >> junk >> normID;
-						}
-						else
-						{
-							char junk;
-							currentSection >> posID >>junk >> uvID >> junk >> normID;
-						}
-
-						if( posID > 0 )
-						{
-							orderedPositionData.push_back( rawPositionData[posID-1] );
-						}
-						if( uvID > 0 )
-						{
-							orderedUVData.push_back( rawUVData[uvID-1] );
-						}
-						if( normID > 0 )
-						{
-							orderedNormalData.push_back( rawNormalData[normID-1] );
-						}
-
-					}
-				}
-				else
-				{
-					std::cerr<<"WARNING: This OBJ loader only works with triangles but a quad has been detected. Please triangulate your mesh."<<std::endl;
-					inputFile.close();
-					return;
-				}
+		}
 
-			}
+		if( options.optimise )
+		{
+			// Stats are for full detail, which comes first in the index buffer
+			size_t fullDetailCount = meshData.lods.empty() ? meshData.indices.size() : meshData.lods[0].indexCount;
+			std::vector<unsigned int> fullDetail( meshData.indices.begin(), meshData.indices.begin() + fullDetailCount );
+			VertexCacheStats before = AnalyseVertexCache( fullDetail, meshData.positions.size() );
+			OptimiseMesh( meshData );
+			fullDetail.assign( meshData.indices.begin(), meshData.indices.begin() + fullDetailCount );
+			VertexCacheStats after = AnalyseVertexCache( fullDetail, meshData.positions.size() );
+			std::cout<<"INFO: Optimised "<<filename<<": ACMR "<<before.acmr<<" -> "<<after.acmr<<", ATVR "<<before.atvr<<" -> "<<after.atvr<<std::endl;
+		}
+
+		// Meshlets come last, they keep the triangle order they're given
+		if( options.buildMeshlets )
+		{
+			BuildMeshlets( meshData );
+			std::cout<<"INFO: Split "<<filename<<" into "<<meshData.meshlets.size()<<" meshlets"<<std::endl;
 		}
 
-		inputFile.close();
+		bool hasNormals = !meshData.normals.empty();
+		bool hasUVs = !meshData.uvs.empty();
+		VertexFormat format = options.quantize ? VertexFormat::Quantized( hasNormals, hasUVs, options.separatePositions )
+			: VertexFormat::Standard( hasNormals, hasUVs, options.separatePositions );
 
-		_numVertices = orderedPositionData.size();
+		PackedMesh packedMesh;
+		packedMesh.Pack( meshData, format );
+		UploadPacked( packedMesh );
 
-		if( _numVertices > 0 )
+		if( options.quantize )
 		{
+			// Say how much we saved and what it cost, so it's easy to spot a mesh that doesn't survive quantization
+			unsigned int fullSize = VertexFormat::Standard( hasNormals, hasUVs, false ).GetStride( VERTEX_STREAM_MAIN );
+			unsigned int quantizedSize = format.GetStride( VERTEX_STREAM_MAIN ) + format.GetStride( VERTEX_STREAM_POSITION );
+			QuantizationError error = MeasureQuantizationError( meshData, packedMesh.decode );
+			std::cout<<"INFO: Quantized "<<filename<<": "<<fullSize<<" -> "<<quantizedSize<<" bytes per vertex, max error: position "<<error.position
+				<<" ("<<error.positionRelative * 100.0f<<"% of bounds), normal "<<error.normalDegrees<<" degrees, uv "<<error.uv<<std::endl;
+		}
 
-			glBindVertexArray( _VAO );
-
-						// Variable for storing a VBO
-			GLuint posBuffer = 0;
-			// Create a generic 'buffer'
-			glGenBuffers(1, &posBuffer);
-			// Tell OpenGL that we want to activate the buffer and that it's a VBO
-			glBindBuffer(GL_ARRAY_BUFFER, posBuffer);
-			// With this buffer active, we can now send our data to OpenGL
-			// We need to tell it how much data to send
-			// We can also tell OpenGL how we intend to use this buffer - here we say GL_STATIC_DRAW because we're only writing it once
-			glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _numVertices * 3, &orderedPositionData[0], GL_STATIC_DRAW);
-
-			// This tells OpenGL how we link the vertex data to the shader
-			// (We will look at this properly in the lectures)
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0 );
-			glEnableVertexAttribArray(0);
-	
-			if( orderedNormalData.size() > 0 )
-			{
-							// Variable for storing a VBO
-				GLuint normBuffer = 0;
-				// Create a generic 'buffer'
-				glGenBuffers(1, &normBuffer);
-				// Tell OpenGL that we want to activate the buffer and that it's a VBO
-				glBindBuffer(GL_ARRAY_BUFFER, normBuffer);
-				// With this buffer active, we can now send our data to OpenGL
-				// We need to tell it how much data to send
-				// We can also tell OpenGL how we intend to use this buffer - here we say GL_STATIC_DRAW because we're only writing it once
-				glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _numVertices * 3, &orderedNormalData[0], GL_STATIC_DRAW);
+		// Save what we uploaded so next time we can skip all of the above
+		if( options.useCache )
+		{
+			MeshCache::Write( cachePath, inputFile, options.GetSettingsHash(), packedMesh );
+		}
+	}
+	else
+	{
+		std::cerr<<"WARNING: File not found: "<<filename<<std::endl;
+	}
+}
 
-				// This tells OpenGL how we link the vertex data to the shader
-				// (We will look at this properly in the lectures)
-				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-				glEnableVertexAttribArray(1);
-			}
+void Mesh::Upload( const MeshData &meshData, const VertexFormat &format )
+{
+	PackedMesh packedMesh;
+	packedMesh.Pack( meshData, format );
+	UploadPacked( packedMesh );
+}
+
+void Mesh::UploadPacked( const PackedMesh &packedMesh )
+{
+	ReleaseBuffers();
+
+	_format = packedMesh.format;
+	_decode = packedMesh.decode;
+	_numVertices = packedMesh.numVertices;
+	_numIndices = packedMesh.numIndices;
+	_indexType = packedMesh.indexType;
+	_boundsMin = packedMesh.boundsMin;
+	_boundsMax = packedMesh.boundsMax;
+
+	_lods = packedMesh.lods;
+	_meshlets = packedMesh.meshlets;
+	if( _lods.empty() )
+	{
+		MeshLod fullDetail = { 0, _numIndices, 0.0f, 0, 0 };
+		_lods.push_back( fullDetail );
+	}
+
+	if( _numVertices > 0 && _numIndices > 0 && _pool != NULL )
+	{
+		// Pooled meshes are drawn through the pool's VAO, so there's nothing else to set up
+		_inPool = _pool->Add( packedMesh, _baseVertex, _firstIndex );
+	}
 
-			
-			if( orderedUVData.size() > 0 )
+	if( _numVertices > 0 && _numIndices > 0 && !_inPool )
+	{
+		_baseVertex = 0;
+		_firstIndex = 0;
+		for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+		{
+			if( packedMesh.streamSizes[i] > 0 )
 			{
-							// Variable for storing a VBO
-				GLuint texBuffer = 0;
 				// Create a generic 'buffer'
-				glGenBuffers(1, &texBuffer);
+				glGenBuffers(1, &_vertexBuffers[i]);
 				// Tell OpenGL that we want to activate the buffer and that it's a VBO
-				glBindBuffer(GL_ARRAY_BUFFER, texBuffer);
+				glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffers[i]);
 				// With this buffer active, we can now send our data to OpenGL
-				// We need to tell it how much data to send
 				// We can also tell OpenGL how we intend to use this buffer - here we say GL_STATIC_DRAW because we're only writing it once
-				glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _numVertices * 2, &orderedUVData[0], GL_STATIC_DRAW);
-
-				// This tells OpenGL how we link the vertex data to the shader
-				// (We will look at this properly in the lectures)
-				glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0 );
-				glEnableVertexAttribArray(2);
+				glBufferData(GL_ARRAY_BUFFER, packedMesh.streamSizes[i], packedMesh.streamData[i], GL_STATIC_DRAW);
 			}
 		}
+
+		// Draws leave their VAO bound, and binding an index buffer would change whichever VAO that is
+		GLState::BindVertexArray( 0 );
+
+		// The index buffer says which vertices make up each triangle
+		glGenBuffers(1, &_indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedMesh.indexSize, packedMesh.indexData, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		// This tells OpenGL how we link the vertex data to the shader
+		// The VAO remembers the attribute pointers and which index buffer is bound to it
+		GLState::BindVertexArray( _VAO );
+		_format.Apply( _vertexBuffers, false );
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+
+		// With positions in their own buffer, depth-only passes get a VAO that reads nothing else
+		if( _format.HasSeparatePositions() )
+		{
+			glGenVertexArrays( 1, &_positionsOnlyVAO );
+			GLState::BindVertexArray( _positionsOnlyVAO );
+			_format.Apply( _vertexBuffers, true );
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+		}
+
+		// Unbind VAO before the index buffer, otherwise the VAO would forget it
+		GLState::BindVertexArray( 0 );
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
-	else
+}
+
+GLuint Mesh::GetVertexArray( bool positionsOnly ) const
+{
+	if( _inPool )
 	{
-		std::cerr<<"WARNING: File not found: "<<filename<<std::endl;
+		return _pool->GetVertexArray( positionsOnly );
 	}
+	// Without a separate position buffer the full VAO is the best we have
+	return ( positionsOnly && _positionsOnlyVAO ) ? _positionsOnlyVAO : _VAO;
 }
 
-void Mesh::Draw()
+void Mesh::AddDrawCommands( unsigned int lod, const MeshletView *view, unsigned int instanceCount, GLuint baseInstance, std::vector<DrawCommand> &commands )
 {
-		// Activate the VAO
-		glBindVertexArray( _VAO );
-
-			// Tell OpenGL to draw it
-			// Must specify the type of geometry to draw and the number of vertices
-			glDrawArrays(GL_TRIANGLES, 0, _numVertices);
-			
-		// Unbind VAO
-		glBindVertexArray( 0 );
-}
+	// Each level of detail is its own run of the index buffer
+	const MeshLod &level = _lods[std::min( lod, (unsigned int) _lods.size() - 1 )];
+	if( level.indexCount == 0 )
+	{
+		_meshletsDrawn = 0;
+		return;
+	}
+
+	DrawCommand command;
+	command.instanceCount = instanceCount;
+	command.baseVertex = _baseVertex;
+	command.baseInstance = baseInstance;
+
+	if( instanceCount > 1 || view == NULL || level.meshletCount == 0 )
+	{
+		// Every instance gets the whole level, the shader tells them apart by their instance index
+		command.count = level.indexCount;
+		command.firstIndex = _firstIndex + level.indexOffset;
+		commands.push_back( command );
+		_meshletsDrawn = level.meshletCount;
+		return;
+	}
+
+	// Only draw the meshlets the view can see
+	// Meshlets next to each other in the index buffer are joined into one command, so a fully visible mesh is still one
+	_meshletsDrawn = 0;
+	unsigned int rangeEnd = ~0u;
+	for( unsigned int m = level.meshletOffset; m < level.meshletOffset + level.meshletCount; m++ )
+	{
+		const Meshlet &meshlet = _meshlets[m];
+		if( !view->IsVisible( meshlet ) )
+		{
+			continue;
+		}
+		_meshletsDrawn++;
 
+		if( meshlet.indexOffset == rangeEnd )
+		{
+			commands.back().count += meshlet.indexCount;
+		}
+		else
+		{
+			command.count = meshlet.indexCount;
+			command.firstIndex = _firstIndex + meshlet.indexOffset;
+			commands.push_back( command );
+		}
+		rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+	}
+}
@@ -6,6 +6,64 @@
 #include <SDL/SDL.h>
 #include "glew.h"
 #include <string>
+#include <vector>
+#include "VertexFormat.h"
+#include "VertexQuantization.h"
+#include "MeshData.h"
+
+struct PackedMesh;
+struct MeshletView;
+class GeometryPool;
+
+// One draw of a glMultiDrawElementsIndirect, laid out the way OpenGL reads it from the GL_DRAW_INDIRECT_BUFFER
+struct DrawCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	// In indices, not bytes
+	GLuint firstIndex;
+	// Added to every index, so a mesh packed into a GeometryPool can keep indices relative to its own vertices
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Settings for how a mesh is loaded and laid out on the GPU
+struct MeshLoadOptions
+{
+	MeshLoadOptions() : numThreads( 0 ), separatePositions( false ), optimise( false ), quantize( false ), buildMeshlets( false ), useCache( true ), geometryPool( NULL ) {}
+
+	// Threads used to parse the OBJ file - 0 picks a count based on the file size
+	unsigned int numThreads;
+
+	// Gives positions their own vertex buffer so depth-only passes only fetch 12 bytes per vertex
+	bool separatePositions;
+
+	// Reorders triangles and vertices for the vertex cache, overdraw and vertex fetch (see MeshOptimiser.h)
+	// This doesn't change what the mesh looks like, just how fast it draws
+	bool optimise;
+
+	// Stores vertices in the compressed VertexFormat::Quantized layout, 16 bytes per vertex instead of 32
+	// Shaders must decode the attributes with the mesh's VertexDecode
+	bool quantize;
+
+	// Fractions of the full triangle count to build lower detail levels with, e.g. { 0.5f, 0.25f, 0.125f, 0.0625f }
+	// Empty for no levels of detail (see MeshSimplifier.h)
+	std::vector<float> lodRatios;
+
+	// Splits the mesh into meshlets so draws can skip the parts a view can't see (see Meshlets.h)
+	bool buildMeshlets;
+
+	// Loads from (and saves to) a binary .smesh file next to the source, skipping the parse when it's up to date
+	bool useCache;
+
+	// Puts the mesh in a shared set of buffers instead of its own, so it can be drawn in the same multi-draw as the others there
+	// Meshes whose format doesn't match the pool's still get buffers of their own
+	// The pool must outlive the mesh, it isn't part of the settings hash as it doesn't change the data
+	GeometryPool *geometryPool;
+
+	// Hash of every setting that changes the uploaded data, so caches made with other settings aren't used
+	unsigned long long GetSettingsHash() const;
+};
 
 // For loading a mesh from OBJ file and keeping a reference for it
 class Mesh
@@ -16,19 +74,89 @@ public:
 	~Mesh();
 	
 	// OBJ file must be triangulated
-	void LoadOBJ( std::string filename );
+	// With options.useCache, the result is saved next to the OBJ and later loads just map and upload that
+	void LoadOBJ( std::string filename, const MeshLoadOptions &options = MeshLoadOptions() );
+
+	// Sends indexed geometry to OpenGL, packed with the given vertex format
+	void Upload( const MeshData &meshData, const VertexFormat &format );
+
+	// Sends already packed geometry to OpenGL, exactly as it is laid out in memory
+	void UploadPacked( const PackedMesh &packedMesh );
 
-	// Draws the mesh - must have shaders applied for this to display!
-	void Draw();
+	// Adds the commands that draw one level of detail to a multi-draw (see RenderQueue)
+	// lod picks the level of detail, 0 is full detail
+	// With a view, meshlets it can't see are left out and each run of visible ones becomes a command
+	// With more than one instance the whole level is one command drawn instanceCount times,
+	// and the view is ignored - a meshlet one instance can't see may well be in front of another
+	// baseInstance is where the instances start in the render queue's instance buffer
+	void AddDrawCommands( unsigned int lod, const MeshletView *view, unsigned int instanceCount, GLuint baseInstance, std::vector<DrawCommand> &commands );
+
+	// The VAO the commands draw with, and the type of its indices
+	// positionsOnly gives one that only fetches positions, for depth-only passes such as the shadow map
+	GLuint GetVertexArray( bool positionsOnly ) const;
+	GLenum GetIndexType() const { return _inPool ? GL_UNSIGNED_INT : _indexType; }
+
+	// Levels of detail, there's always at least one
+	unsigned int GetNumLods() const { return _lods.size(); }
+	const MeshLod& GetLod( unsigned int lod ) const { return _lods[lod]; }
+
+	// Meshlets the most recent AddDrawCommands sent, out of GetNumMeshlets()
+	unsigned int GetNumMeshlets() const { return _meshlets.size(); }
+	unsigned int GetMeshletsDrawn() const { return _meshletsDrawn; }
+
+	// Axis-aligned box around the mesh, in model space
+	const glm::vec3& GetBoundsMin() const { return _boundsMin; }
+	const glm::vec3& GetBoundsMax() const { return _boundsMax; }
+
+	// What the vertex shader needs to unpack this mesh's attributes, it goes in each instance's InstanceData
+	const VertexDecode& GetVertexDecode() const { return _decode; }
 
 protected:
-	
+
+	// Deletes the GL buffers, ready for new data
+	void ReleaseBuffers();
+
 	// OpenGL Vertex Array Object
 	GLuint _VAO;
 
+	// VAO which only reads positions, used when they are in their own buffer
+	GLuint _positionsOnlyVAO;
+
+	// Vertex buffers for each VertexStream (0 if unused) and the index buffer
+	GLuint _vertexBuffers[VERTEX_STREAM_COUNT];
+	GLuint _indexBuffer;
+
+	// Where the mesh lives instead, when it was loaded into a pool
+	// Indices count from _firstIndex in the pool's index buffer and vertices from _baseVertex
+	GeometryPool *_pool;
+	bool _inPool;
+	GLint _baseVertex;
+	GLuint _firstIndex;
+
+	// Layout of the vertex buffers
+	VertexFormat _format;
+	VertexDecode _decode;
+
 	// Number of vertices in the mesh
 	unsigned int _numVertices;
 
+	// Number of indices in the mesh, three per triangle
+	unsigned int _numIndices;
+
+	// Which part of the index buffer each level of detail draws
+	std::vector<MeshLod> _lods;
+
+	// Culling bounds for each meshlet
+	std::vector<Meshlet> _meshlets;
+	unsigned int _meshletsDrawn;
+
+	// Either GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, depending on how many vertices there are
+	GLenum _indexType;
+
+	// Model space bounding box
+	glm::vec3 _boundsMin;
+	glm::vec3 _boundsMax;
+
 };
 
 
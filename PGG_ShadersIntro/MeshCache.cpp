@@ -0,0 +1,405 @@
+
+#include "MeshCache.h"
+#include "MeshData.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+
+// Bump this whenever the layout of the file or of PackedMesh changes, so old caches get rebuilt
+static const unsigned int MESH_CACHE_VERSION = 4;
+
+// Data sections start on 16 byte boundaries, so they're nicely aligned when mapped
+static const size_t MESH_CACHE_ALIGNMENT = 16;
+
+// Start of every .smesh file
+// Everything is fixed size so the file can be used straight from its mapping
+struct MeshCacheHeader
+{
+	char magic[4];
+	unsigned int version;
+
+	// What the cache was built from
+	unsigned long long sourceSize;
+	unsigned long long sourceModifiedTime;
+	unsigned long long sourceHash;
+	unsigned long long settingsHash;
+
+	unsigned int numVertices;
+	unsigned int numIndices;
+	unsigned int indexType;
+	unsigned int numAttributes;
+	unsigned int numLods;
+	unsigned int numMeshlets;
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	// VertexDecode, for quantized formats
+	float positionScale[3];
+	float positionOffset[3];
+	float uvScale[2];
+	float uvOffset[2];
+	unsigned int octNormals;
+
+	// Byte offsets from the start of the file
+	unsigned long long streamOffsets[VERTEX_STREAM_COUNT];
+	unsigned long long streamSizes[VERTEX_STREAM_COUNT];
+	unsigned long long indexOffset;
+	unsigned long long indexSize;
+};
+
+// One of these follows the header for each vertex attribute
+struct MeshCacheAttribute
+{
+	unsigned int location;
+	int components;
+	unsigned int type;
+	unsigned int normalized;
+	unsigned int stream;
+	unsigned int offset;
+};
+
+// After the attributes come the levels of detail and the meshlets, stored as MeshLods and Meshlets
+
+static size_t AlignOffset( size_t offset )
+{
+	return ( offset + MESH_CACHE_ALIGNMENT - 1 ) & ~( MESH_CACHE_ALIGNMENT - 1 );
+}
+
+// Whether a section lies inside a file of the given size, written so huge values from a corrupt header can't wrap round
+static bool IsInFile( unsigned long long offset, unsigned long long sectionSize, size_t fileSize )
+{
+	return offset <= fileSize && sectionSize <= fileSize - offset;
+}
+
+
+PackedMesh::PackedMesh()
+{
+	numVertices = 0;
+	numIndices = 0;
+	indexType = GL_UNSIGNED_INT;
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		streamData[i] = NULL;
+		streamSizes[i] = 0;
+	}
+	indexData = NULL;
+	indexSize = 0;
+	boundsMin = glm::vec3( 0.0f );
+	boundsMax = glm::vec3( 0.0f );
+}
+
+void PackedMesh::Pack( const MeshData &meshData, const VertexFormat &vertexFormat )
+{
+	format = vertexFormat;
+	decode = format.IsQuantized() ? ComputeQuantizedDecode( meshData ) : VertexDecode();
+	numVertices = meshData.positions.size();
+	numIndices = meshData.indices.size();
+
+	// There's always at least one level, even if it's just the whole mesh
+	lods = meshData.lods;
+	if( lods.empty() )
+	{
+		MeshLod fullDetail = { 0, numIndices, 0.0f, 0, 0 };
+		lods.push_back( fullDetail );
+	}
+	meshlets = meshData.meshlets;
+
+	// Lay the vertices out as the format describes, interleaving the attributes that share a buffer
+	format.Pack( meshData, decode, packedStreams );
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		streamData[i] = packedStreams[i].empty() ? NULL : &packedStreams[i][0];
+		streamSizes[i] = packedStreams[i].size();
+	}
+
+	// 16-bit indices halve the size of the index buffer, so use them whenever every vertex can be reached with one
+	if( numVertices <= 65536 )
+	{
+		indexType = GL_UNSIGNED_SHORT;
+		packedIndices.resize( numIndices * sizeof( unsigned short ) );
+		for( unsigned int i = 0; i < numIndices; i++ )
+		{
+			unsigned short index = (unsigned short) meshData.indices[i];
+			memcpy( &packedIndices[i * sizeof( unsigned short )], &index, sizeof( unsigned short ) );
+		}
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		packedIndices.resize( numIndices * sizeof( unsigned int ) );
+		if( numIndices > 0 )
+		{
+			memcpy( &packedIndices[0], &meshData.indices[0], packedIndices.size() );
+		}
+	}
+	indexData = packedIndices.empty() ? NULL : &packedIndices[0];
+	indexSize = packedIndices.size();
+
+	boundsMin = glm::vec3( 0.0f );
+	boundsMax = glm::vec3( 0.0f );
+	if( !meshData.positions.empty() )
+	{
+		boundsMin = boundsMax = meshData.positions[0];
+		for( size_t i = 1; i < meshData.positions.size(); i++ )
+		{
+			boundsMin = glm::min( boundsMin, meshData.positions[i] );
+			boundsMax = glm::max( boundsMax, meshData.positions[i] );
+		}
+	}
+}
+
+
+std::string MeshCache::GetCachePath( const std::string &sourceFilename )
+{
+	// Swap the extension, but don't mistake a dot in a folder name for one
+	size_t dot = sourceFilename.find_last_of( '.' );
+	size_t slash = sourceFilename.find_last_of( "/\\" );
+	if( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+	{
+		return sourceFilename + ".smesh";
+	}
+	return sourceFilename.substr( 0, dot ) + ".smesh";
+}
+
+bool MeshCache::Read( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, MappedFile &cacheFile, PackedMesh &mesh )
+{
+	if( !cacheFile.Open( cachePath ) )
+	{
+		return false;
+	}
+
+	const char *data = cacheFile.GetData();
+	size_t size = cacheFile.GetSize();
+	if( size < sizeof( MeshCacheHeader ) )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memcpy( &header, data, sizeof( header ) );
+
+	// Is this a cache we can read, made with the same settings?
+	if( memcmp( header.magic, "SMSH", 4 ) != 0 || header.version != MESH_CACHE_VERSION || header.settingsHash != settingsHash
+		|| header.sourceSize != sourceFile.GetSize() )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	// A matching size and time means the source almost certainly hasn't changed
+	// If only the time differs (e.g. the file was copied or checked out again) the contents might still match, so check the hash
+	if( header.sourceModifiedTime != sourceFile.GetModifiedTime()
+		&& header.sourceHash != HashBytes( sourceFile.GetData(), sourceFile.GetSize() ) )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	// Make sure everything the header points at is actually in the file
+	size_t attributesEnd = sizeof( MeshCacheHeader ) + (size_t) header.numAttributes * sizeof( MeshCacheAttribute );
+	size_t lodsEnd = attributesEnd + (size_t) header.numLods * sizeof( MeshLod );
+	size_t meshletsEnd = lodsEnd + (size_t) header.numMeshlets * sizeof( Meshlet );
+	bool valid = ( meshletsEnd <= size ) && IsInFile( header.indexOffset, header.indexSize, size );
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		valid = valid && IsInFile( header.streamOffsets[i], header.streamSizes[i], size );
+	}
+	if( !valid )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	// Rebuild the vertex format, it must come out exactly as it was saved
+	mesh.format = VertexFormat();
+	for( unsigned int a = 0; a < header.numAttributes; a++ )
+	{
+		MeshCacheAttribute attribute;
+		memcpy( &attribute, data + sizeof( MeshCacheHeader ) + a * sizeof( MeshCacheAttribute ), sizeof( attribute ) );
+		if( attribute.stream >= VERTEX_STREAM_COUNT )
+		{
+			cacheFile.Close();
+			return false;
+		}
+
+		mesh.format.AddAttribute( attribute.location, attribute.components, attribute.type, (GLboolean) attribute.normalized, (VertexStream) attribute.stream );
+		if( mesh.format.GetAttributes().back().offset != attribute.offset )
+		{
+			cacheFile.Close();
+			return false;
+		}
+	}
+
+	// The index and vertex data have to be exactly as big as the counts say, or draws could read past them
+	unsigned long long indexBytes = header.indexType == GL_UNSIGNED_SHORT ? sizeof( GLushort ) : sizeof( GLuint );
+	valid = ( header.indexType == GL_UNSIGNED_SHORT || header.indexType == GL_UNSIGNED_INT )
+		&& header.indexSize == header.numIndices * indexBytes;
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		valid = valid && header.streamSizes[i] == (unsigned long long) header.numVertices * mesh.format.GetStride( (VertexStream) i );
+	}
+	if( !valid )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	// Every level has to be inside the index buffer
+	mesh.lods.resize( header.numLods );
+	for( unsigned int l = 0; l < header.numLods; l++ )
+	{
+		memcpy( &mesh.lods[l], data + attributesEnd + l * sizeof( MeshLod ), sizeof( MeshLod ) );
+		if( (unsigned long long) mesh.lods[l].indexOffset + mesh.lods[l].indexCount > header.numIndices
+			|| (unsigned long long) mesh.lods[l].meshletOffset + mesh.lods[l].meshletCount > header.numMeshlets )
+		{
+			cacheFile.Close();
+			return false;
+		}
+	}
+
+	mesh.meshlets.resize( header.numMeshlets );
+	for( unsigned int m = 0; m < header.numMeshlets; m++ )
+	{
+		memcpy( &mesh.meshlets[m], data + lodsEnd + m * sizeof( Meshlet ), sizeof( Meshlet ) );
+		if( (unsigned long long) mesh.meshlets[m].indexOffset + mesh.meshlets[m].indexCount > header.numIndices )
+		{
+			cacheFile.Close();
+			return false;
+		}
+	}
+
+	mesh.numVertices = header.numVertices;
+	mesh.numIndices = header.numIndices;
+	mesh.indexType = header.indexType;
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		mesh.streamData[i] = header.streamSizes[i] > 0 ? data + header.streamOffsets[i] : NULL;
+		mesh.streamSizes[i] = (size_t) header.streamSizes[i];
+	}
+	mesh.indexData = header.indexSize > 0 ? data + header.indexOffset : NULL;
+	mesh.indexSize = (size_t) header.indexSize;
+	mesh.boundsMin = glm::vec3( header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] );
+	mesh.boundsMax = glm::vec3( header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] );
+	mesh.decode.positionScale = glm::vec3( header.positionScale[0], header.positionScale[1], header.positionScale[2] );
+	mesh.decode.positionOffset = glm::vec3( header.positionOffset[0], header.positionOffset[1], header.positionOffset[2] );
+	mesh.decode.uvScale = glm::vec2( header.uvScale[0], header.uvScale[1] );
+	mesh.decode.uvOffset = glm::vec2( header.uvOffset[0], header.uvOffset[1] );
+	mesh.decode.octNormals = header.octNormals != 0;
+	return true;
+}
+
+bool MeshCache::Write( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, const PackedMesh &mesh )
+{
+	const std::vector<VertexAttribute> &attributes = mesh.format.GetAttributes();
+
+	MeshCacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, "SMSH", 4 );
+	header.version = MESH_CACHE_VERSION;
+	header.sourceSize = sourceFile.GetSize();
+	header.sourceModifiedTime = sourceFile.GetModifiedTime();
+	header.sourceHash = HashBytes( sourceFile.GetData(), sourceFile.GetSize() );
+	header.settingsHash = settingsHash;
+	header.numVertices = mesh.numVertices;
+	header.numIndices = mesh.numIndices;
+	header.indexType = mesh.indexType;
+	header.numAttributes = attributes.size();
+	header.numLods = mesh.lods.size();
+	header.numMeshlets = mesh.meshlets.size();
+	for( int i = 0; i < 3; i++ )
+	{
+		header.boundsMin[i] = mesh.boundsMin[i];
+		header.boundsMax[i] = mesh.boundsMax[i];
+		header.positionScale[i] = mesh.decode.positionScale[i];
+		header.positionOffset[i] = mesh.decode.positionOffset[i];
+	}
+	for( int i = 0; i < 2; i++ )
+	{
+		header.uvScale[i] = mesh.decode.uvScale[i];
+		header.uvOffset[i] = mesh.decode.uvOffset[i];
+	}
+	header.octNormals = mesh.decode.octNormals ? 1 : 0;
+
+	// Work out where each section goes
+	size_t offset = sizeof( MeshCacheHeader ) + attributes.size() * sizeof( MeshCacheAttribute ) + mesh.lods.size() * sizeof( MeshLod )
+		+ mesh.meshlets.size() * sizeof( Meshlet );
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		offset = AlignOffset( offset );
+		header.streamOffsets[i] = offset;
+		header.streamSizes[i] = mesh.streamSizes[i];
+		offset += mesh.streamSizes[i];
+	}
+	offset = AlignOffset( offset );
+	header.indexOffset = offset;
+	header.indexSize = mesh.indexSize;
+
+	// Write to a temporary file first, so a crash part way through never leaves a broken cache behind
+	std::string tempPath = cachePath + ".tmp";
+	FILE *file = fopen( tempPath.c_str(), "wb" );
+	if( file == NULL )
+	{
+		std::cerr<<"WARNING: Could not write mesh cache: "<<cachePath<<std::endl;
+		return false;
+	}
+
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+	for( size_t a = 0; a < attributes.size() && ok; a++ )
+	{
+		MeshCacheAttribute attribute;
+		attribute.location = attributes[a].location;
+		attribute.components = attributes[a].components;
+		attribute.type = attributes[a].type;
+		attribute.normalized = attributes[a].normalized;
+		attribute.stream = attributes[a].stream;
+		attribute.offset = attributes[a].offset;
+		ok = fwrite( &attribute, sizeof( attribute ), 1, file ) == 1;
+	}
+	if( ok && !mesh.lods.empty() )
+	{
+		ok = fwrite( &mesh.lods[0], sizeof( MeshLod ), mesh.lods.size(), file ) == mesh.lods.size();
+	}
+	if( ok && !mesh.meshlets.empty() )
+	{
+		ok = fwrite( &mesh.meshlets[0], sizeof( Meshlet ), mesh.meshlets.size(), file ) == mesh.meshlets.size();
+	}
+
+	// Sections, each padded out to its offset
+	static const char padding[MESH_CACHE_ALIGNMENT] = { 0 };
+	for( unsigned int i = 0; i <= VERTEX_STREAM_COUNT && ok; i++ )
+	{
+		unsigned long long sectionOffset = ( i < VERTEX_STREAM_COUNT ) ? header.streamOffsets[i] : header.indexOffset;
+		const void *sectionData = ( i < VERTEX_STREAM_COUNT ) ? mesh.streamData[i] : mesh.indexData;
+		size_t sectionSize = ( i < VERTEX_STREAM_COUNT ) ? mesh.streamSizes[i] : mesh.indexSize;
+
+		long position = ftell( file );
+		if( position < 0 || (unsigned long long) position > sectionOffset )
+		{
+			ok = false;
+			break;
+		}
+		size_t padSize = (size_t) ( sectionOffset - position );
+		ok = ( padSize == 0 || fwrite( padding, 1, padSize, file ) == padSize );
+		if( ok && sectionSize > 0 )
+		{
+			ok = fwrite( sectionData, 1, sectionSize, file ) == sectionSize;
+		}
+	}
+
+	ok = ( fclose( file ) == 0 ) && ok;
+
+	// Replace the old cache with the new one
+	remove( cachePath.c_str() );
+	if( !ok || rename( tempPath.c_str(), cachePath.c_str() ) != 0 )
+	{
+		remove( tempPath.c_str() );
+		std::cerr<<"WARNING: Could not write mesh cache: "<<cachePath<<std::endl;
+		return false;
+	}
+	return true;
+}
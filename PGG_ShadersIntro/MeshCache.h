@@ -0,0 +1,73 @@
+
+#ifndef __MESH_CACHE__
+#define __MESH_CACHE__
+
+#include "glew.h"
+#include "VertexFormat.h"
+#include "VertexQuantization.h"
+#include "MeshData.h"
+#include <GLM/glm.hpp>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+// A mesh in the exact byte layout it is uploaded to OpenGL in
+// The data pointers either point into the arrays below (after Pack) or straight into a mapped cache file
+struct PackedMesh
+{
+	PackedMesh();
+
+	// Lays out the mesh with the given format, keeping the bytes in the arrays below
+	// Picks 16-bit indices when every vertex can be reached with one
+	// Quantized formats get their decode ranges worked out from the mesh
+	void Pack( const MeshData &meshData, const VertexFormat &vertexFormat );
+
+	VertexFormat format;
+	// What the vertex shader needs to unpack quantized attributes
+	VertexDecode decode;
+	unsigned int numVertices;
+	unsigned int numIndices;
+	// Either GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum indexType;
+
+	// Vertex bytes for each VertexStream, NULL if unused
+	const void *streamData[VERTEX_STREAM_COUNT];
+	size_t streamSizes[VERTEX_STREAM_COUNT];
+	const void *indexData;
+	size_t indexSize;
+
+	// Levels of detail, as runs of the index buffer
+	std::vector<MeshLod> lods;
+
+	// Culling clusters, which the levels of detail point into
+	std::vector<Meshlet> meshlets;
+
+	// Axis-aligned box around every vertex position
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	// Storage for a mesh packed in memory, unused when the data comes from a cache file
+	// Pointers above point in here, so don't copy a PackedMesh after packing it
+	std::vector<unsigned char> packedStreams[VERTEX_STREAM_COUNT];
+	std::vector<unsigned char> packedIndices;
+};
+
+// Reads and writes .smesh files, a binary copy of a PackedMesh stored next to the source file
+// Loading one is just a file map and a couple of glBufferData calls, so start-up cost depends on I/O rather than parsing
+class MeshCache
+{
+public:
+
+	// Where the cache for a source file lives, e.g. Resources/Maxwell.obj -> Resources/Maxwell.smesh
+	static std::string GetCachePath( const std::string &sourceFilename );
+
+	// Maps the cache and checks it was made from this source file with these settings
+	// On success the mesh's data points into cacheFile, so it must stay open while the data is used
+	static bool Read( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, MappedFile &cacheFile, PackedMesh &mesh );
+
+	// Saves the mesh, recording what it was made from so later reads can tell if it's out of date
+	static bool Write( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, const PackedMesh &mesh );
+};
+
+#endif
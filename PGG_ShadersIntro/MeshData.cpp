@@ -0,0 +1,98 @@
+
+#include "MeshData.h"
+#include <iostream>
+#include <unordered_map>
+#include <cstring>
+
+
+// Everything that makes a vertex unique, compared bit for bit
+struct VertexKey
+{
+	float values[8];
+
+	bool operator==( const VertexKey &other ) const
+	{
+		return !memcmp( values, other.values, sizeof( values ) );
+	}
+};
+
+struct VertexKeyHash
+{
+	size_t operator()( const VertexKey &key ) const
+	{
+		// FNV-1a over the 32-bit words of the vertex
+		unsigned int words[8];
+		memcpy( words, key.values, sizeof( words ) );
+
+		size_t hash = 2166136261u;
+		for( unsigned int i = 0; i < 8; i++ )
+		{
+			hash = ( hash ^ words[i] ) * 16777619u;
+		}
+		return hash;
+	}
+};
+
+
+void WeldVertices( const ObjMeshData &input, MeshData &output )
+{
+	output.positions.clear();
+	output.normals.clear();
+	output.uvs.clear();
+	output.indices.clear();
+	output.lods.clear();
+	output.meshlets.clear();
+
+	size_t numCorners = input.positions.size();
+
+	// An attribute is only usable if every corner has one, otherwise they can't be matched up to the positions
+	bool hasNormals = !input.normals.empty();
+	bool hasUVs = !input.uvs.empty();
+	if( hasNormals && input.normals.size() != numCorners )
+	{
+		std::cerr<<"WARNING: Not every face in the mesh has normals, ignoring all of them"<<std::endl;
+		hasNormals = false;
+	}
+	if( hasUVs && input.uvs.size() != numCorners )
+	{
+		std::cerr<<"WARNING: Not every face in the mesh has texture coordinates, ignoring all of them"<<std::endl;
+		hasUVs = false;
+	}
+
+	std::unordered_map<VertexKey, unsigned int, VertexKeyHash> vertexLookup;
+	vertexLookup.reserve( numCorners );
+	output.indices.reserve( numCorners );
+
+	for( size_t i = 0; i < numCorners; i++ )
+	{
+		VertexKey key;
+		memset( &key, 0, sizeof( key ) );
+		memcpy( &key.values[0], &input.positions[i], sizeof( glm::vec3 ) );
+		if( hasNormals )
+		{
+			memcpy( &key.values[3], &input.normals[i], sizeof( glm::vec3 ) );
+		}
+		if( hasUVs )
+		{
+			memcpy( &key.values[6], &input.uvs[i], sizeof( glm::vec2 ) );
+		}
+
+		// Either finds the existing vertex or adds this one as the next index
+		std::pair<std::unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator, bool> result =
+			vertexLookup.insert( std::make_pair( key, (unsigned int) output.positions.size() ) );
+
+		if( result.second )
+		{
+			output.positions.push_back( input.positions[i] );
+			if( hasNormals )
+			{
+				output.normals.push_back( input.normals[i] );
+			}
+			if( hasUVs )
+			{
+				output.uvs.push_back( input.uvs[i] );
+			}
+		}
+		output.indices.push_back( result.first->second );
+	}
+}
@@ -0,0 +1,64 @@
+
+#ifndef __MESH_DATA__
+#define __MESH_DATA__
+
+#include <GLM/glm.hpp>
+#include <vector>
+#include "ObjParser.h"
+
+// One level of detail: a run of the index buffer and how far its surface can be from the full detail mesh
+struct MeshLod
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+
+	// Model space distance, 0 for the full detail level
+	float error;
+
+	// Run of MeshData::meshlets covering this level, if meshlets have been built
+	unsigned int meshletOffset;
+	unsigned int meshletCount;
+};
+
+// Small cluster of triangles that can be culled on its own (see Meshlets.h)
+// It's a run of the index buffer, so visible meshlets can be drawn straight from it
+struct Meshlet
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+
+	// Bounding sphere, in model space
+	glm::vec3 centre;
+	float radius;
+
+	// Every triangle's normal is within a cone around coneAxis
+	// coneCutoff is the sine of the cone's half angle, 1 when the triangles face too many ways for the cone to be any use
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// CPU-side copy of an indexed mesh, ready to be uploaded by a Mesh
+// Each vertex is stored once, and every three indices make a triangle
+struct MeshData
+{
+	std::vector<glm::vec3> positions;
+
+	// These are either empty (the mesh doesn't have them) or the same size as positions
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+
+	std::vector<unsigned int> indices;
+
+	// Levels of detail, from full detail down, each a run of the index buffer sharing the same vertices
+	// Empty means the whole index buffer is the only level
+	std::vector<MeshLod> lods;
+
+	// Clusters of triangles for culling, empty if they haven't been built
+	std::vector<Meshlet> meshlets;
+};
+
+// Merges face corners with identical position, uv and normal into single vertices and builds the index buffer
+// Corners from an OBJ file repeat every shared vertex, so this typically cuts the vertex count by around 6x on closed meshes
+void WeldVertices( const ObjMeshData &input, MeshData &output );
+
+#endif
@@ -0,0 +1,407 @@
+
+#include "MeshOptimiser.h"
+#include "MeshData.h"
+#include <algorithm>
+
+
+// Simulated FIFO cache
+// Rather than shifting entries along, each vertex remembers the time it was loaded, and time moves on by one every miss
+// A vertex is then in the cache if fewer than cacheSize misses have happened since it was loaded
+class VertexCacheSimulator
+{
+public:
+
+	VertexCacheSimulator( unsigned int numVertices, unsigned int cacheSize )
+		: _loadTimes( numVertices, 0 ), _time( cacheSize + 1 ), _cacheSize( cacheSize )
+	{
+	}
+
+	// Pretends everything was evicted
+	void Flush() { _time += _cacheSize + 1; }
+
+	bool IsCached( unsigned int vertex ) const { return _time - _loadTimes[vertex] <= _cacheSize; }
+
+	// How long ago the vertex was loaded, in misses
+	unsigned int GetAge( unsigned int vertex ) const { return _time - _loadTimes[vertex]; }
+
+	// Returns true if the vertex had to be transformed
+	bool Use( unsigned int vertex )
+	{
+		if( IsCached( vertex ) )
+		{
+			return false;
+		}
+		_loadTimes[vertex] = _time++;
+		return true;
+	}
+
+	// Number of vertex transforms needed for one triangle
+	unsigned int UseTriangle( const unsigned int *triangle )
+	{
+		return Use( triangle[0] ) + Use( triangle[1] ) + Use( triangle[2] );
+	}
+
+protected:
+
+	std::vector<unsigned int> _loadTimes;
+	unsigned int _time;
+	unsigned int _cacheSize;
+};
+
+
+VertexCacheStats AnalyseVertexCache( const std::vector<unsigned int> &indices, unsigned int numVertices, unsigned int cacheSize )
+{
+	VertexCacheSimulator cache( numVertices, cacheSize );
+	unsigned int misses = 0;
+	for( size_t i = 0; i + 2 < indices.size(); i += 3 )
+	{
+		misses += cache.UseTriangle( &indices[i] );
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indices.size() >= 3 ? misses / (float) ( indices.size() / 3 ) : 0.0f;
+	stats.atvr = numVertices > 0 ? misses / (float) numVertices : 0.0f;
+	return stats;
+}
+
+
+// Detail levels are optimised one at a time, so no triangle moves from one level's range into another
+static std::vector<MeshLod> GetLevels( const MeshData &meshData )
+{
+	if( !meshData.lods.empty() )
+	{
+		return meshData.lods;
+	}
+	MeshLod whole = { 0, (unsigned int) meshData.indices.size(), 0.0f, 0, 0 };
+	return std::vector<MeshLod>( 1, whole );
+}
+
+static void OptimiseLevelVertexCache( std::vector<unsigned int> &indices, unsigned int numVertices, unsigned int cacheSize )
+{
+	size_t numTriangles = indices.size() / 3;
+	if( numTriangles == 0 )
+	{
+		return;
+	}
+
+	// Triangles that use each vertex, stored back to back in one array
+	// liveTriangles counts the ones that haven't been output yet
+	std::vector<unsigned int> liveTriangles( numVertices, 0 );
+	for( size_t i = 0; i < numTriangles * 3; i++ )
+	{
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<unsigned int> adjacencyOffsets( numVertices + 1, 0 );
+	for( unsigned int v = 0; v < numVertices; v++ )
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<unsigned int> adjacency( numTriangles * 3 );
+	std::vector<unsigned int> fillOffsets( adjacencyOffsets.begin(), adjacencyOffsets.end() - 1 );
+	for( size_t t = 0; t < numTriangles; t++ )
+	{
+		for( unsigned int c = 0; c < 3; c++ )
+		{
+			adjacency[fillOffsets[indices[t * 3 + c]]++] = (unsigned int) t;
+		}
+	}
+
+	VertexCacheSimulator cache( numVertices, cacheSize );
+	std::vector<bool> emitted( numTriangles, false );
+	std::vector<unsigned int> output;
+	output.reserve( numTriangles * 3 );
+
+	// Recently used vertices, to go back to when fanning runs into a dead end
+	std::vector<unsigned int> deadEndStack;
+	// Vertices of the triangles just output, where the next fan should come from
+	std::vector<unsigned int> candidates;
+	// Next vertex to try in input order, once the dead end stack runs out too
+	unsigned int cursor = 0;
+
+	int fanningVertex = 0;
+	while( fanningVertex >= 0 )
+	{
+		// Output every remaining triangle around the fanning vertex
+		candidates.clear();
+		for( unsigned int a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++ )
+		{
+			unsigned int t = adjacency[a];
+			if( emitted[t] )
+			{
+				continue;
+			}
+			emitted[t] = true;
+
+			for( unsigned int c = 0; c < 3; c++ )
+			{
+				unsigned int v = indices[t * 3 + c];
+				output.push_back( v );
+				deadEndStack.push_back( v );
+				candidates.push_back( v );
+				liveTriangles[v]--;
+				cache.Use( v );
+			}
+		}
+
+		// Pick the next vertex to fan around from the ones just used
+		// Prefer the oldest one that will still be in the cache after its own fan is output, since it's closest to being evicted
+		// Anything with triangles left beats jumping somewhere else
+		fanningVertex = -1;
+		int bestPriority = -1;
+		for( size_t i = 0; i < candidates.size(); i++ )
+		{
+			unsigned int v = candidates[i];
+			if( liveTriangles[v] == 0 )
+			{
+				continue;
+			}
+
+			int priority = 0;
+			if( cache.GetAge( v ) + 2 * liveTriangles[v] <= cacheSize )
+			{
+				priority = (int) cache.GetAge( v );
+			}
+			if( priority > bestPriority )
+			{
+				bestPriority = priority;
+				fanningVertex = (int) v;
+			}
+		}
+
+		// Dead end, so go back to something used recently, or failing that anything with triangles left
+		while( fanningVertex < 0 && !deadEndStack.empty() )
+		{
+			unsigned int v = deadEndStack.back();
+			deadEndStack.pop_back();
+			if( liveTriangles[v] > 0 )
+			{
+				fanningVertex = (int) v;
+			}
+		}
+		while( fanningVertex < 0 && cursor < numVertices )
+		{
+			if( liveTriangles[cursor] > 0 )
+			{
+				fanningVertex = (int) cursor;
+			}
+			cursor++;
+		}
+	}
+
+	indices.swap( output );
+}
+
+void OptimiseVertexCache( MeshData &meshData, unsigned int cacheSize )
+{
+	std::vector<MeshLod> levels = GetLevels( meshData );
+	std::vector<unsigned int> indices;
+	for( size_t l = 0; l < levels.size(); l++ )
+	{
+		std::vector<unsigned int>::iterator start = meshData.indices.begin() + levels[l].indexOffset;
+		indices.assign( start, start + levels[l].indexCount );
+		OptimiseLevelVertexCache( indices, meshData.positions.size(), cacheSize );
+		std::copy( indices.begin(), indices.end(), start );
+	}
+}
+
+
+// Cluster of triangles to be sorted by OptimiseOverdraw
+struct TriangleCluster
+{
+	unsigned int start, end;
+	float sortKey;
+};
+
+static bool DrawClusterFirst( const TriangleCluster &a, const TriangleCluster &b )
+{
+	return a.sortKey > b.sortKey;
+}
+
+static void OptimiseLevelOverdraw( std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions, float threshold, unsigned int cacheSize )
+{
+	unsigned int numTriangles = indices.size() / 3;
+	if( numTriangles == 0 )
+	{
+		return;
+	}
+
+	// Hard boundaries: a triangle that misses the cache on all three vertices starts a new patch of the mesh anyway,
+	// so it can be moved without losing anything
+	std::vector<unsigned int> hardBoundaries;
+	{
+		VertexCacheSimulator cache( positions.size(), cacheSize );
+		for( unsigned int t = 0; t < numTriangles; t++ )
+		{
+			if( cache.UseTriangle( &indices[t * 3] ) == 3 || t == 0 )
+			{
+				hardBoundaries.push_back( t );
+			}
+		}
+		hardBoundaries.push_back( numTriangles );
+	}
+
+	// Soft boundaries: split those patches up further, starting each piece with a cold cache
+	// A piece ends as soon as its own ACMR is within the threshold of the whole patch's, so splitting barely costs anything
+	std::vector<TriangleCluster> clusters;
+	{
+		VertexCacheSimulator cache( positions.size(), cacheSize );
+		for( size_t h = 0; h + 1 < hardBoundaries.size(); h++ )
+		{
+			unsigned int start = hardBoundaries[h];
+			unsigned int end = hardBoundaries[h + 1];
+
+			cache.Flush();
+			unsigned int patchMisses = 0;
+			for( unsigned int t = start; t < end; t++ )
+			{
+				patchMisses += cache.UseTriangle( &indices[t * 3] );
+			}
+			float patchThreshold = threshold * patchMisses / (float) ( end - start );
+
+			cache.Flush();
+			unsigned int pieceStart = start;
+			unsigned int pieceMisses = 0;
+			for( unsigned int t = start; t < end; t++ )
+			{
+				pieceMisses += cache.UseTriangle( &indices[t * 3] );
+				if( t + 1 < end && pieceMisses <= patchThreshold * ( t + 1 - pieceStart ) )
+				{
+					TriangleCluster cluster = { pieceStart, t + 1, 0.0f };
+					clusters.push_back( cluster );
+					pieceStart = t + 1;
+					pieceMisses = 0;
+					cache.Flush();
+				}
+			}
+			TriangleCluster cluster = { pieceStart, end, 0.0f };
+			clusters.push_back( cluster );
+		}
+	}
+
+	// Sort key is how far the cluster sits out from the middle of the mesh in the direction it faces
+	// Clusters on the outside facing out get drawn first, no matter where the camera is
+	glm::vec3 meshCentre( 0.0f );
+	for( size_t v = 0; v < positions.size(); v++ )
+	{
+		meshCentre += positions[v];
+	}
+	meshCentre /= (float) positions.size();
+
+	for( size_t c = 0; c < clusters.size(); c++ )
+	{
+		TriangleCluster &cluster = clusters[c];
+
+		// Area weighted centre and normal (the cross product's length is twice the triangle's area)
+		glm::vec3 centre( 0.0f ), normal( 0.0f );
+		float area = 0.0f;
+		for( unsigned int t = cluster.start; t < cluster.end; t++ )
+		{
+			const glm::vec3 &a = positions[indices[t * 3]];
+			const glm::vec3 &b = positions[indices[t * 3 + 1]];
+			const glm::vec3 &d = positions[indices[t * 3 + 2]];
+			glm::vec3 triangleNormal = glm::cross( b - a, d - a );
+			float triangleArea = glm::length( triangleNormal );
+
+			centre += ( a + b + d ) * ( triangleArea / 3.0f );
+			normal += triangleNormal;
+			area += triangleArea;
+		}
+		if( area > 0.0f )
+		{
+			centre /= area;
+		}
+		float normalLength = glm::length( normal );
+		if( normalLength > 0.0f )
+		{
+			normal /= normalLength;
+		}
+		cluster.sortKey = glm::dot( centre - meshCentre, normal );
+	}
+
+	// Stable, so clusters that tie keep their cache-friendly order
+	std::stable_sort( clusters.begin(), clusters.end(), DrawClusterFirst );
+
+	std::vector<unsigned int> output;
+	output.reserve( indices.size() );
+	for( size_t c = 0; c < clusters.size(); c++ )
+	{
+		output.insert( output.end(), indices.begin() + clusters[c].start * 3, indices.begin() + clusters[c].end * 3 );
+	}
+	indices.swap( output );
+}
+
+void OptimiseOverdraw( MeshData &meshData, float threshold, unsigned int cacheSize )
+{
+	std::vector<MeshLod> levels = GetLevels( meshData );
+	std::vector<unsigned int> indices;
+	for( size_t l = 0; l < levels.size(); l++ )
+	{
+		std::vector<unsigned int>::iterator start = meshData.indices.begin() + levels[l].indexOffset;
+		indices.assign( start, start + levels[l].indexCount );
+		OptimiseLevelOverdraw( indices, meshData.positions, threshold, cacheSize );
+		std::copy( indices.begin(), indices.end(), start );
+	}
+}
+
+
+void OptimiseVertexFetch( MeshData &meshData )
+{
+	unsigned int numVertices = meshData.positions.size();
+	const unsigned int unused = ~0u;
+
+	// New number for each vertex, handed out in the order the index buffer reaches them
+	std::vector<unsigned int> remap( numVertices, unused );
+	unsigned int nextVertex = 0;
+	for( size_t i = 0; i < meshData.indices.size(); i++ )
+	{
+		unsigned int &newIndex = remap[meshData.indices[i]];
+		if( newIndex == unused )
+		{
+			newIndex = nextVertex++;
+		}
+		meshData.indices[i] = newIndex;
+	}
+	for( unsigned int v = 0; v < numVertices; v++ )
+	{
+		if( remap[v] == unused )
+		{
+			remap[v] = nextVertex++;
+		}
+	}
+
+	// Move the vertices to match
+	std::vector<glm::vec3> positions( numVertices );
+	for( unsigned int v = 0; v < numVertices; v++ )
+	{
+		positions[remap[v]] = meshData.positions[v];
+	}
+	meshData.positions.swap( positions );
+
+	if( !meshData.normals.empty() )
+	{
+		std::vector<glm::vec3> normals( numVertices );
+		for( unsigned int v = 0; v < numVertices; v++ )
+		{
+			normals[remap[v]] = meshData.normals[v];
+		}
+		meshData.normals.swap( normals );
+	}
+
+	if( !meshData.uvs.empty() )
+	{
+		std::vector<glm::vec2> uvs( numVertices );
+		for( unsigned int v = 0; v < numVertices; v++ )
+		{
+			uvs[remap[v]] = meshData.uvs[v];
+		}
+		meshData.uvs.swap( uvs );
+	}
+}
+
+
+void OptimiseMesh( MeshData &meshData )
+{
+	OptimiseVertexCache( meshData );
+	OptimiseOverdraw( meshData );
+	OptimiseVertexFetch( meshData );
+}
@@ -0,0 +1,46 @@
+
+#ifndef __MESH_OPTIMISER__
+#define __MESH_OPTIMISER__
+
+#include <vector>
+
+struct MeshData;
+
+// How well an index buffer uses the GPU's post-transform vertex cache, simulated as a FIFO
+struct VertexCacheStats
+{
+	// Average Cache Miss Ratio: vertex shader runs per triangle
+	// 3 is the worst case, around 0.5 - 0.7 is about as good as a typical closed mesh gets
+	float acmr;
+
+	// Average Transformed Vertex Ratio: vertex shader runs per vertex, 1 is perfect
+	float atvr;
+};
+
+// Default cache size used for optimising and analysing
+// Real hardware varies, but orderings that are good for 16 entries are good for the rest too
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// Runs the index buffer through a simulated FIFO vertex cache and counts the misses
+VertexCacheStats AnalyseVertexCache( const std::vector<unsigned int> &indices, unsigned int numVertices, unsigned int cacheSize = VERTEX_CACHE_SIZE );
+
+// Reorders triangles so vertices are reused while they're still in the post-transform cache
+// This is Tipsify (Sander, Nehab and Barczak 2007): it fans around one vertex at a time, picking the next one from
+// the vertices just used, and only jumps elsewhere when it runs out
+// Each detail level in meshData.lods is reordered on its own
+void OptimiseVertexCache( MeshData &meshData, unsigned int cacheSize = VERTEX_CACHE_SIZE );
+
+// Splits a cache-optimised index buffer into clusters and draws the ones facing outwards first
+// Triangles on the outside of the mesh tend to hide those further in, so the depth test rejects more of what comes later
+// Clusters are only split where doing so costs at most 'threshold' times their ACMR, so the cache order mostly survives
+void OptimiseOverdraw( MeshData &meshData, float threshold = 1.05f, unsigned int cacheSize = VERTEX_CACHE_SIZE );
+
+// Renumbers the vertices in the order the index buffer first uses them, so vertex fetches walk through memory in order
+// With detail levels that's the order full detail uses them, and the lower levels share the same vertices
+// Vertices no triangle uses are moved to the end
+void OptimiseVertexFetch( MeshData &meshData );
+
+// Runs all three passes above, in order
+void OptimiseMesh( MeshData &meshData );
+
+#endif
@@ -0,0 +1,508 @@
+
+#include "MeshSimplifier.h"
+#include "MeshData.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+
+// Marks for the open edge lists below
+static const unsigned int NO_EDGE = ~0u;
+static const unsigned int MANY_EDGES = ~1u;
+
+// How much harder it is to move a border or seam edge than a surface, so they keep their shape
+static const double EDGE_QUADRIC_WEIGHT = 10.0;
+
+// What a vertex is allowed to do
+enum SimplifyVertexKind
+{
+	// Surrounded by triangles with no seams, can collapse onto any neighbour
+	VERTEX_MANIFOLD,
+	// On an open edge of the mesh, can only slide along it
+	VERTEX_BORDER,
+	// On a uv or normal seam (two vertices at one position), both sides slide along it together
+	VERTEX_SEAM,
+	// Anything more complicated, like where seams meet, never moves
+	VERTEX_LOCKED
+};
+
+// Sum of weighted squared distances to a set of planes, as a function of position
+// For plane n.p + d = 0 that's p'(n n')p + 2(d n).p + d^2, so it's stored as a symmetric matrix, a vector and a constant
+struct Quadric
+{
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+static void AddPlane( Quadric &q, const glm::dvec3 &normal, double distance, double weight )
+{
+	q.a00 += weight * normal.x * normal.x;
+	q.a11 += weight * normal.y * normal.y;
+	q.a22 += weight * normal.z * normal.z;
+	q.a01 += weight * normal.x * normal.y;
+	q.a02 += weight * normal.x * normal.z;
+	q.a12 += weight * normal.y * normal.z;
+	q.b0 += weight * normal.x * distance;
+	q.b1 += weight * normal.y * distance;
+	q.b2 += weight * normal.z * distance;
+	q.c += weight * distance * distance;
+	q.weight += weight;
+}
+
+static void AddQuadric( Quadric &q, const Quadric &other )
+{
+	q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+	q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+	q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+	q.c += other.c;
+	q.weight += other.weight;
+}
+
+// Weighted mean squared distance from p to the planes
+static double QuadricError( const Quadric &q, const glm::vec3 &position )
+{
+	double x = position.x, y = position.y, z = position.z;
+	double error = x * ( q.a00 * x + q.a01 * y + q.a02 * z )
+		+ y * ( q.a01 * x + q.a11 * y + q.a12 * z )
+		+ z * ( q.a02 * x + q.a12 * y + q.a22 * z )
+		+ 2.0 * ( q.b0 * x + q.b1 * y + q.b2 * z ) + q.c;
+	return q.weight > 0.0 ? std::max( error, 0.0 ) / q.weight : 0.0;
+}
+
+
+struct PositionKey
+{
+	unsigned int bits[3];
+	bool operator==( const PositionKey &other ) const { return !memcmp( bits, other.bits, sizeof( bits ) ); }
+};
+
+struct PositionKeyHash
+{
+	size_t operator()( const PositionKey &key ) const
+	{
+		return ( key.bits[0] * 73856093u ) ^ ( key.bits[1] * 19349663u ) ^ ( key.bits[2] * 83492791u );
+	}
+};
+
+// Triangles around each vertex, stored back to back in one array
+struct VertexAdjacency
+{
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> triangles;
+
+	void Build( const std::vector<unsigned int> &indices, size_t numVertices )
+	{
+		offsets.assign( numVertices + 1, 0 );
+		for( size_t i = 0; i < indices.size(); i++ )
+		{
+			offsets[indices[i] + 1]++;
+		}
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize( indices.size() );
+		std::vector<unsigned int> fill( offsets.begin(), offsets.end() - 1 );
+		for( size_t i = 0; i < indices.size(); i++ )
+		{
+			triangles[fill[indices[i]]++] = (unsigned int) ( i / 3 );
+		}
+	}
+
+	// Is there a triangle with the edge from a to b, in that winding?
+	bool HasEdge( const std::vector<unsigned int> &indices, unsigned int a, unsigned int b ) const
+	{
+		for( unsigned int i = offsets[a]; i < offsets[a + 1]; i++ )
+		{
+			const unsigned int *triangle = &indices[triangles[i] * 3];
+			for( unsigned int c = 0; c < 3; c++ )
+			{
+				if( triangle[c] == a && triangle[( c + 1 ) % 3] == b )
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+};
+
+// A candidate edge collapse: vertex 'from' moves onto vertex 'to'
+struct EdgeCollapse
+{
+	unsigned int from, to;
+	float cost;
+};
+
+static bool CheaperCollapse( const EdgeCollapse &a, const EdgeCollapse &b )
+{
+	return a.cost < b.cost;
+}
+
+static void RecordOpenEdge( unsigned int &slot, unsigned int vertex )
+{
+	slot = ( slot == NO_EDGE || slot == vertex ) ? vertex : MANY_EDGES;
+}
+
+static bool IsSingleEdge( unsigned int slot )
+{
+	return slot != NO_EDGE && slot != MANY_EDGES;
+}
+
+
+float SimplifyMesh( const MeshData &meshData, const std::vector<unsigned int> &indices, size_t targetIndexCount, std::vector<unsigned int> &result )
+{
+	const std::vector<glm::vec3> &positions = meshData.positions;
+	size_t numVertices = positions.size();
+
+	// Vertices that only differ by normal or uv share a position, and are moved together
+	// positionIds gives each one the first vertex with the same position
+	std::vector<unsigned int> positionIds( numVertices );
+	{
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> lookup;
+		lookup.reserve( numVertices );
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			PositionKey key;
+			memcpy( key.bits, &positions[v], sizeof( key.bits ) );
+			positionIds[v] = lookup.insert( std::make_pair( key, (unsigned int) v ) ).first->second;
+		}
+	}
+
+	// Drop triangles that are already degenerate, they would only get in the way
+	result.clear();
+	result.reserve( indices.size() );
+	for( size_t i = 0; i + 2 < indices.size(); i += 3 )
+	{
+		unsigned int a = positionIds[indices[i]], b = positionIds[indices[i + 1]], c = positionIds[indices[i + 2]];
+		if( a != b && b != c && c != a )
+		{
+			result.insert( result.end(), indices.begin() + i, indices.begin() + i + 3 );
+		}
+	}
+
+	VertexAdjacency adjacency;
+	adjacency.Build( result, numVertices );
+
+	// Open edges have no matching edge going the other way, so they're either a border of the mesh or a seam
+	// Each vertex remembers its open edges in and out, which is all that's needed to tell which it is
+	std::vector<unsigned int> openIn( numVertices ), openOut( numVertices );
+	std::vector<unsigned char> kinds( numVertices );
+	std::vector<unsigned int> wedges( numVertices );
+
+	// Quadrics start out as the planes of the triangles around each position, weighted by area
+	// Borders and seams also get a plane through the edge at right angles to the surface, so they resist moving sideways
+	std::vector<Quadric> quadrics( numVertices );
+	memset( &quadrics[0], 0, numVertices * sizeof( Quadric ) );
+	for( size_t i = 0; i < result.size(); i += 3 )
+	{
+		glm::dvec3 p0( positions[result[i]] ), p1( positions[result[i + 1]] ), p2( positions[result[i + 2]] );
+		glm::dvec3 normal = glm::cross( p1 - p0, p2 - p0 );
+		double length = glm::length( normal );
+		if( length <= 0.0 )
+		{
+			continue;
+		}
+		glm::dvec3 unitNormal = normal / length;
+		double area = length * 0.5;
+		for( unsigned int c = 0; c < 3; c++ )
+		{
+			AddPlane( quadrics[positionIds[result[i + c]]], unitNormal, -glm::dot( unitNormal, p0 ), area );
+		}
+
+		for( unsigned int c = 0; c < 3; c++ )
+		{
+			unsigned int a = result[i + c], b = result[i + ( c + 1 ) % 3];
+			if( adjacency.HasEdge( result, b, a ) )
+			{
+				continue;
+			}
+			glm::dvec3 pa( positions[a] ), pb( positions[b] );
+			glm::dvec3 edge = pb - pa;
+			glm::dvec3 edgeNormal = glm::cross( edge, unitNormal );
+			double edgeLength = glm::length( edgeNormal );
+			if( edgeLength > 0.0 )
+			{
+				edgeNormal /= edgeLength;
+				double weight = EDGE_QUADRIC_WEIGHT * glm::dot( edge, edge );
+				AddPlane( quadrics[positionIds[a]], edgeNormal, -glm::dot( edgeNormal, pa ), weight );
+				AddPlane( quadrics[positionIds[b]], edgeNormal, -glm::dot( edgeNormal, pa ), weight );
+			}
+		}
+	}
+
+	size_t targetTriangles = targetIndexCount / 3;
+	double maxError = 0.0;
+
+	std::vector<EdgeCollapse> collapses;
+	std::vector<unsigned int> collapseTargets( numVertices );
+	std::vector<unsigned char> lockedThisPass( numVertices );
+	std::vector<unsigned int> firstWedge( numVertices );
+
+	// Each pass collapses as many cheap edges as it can without two collapses touching the same triangles,
+	// then rebuilds the index buffer
+	while( result.size() / 3 > targetTriangles )
+	{
+		adjacency.Build( result, numVertices );
+
+		// Link up vertices that share a position into rings, only counting the ones still in use
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			wedges[v] = (unsigned int) v;
+			firstWedge[v] = NO_EDGE;
+		}
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			if( adjacency.offsets[v] == adjacency.offsets[v + 1] )
+			{
+				continue;
+			}
+			unsigned int &first = firstWedge[positionIds[v]];
+			if( first == NO_EDGE )
+			{
+				first = (unsigned int) v;
+			}
+			else
+			{
+				wedges[v] = wedges[first];
+				wedges[first] = (unsigned int) v;
+			}
+		}
+
+		// Find the open edges, then work out what each vertex is
+		std::fill( openIn.begin(), openIn.end(), NO_EDGE );
+		std::fill( openOut.begin(), openOut.end(), NO_EDGE );
+		for( size_t i = 0; i < result.size(); i += 3 )
+		{
+			for( unsigned int c = 0; c < 3; c++ )
+			{
+				unsigned int a = result[i + c], b = result[i + ( c + 1 ) % 3];
+				if( !adjacency.HasEdge( result, b, a ) )
+				{
+					RecordOpenEdge( openOut[a], b );
+					RecordOpenEdge( openIn[b], a );
+				}
+			}
+		}
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			unsigned int w = wedges[v];
+			if( w == v )
+			{
+				if( openIn[v] == NO_EDGE && openOut[v] == NO_EDGE )
+				{
+					kinds[v] = VERTEX_MANIFOLD;
+				}
+				else
+				{
+					kinds[v] = ( IsSingleEdge( openIn[v] ) && IsSingleEdge( openOut[v] ) ) ? VERTEX_BORDER : VERTEX_LOCKED;
+				}
+			}
+			else if( wedges[w] == v )
+			{
+				// A seam runs one way on one side and the opposite way on the other
+				bool seam = IsSingleEdge( openIn[v] ) && IsSingleEdge( openOut[v] ) && IsSingleEdge( openIn[w] ) && IsSingleEdge( openOut[w] )
+					&& positionIds[openIn[v]] == positionIds[openOut[w]] && positionIds[openOut[v]] == positionIds[openIn[w]];
+				kinds[v] = seam ? VERTEX_SEAM : VERTEX_LOCKED;
+			}
+			else
+			{
+				kinds[v] = VERTEX_LOCKED;
+			}
+		}
+
+		// Cost every allowed collapse along every edge
+		collapses.clear();
+		for( size_t i = 0; i < result.size(); i += 3 )
+		{
+			for( unsigned int c = 0; c < 6; c++ )
+			{
+				unsigned int from = result[i + c % 3];
+				unsigned int to = result[i + ( c / 3 == 0 ? ( c + 1 ) % 3 : ( c + 2 ) % 3 )];
+
+				bool allowed = false;
+				switch( kinds[from] )
+				{
+				case VERTEX_MANIFOLD:
+					allowed = true;
+					break;
+				case VERTEX_BORDER:
+				case VERTEX_SEAM:
+					// Only along the open edge, and onto something that isn't in the middle of the surface
+					allowed = ( to == openIn[from] || to == openOut[from] ) && kinds[to] != VERTEX_MANIFOLD
+						&& ( kinds[from] == VERTEX_BORDER || kinds[to] != VERTEX_BORDER );
+					break;
+				default:
+					break;
+				}
+				if( !allowed )
+				{
+					continue;
+				}
+
+				Quadric merged = quadrics[positionIds[from]];
+				AddQuadric( merged, quadrics[positionIds[to]] );
+				EdgeCollapse collapse = { from, to, (float) QuadricError( merged, positions[to] ) };
+				collapses.push_back( collapse );
+			}
+		}
+		std::sort( collapses.begin(), collapses.end(), CheaperCollapse );
+
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			collapseTargets[v] = (unsigned int) v;
+		}
+		std::fill( lockedThisPass.begin(), lockedThisPass.end(), 0 );
+
+		size_t trianglesLeft = result.size() / 3;
+		unsigned int numCollapsed = 0;
+		for( size_t i = 0; i < collapses.size() && trianglesLeft > targetTriangles; i++ )
+		{
+			const EdgeCollapse &collapse = collapses[i];
+			unsigned int from = collapse.from, to = collapse.to;
+			if( lockedThisPass[positionIds[from]] || lockedThisPass[positionIds[to]] )
+			{
+				continue;
+			}
+
+			// The other side of a seam moves onto the matching vertex on its side
+			unsigned int otherFrom = NO_EDGE, otherTo = NO_EDGE;
+			if( kinds[from] == VERTEX_SEAM )
+			{
+				otherFrom = wedges[from];
+				otherTo = ( to == openOut[from] ) ? openIn[otherFrom] : openOut[otherFrom];
+			}
+
+			// Don't let any triangle flip over, or fold onto another
+			bool flips = false;
+			size_t removed = 0;
+			for( unsigned int side = 0; side < 2 && !flips; side++ )
+			{
+				unsigned int vertex = side == 0 ? from : otherFrom;
+				if( vertex == NO_EDGE )
+				{
+					continue;
+				}
+				for( unsigned int a = adjacency.offsets[vertex]; a < adjacency.offsets[vertex + 1]; a++ )
+				{
+					const unsigned int *triangle = &result[adjacency.triangles[a] * 3];
+					glm::vec3 before[3], after[3];
+					bool folds = false;
+					for( unsigned int c = 0; c < 3; c++ )
+					{
+						before[c] = positions[triangle[c]];
+						after[c] = triangle[c] == vertex ? positions[to] : before[c];
+						folds = folds || positionIds[triangle[c]] == positionIds[to];
+					}
+					if( folds )
+					{
+						removed++;
+						continue;
+					}
+					glm::vec3 normalBefore = glm::cross( before[1] - before[0], before[2] - before[0] );
+					glm::vec3 normalAfter = glm::cross( after[1] - after[0], after[2] - after[0] );
+					if( glm::dot( normalBefore, normalAfter ) <= 0.0f )
+					{
+						flips = true;
+						break;
+					}
+				}
+			}
+			if( flips )
+			{
+				continue;
+			}
+
+			collapseTargets[from] = to;
+			if( otherFrom != NO_EDGE )
+			{
+				collapseTargets[otherFrom] = otherTo;
+			}
+			AddQuadric( quadrics[positionIds[to]], quadrics[positionIds[from]] );
+			maxError = std::max( maxError, (double) collapse.cost );
+			trianglesLeft -= std::min( removed, trianglesLeft );
+			numCollapsed++;
+
+			// Everything touching the moved triangles is off limits until the next pass
+			for( unsigned int side = 0; side < 2; side++ )
+			{
+				unsigned int vertex = side == 0 ? from : otherFrom;
+				if( vertex == NO_EDGE )
+				{
+					continue;
+				}
+				for( unsigned int a = adjacency.offsets[vertex]; a < adjacency.offsets[vertex + 1]; a++ )
+				{
+					const unsigned int *triangle = &result[adjacency.triangles[a] * 3];
+					for( unsigned int c = 0; c < 3; c++ )
+					{
+						lockedThisPass[positionIds[triangle[c]]] = 1;
+					}
+				}
+			}
+		}
+
+		if( numCollapsed == 0 )
+		{
+			break;
+		}
+
+		// Apply the collapses and throw away the triangles that have folded down to nothing
+		size_t write = 0;
+		for( size_t i = 0; i < result.size(); i += 3 )
+		{
+			unsigned int a = collapseTargets[result[i]], b = collapseTargets[result[i + 1]], c = collapseTargets[result[i + 2]];
+			if( positionIds[a] != positionIds[b] && positionIds[b] != positionIds[c] && positionIds[c] != positionIds[a] )
+			{
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize( write );
+	}
+
+	return (float) std::sqrt( maxError );
+}
+
+
+void GenerateLods( MeshData &meshData, const std::vector<float> &ratios )
+{
+	if( meshData.indices.empty() )
+	{
+		return;
+	}
+	if( meshData.lods.empty() )
+	{
+		MeshLod fullDetail = { 0, (unsigned int) meshData.indices.size(), 0.0f, 0, 0 };
+		meshData.lods.push_back( fullDetail );
+	}
+
+	// Each level is simplified from the one before, which is quicker than starting from full detail every time
+	// The errors add up, so each level's error is still measured against full detail
+	const MeshLod &fullDetail = meshData.lods[0];
+	std::vector<unsigned int> source( meshData.indices.begin() + fullDetail.indexOffset, meshData.indices.begin() + fullDetail.indexOffset + fullDetail.indexCount );
+	size_t fullTriangles = fullDetail.indexCount / 3;
+	float error = 0.0f;
+
+	std::vector<unsigned int> simplified;
+	for( size_t r = 0; r < ratios.size(); r++ )
+	{
+		size_t targetTriangles = std::max( (size_t) ( fullTriangles * ratios[r] ), (size_t) 1 );
+		error += SimplifyMesh( meshData, source, targetTriangles * 3, simplified );
+
+		// Not worth a level of its own if seams and borders stopped it getting any smaller
+		if( simplified.empty() || simplified.size() * 20 > source.size() * 19 )
+		{
+			break;
+		}
+
+		MeshLod lod = { (unsigned int) meshData.indices.size(), (unsigned int) simplified.size(), error, 0, 0 };
+		meshData.indices.insert( meshData.indices.end(), simplified.begin(), simplified.end() );
+		meshData.lods.push_back( lod );
+		source.swap( simplified );
+	}
+}
@@ -0,0 +1,24 @@
+
+#ifndef __MESH_SIMPLIFIER__
+#define __MESH_SIMPLIFIER__
+
+#include <vector>
+#include <cstddef>
+
+struct MeshData;
+
+// Reduces the triangles in 'indices' (which index meshData's vertices) to about targetIndexCount indices
+// Edges are collapsed cheapest first, costed with quadric error metrics (Garland and Heckbert 1997)
+// No new vertices are made, each collapse moves a vertex onto one of its neighbours, so the result can share
+// the original vertex buffer
+// UV and normal seams, and open borders, only ever collapse along themselves so they keep their shape
+// Returns the error of the result: roughly the furthest its surface moved, in model space
+float SimplifyMesh( const MeshData &meshData, const std::vector<unsigned int> &indices, size_t targetIndexCount, std::vector<unsigned int> &result );
+
+// Builds a chain of lower detail levels, each keeping the given fraction of the full detail mesh's triangles
+// e.g. { 0.5f, 0.25f, 0.125f, 0.0625f }
+// Each level's indices are appended to meshData.indices and described in meshData.lods
+// The chain stops early if a level can't be simplified any further
+void GenerateLods( MeshData &meshData, const std::vector<float> &ratios );
+
+#endif
@@ -0,0 +1,192 @@
+
+#include "Meshlets.h"
+#include "MeshData.h"
+#include <algorithm>
+#include <cmath>
+
+
+// Works out the bounding sphere and normal cone of a finished meshlet
+static void ComputeMeshletBounds( const MeshData &meshData, Meshlet &meshlet )
+{
+	const std::vector<glm::vec3> &positions = meshData.positions;
+	const unsigned int *indices = &meshData.indices[meshlet.indexOffset];
+
+	// Sphere around the middle of the bounding box - not the smallest possible, but close enough for culling
+	glm::vec3 boundsMin = positions[indices[0]], boundsMax = positions[indices[0]];
+	for( unsigned int i = 1; i < meshlet.indexCount; i++ )
+	{
+		boundsMin = glm::min( boundsMin, positions[indices[i]] );
+		boundsMax = glm::max( boundsMax, positions[indices[i]] );
+	}
+	meshlet.centre = ( boundsMin + boundsMax ) * 0.5f;
+	meshlet.radius = 0.0f;
+	for( unsigned int i = 0; i < meshlet.indexCount; i++ )
+	{
+		meshlet.radius = std::max( meshlet.radius, glm::length( positions[indices[i]] - meshlet.centre ) );
+	}
+
+	// Cone axis is the average face direction, and the cone is as wide as the triangle furthest from it
+	std::vector<glm::vec3> normals;
+	normals.reserve( meshlet.indexCount / 3 );
+	glm::vec3 axis( 0.0f );
+	for( unsigned int i = 0; i + 2 < meshlet.indexCount; i += 3 )
+	{
+		const glm::vec3 &a = positions[indices[i]];
+		glm::vec3 normal = glm::cross( positions[indices[i + 1]] - a, positions[indices[i + 2]] - a );
+		float length = glm::length( normal );
+		if( length > 0.0f )
+		{
+			normals.push_back( normal / length );
+			axis += normal / length;
+		}
+	}
+
+	meshlet.coneAxis = glm::vec3( 0.0f, 0.0f, 1.0f );
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = glm::length( axis );
+	if( axisLength <= 0.0f )
+	{
+		return;
+	}
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for( size_t n = 0; n < normals.size(); n++ )
+	{
+		minDot = std::min( minDot, glm::dot( axis, normals[n] ) );
+	}
+
+	// Once the cone is nearly a hemisphere it would hardly ever cull anything, so don't bother
+	meshlet.coneAxis = axis;
+	if( minDot > 0.1f )
+	{
+		meshlet.coneCutoff = std::sqrt( 1.0f - minDot * minDot );
+	}
+}
+
+void BuildMeshlets( MeshData &meshData, unsigned int maxVertices, unsigned int maxTriangles )
+{
+	meshData.meshlets.clear();
+	if( meshData.indices.empty() )
+	{
+		return;
+	}
+	if( meshData.lods.empty() )
+	{
+		MeshLod fullDetail = { 0, (unsigned int) meshData.indices.size(), 0.0f, 0, 0 };
+		meshData.lods.push_back( fullDetail );
+	}
+
+	// Which meshlet each vertex was last counted in, so each is only counted once per meshlet
+	std::vector<unsigned int> vertexMeshlet( meshData.positions.size(), ~0u );
+
+	for( size_t l = 0; l < meshData.lods.size(); l++ )
+	{
+		MeshLod &lod = meshData.lods[l];
+		lod.meshletOffset = meshData.meshlets.size();
+
+		// Keep adding triangles until one more would break a limit, then start the next meshlet
+		Meshlet meshlet = { lod.indexOffset, 0, glm::vec3( 0.0f ), 0.0f, glm::vec3( 0.0f ), 1.0f };
+		unsigned int meshletId = meshData.meshlets.size();
+		unsigned int numVertices = 0;
+		for( unsigned int i = lod.indexOffset; i + 2 < lod.indexOffset + lod.indexCount; i += 3 )
+		{
+			const unsigned int *triangle = &meshData.indices[i];
+			unsigned int newVertices = 0;
+			for( unsigned int c = 0; c < 3; c++ )
+			{
+				bool repeated = ( c > 0 && triangle[c] == triangle[0] ) || ( c > 1 && triangle[c] == triangle[1] );
+				newVertices += ( vertexMeshlet[triangle[c]] != meshletId && !repeated ) ? 1 : 0;
+			}
+
+			if( meshlet.indexCount > 0 && ( numVertices + newVertices > maxVertices || meshlet.indexCount / 3 + 1 > maxTriangles ) )
+			{
+				meshData.meshlets.push_back( meshlet );
+				meshlet.indexOffset = i;
+				meshlet.indexCount = 0;
+				meshletId++;
+				numVertices = 0;
+			}
+
+			for( unsigned int c = 0; c < 3; c++ )
+			{
+				if( vertexMeshlet[triangle[c]] != meshletId )
+				{
+					vertexMeshlet[triangle[c]] = meshletId;
+					numVertices++;
+				}
+			}
+			meshlet.indexCount += 3;
+		}
+		if( meshlet.indexCount > 0 )
+		{
+			meshData.meshlets.push_back( meshlet );
+		}
+
+		lod.meshletCount = meshData.meshlets.size() - lod.meshletOffset;
+	}
+
+	for( size_t m = 0; m < meshData.meshlets.size(); m++ )
+	{
+		ComputeMeshletBounds( meshData, meshData.meshlets[m] );
+	}
+}
+
+
+MeshletView::MeshletView( const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix, bool cullBackfaces )
+{
+	this->cullBackfaces = cullBackfaces;
+
+	// Frustum planes come straight out of the rows of the combined matrix (Gribb and Hartmann)
+	// Using the model matrix too puts them in model space, so meshlet bounds can be tested without transforming them
+	glm::mat4 modelViewProj = projMatrix * viewMatrix * modelMatrix;
+	glm::vec4 rows[4];
+	for( int r = 0; r < 4; r++ )
+	{
+		rows[r] = glm::vec4( modelViewProj[0][r], modelViewProj[1][r], modelViewProj[2][r], modelViewProj[3][r] );
+	}
+	for( int p = 0; p < 6; p++ )
+	{
+		glm::vec4 plane = ( p % 2 == 0 ) ? rows[3] + rows[p / 2] : rows[3] - rows[p / 2];
+		float length = glm::length( glm::vec3( plane ) );
+		frustumPlanes[p] = length > 0.0f ? plane / length : plane;
+	}
+
+	// Orthographic projections leave w alone
+	orthographic = projMatrix[3][3] == 1.0f;
+	glm::mat4 viewToModel = glm::inverse( viewMatrix * modelMatrix );
+	cameraPosition = glm::vec3( viewToModel * glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f ) );
+	viewDirection = glm::normalize( glm::vec3( viewToModel * glm::vec4( 0.0f, 0.0f, -1.0f, 0.0f ) ) );
+}
+
+bool MeshletView::IsSphereVisible( const glm::vec3 &centre, float radius ) const
+{
+	for( int p = 0; p < 6; p++ )
+	{
+		if( glm::dot( glm::vec3( frustumPlanes[p] ), centre ) + frustumPlanes[p].w < -radius )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MeshletView::IsVisible( const Meshlet &meshlet ) const
+{
+	if( !IsSphereVisible( meshlet.centre, meshlet.radius ) )
+	{
+		return false;
+	}
+
+	// Back facing if every direction in the cone points away from the camera, wherever on the sphere the triangles are
+	if( cullBackfaces && meshlet.coneCutoff < 1.0f )
+	{
+		if( orthographic )
+		{
+			return glm::dot( viewDirection, meshlet.coneAxis ) < meshlet.coneCutoff;
+		}
+		glm::vec3 toMeshlet = meshlet.centre - cameraPosition;
+		return glm::dot( toMeshlet, meshlet.coneAxis ) < meshlet.coneCutoff * glm::length( toMeshlet ) + meshlet.radius;
+	}
+	return true;
+}
@@ -0,0 +1,45 @@
+
+#ifndef __MESHLETS__
+#define __MESHLETS__
+
+#include <GLM/glm.hpp>
+#include <vector>
+
+struct MeshData;
+struct Meshlet;
+
+// Meshlet size limits
+// Small enough that culling one throws away a useful chunk of a big mesh, big enough that there aren't too many to test
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// Splits each level of detail's triangles into meshlets, in the order the index buffer already has them
+// Nothing is reordered, so run this after OptimiseMesh - the cache-optimised order keeps neighbouring triangles together
+// which makes the meshlets nice compact patches
+void BuildMeshlets( MeshData &meshData, unsigned int maxVertices = MESHLET_MAX_VERTICES, unsigned int maxTriangles = MESHLET_MAX_TRIANGLES );
+
+// What a draw pass can see, moved into a mesh's model space so meshlets can be tested as they are
+struct MeshletView
+{
+	// modelMatrix places the mesh, viewMatrix and projMatrix are the pass's camera (perspective or orthographic)
+	// cullBackfaces also drops meshlets facing completely away from the camera - only use it when the pass culls back faces
+	MeshletView( const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix, bool cullBackfaces );
+
+	// True if any of the meshlet might end up on screen
+	bool IsVisible( const Meshlet &meshlet ) const;
+
+	// True if any of a model space sphere is inside the frustum, e.g. one around the whole mesh
+	bool IsSphereVisible( const glm::vec3 &centre, float radius ) const;
+
+	// Left, right, bottom, top, near, far, with normals pointing inwards and normalised in model space
+	glm::vec4 frustumPlanes[6];
+
+	// Orthographic cameras look along a direction, perspective ones out from a position
+	bool orthographic;
+	glm::vec3 cameraPosition;
+	glm::vec3 viewDirection;
+
+	bool cullBackfaces;
+};
+
+#endif
@@ -0,0 +1,293 @@
+
+#include "MipChain.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// SSE2 is always there on 64-bit x86, and on 32-bit builds that ask for it
+#if defined( _M_X64 ) || defined( _M_AMD64 ) || defined( __SSE2__ ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define MIP_CHAIN_SSE2
+#endif
+
+
+// Entries in the linear to sRGB table
+// Enough that any 8-bit sRGB value survives going to linear and back unchanged, even in the darks where the curve is steepest
+static const unsigned int LINEAR_TO_SRGB_SIZE = 16384;
+
+// Lookup tables for going between sRGB and linear colour, made the first time they're needed
+struct SrgbTables
+{
+	SrgbTables()
+	{
+		for( unsigned int i = 0; i < 256; i++ )
+		{
+			float srgb = i / 255.0f;
+			toLinear[i] = srgb <= 0.04045f ? srgb / 12.92f : std::pow( ( srgb + 0.055f ) / 1.055f, 2.4f );
+		}
+		for( unsigned int i = 0; i < LINEAR_TO_SRGB_SIZE; i++ )
+		{
+			float linear = i / (float) ( LINEAR_TO_SRGB_SIZE - 1 );
+			float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow( linear, 1.0f / 2.4f ) - 0.055f;
+			fromLinear[i] = (unsigned char) std::min( 255.0f, std::max( 0.0f, srgb * 255.0f + 0.5f ) );
+		}
+	}
+
+	float toLinear[256];
+	unsigned char fromLinear[LINEAR_TO_SRGB_SIZE];
+};
+
+static const SrgbTables& GetSrgbTables()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+// Rows of 8-bit sRGB to 4 floats a pixel of linear colour
+// Alpha isn't a colour, so it is only scaled
+static void DecodeRow( const unsigned char *rgba, unsigned int width, float *linear )
+{
+	const SrgbTables &tables = GetSrgbTables();
+	for( unsigned int x = 0; x < width; x++, rgba += 4, linear += 4 )
+	{
+		linear[0] = tables.toLinear[rgba[0]];
+		linear[1] = tables.toLinear[rgba[1]];
+		linear[2] = tables.toLinear[rgba[2]];
+		linear[3] = rgba[3] * ( 1.0f / 255.0f );
+	}
+}
+
+// Linear floats back to 8-bit sRGB, the scalar reference for EncodeRowSSE2
+static void EncodeRowScalar( const float *linear, unsigned int width, unsigned char *rgba )
+{
+	const SrgbTables &tables = GetSrgbTables();
+	const float colourLimit = (float) ( LINEAR_TO_SRGB_SIZE - 1 );
+	for( unsigned int x = 0; x < width; x++, rgba += 4, linear += 4 )
+	{
+		for( int c = 0; c < 3; c++ )
+		{
+			float index = std::min( std::max( linear[c] * colourLimit + 0.5f, 0.0f ), colourLimit );
+			rgba[c] = tables.fromLinear[(int) index];
+		}
+		float alpha = std::min( std::max( linear[3] * 255.0f + 0.5f, 0.0f ), 255.0f );
+		rgba[3] = (unsigned char) (int) alpha;
+	}
+}
+
+// One row of the next level down, each pixel the average of the 2x2 block above it
+// An odd sized level's last row or column goes into the last block, which averages 3 pixels that way instead of 2,
+// so nothing is dropped. A level 1 pixel across just uses that pixel twice
+// This is the scalar reference for DownsampleRowSSE2
+static void DownsampleRowScalar( const float *source, unsigned int sourceWidth, unsigned int sourceHeight, float *dest, unsigned int destWidth, unsigned int y )
+{
+	const float *row0 = source + (size_t) std::min( 2 * y, sourceHeight - 1 ) * sourceWidth * 4;
+	const float *row1 = source + (size_t) std::min( 2 * y + 1, sourceHeight - 1 ) * sourceWidth * 4;
+	const float *row2 = 2 * y + 3 == sourceHeight ? source + (size_t) ( 2 * y + 2 ) * sourceWidth * 4 : NULL;
+	for( unsigned int x = 0; x < destWidth; x++, dest += 4 )
+	{
+		unsigned int x0 = std::min( 2 * x, sourceWidth - 1 ) * 4;
+		unsigned int x1 = std::min( 2 * x + 1, sourceWidth - 1 ) * 4;
+		unsigned int x2 = ( 2 * x + 2 ) * 4;
+		bool wide = 2 * x + 3 == sourceWidth;
+		float weight = 1.0f / (float) ( ( wide ? 3 : 2 ) * ( row2 != NULL ? 3 : 2 ) );
+		for( int c = 0; c < 4; c++ )
+		{
+			float top = row0[x0 + c] + row0[x1 + c];
+			float bottom = row1[x0 + c] + row1[x1 + c];
+			if( wide )
+			{
+				top += row0[x2 + c];
+				bottom += row1[x2 + c];
+			}
+			float sum = top + bottom;
+			if( row2 != NULL )
+			{
+				float last = row2[x0 + c] + row2[x1 + c];
+				if( wide )
+				{
+					last += row2[x2 + c];
+				}
+				sum += last;
+			}
+			dest[c] = sum * weight;
+		}
+	}
+}
+
+#ifdef MIP_CHAIN_SSE2
+
+// Same sums in the same order as DownsampleRowScalar, with a whole pixel in each register
+static void DownsampleRowSSE2( const float *source, unsigned int sourceWidth, unsigned int sourceHeight, float *dest, unsigned int destWidth, unsigned int y )
+{
+	const float *row0 = source + (size_t) std::min( 2 * y, sourceHeight - 1 ) * sourceWidth * 4;
+	const float *row1 = source + (size_t) std::min( 2 * y + 1, sourceHeight - 1 ) * sourceWidth * 4;
+	const float *row2 = 2 * y + 3 == sourceHeight ? source + (size_t) ( 2 * y + 2 ) * sourceWidth * 4 : NULL;
+	for( unsigned int x = 0; x < destWidth; x++, dest += 4 )
+	{
+		unsigned int x0 = std::min( 2 * x, sourceWidth - 1 ) * 4;
+		unsigned int x1 = std::min( 2 * x + 1, sourceWidth - 1 ) * 4;
+		unsigned int x2 = ( 2 * x + 2 ) * 4;
+		bool wide = 2 * x + 3 == sourceWidth;
+		__m128 weight = _mm_set1_ps( 1.0f / (float) ( ( wide ? 3 : 2 ) * ( row2 != NULL ? 3 : 2 ) ) );
+		__m128 top = _mm_add_ps( _mm_loadu_ps( row0 + x0 ), _mm_loadu_ps( row0 + x1 ) );
+		__m128 bottom = _mm_add_ps( _mm_loadu_ps( row1 + x0 ), _mm_loadu_ps( row1 + x1 ) );
+		if( wide )
+		{
+			top = _mm_add_ps( top, _mm_loadu_ps( row0 + x2 ) );
+			bottom = _mm_add_ps( bottom, _mm_loadu_ps( row1 + x2 ) );
+		}
+		__m128 sum = _mm_add_ps( top, bottom );
+		if( row2 != NULL )
+		{
+			__m128 last = _mm_add_ps( _mm_loadu_ps( row2 + x0 ), _mm_loadu_ps( row2 + x1 ) );
+			if( wide )
+			{
+				last = _mm_add_ps( last, _mm_loadu_ps( row2 + x2 ) );
+			}
+			sum = _mm_add_ps( sum, last );
+		}
+		_mm_storeu_ps( dest, _mm_mul_ps( sum, weight ) );
+	}
+}
+
+// Scales and clamps all four channels at once, only the table lookups are done one at a time
+static void EncodeRowSSE2( const float *linear, unsigned int width, unsigned char *rgba )
+{
+	const SrgbTables &tables = GetSrgbTables();
+	const float colourLimit = (float) ( LINEAR_TO_SRGB_SIZE - 1 );
+	const __m128 scale = _mm_set_ps( 255.0f, colourLimit, colourLimit, colourLimit );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	const __m128 zero = _mm_setzero_ps();
+	int indices[4];
+	for( unsigned int x = 0; x < width; x++, rgba += 4, linear += 4 )
+	{
+		__m128 index = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( linear ), scale ), half );
+		index = _mm_min_ps( _mm_max_ps( index, zero ), scale );
+		_mm_storeu_si128( (__m128i*) indices, _mm_cvttps_epi32( index ) );
+		rgba[0] = tables.fromLinear[indices[0]];
+		rgba[1] = tables.fromLinear[indices[1]];
+		rgba[2] = tables.fromLinear[indices[2]];
+		rgba[3] = (unsigned char) indices[3];
+	}
+}
+
+#endif
+
+// Splits a level's rows into a few bands for each thread, so threads that finish early can pick up more
+static void ForEachBand( ThreadPool &pool, unsigned int numRows, const std::function<void( unsigned int, unsigned int )> &task )
+{
+	unsigned int numBands = std::max( 1u, std::min( numRows, pool.GetNumThreads() * 4 ) );
+	unsigned int rowsPerBand = ( numRows + numBands - 1 ) / numBands;
+	pool.ParallelFor( numBands, [&]( unsigned int band )
+	{
+		unsigned int first = band * rowsPerBand;
+		task( first, std::min( first + rowsPerBand, numRows ) );
+	} );
+}
+
+
+const char* GetTextureFormatName( TextureFormat format )
+{
+	static const char *names[TEXTURE_FORMAT_COUNT] = { "RGBA8", "BC1", "BC3", "BC5", "BC7" };
+	return format < TEXTURE_FORMAT_COUNT ? names[format] : "unknown";
+}
+
+size_t GetTextureLevelSize( TextureFormat format, unsigned int width, unsigned int height )
+{
+	if( format == TEXTURE_FORMAT_RGBA8 )
+	{
+		return (size_t) width * height * 4;
+	}
+	size_t numBlocks = (size_t) ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 );
+	return numBlocks * ( format == TEXTURE_FORMAT_BC1 ? 8 : 16 );
+}
+
+
+MipChain::MipChain()
+{
+	width = 0;
+	height = 0;
+	format = TEXTURE_FORMAT_RGBA8;
+	data = NULL;
+	dataSize = 0;
+}
+
+size_t MipChain::Layout( unsigned int topWidth, unsigned int topHeight, TextureFormat levelFormat, unsigned int numLevels )
+{
+	width = topWidth;
+	height = topHeight;
+	format = levelFormat;
+	levels.clear();
+
+	size_t offset = 0;
+	unsigned int levelWidth = topWidth, levelHeight = topHeight;
+	while( true )
+	{
+		MipLevel level;
+		level.width = levelWidth;
+		level.height = levelHeight;
+		level.offset = offset;
+		levels.push_back( level );
+		offset += GetTextureLevelSize( levelFormat, levelWidth, levelHeight );
+
+		if( ( levelWidth == 1 && levelHeight == 1 ) || levels.size() == numLevels )
+		{
+			break;
+		}
+		levelWidth = std::max( levelWidth / 2, 1u );
+		levelHeight = std::max( levelHeight / 2, 1u );
+	}
+	dataSize = offset;
+	return offset;
+}
+
+void MipChain::Build( const unsigned char *rgba, unsigned int topWidth, unsigned int topHeight, unsigned int numThreads, bool useSimd )
+{
+	pixels.resize( Layout( topWidth, topHeight ) );
+	data = &pixels[0];
+	memcpy( &pixels[0], rgba, (size_t) topWidth * topHeight * 4 );
+
+#ifdef MIP_CHAIN_SSE2
+	void (*downsampleRow)( const float*, unsigned int, unsigned int, float*, unsigned int, unsigned int ) = useSimd ? DownsampleRowSSE2 : DownsampleRowScalar;
+	void (*encodeRow)( const float*, unsigned int, unsigned char* ) = useSimd ? EncodeRowSSE2 : EncodeRowScalar;
+#else
+	void (*downsampleRow)( const float*, unsigned int, unsigned int, float*, unsigned int, unsigned int ) = DownsampleRowScalar;
+	void (*encodeRow)( const float*, unsigned int, unsigned char* ) = EncodeRowScalar;
+#endif
+
+	// Make the tables before the threads all want them
+	GetSrgbTables();
+	ThreadPool pool( numThreads );
+
+	// Each level is filtered from the linear colour of the one above it, which is kept as floats
+	// so the rounding to 8 bits doesn't pile up level after level
+	std::vector<float> source( (size_t) topWidth * topHeight * 4 );
+	std::vector<float> dest;
+	ForEachBand( pool, topHeight, [&]( unsigned int firstRow, unsigned int endRow )
+	{
+		for( unsigned int y = firstRow; y < endRow; y++ )
+		{
+			DecodeRow( rgba + (size_t) y * topWidth * 4, topWidth, &source[(size_t) y * topWidth * 4] );
+		}
+	} );
+
+	// Levels need the one before, so they're made in order, but the rows of each are shared between the threads
+	for( size_t l = 1; l < levels.size(); l++ )
+	{
+		const MipLevel &above = levels[l - 1];
+		const MipLevel &level = levels[l];
+		dest.resize( (size_t) level.width * level.height * 4 );
+
+		ForEachBand( pool, level.height, [&]( unsigned int firstRow, unsigned int endRow )
+		{
+			for( unsigned int y = firstRow; y < endRow; y++ )
+			{
+				float *destRow = &dest[(size_t) y * level.width * 4];
+				downsampleRow( &source[0], above.width, above.height, destRow, level.width, y );
+				encodeRow( destRow, level.width, &pixels[level.offset + (size_t) y * level.width * 4] );
+			}
+		} );
+		source.swap( dest );
+	}
+}
@@ -0,0 +1,70 @@
+
+#ifndef __MIP_CHAIN__
+#define __MIP_CHAIN__
+
+#include <vector>
+#include <cstddef>
+
+// How a chain's pixels are stored
+// The BC formats split each level into 4x4 blocks, padding the edges out to whole blocks (see BlockCompressor.h)
+enum TextureFormat
+{
+	// 4 bytes a pixel
+	TEXTURE_FORMAT_RGBA8,
+	// 8 bytes a block, colour only
+	TEXTURE_FORMAT_BC1,
+	// 16 bytes a block, BC1 colour with a separate block for alpha
+	TEXTURE_FORMAT_BC3,
+	// 16 bytes a block, two independent channels, mostly for normal maps
+	TEXTURE_FORMAT_BC5,
+	// 16 bytes a block, colour and alpha at higher quality than BC3
+	TEXTURE_FORMAT_BC7,
+	TEXTURE_FORMAT_COUNT
+};
+
+// For messages, e.g. "BC1"
+const char* GetTextureFormatName( TextureFormat format );
+
+// Bytes taken by one level of the given size
+size_t GetTextureLevelSize( TextureFormat format, unsigned int width, unsigned int height );
+
+// Where one level sits in a MipChain
+struct MipLevel
+{
+	unsigned int width, height;
+	// Byte offset of the level's first pixel
+	size_t offset;
+};
+
+// A texture's set of mipmap levels, each half the size of the one before, normally all the way down to 1x1
+// Pixels are 8-bit RGBA with colour in sRGB, or blocks of one of the compressed formats
+// Every level is packed one after another with no row padding
+// The data pointer either points into pixels (after Build) or straight into a mapped file (see TextureCache and TextureFile)
+struct MipChain
+{
+	MipChain();
+
+	// Works out the size and offset of every level for a top level of the given size
+	// numLevels of 0 goes all the way down to 1x1
+	// Returns the bytes needed for all of them
+	size_t Layout( unsigned int width, unsigned int height, TextureFormat format = TEXTURE_FORMAT_RGBA8, unsigned int numLevels = 0 );
+
+	// Makes every level from the top one, which is copied in first, as RGBA8
+	// Levels are filtered in linear colour rather than sRGB, so averaging doesn't darken them
+	// numThreads of 0 uses one thread per core, useSimd false runs the plain C++ version, which gives exactly the same bytes
+	void Build( const unsigned char *rgba, unsigned int width, unsigned int height, unsigned int numThreads = 0, bool useSimd = true );
+
+	const unsigned char* GetLevelData( unsigned int level ) const { return data + levels[level].offset; }
+
+	unsigned int width, height;
+	TextureFormat format;
+	std::vector<MipLevel> levels;
+	const unsigned char *data;
+	size_t dataSize;
+
+	// Storage for a chain built in memory, unused when the data comes from a cache file
+	// The data pointer points in here, so don't copy a MipChain after building it
+	std::vector<unsigned char> pixels;
+};
+
+#endif
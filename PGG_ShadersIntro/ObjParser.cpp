@@ -0,0 +1,432 @@
+
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+
+// Helpers for walking through the text
+// All of these stop at 'end' and never read past it, as mapped files are not NULL-terminated
+
+static inline bool IsSpace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit( char c )
+{
+	return (unsigned char)( c - '0' ) < 10;
+}
+
+static inline const char* SkipSpaces( const char *p, const char *end )
+{
+	while( p < end && IsSpace( *p ) )
+	{
+		p++;
+	}
+	return p;
+}
+
+// Returns the start of the next line
+static inline const char* SkipLine( const char *p, const char *end )
+{
+	const char *newline = (const char*) memchr( p, '\n', end - p );
+	return newline ? newline + 1 : end;
+}
+
+// Parses a (possibly signed) integer, returns 0 if there isn't one
+static inline int ParseInt( const char *&p, const char *end )
+{
+	bool negative = false;
+	if( p < end && ( *p == '-' || *p == '+' ) )
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	int value = 0;
+	while( p < end && IsDigit( *p ) )
+	{
+		value = value * 10 + ( *p - '0' );
+		p++;
+	}
+	return negative ? -value : value;
+}
+
+// Parses a decimal float such as -1.5, .25 or 3.2e-05
+// Returns 0 if there isn't a number, which matches what the old stream based loader did
+static inline float ParseFloat( const char *&p, const char *end )
+{
+	// Exact powers of ten that fit in a double
+	static const double powersOfTen[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	bool negative = false;
+	if( p < end && ( *p == '-' || *p == '+' ) )
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	// Gather up to 19 significant digits, which always fit in 64 bits
+	unsigned long long mantissa = 0;
+	int numDigits = 0;
+	int exponent = 0;
+	while( p < end && IsDigit( *p ) )
+	{
+		if( numDigits < 19 )
+		{
+			mantissa = mantissa * 10 + ( *p - '0' );
+			if( mantissa != 0 )
+			{
+				numDigits++;
+			}
+		}
+		else
+		{
+			// Digits we can't store still scale the number
+			exponent++;
+		}
+		p++;
+	}
+	if( p < end && *p == '.' )
+	{
+		p++;
+		while( p < end && IsDigit( *p ) )
+		{
+			if( numDigits < 19 )
+			{
+				mantissa = mantissa * 10 + ( *p - '0' );
+				if( mantissa != 0 )
+				{
+					numDigits++;
+				}
+				exponent--;
+			}
+			p++;
+		}
+	}
+	if( p < end && ( *p == 'e' || *p == 'E' ) )
+	{
+		p++;
+		exponent += ParseInt( p, end );
+	}
+
+	double value = (double) mantissa;
+	if( exponent < 0 )
+	{
+		// Dividing by an exact power of ten keeps this correctly rounded for typical OBJ values
+		while( exponent < -22 )
+		{
+			value /= powersOfTen[22];
+			exponent += 22;
+		}
+		value /= powersOfTen[-exponent];
+	}
+	else
+	{
+		while( exponent > 22 )
+		{
+			value *= powersOfTen[22];
+			exponent -= 22;
+		}
+		value *= powersOfTen[exponent];
+	}
+
+	return (float) ( negative ? -value : value );
+}
+
+// Reads one face corner, in any of the forms: p  p/t  p//n  p/t/n
+// Indices that are missing are left at 0
+static inline void ParseFaceCorner( const char *&p, const char *end, int &posID, int &uvID, int &normID )
+{
+	posID = ParseInt( p, end );
+	uvID = 0;
+	normID = 0;
+	if( p < end && *p == '/' )
+	{
+		p++;
+		if( p < end && *p != '/' )
+		{
+			uvID = ParseInt( p, end );
+		}
+		if( p < end && *p == '/' )
+		{
+			p++;
+			normID = ParseInt( p, end );
+		}
+	}
+}
+
+// Checks the line starts with the given keyword followed by whitespace
+static inline bool MatchKeyword( const char *p, const char *end, const char *keyword, size_t length )
+{
+	return (size_t)( end - p ) > length && !memcmp( p, keyword, length ) && IsSpace( p[length] );
+}
+
+
+// Converts an OBJ index to a 0-based one
+// Positive indices count from the start of the file, negative ones count back from the last element defined before this line
+// Returns -1 if the index is missing (0) or falls outside the array
+static inline int ResolveIndex( int objIndex, unsigned int numDefinedSoFar, unsigned int numTotal )
+{
+	long long index;
+	if( objIndex > 0 )
+	{
+		index = (long long) objIndex - 1;
+	}
+	else if( objIndex < 0 )
+	{
+		index = (long long) numDefinedSoFar + objIndex;
+	}
+	else
+	{
+		return -1;
+	}
+	return ( index >= 0 && index < numTotal ) ? (int) index : -1;
+}
+
+
+// One newline-aligned piece of the file
+// Each chunk is parsed independently and the results are stitched together in file order
+struct ObjChunk
+{
+	const char *begin, *end;
+
+	// Counted in the first pass
+	unsigned int numPositions, numUVs, numNormals, numFaces;
+
+	// Where this chunk's elements start in the whole-file arrays
+	unsigned int positionBase, uvBase, normalBase;
+
+	// Resolved 0-based (pos, uv, normal) indices for every face corner, -1 where missing
+	std::vector<int> corners;
+	unsigned int numCornerPositions, numCornerUVs, numCornerNormals;
+	unsigned int cornerPositionBase, cornerUVBase, cornerNormalBase;
+
+	bool foundQuad;
+};
+
+// First pass: count how many of each element the chunk holds, so every chunk knows where its data goes
+static void CountChunk( ObjChunk &chunk )
+{
+	chunk.numPositions = chunk.numUVs = chunk.numNormals = chunk.numFaces = 0;
+
+	const char *p = chunk.begin;
+	const char *end = chunk.end;
+	while( p < end )
+	{
+		p = SkipSpaces( p, end );
+
+		if( MatchKeyword( p, end, "vt", 2 ) )
+		{
+			chunk.numUVs++;
+		}
+		else if( MatchKeyword( p, end, "vn", 2 ) )
+		{
+			chunk.numNormals++;
+		}
+		else if( MatchKeyword( p, end, "v", 1 ) )
+		{
+			chunk.numPositions++;
+		}
+		else if( MatchKeyword( p, end, "f", 1 ) )
+		{
+			chunk.numFaces++;
+		}
+
+		p = SkipLine( p, end );
+	}
+}
+
+// Second pass: read the vertex data straight into the whole-file arrays and resolve the face indices
+static void ParseChunk( ObjChunk &chunk, glm::vec3 *rawPositionData, glm::vec2 *rawUVData, glm::vec3 *rawNormalData,
+	unsigned int totalPositions, unsigned int totalUVs, unsigned int totalNormals )
+{
+	chunk.corners.resize( chunk.numFaces * 9 );
+	chunk.numCornerPositions = chunk.numCornerUVs = chunk.numCornerNormals = 0;
+	chunk.foundQuad = false;
+
+	// Running counts, as relative indices are based on what has been defined so far
+	unsigned int numPositions = chunk.positionBase;
+	unsigned int numUVs = chunk.uvBase;
+	unsigned int numNormals = chunk.normalBase;
+	int *corner = chunk.corners.empty() ? NULL : &chunk.corners[0];
+
+	const char *p = chunk.begin;
+	const char *end = chunk.end;
+	while( p < end )
+	{
+		p = SkipSpaces( p, end );
+
+		if( MatchKeyword( p, end, "vt", 2 ) )
+		{
+			p = SkipSpaces( p + 2, end );
+			glm::vec2 &uv = rawUVData[numUVs++];
+			uv.x = ParseFloat( p, end );
+			p = SkipSpaces( p, end );
+			uv.y = ParseFloat( p, end );
+		}
+		else if( MatchKeyword( p, end, "vn", 2 ) )
+		{
+			p = SkipSpaces( p + 2, end );
+			glm::vec3 &normal = rawNormalData[numNormals++];
+			normal.x = ParseFloat( p, end );
+			p = SkipSpaces( p, end );
+			normal.y = ParseFloat( p, end );
+			p = SkipSpaces( p, end );
+			normal.z = ParseFloat( p, end );
+		}
+		else if( MatchKeyword( p, end, "v", 1 ) )
+		{
+			p = SkipSpaces( p + 1, end );
+			glm::vec3 &position = rawPositionData[numPositions++];
+			position.x = ParseFloat( p, end );
+			p = SkipSpaces( p, end );
+			position.y = ParseFloat( p, end );
+			p = SkipSpaces( p, end );
+			position.z = ParseFloat( p, end );
+		}
+		else if( MatchKeyword( p, end, "f", 1 ) )
+		{
+			p = SkipSpaces( p + 1, end );
+			for( unsigned int i = 0; i < 3; i++ )
+			{
+				int posID, uvID, normID;
+				ParseFaceCorner( p, end, posID, uvID, normID );
+				p = SkipSpaces( p, end );
+
+				// Indices outside the arrays are ignored rather than read out of bounds
+				corner[0] = ResolveIndex( posID, numPositions, totalPositions );
+				corner[1] = ResolveIndex( uvID, numUVs, totalUVs );
+				corner[2] = ResolveIndex( normID, numNormals, totalNormals );
+				chunk.numCornerPositions += corner[0] >= 0;
+				chunk.numCornerUVs += corner[1] >= 0;
+				chunk.numCornerNormals += corner[2] >= 0;
+				corner += 3;
+			}
+
+			// Anything left on the line means this is a quad (or bigger)
+			if( p < end && *p != '\n' )
+			{
+				chunk.foundQuad = true;
+				return;
+			}
+		}
+
+		p = SkipLine( p, end );
+	}
+}
+
+// Third pass: look up the vertex data for every face corner, writing into this chunk's part of the output
+static void GatherChunk( const ObjChunk &chunk, const std::vector<glm::vec3> &rawPositionData, const std::vector<glm::vec2> &rawUVData,
+	const std::vector<glm::vec3> &rawNormalData, ObjMeshData &output )
+{
+	glm::vec3 *positions = output.positions.empty() ? NULL : &output.positions[chunk.cornerPositionBase];
+	glm::vec2 *uvs = output.uvs.empty() ? NULL : &output.uvs[chunk.cornerUVBase];
+	glm::vec3 *normals = output.normals.empty() ? NULL : &output.normals[chunk.cornerNormalBase];
+
+	for( size_t i = 0; i < chunk.corners.size(); i += 3 )
+	{
+		if( chunk.corners[i] >= 0 )
+		{
+			*positions++ = rawPositionData[chunk.corners[i]];
+		}
+		if( chunk.corners[i+1] >= 0 )
+		{
+			*uvs++ = rawUVData[chunk.corners[i+1]];
+		}
+		if( chunk.corners[i+2] >= 0 )
+		{
+			*normals++ = rawNormalData[chunk.corners[i+2]];
+		}
+	}
+}
+
+
+bool ObjParser::Parse( const char *begin, const char *end, ObjMeshData &output, unsigned int numThreads )
+{
+	output.positions.clear();
+	output.normals.clear();
+	output.uvs.clear();
+
+	size_t fileSize = end - begin;
+	if( numThreads == 0 )
+	{
+		// Threads only pay for themselves on bigger files, so give each one at least a megabyte
+		numThreads = std::max( 1u, std::min( std::thread::hardware_concurrency(), (unsigned int)( fileSize >> 20 ) + 1 ) );
+	}
+
+	// Split the file into newline-aligned chunks
+	// Using a few more chunks than threads evens out the load when some parts of the file are slower to parse
+	unsigned int numChunks = numThreads == 1 ? 1 : numThreads * 4;
+	std::vector<ObjChunk> chunks;
+	const char *chunkStart = begin;
+	for( unsigned int i = 1; i <= numChunks && chunkStart < end; i++ )
+	{
+		const char *chunkEnd = i == numChunks ? end : SkipLine( std::max( chunkStart, begin + fileSize * i / numChunks ), end );
+
+		ObjChunk chunk = ObjChunk();
+		chunk.begin = chunkStart;
+		chunk.end = chunkEnd;
+		chunks.push_back( chunk );
+
+		chunkStart = chunkEnd;
+	}
+	numChunks = (unsigned int) chunks.size();
+
+	ThreadPool pool( std::min( numThreads, std::max( numChunks, 1u ) ) );
+
+	// Count everything so each chunk knows where its vertex data starts
+	pool.ParallelFor( numChunks, [&]( unsigned int i ){ CountChunk( chunks[i] ); } );
+
+	unsigned int totalPositions = 0, totalUVs = 0, totalNormals = 0;
+	for( unsigned int i = 0; i < numChunks; i++ )
+	{
+		chunks[i].positionBase = totalPositions;
+		chunks[i].uvBase = totalUVs;
+		chunks[i].normalBase = totalNormals;
+		totalPositions += chunks[i].numPositions;
+		totalUVs += chunks[i].numUVs;
+		totalNormals += chunks[i].numNormals;
+	}
+
+	// OBJ files can store texture coordinates, positions and normals
+	std::vector<glm::vec2> rawUVData( totalUVs );
+	std::vector<glm::vec3> rawPositionData( totalPositions );
+	std::vector<glm::vec3> rawNormalData( totalNormals );
+
+	pool.ParallelFor( numChunks, [&]( unsigned int i )
+	{
+		ParseChunk( chunks[i], rawPositionData.empty() ? NULL : &rawPositionData[0], rawUVData.empty() ? NULL : &rawUVData[0],
+			rawNormalData.empty() ? NULL : &rawNormalData[0], totalPositions, totalUVs, totalNormals );
+	} );
+
+	unsigned int totalCornerPositions = 0, totalCornerUVs = 0, totalCornerNormals = 0;
+	for( unsigned int i = 0; i < numChunks; i++ )
+	{
+		if( chunks[i].foundQuad )
+		{
+			std::cerr<<"WARNING: This OBJ loader only works with triangles but a quad has been detected. Please triangulate your mesh."<<std::endl;
+			return false;
+		}
+		chunks[i].cornerPositionBase = totalCornerPositions;
+		chunks[i].cornerUVBase = totalCornerUVs;
+		chunks[i].cornerNormalBase = totalCornerNormals;
+		totalCornerPositions += chunks[i].numCornerPositions;
+		totalCornerUVs += chunks[i].numCornerUVs;
+		totalCornerNormals += chunks[i].numCornerNormals;
+	}
+
+	output.positions.resize( totalCornerPositions );
+	output.uvs.resize( totalCornerUVs );
+	output.normals.resize( totalCornerNormals );
+
+	pool.ParallelFor( numChunks, [&]( unsigned int i ){ GatherChunk( chunks[i], rawPositionData, rawUVData, rawNormalData, output ); } );
+
+	return true;
+}
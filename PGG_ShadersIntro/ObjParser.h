@@ -0,0 +1,32 @@
+
+#ifndef __OBJ_PARSER__
+#define __OBJ_PARSER__
+
+#include <GLM/glm.hpp>
+#include <vector>
+
+// Geometry read from an OBJ file
+// Every face corner has been looked up, so each group of three positions makes a triangle
+struct ObjMeshData
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+};
+
+// Parses OBJ text straight out of memory (e.g. a MappedFile)
+// The text is tokenised in place with hand-written number parsing, so there are no per-line allocations or locale lookups
+// Big files can be split into newline-aligned chunks and parsed on several threads
+class ObjParser
+{
+public:
+
+	// Parses the characters in [begin, end)
+	// OBJ file must be triangulated
+	// numThreads of 0 picks a count based on the file size, 1 parses on the calling thread only
+	// The output is the same whatever the thread count
+	// Returns false if the mesh can't be used - it will also print out messages to console
+	static bool Parse( const char *begin, const char *end, ObjMeshData &output, unsigned int numThreads = 0 );
+};
+
+#endif
@@ -0,0 +1,154 @@
+
+#include "ProgramCache.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include <sstream>
+
+
+// Bump this whenever the layout of the file changes, so old caches get rebuilt
+static const unsigned int PROGRAM_CACHE_VERSION = 1;
+
+// Start of every .sprog file, the driver's binary follows straight after
+struct ProgramCacheHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned long long key;
+	unsigned int binaryFormat;
+	unsigned int binarySize;
+};
+
+// Filename without its folder or extension
+static std::string GetBaseName( const std::string &filename )
+{
+	size_t slash = filename.find_last_of( "/\\" );
+	size_t start = ( slash == std::string::npos ) ? 0 : slash + 1;
+	size_t dot = filename.find_last_of( '.' );
+	if( dot == std::string::npos || dot < start )
+	{
+		dot = filename.size();
+	}
+	return filename.substr( start, dot - start );
+}
+
+
+bool ProgramCache::IsSupported()
+{
+	// Part of core OpenGL since 4.1, but a driver is allowed to support no binary formats at all
+	if( glGetProgramBinary == NULL || glProgramBinary == NULL || glProgramParameteri == NULL )
+	{
+		return false;
+	}
+	GLint numFormats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+	return numFormats > 0;
+}
+
+std::string ProgramCache::GetCachePath( const std::string &vertFilename, const std::string &fragFilename, const std::string &variant )
+{
+	// Next to the vertex shader, named after both, plus a hash of the variant if there is one
+	size_t slash = vertFilename.find_last_of( "/\\" );
+	std::string folder = ( slash == std::string::npos ) ? "" : vertFilename.substr( 0, slash + 1 );
+	std::string path = folder + GetBaseName( vertFilename ) + ( fragFilename.empty() ? "" : "_" + GetBaseName( fragFilename ) );
+	if( !variant.empty() )
+	{
+		std::ostringstream variantHash;
+		variantHash<<"_"<<std::hex<<HashString( variant );
+		path += variantHash.str();
+	}
+	return path + ".sprog";
+}
+
+unsigned long long ProgramCache::GetKey( const std::string &vertSource, const std::string &fragSource )
+{
+	unsigned long long key = HashString( fragSource, HashString( vertSource ) );
+
+	// GL_VERSION includes the driver version, so updating the driver changes the key
+	GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for( unsigned int i = 0; i < 3; i++ )
+	{
+		const char *text = (const char*) glGetString( strings[i] );
+		if( text != NULL )
+		{
+			key = HashBytes( text, strlen( text ), key );
+		}
+	}
+	return key;
+}
+
+bool ProgramCache::Load( const std::string &cachePath, unsigned long long key, GLuint program )
+{
+	MappedFile cacheFile;
+	if( !cacheFile.Open( cachePath ) || cacheFile.GetSize() < sizeof( ProgramCacheHeader ) )
+	{
+		return false;
+	}
+
+	ProgramCacheHeader header;
+	memcpy( &header, cacheFile.GetData(), sizeof( header ) );
+	if( memcmp( header.magic, "SPRG", 4 ) != 0 || header.version != PROGRAM_CACHE_VERSION || header.key != key
+		|| sizeof( header ) + header.binarySize > cacheFile.GetSize() )
+	{
+		return false;
+	}
+
+	// The driver has the final say, it can turn a binary down for any reason
+	glProgramBinary( program, header.binaryFormat, cacheFile.GetData() + sizeof( header ), header.binarySize );
+	// A format it doesn't know is a GL error rather than a failed link, don't leave that lying around
+	glGetError();
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &linked );
+	return linked == GL_TRUE;
+}
+
+bool ProgramCache::Save( const std::string &cachePath, unsigned long long key, GLuint program )
+{
+	GLint binarySize = 0;
+	glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &binarySize );
+	if( binarySize <= 0 )
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> binary( binarySize );
+	GLenum binaryFormat = 0;
+	glGetProgramBinary( program, binarySize, &binarySize, &binaryFormat, &binary[0] );
+	if( binarySize <= 0 )
+	{
+		return false;
+	}
+
+	ProgramCacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, "SPRG", 4 );
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	header.binaryFormat = binaryFormat;
+	header.binarySize = binarySize;
+
+	// Write to a temporary file first, so a crash part way through never leaves a broken cache behind
+	std::string tempPath = cachePath + ".tmp";
+	FILE *file = fopen( tempPath.c_str(), "wb" );
+	if( file == NULL )
+	{
+		std::cerr<<"WARNING: Could not write program cache: "<<cachePath<<std::endl;
+		return false;
+	}
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+	ok = ok && fwrite( &binary[0], 1, binarySize, file ) == (size_t) binarySize;
+	ok = ( fclose( file ) == 0 ) && ok;
+
+	remove( cachePath.c_str() );
+	if( !ok || rename( tempPath.c_str(), cachePath.c_str() ) != 0 )
+	{
+		remove( tempPath.c_str() );
+		std::cerr<<"WARNING: Could not write program cache: "<<cachePath<<std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+
+#ifndef __PROGRAM_CACHE__
+#define __PROGRAM_CACHE__
+
+#include "glew.h"
+#include <string>
+
+// Reads and writes .sprog files, the driver's own compiled copy of a linked program (glGetProgramBinary)
+// Loading one skips compiling and linking, which is most of the cost of a shader at start-up
+// Binaries only work on the driver that made them, so the key covers the GPU and driver version as well as the sources
+class ProgramCache
+{
+public:
+
+	// True if the driver can save and load program binaries at all
+	static bool IsSupported();
+
+	// Where the binary for a pair of shaders lives, e.g. Resources/vertShader_fragShader.sprog
+	// Compute programs have no fragment shader, and are just named after the one file
+	// Each variant (see JoinShaderDefines) gets its own file, so they don't keep replacing each other
+	static std::string GetCachePath( const std::string &vertFilename, const std::string &fragFilename, const std::string &variant = std::string() );
+
+	// Hash of both sources, GL_VENDOR, GL_RENDERER and GL_VERSION
+	static unsigned long long GetKey( const std::string &vertSource, const std::string &fragSource );
+
+	// Gives the program the cached binary, if there is one with this key
+	// Returns false if there isn't, or if the driver won't take it (e.g. after a driver update), leaving the program unlinked
+	static bool Load( const std::string &cachePath, unsigned long long key, GLuint program );
+
+	// Saves a linked program's binary - it must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	static bool Save( const std::string &cachePath, unsigned long long key, GLuint program );
+};
+
+#endif
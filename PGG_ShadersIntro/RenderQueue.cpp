@@ -0,0 +1,350 @@
+
+#include "RenderQueue.h"
+#include "Material.h"
+#include "GLState.h"
+#include <cstring>
+
+
+// Where each part of the key starts, and how many bits it gets
+static const unsigned int KEY_PASS_SHIFT = 60;
+static const unsigned int KEY_PROGRAM_SHIFT = 48;
+static const unsigned int KEY_MATERIAL_SHIFT = 36;
+static const unsigned int KEY_MESH_SHIFT = 24;
+static const unsigned int KEY_LOD_SHIFT = 20;
+static const unsigned long long KEY_ID_MASK = 0xFFF;
+static const unsigned long long KEY_LOD_MASK = 0xF;
+static const unsigned long long KEY_DEPTH_MASK = 0xFFFFF;
+
+// Keeps the order of depths in 20 bits
+// A positive float's bits sort the same way as the float, so the top 20 of them do too
+static unsigned long long DepthBits( float depth )
+{
+	if( !( depth > 0.0f ) )
+	{
+		return 0;
+	}
+	unsigned int bits;
+	memcpy( &bits, &depth, sizeof( bits ) );
+	return ( bits >> 12 ) & KEY_DEPTH_MASK;
+}
+
+
+RenderQueue::RenderQueue()
+{
+	memset( &_stats, 0, sizeof( _stats ) );
+	_instanceBuffer = 0;
+	_instanceBufferSize = 0;
+	_commandBuffer = 0;
+	_commandBufferSize = 0;
+	_drawnInstanceBuffer = 0;
+	_drawnInstanceBufferSize = 0;
+	_gpuCulling = false;
+	_cullObjectBuffer = 0;
+	_cullObjectBufferSize = 0;
+	for( unsigned int p = 0; p < RENDER_PASS_COUNT; p++ )
+	{
+		_passFirst[p] = 0;
+		_passCount[p] = 0;
+	}
+}
+
+RenderQueue::~RenderQueue()
+{
+	glDeleteBuffers( 1, &_instanceBuffer );
+	glDeleteBuffers( 1, &_commandBuffer );
+	glDeleteBuffers( 1, &_drawnInstanceBuffer );
+	glDeleteBuffers( 1, &_cullObjectBuffer );
+	VertexFormat::ReleaseInstanceIndices();
+}
+
+void RenderQueue::Clear()
+{
+	_items.clear();
+	_entries.clear();
+	_commands.clear();
+	_groups.clear();
+	_cullObjects.clear();
+	_stateMaterials.clear();
+	for( unsigned int p = 0; p < RENDER_PASS_COUNT; p++ )
+	{
+		_passFirst[p] = 0;
+		_passCount[p] = 0;
+	}
+	memset( &_stats, 0, sizeof( _stats ) );
+}
+
+unsigned int RenderQueue::GetId( const void *object )
+{
+	std::map<const void*, unsigned int>::iterator found = _ids.find( object );
+	if( found != _ids.end() )
+	{
+		return found->second;
+	}
+	// Ids wrap around after 4096, which only makes sorting a little less good
+	unsigned int id = (unsigned int) ( _ids.size() & KEY_ID_MASK );
+	_ids[object] = id;
+	return id;
+}
+
+unsigned int RenderQueue::GetStateId( const Material *material )
+{
+	// Scenes have few enough materials that looking through them all is cheaper than anything cleverer
+	for( size_t i = 0; i < _stateMaterials.size(); i++ )
+	{
+		if( _stateMaterials[i]->SharesStateWith( *material ) )
+		{
+			return GetId( _stateMaterials[i] );
+		}
+	}
+	_stateMaterials.push_back( material );
+	return GetId( material );
+}
+
+void RenderQueue::Submit( RenderPass pass, Material *material, Mesh *mesh, unsigned int lod, const glm::mat4 &modelMatrix, const glm::vec4 &colour,
+	const MeshletView &view, float depth )
+{
+	const ShaderProgram *program = material->GetShaderProgram();
+	unsigned long long programId = program ? program->GetHandle() : 0;
+
+	SortEntry entry;
+	entry.key = ( (unsigned long long) pass << KEY_PASS_SHIFT )
+		| ( ( programId & KEY_ID_MASK ) << KEY_PROGRAM_SHIFT )
+		| ( (unsigned long long) GetStateId( material ) << KEY_MATERIAL_SHIFT )
+		| ( (unsigned long long) GetId( mesh ) << KEY_MESH_SHIFT )
+		| ( ( (unsigned long long) lod & KEY_LOD_MASK ) << KEY_LOD_SHIFT )
+		| DepthBits( depth );
+	entry.item = (unsigned int) _items.size();
+	_entries.push_back( entry );
+
+	const VertexDecode &decode = mesh->GetVertexDecode();
+	InstanceData instance;
+	instance.modelMatrix = modelMatrix;
+	instance.colour = colour;
+	instance.positionDecodeScale = glm::vec4( decode.positionScale, decode.octNormals ? 1.0f : 0.0f );
+	instance.positionDecodeOffset = glm::vec4( decode.positionOffset, 0.0f );
+	instance.uvDecode = glm::vec4( decode.uvScale, decode.uvOffset );
+	instance.textureLayer = material->UpdateTextureLayer();
+	instance.padding[0] = 0;
+	instance.padding[1] = 0;
+	instance.padding[2] = 0;
+	_items.push_back( RenderItem( material, mesh, lod, instance, view ) );
+}
+
+void RenderQueue::Sort()
+{
+	// Radix sort, a byte at a time starting with the lowest
+	// Each pass is stable, so the order from the lower bytes is kept wherever the higher ones are the same
+	_sortBuffer.resize( _entries.size() );
+	for( unsigned int shift = 0; shift < 64; shift += 8 )
+	{
+		unsigned int counts[256] = { 0 };
+		for( size_t i = 0; i < _entries.size(); i++ )
+		{
+			counts[( _entries[i].key >> shift ) & 0xFF]++;
+		}
+
+		// If every key has the same byte here, this pass wouldn't move anything
+		if( counts[( _entries.empty() ? 0 : _entries[0].key >> shift ) & 0xFF] == _entries.size() )
+		{
+			continue;
+		}
+
+		// Turn the counts into where each byte value's run starts
+		unsigned int offset = 0;
+		for( unsigned int b = 0; b < 256; b++ )
+		{
+			unsigned int count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+		for( size_t i = 0; i < _entries.size(); i++ )
+		{
+			_sortBuffer[counts[( _entries[i].key >> shift ) & 0xFF]++] = _entries[i];
+		}
+		_entries.swap( _sortBuffer );
+	}
+
+	// Instance data goes in the sorted order, so every command's instances are one run of the buffer
+	_instances.resize( _entries.size() );
+	_drawnInstances.resize( _entries.size() );
+	for( size_t i = 0; i < _entries.size(); i++ )
+	{
+		_instances[i] = _items[_entries[i].item].instance;
+		_drawnInstances[i] = (GLuint) i;
+
+		// The pass is the top of the key, so each pass's objects are one run
+		RenderPass pass = (RenderPass) ( _entries[i].key >> KEY_PASS_SHIFT );
+		if( _passCount[pass] == 0 )
+		{
+			_passFirst[pass] = (unsigned int) i;
+		}
+		_passCount[pass]++;
+	}
+	if( _instances.empty() )
+	{
+		return;
+	}
+	BuildDraws();
+
+	UploadStreamed( GL_SHADER_STORAGE_BUFFER, _instanceBuffer, _instanceBufferSize, &_instances[0], _instances.size() * sizeof( InstanceData ) );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, _instanceBuffer );
+	UploadStreamed( GL_SHADER_STORAGE_BUFFER, _drawnInstanceBuffer, _drawnInstanceBufferSize, &_drawnInstances[0], _drawnInstances.size() * sizeof( GLuint ) );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, DRAWN_INSTANCE_BUFFER_BINDING, _drawnInstanceBuffer );
+
+	if( _gpuCulling )
+	{
+		// The cull shader counts the instances back up as it finds them visible
+		for( size_t c = 0; c < _commands.size(); c++ )
+		{
+			_commands[c].instanceCount = 0;
+		}
+		UploadStreamed( GL_SHADER_STORAGE_BUFFER, _cullObjectBuffer, _cullObjectBufferSize, &_cullObjects[0], _cullObjects.size() * sizeof( CullObject ) );
+	}
+	if( !_commands.empty() )
+	{
+		UploadStreamed( GL_DRAW_INDIRECT_BUFFER, _commandBuffer, _commandBufferSize, &_commands[0], _commands.size() * sizeof( DrawCommand ) );
+	}
+	VertexFormat::ReserveInstanceIndices( (unsigned int) _instances.size() );
+}
+
+void RenderQueue::GetPassRange( RenderPass pass, unsigned int &first, unsigned int &count ) const
+{
+	first = _passFirst[pass];
+	count = _passCount[pass];
+}
+
+void RenderQueue::UploadStreamed( GLenum target, GLuint &buffer, size_t &bufferSize, const void *data, size_t bytes )
+{
+	if( buffer == 0 )
+	{
+		glGenBuffers( 1, &buffer );
+	}
+	glBindBuffer( target, buffer );
+	if( bytes > bufferSize )
+	{
+		// Grow by half as much again, so a slowly growing scene doesn't reallocate every frame
+		bufferSize = bytes + bytes / 2;
+	}
+	// Giving glBufferData a new store each frame means the driver never waits for last frame's draws to finish with the old one
+	glBufferData( target, bufferSize, NULL, GL_STREAM_DRAW );
+	glBufferSubData( target, 0, bytes, data );
+	glBindBuffer( target, 0 );
+}
+
+void RenderQueue::BuildDraws()
+{
+	size_t i = 0;
+	while( i < _entries.size() )
+	{
+		RenderItem &item = _items[_entries[i].item];
+		RenderPass pass = (RenderPass) ( _entries[i].key >> KEY_PASS_SHIFT );
+
+		// Everything after this with the same material state, mesh and level of detail joins the same command
+		size_t batchEnd = i + 1;
+		while( batchEnd < _entries.size() )
+		{
+			const RenderItem &next = _items[_entries[batchEnd].item];
+			if( ( _entries[batchEnd].key >> KEY_PASS_SHIFT ) != (unsigned long long) pass
+				|| next.mesh != item.mesh || next.lod != item.lod || !next.material->SharesStateWith( *item.material ) )
+			{
+				break;
+			}
+			batchEnd++;
+		}
+		unsigned int instanceCount = (unsigned int) ( batchEnd - i );
+
+		// The batch's instances start at its position in the sorted order
+		unsigned int firstCommand = (unsigned int) _commands.size();
+		item.mesh->AddDrawCommands( item.lod, &item.view, instanceCount, (GLuint) i, _commands );
+		unsigned int numCommands = (unsigned int) _commands.size() - firstCommand;
+
+		if( _gpuCulling )
+		{
+			// Every object of the batch is tested on its own, and adds itself to the batch's commands if it's visible
+			glm::vec3 boundsMin = item.mesh->GetBoundsMin();
+			glm::vec3 boundsMax = item.mesh->GetBoundsMax();
+			CullObject cullObject;
+			cullObject.sphere = glm::vec4( ( boundsMin + boundsMax ) * 0.5f, glm::length( boundsMax - boundsMin ) * 0.5f );
+			cullObject.firstCommand = firstCommand;
+			cullObject.numCommands = numCommands;
+			cullObject.padding[0] = 0;
+			cullObject.padding[1] = 0;
+			_cullObjects.insert( _cullObjects.end(), instanceCount, cullObject );
+		}
+
+		// The shadow pass draws positions only
+		GLuint vertexArray = item.mesh->GetVertexArray( pass == RENDER_PASS_SHADOW );
+		GLenum indexType = item.mesh->GetIndexType();
+
+		// Commands follow on from the last group's when nothing has to change between them
+		// Sorting by program then material puts the ones that can next to each other
+		DrawGroup *last = _groups.empty() ? NULL : &_groups.back();
+		if( last != NULL && last->pass == pass && last->vertexArray == vertexArray && last->indexType == indexType
+			&& last->material->SharesStateWith( *item.material ) )
+		{
+			last->numCommands += numCommands;
+			last->numObjects += instanceCount;
+		}
+		else
+		{
+			DrawGroup group;
+			group.pass = pass;
+			group.material = item.material;
+			group.vertexArray = vertexArray;
+			group.indexType = indexType;
+			group.firstCommand = firstCommand;
+			group.numCommands = numCommands;
+			group.numObjects = instanceCount;
+			_groups.push_back( group );
+		}
+		i = batchEnd;
+	}
+}
+
+void RenderQueue::Execute( RenderPass pass )
+{
+	const Material *currentMaterial = NULL;
+	const ShaderProgram *currentProgram = NULL;
+	GLuint currentVertexArray = 0;
+
+	// Every pass reads its commands from the one buffer, at its own offsets
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, _commandBuffer );
+	for( size_t g = 0; g < _groups.size(); g++ )
+	{
+		const DrawGroup &group = _groups[g];
+		if( group.pass != pass )
+		{
+			continue;
+		}
+		_stats.draws += group.numObjects;
+		if( group.numCommands == 0 )
+		{
+			// Every meshlet was culled
+			continue;
+		}
+
+		// Only where the group's state differs from the last does anything need setting
+		if( group.material != currentMaterial )
+		{
+			if( group.material->GetShaderProgram() != currentProgram )
+			{
+				currentProgram = group.material->GetShaderProgram();
+				_stats.programSwitches++;
+			}
+			group.material->Apply();
+			currentMaterial = group.material;
+			_stats.materialSwitches++;
+		}
+		if( group.vertexArray != currentVertexArray )
+		{
+			GLState::BindVertexArray( group.vertexArray );
+			currentVertexArray = group.vertexArray;
+			_stats.vertexArraySwitches++;
+		}
+
+		glMultiDrawElementsIndirect( GL_TRIANGLES, group.indexType, (const void*) ( group.firstCommand * sizeof( DrawCommand ) ), group.numCommands, 0 );
+		_stats.commands += group.numCommands;
+		_stats.drawCalls++;
+	}
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+}
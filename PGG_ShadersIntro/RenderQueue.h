@@ -0,0 +1,210 @@
+
+#ifndef __RENDER_QUEUE__
+#define __RENDER_QUEUE__
+
+#include "Meshlets.h"
+#include "Mesh.h"
+#include "glew.h"
+#include <GLM/glm.hpp>
+#include <map>
+#include <vector>
+
+class Material;
+
+// The passes a frame is drawn in, in the order they're drawn
+enum RenderPass
+{
+	RENDER_PASS_SHADOW = 0,
+	RENDER_PASS_MAIN = 1,
+	RENDER_PASS_COUNT = 2
+};
+
+// Shader storage binding points of the instance buffer and the list of instances each command draws, see Resources/instances.txt
+const GLuint INSTANCE_BUFFER_BINDING = 0;
+const GLuint DRAWN_INSTANCE_BUFFER_BINDING = 1;
+
+// One object's entry in the instance buffer
+// Laid out the same as InstanceData in Resources/instances.txt, std430 packs this with no gaps
+struct InstanceData
+{
+	glm::mat4 modelMatrix;
+	glm::vec4 colour;
+
+	// The mesh's VertexDecode, packed into vec4s
+	// w of positionDecodeScale is 1 for octahedron encoded normals, uvDecode is the uv scale then offset
+	glm::vec4 positionDecodeScale;
+	glm::vec4 positionDecodeOffset;
+	glm::vec4 uvDecode;
+
+	// Layer of the material's texture array or id of its virtual texture, -1 for the material's own texture (see Material::GetTextureLayer)
+	GLint textureLayer;
+	GLint padding[3];
+};
+
+// What the cull shader needs to know about each object, in the same order as the instance buffer
+// Laid out the same as CullObject in Resources/cullCompShader.txt
+struct CullObject
+{
+	// Model space bounding sphere, centre and radius
+	glm::vec4 sphere;
+	// The commands that draw the object
+	GLuint firstCommand;
+	GLuint numCommands;
+	GLuint padding[2];
+};
+
+// How many times the state changed between draws, counted since the last Clear
+struct RenderQueueStats
+{
+	// Objects drawn, the commands they made and the multi-draw calls those went in
+	// Objects sharing a mesh and material are one command, and every command drawn with the same state is one call
+	unsigned int draws;
+	unsigned int commands;
+	unsigned int drawCalls;
+	unsigned int programSwitches;
+	// A new material means new colours and textures, even with the same program
+	unsigned int materialSwitches;
+	// Meshes in a GeometryPool all share its VAO, so this only counts meshes with buffers of their own
+	unsigned int vertexArraySwitches;
+};
+
+// Collects a frame's draws, sorts them so draws sharing state end up next to each other, then draws them
+// Each draw gets a 64 bit key, most important bits first:
+//   pass (4 bits) | program (12) | material state (12) | mesh (12) | level of detail (4) | depth (20)
+// Materials that share state (see Material::SharesStateWith) get the same material state, e.g. ones whose textures are layers of one array
+// Sorting by the key groups draws by program, then material state, then mesh, and within that draws them front to back
+// State is then only set where the key changes, rather than for every draw
+// Objects next to each other with the same material state, mesh and level of detail are instances of one draw command,
+// reading their model matrices, colours, vertex decode and texture layers from an instance buffer filled once a frame
+// Commands are gathered into an indirect buffer, and every run of them with the same VAO and material state
+// is drawn with one glMultiDrawElementsIndirect - with the meshes in a GeometryPool, a whole pass can be one call
+class RenderQueue
+{
+public:
+
+	RenderQueue();
+	~RenderQueue();
+
+	// Empties the queue and resets the stats, ready for a new frame
+	void Clear();
+
+	// Adds a draw
+	// colour multiplies the object's lit colour, it's stored per instance so it doesn't stop objects being drawn together
+	// depth is the distance from the pass's camera, nearer draws go first so they hide more of the ones behind
+	// view is copied, it says which meshlets the pass can see when the object ends up drawn on its own
+	void Submit( RenderPass pass, Material *material, Mesh *mesh, unsigned int lod, const glm::mat4 &modelMatrix, const glm::vec4 &colour,
+		const MeshletView &view, float depth );
+
+	// Sorts everything submitted so far, builds the draw commands and uploads them with the instance buffer
+	// Call once before executing the passes
+	void Sort();
+
+	// Draws one pass's items in sorted order
+	// The shadow pass draws positions only
+	void Execute( RenderPass pass );
+
+	// Leaves culling whole objects to the GPU (see GpuCuller)
+	// Commands are then uploaded with no instances, and only draw the objects the cull shader adds to them
+	// Objects stop testing themselves against the view before they're submitted, so that cost goes from the CPU too
+	void SetGpuCulling( bool enabled ) { _gpuCulling = enabled; }
+	bool IsGpuCulling() const { return _gpuCulling; }
+
+	// What GpuCuller works on, valid after Sort
+	// Objects of a pass are a run of the instance buffer, starting at first
+	void GetPassRange( RenderPass pass, unsigned int &first, unsigned int &count ) const;
+	GLuint GetCommandBuffer() const { return _commandBuffer; }
+	GLuint GetCullObjectBuffer() const { return _cullObjectBuffer; }
+
+	const RenderQueueStats& GetStats() const { return _stats; }
+
+protected:
+
+	// The buffers can't be shared between queues
+	RenderQueue( const RenderQueue & );
+	RenderQueue& operator=( const RenderQueue & );
+
+	// Everything needed to issue one draw
+	struct RenderItem
+	{
+		RenderItem( Material *material, Mesh *mesh, unsigned int lod, const InstanceData &instance, const MeshletView &view )
+			: material( material ), mesh( mesh ), lod( lod ), instance( instance ), view( view ) {}
+
+		Material *material;
+		Mesh *mesh;
+		unsigned int lod;
+		InstanceData instance;
+		MeshletView view;
+	};
+
+	// Sorted instead of the items themselves, which are much bigger
+	struct SortEntry
+	{
+		unsigned long long key;
+		unsigned int item;
+	};
+
+	// A run of commands that are drawn in one glMultiDrawElementsIndirect
+	struct DrawGroup
+	{
+		RenderPass pass;
+		// Applied before the draw, any other material in the group shares its state
+		Material *material;
+		GLuint vertexArray;
+		GLenum indexType;
+		unsigned int firstCommand;
+		unsigned int numCommands;
+		// Objects the commands draw, for the stats
+		unsigned int numObjects;
+	};
+
+	// Small number standing in for a material or mesh in the key, the same one every frame
+	unsigned int GetId( const void *object );
+
+	// Id of the first material submitted this frame that shares the material's state, so they sort together
+	unsigned int GetStateId( const Material *material );
+
+	// Turns the sorted items into commands and groups
+	void BuildDraws();
+
+	// Copies data into a buffer that's given a new store every frame, growing it if it's too small
+	static void UploadStreamed( GLenum target, GLuint &buffer, size_t &bufferSize, const void *data, size_t bytes );
+
+	std::vector<RenderItem> _items;
+	std::vector<SortEntry> _entries;
+	// Where the radix sort puts each pass's output
+	std::vector<SortEntry> _sortBuffer;
+
+	std::map<const void*, unsigned int> _ids;
+
+	// The first material submitted this frame with each set of state
+	std::vector<const Material*> _stateMaterials;
+
+	// Every item's InstanceData in sorted order, so each instanced draw's entries are next to each other
+	std::vector<InstanceData> _instances;
+	GLuint _instanceBuffer;
+	// Bytes allocated for _instanceBuffer
+	size_t _instanceBufferSize;
+
+	std::vector<DrawCommand> _commands;
+	std::vector<DrawGroup> _groups;
+	GLuint _commandBuffer;
+	size_t _commandBufferSize;
+
+	// Each command's instances, in order unless the cull shader replaces them
+	std::vector<GLuint> _drawnInstances;
+	GLuint _drawnInstanceBuffer;
+	size_t _drawnInstanceBufferSize;
+
+	bool _gpuCulling;
+	std::vector<CullObject> _cullObjects;
+	GLuint _cullObjectBuffer;
+	size_t _cullObjectBufferSize;
+
+	// Where each pass's objects start in the sorted order, and how many there are
+	unsigned int _passFirst[RENDER_PASS_COUNT];
+	unsigned int _passCount[RENDER_PASS_COUNT];
+
+	RenderQueueStats _stats;
+};
+
+#endif
@@ -1,6 +1,7 @@
 
 #include "Scene.h"
 #include "Camera.h"
+#include "GLState.h"
 
 #include <iostream>
 #include <SDL/SDL.h>
@@ -13,6 +14,8 @@ Scene::Scene()
 	_cameraAngleY = 0.0f;
 
 	_viewMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -5.0f));
+	_viewportWidth = 1080;
+	_viewportHeight = 1080;
 	_projMatrix = glm::perspective(45.0f, 1.0f, 0.1f, 100.0f);
 
 
@@ -22,7 +25,7 @@ Scene::Scene()
 	glCullFace(GL_FRONT);
 	//Creating 2D texture to use as depth buffer
 	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
+	GLState::BindTexture(0, GL_TEXTURE_2D, depthMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
 		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -53,20 +56,34 @@ Scene::Scene()
 	planeMaterial = new Material();
 	floppMaterial = new Material();
 
-	//Creating Light material for game object
-	Material* maxwellLightMaterial = new Material();
-	Material* planeLightMaterial = new Material();
-	Material* floppLightMaterial = new Material();
+	//Creating Light material, every object draws to the shadow map the same way so they can share one
+	_shadowMat = new Material();
 
 	// Setting Shaders
-	maxwellMaterial->LoadShaders("Resources/VertShader.txt", "Resources/FragShader.txt");
-	planeMaterial->LoadShaders("Resources/VertShader.txt", "Resources/FragShader.txt");
-	floppMaterial->LoadShaders("Resources/VertShader.txt", "Resources/FragShader.txt");
-
+	// The registry only compiles each pair of shaders once, however many materials use them
+	// Every program is submitted before any is waited on, so the driver can compile them all at the same time
+	// The cats read their textures from layers of one array, so they need the variant that does
+	ShaderDefines litDefines = { "TEXTURE_ARRAY" };
+	_arrayProgram = _assets.GetShaderProgram("Resources/VertShader.txt", "Resources/FragShader.txt", litDefines);
+	// Or from virtual textures, which need another
+	ShaderDefines virtualDefines = { "VIRTUAL_TEXTURE" };
+	_virtualProgram = _assets.GetShaderProgram("Resources/VertShader.txt", "Resources/FragShader.txt", virtualDefines);
+	// The mat isn't shiny, so its variant of the shader leaves the specular highlight out altogether
+	ShaderDefines matteDefines = { "NO_SPECULAR" };
+	std::shared_ptr<ShaderProgram> matteProgram = _assets.GetShaderProgram("Resources/VertShader.txt", "Resources/FragShader.txt", matteDefines);
 	//Loading Light Shaders
-	maxwellLightMaterial->LoadShaders("Resources/lightVertShader.txt", "Resources/lightFragShader.txt");
-	planeLightMaterial->LoadShaders("Resources/lightVertShader.txt", "Resources/lightFragShader.txt");
-	floppLightMaterial->LoadShaders("Resources/lightVertShader.txt", "Resources/lightFragShader.txt");
+	std::shared_ptr<ShaderProgram> shadowProgram = _assets.GetShaderProgram("Resources/lightVertShader.txt", "Resources/lightFragShader.txt");
+	_assets.ResolveShaderPrograms();
+
+	// A program that failed to build is still handed back, it just isn't ready, and materials using it draw nothing
+	bool shadersReady = maxwellMaterial->SetShaders(_arrayProgram);
+	shadersReady = planeMaterial->SetShaders(matteProgram) && shadersReady;
+	shadersReady = floppMaterial->SetShaders(_arrayProgram) && shadersReady;
+	shadersReady = _shadowMat->SetShaders(shadowProgram) && shadersReady;
+	if (!shadersReady)
+	{
+		std::cerr<<"WARNING: some of the scene's shaders failed to build, see the log above"<<std::endl;
+	}
 
 	// You can set some simple material properties, these values are passed to the shader
 	// This colour modulates the texture colour
@@ -75,20 +92,40 @@ Scene::Scene()
 	floppMaterial->SetDiffuseColour(glm::vec3(1.0f, 1.0f, 1.0f));
 
 	// Setting default Textures
-	maxwellMaterial->SetTexture("Resources/Maxwell_Diffuse.bmp");
-	planeMaterial->SetTexture("Resources/WelcomeMat_diffuse.bmp");
-	floppMaterial->SetTexture("Resources/Maxwell_Diffuse_Inverted.bmp");
+	// They load in the background and turn up a few frames in, rather than holding up the first frame
+	// Without a buffer that can stay mapped they're loaded here instead, as before
+	if (_textureStreamer.Init())
+	{
+		_textureOptions.streamer = &_textureStreamer;
+	}
+	planeMaterial->SetTexture(_assets.GetTexture("Resources/WelcomeMat_diffuse.bmp", _textureOptions));
+
+	// The cats' textures as virtual textures, however big they were the atlas would stay the same size
+	// When that works they're only loaded as ordinary textures if it's turned off, see SetVirtualTexturing
+	_virtualTexturingSupported = false;
+	_virtualTexturing = false;
+	if (_virtualTextures.Init() && _virtualProgram && _virtualProgram->IsReady())
+	{
+		int maxwellTexture = _virtualTextures.Load("Resources/Maxwell_Diffuse.bmp");
+		int floppTexture = _virtualTextures.Load("Resources/Maxwell_Diffuse_Inverted.bmp");
+		maxwellMaterial->SetVirtualTexture(&_virtualTextures, maxwellTexture);
+		floppMaterial->SetVirtualTexture(&_virtualTextures, floppTexture);
+		_virtualTexturingSupported = maxwellTexture >= 0 && floppTexture >= 0;
+	}
+	SetVirtualTexturing(true);
 
 	// Setting the Shadow Maps
 	maxwellMaterial->SetShadowMap(depthMap);
 	planeMaterial->SetShadowMap(depthMap);
 	floppMaterial->SetShadowMap(depthMap);
 
-	// Need to tell the material the light's position
-	// If you change the light's position you need to call this again
-	maxwellMaterial->SetLightPosition(_lightPosition);
-	planeMaterial->SetLightPosition(_lightPosition);
-	floppMaterial->SetLightPosition(_lightPosition);
+	// Per-frame values shared by every shader, rather than set in each program for each object
+	_frameUniforms.Create(FRAME_BLOCK_BINDING, sizeof(FrameBlock));
+	_lightUniforms.Create(LIGHT_BLOCK_BINDING, sizeof(LightBlock));
+
+	// Objects are culled by compute shaders once they've built, otherwise the CPU goes on doing it
+	_gpuCullingSupported = _gpuCuller.Init() && _depthPyramid.Init();
+	_renderQueue.SetGpuCulling(_gpuCullingSupported);
 
 	//Setting up the light space matrix
 	_lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 1.0f, 10.0f);
@@ -103,28 +140,77 @@ Scene::Scene()
 	m_flopp->SetMaterial(floppMaterial);
 
 	//Light Materials
-	m_maxwell->SetLightMaterial(maxwellLightMaterial);
-	m_plane->SetLightMaterial(planeLightMaterial);
-	m_flopp->SetLightMaterial(floppLightMaterial);
+	m_maxwell->SetLightMaterial(_shadowMat);
+	m_plane->SetLightMaterial(_shadowMat);
+	m_flopp->SetLightMaterial(_shadowMat);
 
 	// The mesh is the geometry for the object
-	Mesh *maxwellMesh = new Mesh();
-	Mesh* planeMesh = new Mesh();
-	Mesh* floppMesh = new Mesh();
+	// Everything casts shadows, so give positions their own buffer for the depth pass
+	MeshLoadOptions meshOptions;
+	meshOptions.separatePositions = true;
+	meshOptions.optimise = true;
+	// Halves vertex memory, the error this introduces is printed when the mesh is first loaded
+	meshOptions.quantize = true;
+	// Levels of detail at half, a quarter, an eighth and a sixteenth of the triangles, picked per object each frame
+	meshOptions.lodRatios = { 0.5f, 0.25f, 0.125f, 0.0625f };
+	// Lets each pass skip the clusters of triangles it can't see
+	meshOptions.buildMeshlets = true;
+	// Puts every mesh in the same buffers, so each pass is a multi-draw per material rather than per mesh
+	// Leave it NULL and each mesh gets buffers of its own again
+	meshOptions.geometryPool = &_geometryPool;
 	// Load from OBJ file. This must have triangulated geometry
-	maxwellMesh->LoadOBJ("Resources/Maxwell.obj");
-	m_maxwell->SetMesh(maxwellMesh);
-
-	planeMesh->LoadOBJ("Resources/WelcomeMatOBJ.obj");
-	m_plane->SetMesh(planeMesh);
+	// Maxwell and Flopp share the same mesh, the registry only loads it once
+	m_maxwell->SetMesh(_assets.GetMesh("Resources/Maxwell.obj", meshOptions));
+	m_plane->SetMesh(_assets.GetMesh("Resources/WelcomeMatOBJ.obj", meshOptions));
+	m_flopp->SetMesh(_assets.GetMesh("Resources/Maxwell.obj", meshOptions));
 
-	floppMesh->LoadOBJ("Resources/Maxwell.obj");
-	m_flopp->SetMesh(floppMesh);
+	_assets.PrintStats();
 }
 
 Scene::~Scene()
 {
 	// You should neatly clean everything up here
+	// Objects first, as they use the materials
+	// Meshes, textures and shaders are freed by the registry's handles as the last user goes
+	delete m_maxwell;
+	delete m_plane;
+	delete m_flopp;
+
+	delete maxwellMaterial;
+	delete planeMaterial;
+	delete floppMaterial;
+	delete _shadowMat;
+
+	glDeleteFramebuffers(1, &depthMapFBO);
+	GLState::ForgetTexture(depthMap);
+	glDeleteTextures(1, &depthMap);
+}
+
+void Scene::SetVirtualTexturing(bool enabled)
+{
+	_virtualTexturing = enabled && _virtualTexturingSupported;
+	if (_virtualTexturing)
+	{
+		// Everything the cats need is in the atlas, so their own textures and the array would only be taking up memory
+		maxwellMaterial->SetTexture(std::shared_ptr<Texture>());
+		floppMaterial->SetTexture(std::shared_ptr<Texture>());
+		maxwellMaterial->SetTextureArray(std::shared_ptr<TextureArray>());
+		floppMaterial->SetTextureArray(std::shared_ptr<TextureArray>());
+		_diffuseArray.reset();
+	}
+	else if (!_diffuseArray)
+	{
+		maxwellMaterial->SetTexture(_assets.GetTexture("Resources/Maxwell_Diffuse.bmp", _textureOptions));
+		floppMaterial->SetTexture(_assets.GetTexture("Resources/Maxwell_Diffuse_Inverted.bmp", _textureOptions));
+
+		// Maxwell's and Flopp's textures are the same size, so with both in one array the two cats can be drawn together
+		// Every layer's storage is made up front, so it only has room for those two
+		_diffuseArray = std::make_shared<TextureArray>(2);
+		maxwellMaterial->SetTextureArray(_diffuseArray);
+		floppMaterial->SetTextureArray(_diffuseArray);
+	}
+	maxwellMaterial->SetShaders(_virtualTexturing ? _virtualProgram : _arrayProgram);
+	floppMaterial->SetShaders(_virtualTexturing ? _virtualProgram : _arrayProgram);
 }
 
 void Scene::Update( float deltaTs )
@@ -137,27 +223,90 @@ void Scene::Update( float deltaTs )
 	_viewMatrix = glm::rotate(glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -15.0f)), _cameraAngleX, glm::vec3(1, 0, 0)), _cameraAngleY, glm::vec3(0, 1, 0));
 }
 
+void Scene::SetViewportSize(int width, int height)
+{
+	// A minimised window reports a zero size, keep the last one until it comes back
+	if (width <= 0 || height <= 0)
+	{
+		return;
+	}
+	_viewportWidth = width;
+	_viewportHeight = height;
+	_projMatrix = glm::perspective(45.0f, (float)width / (float)height, 0.1f, 100.0f);
+}
+
 void Scene::Draw()
 {
+	// Textures the workers have finished go up first, so they're drawn with this frame
+	// Then into the array, which copies from them
+	_textureStreamer.Update();
+	if (_diffuseArray)
+	{
+		_diffuseArray->Update();
+	}
+	_virtualTextures.Update();
+
+	// Pick each object's level of detail from the camera, the shadow pass uses the same one so shadows match
+	m_maxwell->SelectLod(_viewMatrix, _projMatrix, (float)_viewportHeight);
+	m_plane->SelectLod(_viewMatrix, _projMatrix, (float)_viewportHeight);
+	m_flopp->SelectLod(_viewMatrix, _projMatrix, (float)_viewportHeight);
+
+	// Matrices and light for both passes, uploaded once for everything drawn this frame
+	_lightSpaceMatrix = _lightProjection * _lightView;
+	FrameBlock frame;
+	frame.viewMat = _viewMatrix;
+	frame.projMat = _projMatrix;
+	frame.lightSpaceMatrix = _lightSpaceMatrix;
+	_frameUniforms.Update(&frame, sizeof(frame));
+
+	// w has always been 0 here, which the lighting has been tuned around
+	LightBlock light;
+	light.worldSpaceLightPos = glm::vec4(_lightPosition, 0.0f);
+	light.lightColour = glm::vec3(1.0f, 1.0f, 1.0f);
+	light.padding = 0.0f;
+	_lightUniforms.Update(&light, sizeof(light));
+
+	// Queue up both passes, then sort them so objects sharing shaders, materials and meshes are drawn together
+	_renderQueue.Clear();
+	m_maxwell->LightDraw(_renderQueue, _lightView, _lightProjection);
+	m_plane->LightDraw(_renderQueue, _lightView, _lightProjection);
+	m_flopp->LightDraw(_renderQueue, _lightView, _lightProjection);
+	m_maxwell->Draw(_renderQueue, _viewMatrix, _projMatrix);
+	m_plane->Draw(_renderQueue, _viewMatrix, _projMatrix);
+	m_flopp->Draw(_renderQueue, _viewMatrix, _projMatrix);
+	_renderQueue.Sort();
+
+	// Cull each pass against its own camera, only the camera has a depth pyramid to test against
+	_gpuCuller.BeginFrame();
+	if (_renderQueue.IsGpuCulling())
+	{
+		_gpuCuller.Cull(_renderQueue, RENDER_PASS_SHADOW, _lightSpaceMatrix, NULL);
+		_gpuCuller.Cull(_renderQueue, RENDER_PASS_MAIN, _projMatrix * _viewMatrix, &_depthPyramid);
+	}
+
 	// Set the FBO as the write buffer
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 	glClear(GL_DEPTH_BUFFER_BIT);
 
 	// Draw scene from light's POV
-    m_maxwell->LightDraw(_lightView, _lightProjection);
-	m_plane->LightDraw(_lightView, _lightProjection);
-	m_flopp->LightDraw(_lightView, _lightProjection);
+	_renderQueue.Execute(RENDER_PASS_SHADOW);
 
 	// Set the screen as the write buffer
 	// Set the depth map texture for use in the objects
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, 1080, 1080);
+	glViewport(0, 0, _viewportWidth, _viewportHeight);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	_lightSpaceMatrix = _lightProjection * _lightView;
 	// Draw scene from Camera's POV
-	m_maxwell->Draw(_viewMatrix, _projMatrix, _lightSpaceMatrix);
-	m_plane->Draw(_viewMatrix, _projMatrix, _lightSpaceMatrix);
-	m_flopp->Draw(_viewMatrix, _projMatrix, _lightSpaceMatrix);
+	// Back faces are culled here, which also lets the objects skip meshlets that face away
+	GLState::SetEnabled(GL_CULL_FACE, true);
+	_renderQueue.Execute(RENDER_PASS_MAIN);
+	GLState::SetEnabled(GL_CULL_FACE, false);
+
+	// This frame's depth is what next frame's objects get tested against
+	if (_renderQueue.IsGpuCulling())
+	{
+		_depthPyramid.Build(_viewportWidth, _viewportHeight, _projMatrix * _viewMatrix);
+	}
 }
\ No newline at end of file
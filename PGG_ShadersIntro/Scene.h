@@ -1,5 +1,14 @@
 #include "GameObject.h"
 #include "Camera.h"
+#include "AssetRegistry.h"
+#include "UniformBuffer.h"
+#include "RenderQueue.h"
+#include "GeometryPool.h"
+#include "GpuCuller.h"
+#include "DepthPyramid.h"
+#include "TextureStreamer.h"
+#include "TextureArray.h"
+#include "VirtualTexturePool.h"
 
 // The GLM library contains vector and matrix functions and classes for us to use
 // They are designed to easily work with OpenGL!
@@ -32,6 +41,9 @@ public:
 	// Draws the scene from the camera's point of view
 	void Draw();
 
+	// Tells the scene the size of the window's framebuffer so the viewport, projection and LOD selection match it
+	void SetViewportSize( int width, int height );
+
 	GameObject *m_maxwell, *m_plane, *m_flopp;
 	Material* maxwellMaterial, * planeMaterial, * floppMaterial;
 
@@ -39,6 +51,23 @@ public:
 
 	glm::vec3 GetBackgroundColor() { return _backgroundColor; }
 
+	// How many draws and state changes the last Draw needed
+	const RenderQueueStats& GetRenderStats() const { return _renderQueue.GetStats(); }
+
+	// Turns culling whole objects on the GPU on or off, it's on whenever the cull shaders built
+	void SetGpuCulling(bool enabled) { _renderQueue.SetGpuCulling(enabled && _gpuCullingSupported); }
+	bool IsGpuCulling() const { return _renderQueue.IsGpuCulling(); }
+	const CullStats& GetCullStats(RenderPass pass) const { return _gpuCuller.GetStats(pass); }
+
+	// Textures still streaming in, and what the last frame uploaded
+	const TextureStreamStats& GetTextureStreamStats() const { return _textureStreamer.GetStats(); }
+
+	// Switches the cats between their texture array and virtual textures, which are used whenever they loaded
+	void SetVirtualTexturing(bool enabled);
+	bool IsVirtualTexturing() const { return _virtualTexturing; }
+	const VirtualTextureStats& GetVirtualTextureStats() const { return _virtualTextures.GetStats(); }
+	size_t GetVirtualTextureMemory() const { return _virtualTextures.GetMemorySize(); }
+
 protected:
 	
 	unsigned int depthMapFBO;
@@ -50,17 +79,57 @@ protected:
 	// This matrix is like the camera's lens
 	glm::mat4 _projMatrix;
 
+	// Size of the window's framebuffer in pixels
+	int _viewportWidth, _viewportHeight;
+
 	// Current rotation information about the camera
 	float _cameraAngleX, _cameraAngleY;
 
 	// Position of the single point-light in the scene
 	glm::vec3 _lightPosition;
 
+	// Material used by every object when drawing into the shadow map
 	Material* _shadowMat;
 
+	// Every mesh's vertices and indices, so draws of different meshes can go in one multi-draw
+	// Before the registry, so it's still there when the meshes go
+	GeometryPool _geometryPool;
+
+	// Loads the textures in the background, before the registry so it's still there when the textures go
+	TextureStreamer _textureStreamer;
+
+	// Shares meshes, textures and shaders between everything in the scene
+	AssetRegistry _assets;
+
+	// How textures are loaded, kept so the cats' can be loaded again when virtual texturing is turned off
+	TextureLoadOptions _textureOptions;
+
+	// Layers of the cats' textures, so their materials share state and both are drawn with one command
+	// NULL while virtual texturing is on, the cats' textures aren't kept then
+	std::shared_ptr<TextureArray> _diffuseArray;
+
+	// The cats' textures again as virtual textures, drawn from tiles in a fixed size atlas
+	// The programs for each, so SetVirtualTexturing can swap between them
+	VirtualTexturePool _virtualTextures;
+	std::shared_ptr<ShaderProgram> _arrayProgram, _virtualProgram;
+	bool _virtualTexturingSupported, _virtualTexturing;
+
 	glm::vec3 _backgroundColor;
 
 	glm::mat4 _lightProjection;
 	glm::mat4 _lightView;
 	glm::mat4 _lightSpaceMatrix;
+
+	// The camera and light matrices (FrameBlock) and the light's settings (LightBlock)
+	// Filled in once at the start of Draw, every shader reads them from here
+	UniformBuffer _frameUniforms;
+	UniformBuffer _lightUniforms;
+
+	// Every draw of a frame, sorted to keep state changes down
+	RenderQueue _renderQueue;
+
+	// Culls the queue's objects on the GPU, using the depth pyramid from the frame before for the camera pass
+	GpuCuller _gpuCuller;
+	DepthPyramid _depthPyramid;
+	bool _gpuCullingSupported;
 };
@@ -0,0 +1,135 @@
+
+#include "ShaderPreprocessor.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+
+// Adds one file to the output, pulling in its includes as it goes
+static bool AppendShaderFile( const std::string &filename, const ShaderDefines &defines, bool isMainFile, std::string &output, std::vector<std::string> &files )
+{
+	std::string source;
+	if( !ShaderProgram::LoadSource( filename, source ) )
+	{
+		return false;
+	}
+
+	unsigned int fileIndex = files.size();
+	files.push_back( filename );
+
+	size_t slash = filename.find_last_of( "/\\" );
+	std::string folder = ( slash == std::string::npos ) ? "" : filename.substr( 0, slash + 1 );
+
+	std::ostringstream lineDirective;
+	if( !isMainFile )
+	{
+		lineDirective<<"#line 1 "<<fileIndex<<"\n";
+		output += lineDirective.str();
+	}
+
+	bool hasVersion = source.find( "#version" ) != std::string::npos;
+	bool wroteDefines = false;
+	unsigned int lineNumber = 0;
+	size_t lineStart = 0;
+	while( lineStart < source.size() )
+	{
+		size_t lineEnd = source.find( '\n', lineStart );
+		if( lineEnd == std::string::npos )
+		{
+			lineEnd = source.size();
+		}
+		std::string line = source.substr( lineStart, lineEnd - lineStart );
+		lineStart = lineEnd + 1;
+		lineNumber++;
+
+		size_t firstChar = line.find_first_not_of( " \t" );
+		bool isVersion = firstChar != std::string::npos && line.compare( firstChar, 8, "#version" ) == 0;
+		bool isInclude = firstChar != std::string::npos && line.compare( firstChar, 8, "#include" ) == 0;
+
+		// Defines go straight after #version, which has to stay the first thing in the shader
+		// Without a #version they go right at the top
+		if( isMainFile && !wroteDefines && ( isVersion || !hasVersion ) )
+		{
+			if( isVersion )
+			{
+				output += line + "\n";
+			}
+			for( size_t d = 0; d < defines.size(); d++ )
+			{
+				std::string define = defines[d];
+				size_t equals = define.find( '=' );
+				if( equals != std::string::npos )
+				{
+					define[equals] = ' ';
+				}
+				output += "#define " + define + "\n";
+			}
+			wroteDefines = true;
+
+			lineDirective.str( "" );
+			lineDirective<<"#line "<<( isVersion ? lineNumber + 1 : lineNumber )<<" "<<fileIndex<<"\n";
+			output += lineDirective.str();
+			if( isVersion )
+			{
+				continue;
+			}
+		}
+
+		if( !isInclude )
+		{
+			output += line + "\n";
+			continue;
+		}
+
+		size_t openQuote = line.find( '"', firstChar );
+		size_t closeQuote = ( openQuote == std::string::npos ) ? std::string::npos : line.find( '"', openQuote + 1 );
+		if( closeQuote == std::string::npos )
+		{
+			std::cerr<<"ERROR: "<<filename<<"("<<lineNumber<<"): #include needs a filename in quotes"<<std::endl;
+			return false;
+		}
+
+		// Already included files are skipped, but keep the line so the numbering doesn't change
+		std::string includeName = folder + line.substr( openQuote + 1, closeQuote - openQuote - 1 );
+		if( std::find( files.begin(), files.end(), includeName ) != files.end() )
+		{
+			output += "\n";
+			continue;
+		}
+
+		if( !AppendShaderFile( includeName, defines, false, output, files ) )
+		{
+			std::cerr<<"ERROR: included from "<<filename<<"("<<lineNumber<<")"<<std::endl;
+			return false;
+		}
+
+		// Back to this file after the include
+		lineDirective.str( "" );
+		lineDirective<<"#line "<<lineNumber + 1<<" "<<fileIndex<<"\n";
+		output += lineDirective.str();
+	}
+	return true;
+}
+
+bool PreprocessShader( const std::string &filename, const ShaderDefines &defines, std::string &output, std::vector<std::string> *includedFiles )
+{
+	std::vector<std::string> files;
+	output.clear();
+	bool ok = AppendShaderFile( filename, defines, true, output, files );
+	if( includedFiles != NULL )
+	{
+		includedFiles->swap( files );
+	}
+	return ok;
+}
+
+std::string JoinShaderDefines( const ShaderDefines &defines )
+{
+	std::string joined;
+	for( size_t d = 0; d < defines.size(); d++ )
+	{
+		joined += ( d > 0 ? ";" : "" ) + defines[d];
+	}
+	return joined;
+}
@@ -0,0 +1,24 @@
+
+#ifndef __SHADER_PREPROCESSOR__
+#define __SHADER_PREPROCESSOR__
+
+#include <string>
+#include <vector>
+
+// Compile-time switches for one variant of a shader, each either "NAME" or "NAME=VALUE"
+// e.g. { "NO_SHADOWS" } or { "PCF_TAPS=3", "NO_SPECULAR" }
+// Features switched off this way are gone from the compiled program, rather than skipped with a uniform at run time
+typedef std::vector<std::string> ShaderDefines;
+
+// Turns a shader file into the single source string OpenGL compiles
+// #include "file" lines are replaced by that file, found relative to the file including it
+// Each file is only included once, so shared code can be included from anywhere without guards
+// The defines are added straight after the #version line
+// #line directives keep compile errors pointing at the right line, with the file's position in includedFiles as the source number
+// Returns false if a file could not be read
+bool PreprocessShader( const std::string &filename, const ShaderDefines &defines, std::string &output, std::vector<std::string> *includedFiles = NULL );
+
+// The defines as one string, e.g. "NO_SPECULAR;PCF_TAPS=3", for telling variants apart
+std::string JoinShaderDefines( const ShaderDefines &defines );
+
+#endif
@@ -0,0 +1,367 @@
+
+#include "ShaderProgram.h"
+#include "MappedFile.h"
+#include "ProgramCache.h"
+#include "GLState.h"
+#include <SDL/SDL.h>
+#include <iostream>
+#include <cstring>
+
+
+ShaderProgram::ShaderProgram()
+{
+	_program = 0;
+	_vertShader = 0;
+	_fragShader = 0;
+	_computeShader = 0;
+	_state = PROGRAM_EMPTY;
+	_useCache = false;
+	_cacheKey = 0;
+}
+
+ShaderProgram::~ShaderProgram()
+{
+	ReleaseShaders();
+	GLState::ForgetProgram( _program );
+	glDeleteProgram( _program );
+}
+
+bool ShaderProgram::LoadSource( const std::string &filename, std::string &source )
+{
+	// OpenGL doesn't provide any functions for loading shaders from file
+	// Map the file and copy the whole thing into a string, which also gives us the NULL terminator OpenGL needs
+	MappedFile file;
+	if( !file.Open( filename ) || file.GetSize() == 0 )
+	{
+		std::cerr<<"WARNING: could not read shader from file: "<<filename<<std::endl;
+		return false;
+	}
+
+	source.assign( file.GetData(), file.GetSize() );
+	return true;
+}
+
+bool ShaderProgram::Load( const std::string &vertFilename, const std::string &fragFilename, const ShaderDefines &defines )
+{
+	std::string vertSource, fragSource;
+	if( !PreprocessShader( vertFilename, defines, vertSource ) || !PreprocessShader( fragFilename, defines, fragSource ) )
+	{
+		return false;
+	}
+	std::string variant = JoinShaderDefines( defines );
+	std::string name = vertFilename + " + " + fragFilename + ( variant.empty() ? "" : " [" + variant + "]" );
+	return Build( vertSource, fragSource, name, ProgramCache::GetCachePath( vertFilename, fragFilename, variant ) );
+}
+
+bool ShaderProgram::LoadCompute( const std::string &computeFilename, const ShaderDefines &defines )
+{
+	std::string computeSource;
+	if( !PreprocessShader( computeFilename, defines, computeSource ) )
+	{
+		return false;
+	}
+	std::string variant = JoinShaderDefines( defines );
+	std::string name = computeFilename + ( variant.empty() ? "" : " [" + variant + "]" );
+	SubmitCompute( computeSource, name, ProgramCache::GetCachePath( computeFilename, std::string(), variant ) );
+	return Resolve();
+}
+
+bool ShaderProgram::Build( const std::string &vertSource, const std::string &fragSource, const std::string &name, const std::string &cachePath )
+{
+	Submit( vertSource, fragSource, name, cachePath );
+	return Resolve();
+}
+
+bool ShaderProgram::IsParallelCompileSupported()
+{
+	// Worked out once, the first time a program is submitted
+	static int supported = -1;
+	if( supported < 0 )
+	{
+		supported = 0;
+
+		// GLEW doesn't know about this extension, so look for it and its function by hand
+		GLint numExtensions = 0;
+		glGetIntegerv( GL_NUM_EXTENSIONS, &numExtensions );
+		for( GLint i = 0; i < numExtensions && !supported; i++ )
+		{
+			const char *extension = (const char*) glGetStringi( GL_EXTENSIONS, i );
+			if( extension != NULL && ( strcmp( extension, "GL_KHR_parallel_shader_compile" ) == 0 || strcmp( extension, "GL_ARB_parallel_shader_compile" ) == 0 ) )
+			{
+				supported = 1;
+			}
+		}
+
+		// Let the driver use as many compiler threads as it likes
+		if( supported )
+		{
+			typedef void (GLAPIENTRY *MaxShaderCompilerThreadsProc)( GLuint count );
+			MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc) SDL_GL_GetProcAddress( "glMaxShaderCompilerThreadsKHR" );
+			if( maxShaderCompilerThreads == NULL )
+			{
+				maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc) SDL_GL_GetProcAddress( "glMaxShaderCompilerThreadsARB" );
+			}
+			if( maxShaderCompilerThreads != NULL )
+			{
+				maxShaderCompilerThreads( 0xFFFFFFFF );
+			}
+		}
+	}
+	return supported != 0;
+}
+
+void ShaderProgram::Submit( const std::string &vertSource, const std::string &fragSource, const std::string &name, const std::string &cachePath )
+{
+	if( StartSubmit( vertSource, fragSource, name, cachePath ) )
+	{
+		return;
+	}
+
+	// Create the vertex shader, and compile it from the source
+	// Nothing here asks whether it worked, as that would wait for the compile to finish - Resolve checks later
+	_vertShader = SubmitShader( GL_VERTEX_SHADER, vertSource );
+
+	// Same for the fragment shader
+	_fragShader = SubmitShader( GL_FRAGMENT_SHADER, fragSource );
+
+	// This makes sure the vertex and fragment shaders connect together
+	// If a shader failed to compile the link just fails too, and Resolve reports the compile error
+	glLinkProgram( _program );
+	_state = PROGRAM_COMPILING;
+}
+
+void ShaderProgram::SubmitCompute( const std::string &computeSource, const std::string &name, const std::string &cachePath )
+{
+	if( StartSubmit( computeSource, std::string(), name, cachePath ) )
+	{
+		return;
+	}
+
+	// A compute program is just the one shader
+	_computeShader = SubmitShader( GL_COMPUTE_SHADER, computeSource );
+	glLinkProgram( _program );
+	_state = PROGRAM_COMPILING;
+}
+
+bool ShaderProgram::StartSubmit( const std::string &firstSource, const std::string &secondSource, const std::string &name, const std::string &cachePath )
+{
+	ReleaseShaders();
+	GLState::ForgetProgram( _program );
+	glDeleteProgram( _program );
+
+	_name = name;
+	_cachePath = cachePath;
+	_submitTime = std::chrono::high_resolution_clock::now();
+	_state = PROGRAM_FAILED;
+	_parameters.clear();
+
+	// The 'program' stores the shaders
+	_program = glCreateProgram();
+
+	// If an earlier run saved this program, the driver can load it without compiling anything
+	_useCache = !cachePath.empty() && ProgramCache::IsSupported();
+	_cacheKey = _useCache ? ProgramCache::GetKey( firstSource, secondSource ) : 0;
+	if( _useCache )
+	{
+		if( ProgramCache::Load( cachePath, _cacheKey, _program ) )
+		{
+			double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - _submitTime ).count();
+			std::cout<<"INFO: Loaded program "<<name<<" from "<<cachePath<<" in "<<seconds * 1000.0<<" ms"<<std::endl;
+			Reflect();
+			_state = PROGRAM_READY;
+			return true;
+		}
+
+		// A binary the driver turned down leaves the program unusable, so start again with a fresh one
+		GLState::ForgetProgram( _program );
+		glDeleteProgram( _program );
+		_program = glCreateProgram();
+
+		// Ask the driver to keep the binary around so it can be saved
+		glProgramParameteri( _program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+	}
+
+	// Drivers with parallel compiling hand the work to their own threads, so check this before anything waits on it
+	IsParallelCompileSupported();
+	return false;
+}
+
+GLuint ShaderProgram::SubmitShader( GLenum type, const std::string &source )
+{
+	GLuint shader = glCreateShader( type );
+	// Give GL the source for it
+	const GLchar *shaderText = source.c_str();
+	glShaderSource( shader, 1, &shaderText, NULL );
+	glCompileShader( shader );
+	// This links the shader to the program
+	glAttachShader( _program, shader );
+	return shader;
+}
+
+bool ShaderProgram::IsCompiling() const
+{
+	if( _state != PROGRAM_COMPILING || !IsParallelCompileSupported() )
+	{
+		return false;
+	}
+	GLint complete = GL_TRUE;
+	glGetProgramiv( _program, GL_COMPLETION_STATUS_KHR, &complete );
+	return complete == GL_FALSE;
+}
+
+bool ShaderProgram::Resolve()
+{
+	if( _state != PROGRAM_COMPILING )
+	{
+		return _state == PROGRAM_READY;
+	}
+
+	// Check every shader compiled and give useful output if they didn't work!
+	const GLuint shaders[] = { _vertShader, _fragShader, _computeShader };
+	const char *shaderNames[] = { "vertex", "fragment", "compute" };
+	bool compiled = true;
+	for( unsigned int i = 0; i < 3; i++ )
+	{
+		if( shaders[i] != 0 && !CheckShaderCompiled( shaders[i] ) )
+		{
+			std::cerr<<"ERROR: failed to compile "<<shaderNames[i]<<" shader for "<<_name<<std::endl;
+			compiled = false;
+		}
+	}
+
+	// Once linked, the program doesn't need the shader objects any more
+	ReleaseShaders();
+	_state = PROGRAM_FAILED;
+	if( !compiled )
+	{
+		return false;
+	}
+
+	// Check this worked
+	GLint linked;
+	glGetProgramiv( _program, GL_LINK_STATUS, &linked );
+	if ( !linked )
+	{
+		GLsizei len;
+		glGetProgramiv( _program, GL_INFO_LOG_LENGTH, &len );
+
+		GLchar* log = new GLchar[len+1];
+		glGetProgramInfoLog( _program, len, &len, log );
+		std::cerr << "ERROR: Shader linking failed for " << _name << ": " << log << std::endl;
+		delete [] log;
+
+		return false;
+	}
+
+	double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - _submitTime ).count();
+	std::cout<<"INFO: Compiled program "<<_name<<" in "<<seconds * 1000.0<<" ms"<<std::endl;
+
+	// Save it for next time
+	if( _useCache )
+	{
+		ProgramCache::Save( _cachePath, _cacheKey, _program );
+	}
+	Reflect();
+	_state = PROGRAM_READY;
+	return true;
+}
+
+void ShaderProgram::ReleaseShaders()
+{
+	if( _vertShader != 0 )
+	{
+		glDetachShader( _program, _vertShader );
+	}
+	if( _fragShader != 0 )
+	{
+		glDetachShader( _program, _fragShader );
+	}
+	if( _computeShader != 0 )
+	{
+		glDetachShader( _program, _computeShader );
+	}
+	glDeleteShader( _vertShader );
+	glDeleteShader( _fragShader );
+	glDeleteShader( _computeShader );
+	_vertShader = 0;
+	_fragShader = 0;
+	_computeShader = 0;
+}
+
+void ShaderProgram::Reflect()
+{
+	_parameters.clear();
+
+	GLint numUniforms = 0;
+	glGetProgramInterfaceiv( _program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &numUniforms );
+	GLint maxNameLength = 0;
+	glGetProgramInterfaceiv( _program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength );
+	std::vector<GLchar> name( maxNameLength + 1 );
+
+	// Everything we want to know about each uniform, in one call
+	const GLenum properties[] = { GL_BLOCK_INDEX, GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE };
+	const GLsizei numProperties = sizeof( properties ) / sizeof( properties[0] );
+
+	for( GLint i = 0; i < numUniforms; i++ )
+	{
+		GLint values[numProperties];
+		glGetProgramResourceiv( _program, GL_UNIFORM, i, numProperties, properties, numProperties, NULL, values );
+		// Members of a uniform block have no location of their own
+		if( values[0] != -1 || values[1] < 0 )
+		{
+			continue;
+		}
+
+		glGetProgramResourceName( _program, GL_UNIFORM, i, (GLsizei) name.size(), NULL, &name[0] );
+		ShaderParameter parameter;
+		parameter.name = &name[0];
+		parameter.location = values[1];
+		parameter.type = values[2];
+		parameter.arraySize = values[3];
+
+		size_t bracket = parameter.name.find( '[' );
+		if( bracket != std::string::npos )
+		{
+			parameter.name.erase( bracket );
+		}
+		_parameters.push_back( parameter );
+	}
+}
+
+const ShaderParameter* ShaderProgram::FindParameter( const std::string &name ) const
+{
+	for( size_t i = 0; i < _parameters.size(); i++ )
+	{
+		if( _parameters[i].name == name )
+		{
+			return &_parameters[i];
+		}
+	}
+	return NULL;
+}
+
+GLint ShaderProgram::GetUniformLocation( const std::string &name ) const
+{
+	const ShaderParameter *parameter = FindParameter( name );
+	return parameter ? parameter->location : -1;
+}
+
+bool ShaderProgram::CheckShaderCompiled( GLuint shader )
+{
+	GLint compiled;
+	glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
+	if ( !compiled )
+	{
+		GLsizei len;
+		glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &len );
+
+		// OpenGL will store an error message as a string that we can retrieve and print
+		GLchar* log = new GLchar[len+1];
+		glGetShaderInfoLog( shader, len, &len, log );
+		std::cerr << "ERROR: Shader compilation failed: " << log << std::endl;
+		delete [] log;
+
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,141 @@
+
+#ifndef __SHADER_PROGRAM__
+#define __SHADER_PROGRAM__
+
+#include "glew.h"
+#include "ShaderPreprocessor.h"
+#include <string>
+#include <vector>
+#include <chrono>
+
+// From KHR_parallel_shader_compile, which is newer than our GLEW
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// A uniform the linked program actually uses, as reported by the driver
+// Uniforms in blocks aren't included, they're set through buffers rather than locations
+struct ShaderParameter
+{
+	// Arrays are named without the [0] the driver adds
+	std::string name;
+	GLint location;
+	// e.g. GL_FLOAT_VEC3 or GL_SAMPLER_2D
+	GLenum type;
+	GLint arraySize;
+};
+
+// A linked OpenGL program made from a vertex and a fragment shader, or from a single compute shader
+// The program is deleted along with this object, so share it (see AssetRegistry) rather than copying it
+class ShaderProgram
+{
+public:
+
+	ShaderProgram();
+	~ShaderProgram();
+
+	// Reads a whole shader source file into a string
+	// Returns false if the file could not be read
+	static bool LoadSource( const std::string &filename, std::string &source );
+
+	// Compiles both shaders and links them into the program, waiting until it's done
+	// name is only used to say which program failed in error messages
+	// With a cachePath (see ProgramCache), a binary saved by an earlier run is used instead when it's still valid
+	// Returns false if there was an error - it will also print out messages to console
+	bool Build( const std::string &vertSource, const std::string &fragSource, const std::string &name, const std::string &cachePath = std::string() );
+
+	// Build split in two, so several programs can compile at once
+	// Submit starts the compile and link without waiting for either; Resolve waits for them, reports errors and
+	// saves the binary, returning false if there was an error
+	// Submit every program before resolving any, and drivers with parallel compiling work on them all together
+	void Submit( const std::string &vertSource, const std::string &fragSource, const std::string &name, const std::string &cachePath = std::string() );
+	bool Resolve();
+
+	// Submit for a compute program, Resolve as usual
+	void SubmitCompute( const std::string &computeSource, const std::string &name, const std::string &cachePath = std::string() );
+
+	// True while the driver is still working on a submitted program, so Resolve would have to wait
+	// Always false without KHR_parallel_shader_compile, where Resolve is the only way to find out
+	bool IsCompiling() const;
+
+	// True once the program has been resolved and built without errors
+	bool IsReady() const { return _state == PROGRAM_READY; }
+
+	// When the program was submitted, for timing start-up
+	std::chrono::high_resolution_clock::time_point GetSubmitTime() const { return _submitTime; }
+
+	// Name given to Submit or Build
+	const std::string& GetName() const { return _name; }
+
+	// True if the driver compiles shaders on its own threads (KHR_parallel_shader_compile)
+	// The first call also tells the driver to use as many threads as it likes
+	static bool IsParallelCompileSupported();
+
+	// Loads both shaders from file, preprocesses them with the defines (see ShaderPreprocessor.h)
+	// and builds the program from them, using the program cache
+	bool Load( const std::string &vertFilename, const std::string &fragFilename, const ShaderDefines &defines = ShaderDefines() );
+
+	// The same for a compute shader, run with glDispatchCompute once the program is current
+	bool LoadCompute( const std::string &computeFilename, const ShaderDefines &defines = ShaderDefines() );
+
+	// The OpenGL program handle, 0 if it hasn't been built
+	GLuint GetHandle() const { return _program; }
+
+	// Every uniform the program uses, filled in once it's built
+	// Uniforms the compiler threw away because nothing reads them aren't here
+	const std::vector<ShaderParameter>& GetParameters() const { return _parameters; }
+
+	// The uniform with this name, NULL if the program doesn't use it
+	const ShaderParameter* FindParameter( const std::string &name ) const;
+
+	// Location of a uniform variable, -1 if the program doesn't use it
+	GLint GetUniformLocation( const std::string &name ) const;
+
+protected:
+
+	// Programs can't be shared between objects
+	ShaderProgram( const ShaderProgram & );
+	ShaderProgram& operator=( const ShaderProgram & );
+
+	// Utility function
+	static bool CheckShaderCompiled( GLuint shader );
+
+	// What both kinds of submit start with: replaces the old program and tries the cache
+	// Returns true if the cache had it, leaving nothing to compile
+	bool StartSubmit( const std::string &firstSource, const std::string &secondSource, const std::string &name, const std::string &cachePath );
+
+	// Starts compiling one shader and attaches it to the program
+	GLuint SubmitShader( GLenum type, const std::string &source );
+
+	// Detaches and deletes the shader objects, which aren't needed once the program is linked
+	void ReleaseShaders();
+
+	// Fills in _parameters from the linked program
+	void Reflect();
+
+	enum ProgramState
+	{
+		PROGRAM_EMPTY,
+		PROGRAM_COMPILING,
+		PROGRAM_READY,
+		PROGRAM_FAILED
+	};
+
+	GLuint _program;
+
+	// Shaders of a submitted program, kept until Resolve has checked them
+	GLuint _vertShader, _fragShader, _computeShader;
+	ProgramState _state;
+
+	// What Resolve needs to report on and save the program
+	std::string _name;
+	std::string _cachePath;
+	bool _useCache;
+	unsigned long long _cacheKey;
+	std::chrono::high_resolution_clock::time_point _submitTime;
+
+	// The program's uniforms, from Reflect
+	std::vector<ShaderParameter> _parameters;
+};
+
+#endif
@@ -0,0 +1,270 @@
+
+#include "Texture.h"
+#include "GLState.h"
+#include "BlockCompressor.h"
+#include "TextureCache.h"
+#include "TextureFile.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include <SDL/SDL.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+unsigned long long TextureLoadOptions::GetSettingsHash() const
+{
+	// The thread count doesn't change the result, so leave it out
+	unsigned char settings[] = { (unsigned char) compression, (unsigned char) preferCompressedFile };
+	return HashBytes( settings, sizeof( settings ) );
+}
+
+
+Texture::Texture()
+{
+	_texture = 0;
+	_placeholder = 0;
+	_width = 0;
+	_height = 0;
+	_numLevels = 0;
+	_format = TEXTURE_FORMAT_RGBA8;
+	_memorySize = 0;
+}
+
+Texture::~Texture()
+{
+	GLState::ForgetTexture( _texture );
+	glDeleteTextures( 1, &_texture );
+}
+
+GLenum Texture::GetInternalFormat( TextureFormat format )
+{
+	// sRGB formats aren't used, the shaders work on colours as they're stored
+	switch( format )
+	{
+	case TEXTURE_FORMAT_BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	case TEXTURE_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TEXTURE_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+	case TEXTURE_FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return GL_RGBA8;
+	}
+}
+
+bool Texture::IsFormatSupported( TextureFormat format )
+{
+	if( format != TEXTURE_FORMAT_BC1 && format != TEXTURE_FORMAT_BC3 )
+	{
+		return true;
+	}
+	return GLState::IsExtensionSupported( "GL_EXT_texture_compression_s3tc" );
+}
+
+bool Texture::Load( const std::string &filename, const TextureLoadOptions &options )
+{
+	TextureData data;
+	bool loaded = LoadData( filename, options, data );
+	std::cout<<data.log.str();
+	if( !loaded )
+	{
+		return false;
+	}
+	Upload( data.chain );
+	return true;
+}
+
+bool Texture::LoadData( const std::string &filename, const TextureLoadOptions &options, TextureData &data )
+{
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	// A copy compressed ahead of time wins over the image, there's nothing left to do to it but upload it
+	if( options.preferCompressedFile )
+	{
+		static const char *extensions[] = { ".ktx2", ".dds" };
+		for( unsigned int e = 0; e < sizeof( extensions ) / sizeof( extensions[0] ); e++ )
+		{
+			std::string compressedPath = TextureFile::GetCompressedPath( filename, extensions[e] );
+			if( !TextureFile::Read( compressedPath, data.file, data.chain ) )
+			{
+				continue;
+			}
+			if( !IsFormatSupported( data.chain.format ) )
+			{
+				data.log<<"WARNING: "<<compressedPath<<" is "<<GetTextureFormatName( data.chain.format )<<", which this driver can't sample"<<std::endl;
+				data.file.Close();
+				continue;
+			}
+
+			double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+			data.log<<"INFO: Loaded "<<filename<<" from "<<compressedPath<<" ("<<GetTextureFormatName( data.chain.format )<<", "<<data.chain.dataSize / 1024<<" KB) in "<<seconds * 1000.0<<" ms"<<std::endl;
+			return true;
+		}
+	}
+
+	// The file is mapped so it can be checked against the cache, and then decoded straight from memory if it has to be
+	MappedFile inputFile;
+	if( !inputFile.Open( filename ) )
+	{
+		data.log<<"WARNING: could not load BMP image: "<<filename<<std::endl;
+		return false;
+	}
+
+	// If there's an up to date cache, use it as it is and skip the filtering altogether
+	std::string cachePath = TextureCache::GetCachePath( filename );
+	if( options.useCache )
+	{
+		if( TextureCache::Read( cachePath, inputFile, options.GetSettingsHash(), data.file, data.chain ) && IsFormatSupported( data.chain.format ) )
+		{
+			double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+			data.log<<"INFO: Loaded "<<filename<<" from "<<cachePath<<" ("<<GetTextureFormatName( data.chain.format )<<", "<<data.chain.dataSize / 1024<<" KB) in "<<seconds * 1000.0<<" ms"<<std::endl;
+			return true;
+		}
+		data.file.Close();
+	}
+
+	// Load SDL surface
+	SDL_Surface *image = SDL_LoadBMP_RW( SDL_RWFromConstMem( inputFile.GetData(), (int) inputFile.GetSize() ), 1 );
+
+	if( !image ) // Check it worked
+	{
+		data.log<<"WARNING: could not load BMP image: "<<filename<<std::endl;
+		return false;
+	}
+
+	// SDL loads images in BGR order, but the levels are made from RGBA
+	SDL_Surface *rgbaImage = SDL_ConvertSurfaceFormat( image, SDL_PIXELFORMAT_RGBA32, 0 );
+	SDL_FreeSurface( image );
+	if( !rgbaImage )
+	{
+		data.log<<"WARNING: could not convert BMP image: "<<filename<<std::endl;
+		return false;
+	}
+
+	// Surface rows can be padded, the chain's aren't
+	std::vector<unsigned char> rgba( (size_t) rgbaImage->w * rgbaImage->h * 4 );
+	bool hasAlpha = false;
+	for( int y = 0; y < rgbaImage->h; y++ )
+	{
+		unsigned char *row = &rgba[(size_t) y * rgbaImage->w * 4];
+		memcpy( row, (const unsigned char*) rgbaImage->pixels + y * rgbaImage->pitch, (size_t) rgbaImage->w * 4 );
+		for( int x = 0; x < rgbaImage->w && !hasAlpha; x++ )
+		{
+			hasAlpha = row[x * 4 + 3] != 255;
+		}
+	}
+
+	TextureFormat compression = options.compression;
+	if( compression == TEXTURE_FORMAT_BC1 && hasAlpha )
+	{
+		compression = TEXTURE_FORMAT_BC3;
+	}
+	if( !IsFormatSupported( compression ) )
+	{
+		data.log<<"WARNING: This driver can't sample "<<GetTextureFormatName( compression )<<", leaving "<<filename<<" uncompressed"<<std::endl;
+		compression = TEXTURE_FORMAT_RGBA8;
+	}
+
+	// Uncompressed levels are built straight into the result, compressed ones only pass through here on the way
+	MipChain uncompressedChain;
+	MipChain &chain = compression == TEXTURE_FORMAT_RGBA8 ? data.chain : uncompressedChain;
+	chain.Build( &rgba[0], rgbaImage->w, rgbaImage->h, options.numThreads );
+	SDL_FreeSurface( rgbaImage );
+
+	double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+	data.log<<"INFO: Made "<<chain.levels.size()<<" mip levels for "<<filename<<" in "<<seconds * 1000.0<<" ms"<<std::endl;
+
+	if( compression != TEXTURE_FORMAT_RGBA8 )
+	{
+		startTime = std::chrono::high_resolution_clock::now();
+		CompressMipChain( chain, compression, data.chain, options.numThreads );
+		seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+
+		// Say what compression cost, so it's easy to spot a texture that doesn't survive it
+		// BC5 only keeps two channels and BC1 none of the alpha, so only what's kept is measured
+		std::vector<unsigned char> decoded;
+		DecompressLevel( data.chain, 0, decoded );
+		unsigned int numChannels = compression == TEXTURE_FORMAT_BC5 ? 2 : ( compression == TEXTURE_FORMAT_BC1 ? 3 : 4 );
+		double psnr = MeasurePSNR( chain.data, &decoded[0], (size_t) chain.width * chain.height, numChannels );
+		data.log<<"INFO: Compressed "<<filename<<" to "<<GetTextureFormatName( compression )<<": "<<chain.dataSize / 1024<<" KB -> "
+			<<data.chain.dataSize / 1024<<" KB in "<<seconds * 1000.0<<" ms, PSNR "<<psnr<<" dB"<<std::endl;
+	}
+
+	// Save the levels so next time we can skip all of the above
+	if( options.useCache )
+	{
+		TextureCache::Write( cachePath, inputFile, options.GetSettingsHash(), data.chain );
+	}
+	return true;
+}
+
+GLuint Texture::CreateStorage( const MipChain &chain )
+{
+	// Create OpenGL texture
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, texture);
+
+	// Immutable storage, every level is allocated up front and the texture is complete as soon as they're filled
+	glTexStorage2D( GL_TEXTURE_2D, (GLsizei) chain.levels.size(), GetInternalFormat( chain.format ), chain.width, chain.height );
+	SetSampling( GL_TEXTURE_2D, (unsigned int) chain.levels.size() );
+	return texture;
+}
+
+void Texture::SetSampling( GLenum target, unsigned int numLevels )
+{
+	// A file with only some of the levels still makes a complete texture, as long as sampling stops at the last one
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint) numLevels - 1);
+
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// By default, OpenGL mag filter is linear
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// Blend between the two nearest mipmaps, so there's no visible line where one level hands over to the next
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
+
+void Texture::UploadLevel( const MipChain &chain, unsigned int level, const void *pixels )
+{
+	const MipLevel &mipLevel = chain.levels[level];
+	if( chain.format == TEXTURE_FORMAT_RGBA8 )
+	{
+		// Rows are a whole number of 4 byte pixels, so the default unpack alignment is fine
+		glTexSubImage2D( GL_TEXTURE_2D, (GLint) level, 0, 0, mipLevel.width, mipLevel.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+	}
+	else
+	{
+		// Compressed levels go up as they are, the GPU decodes the blocks as it samples them
+		GLsizei levelSize = (GLsizei) GetTextureLevelSize( chain.format, mipLevel.width, mipLevel.height );
+		glCompressedTexSubImage2D( GL_TEXTURE_2D, (GLint) level, 0, 0, mipLevel.width, mipLevel.height, GetInternalFormat( chain.format ), levelSize, pixels );
+	}
+}
+
+void Texture::Adopt( GLuint texture, const MipChain &chain )
+{
+	GLState::ForgetTexture( _texture );
+	glDeleteTextures( 1, &_texture );
+	_texture = texture;
+
+	_width = chain.width;
+	_height = chain.height;
+	_numLevels = (unsigned int) chain.levels.size();
+	_format = chain.format;
+	_memorySize = 0;
+	for( size_t l = 0; l < chain.levels.size(); l++ )
+	{
+		_memorySize += GetTextureLevelSize( chain.format, chain.levels[l].width, chain.levels[l].height );
+	}
+}
+
+void Texture::Upload( const MipChain &chain )
+{
+	GLuint texture = CreateStorage( chain );
+	for( unsigned int l = 0; l < chain.levels.size(); l++ )
+	{
+		UploadLevel( chain, l, chain.GetLevelData( l ) );
+	}
+	Adopt( texture, chain );
+}
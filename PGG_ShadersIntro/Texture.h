@@ -0,0 +1,126 @@
+
+#ifndef __TEXTURE__
+#define __TEXTURE__
+
+#include "glew.h"
+#include "MipChain.h"
+#include "MappedFile.h"
+#include <sstream>
+#include <string>
+
+class TextureStreamer;
+
+// How a texture is loaded, see AssetRegistry::GetTexture
+struct TextureLoadOptions
+{
+	TextureLoadOptions() : compression( TEXTURE_FORMAT_BC1 ), preferCompressedFile( true ), useCache( true ), numThreads( 0 ), streamer( NULL ) {}
+
+	// Block format the levels are compressed to on load (see BlockCompressor.h), TEXTURE_FORMAT_RGBA8 to leave them as they are
+	// BC1 can't keep alpha, so images that use theirs get BC3 instead
+	TextureFormat compression;
+
+	// Loads a .ktx2 or .dds next to the image instead of the image itself, when there is one (see TextureFile)
+	// Those are uploaded exactly as they are, whatever compression says
+	bool preferCompressedFile;
+
+	// Loads from (and saves to) a .smip file next to the image, skipping the filtering and compression when it's up to date
+	bool useCache;
+
+	// Threads used to make and compress the levels, 0 for one per core
+	unsigned int numThreads;
+
+	// Loads the texture in the background instead of straight away, showing a placeholder until it's ready
+	// The streamer must outlive the texture, it isn't part of the settings hash as it doesn't change the data
+	TextureStreamer *streamer;
+
+	// Hash of every setting that changes the uploaded data, so caches made with other settings aren't used
+	unsigned long long GetSettingsHash() const;
+};
+
+// A texture's levels in memory, ready to upload
+struct TextureData
+{
+	MipChain chain;
+	// Cache or compressed file the chain points into, when it came from one
+	MappedFile file;
+	// What loading it had to say, for whoever uploads it to print, so lines from different threads don't get mixed up
+	std::ostringstream log;
+};
+
+// An OpenGL 2D texture loaded from an image file
+// Textures have a full set of mipmaps in immutable storage, so distant surfaces sample a level the size they are on screen
+// The texture is deleted along with this object, so share it (see AssetRegistry) rather than copying it
+class Texture
+{
+public:
+
+	Texture();
+	~Texture();
+
+	// Loads a .bmp from file, along with mipmaps made on the CPU (see MipChain), compressed as the options say
+	// A compressed .ktx2 or .dds with the same name is used instead when there is one
+	// Returns false if there was an error - it will also print out messages to console
+	bool Load( const std::string &filename, const TextureLoadOptions &options = TextureLoadOptions() );
+
+	// Everything Load does short of touching OpenGL, so it can run on any thread (see TextureStreamer)
+	// Nothing is printed, what would have been is left in data.log
+	// Call IsFormatSupported once on the render thread before using this on another, so the answer is already known
+	static bool LoadData( const std::string &filename, const TextureLoadOptions &options, TextureData &data );
+
+	// What OpenGL calls each format, e.g. GL_COMPRESSED_RGBA_S3TC_DXT1_EXT for BC1
+	static GLenum GetInternalFormat( TextureFormat format );
+
+	// Whether the driver can sample the format
+	// BC1 and BC3 come from an extension every desktop driver has, the others are core in OpenGL 4.3
+	static bool IsFormatSupported( TextureFormat format );
+
+	// Makes a texture with storage for every level of the chain and the sampling settings every texture uses
+	// It's left bound to unit 0, ready for UploadLevel
+	static GLuint CreateStorage( const MipChain &chain );
+
+	// Filtering and wrapping every texture is sampled with, for the texture bound to unit 0 as target
+	static void SetSampling( GLenum target, unsigned int numLevels );
+
+	// Fills one level of the texture bound to unit 0
+	// pixels is in memory, or an offset into the pixel unpack buffer if one is bound
+	static void UploadLevel( const MipChain &chain, unsigned int level, const void *pixels );
+
+	// Takes over a texture made by CreateStorage, deleting the one this had
+	void Adopt( GLuint texture, const MipChain &chain );
+
+	// Handed out by GetHandle until the texture has one of its own, e.g. while it streams in
+	// The placeholder isn't deleted along with this object
+	void SetPlaceholder( GLuint placeholder ) { _placeholder = placeholder; }
+
+	// OpenGL handle for the texture, the placeholder until it has been uploaded, 0 if neither
+	GLuint GetHandle() const { return _texture != 0 ? _texture : _placeholder; }
+
+	// False while a streamed texture is still on its way
+	bool IsResident() const { return _texture != 0; }
+
+	int GetWidth() const { return _width; }
+	int GetHeight() const { return _height; }
+	unsigned int GetNumLevels() const { return _numLevels; }
+	TextureFormat GetFormat() const { return _format; }
+
+	// Bytes of video memory taken by every level
+	size_t GetMemorySize() const { return _memorySize; }
+
+protected:
+
+	// Textures can't be shared between objects
+	Texture( const Texture & );
+	Texture& operator=( const Texture & );
+
+	// Makes a new texture holding every level of the chain
+	void Upload( const MipChain &chain );
+
+	GLuint _texture;
+	GLuint _placeholder;
+	int _width, _height;
+	unsigned int _numLevels;
+	TextureFormat _format;
+	size_t _memorySize;
+};
+
+#endif
@@ -0,0 +1,85 @@
+
+#include "TextureArray.h"
+#include "GLState.h"
+#include <algorithm>
+#include <iostream>
+
+
+TextureArray::TextureArray( unsigned int maxLayers )
+{
+	_texture = 0;
+	_maxLayers = maxLayers;
+	_width = 0;
+	_height = 0;
+	_numLevels = 0;
+	_format = TEXTURE_FORMAT_RGBA8;
+	_memorySize = 0;
+}
+
+TextureArray::~TextureArray()
+{
+	GLState::ForgetTexture( _texture );
+	glDeleteTextures( 1, &_texture );
+}
+
+int TextureArray::Add( const std::shared_ptr<Texture> &texture )
+{
+	if( !texture || _layers.size() >= _maxLayers )
+	{
+		return -1;
+	}
+	Layer layer;
+	layer.texture = texture;
+	layer.ready = false;
+	_layers.push_back( layer );
+	return (int) _layers.size() - 1;
+}
+
+void TextureArray::Update()
+{
+	for( size_t l = 0; l < _layers.size(); l++ )
+	{
+		Layer &layer = _layers[l];
+		if( !layer.texture || !layer.texture->IsResident() )
+		{
+			continue;
+		}
+		const Texture &texture = *layer.texture;
+
+		if( _texture == 0 )
+		{
+			// Every layer has the same size and levels, so the first texture to arrive sets them for the rest
+			_width = texture.GetWidth();
+			_height = texture.GetHeight();
+			_numLevels = texture.GetNumLevels();
+			_format = texture.GetFormat();
+			_memorySize = texture.GetMemorySize() * _maxLayers;
+
+			glGenTextures( 1, &_texture );
+			GLState::BindTexture( 0, GL_TEXTURE_2D_ARRAY, _texture );
+			glTexStorage3D( GL_TEXTURE_2D_ARRAY, _numLevels, Texture::GetInternalFormat( _format ), _width, _height, _maxLayers );
+			Texture::SetSampling( GL_TEXTURE_2D_ARRAY, _numLevels );
+			std::cout<<"INFO: Made a "<<_width<<"x"<<_height<<" "<<GetTextureFormatName( _format )<<" texture array with room for "<<_maxLayers<<" layers ("<<_memorySize / 1024<<" KB)"<<std::endl;
+		}
+
+		if( texture.GetWidth() != _width || texture.GetHeight() != _height || texture.GetNumLevels() != _numLevels || texture.GetFormat() != _format )
+		{
+			// It keeps drawing with its own texture, on its own
+			std::cerr<<"WARNING: a "<<texture.GetWidth()<<"x"<<texture.GetHeight()<<" "<<GetTextureFormatName( texture.GetFormat() )
+				<<" texture doesn't match its "<<_width<<"x"<<_height<<" "<<GetTextureFormatName( _format )<<" texture array, leaving it out"<<std::endl;
+			layer.texture.reset();
+			continue;
+		}
+
+		// A straight copy of every level on the GPU, compressed blocks and all, with no trip through the CPU
+		for( unsigned int level = 0; level < _numLevels; level++ )
+		{
+			GLsizei levelWidth = std::max( _width >> level, 1 );
+			GLsizei levelHeight = std::max( _height >> level, 1 );
+			glCopyImageSubData( texture.GetHandle(), GL_TEXTURE_2D, level, 0, 0, 0,
+				_texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, (GLint) l, levelWidth, levelHeight, 1 );
+		}
+		layer.texture.reset();
+		layer.ready = true;
+	}
+}
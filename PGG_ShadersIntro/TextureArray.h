@@ -0,0 +1,63 @@
+
+#ifndef __TEXTURE_ARRAY__
+#define __TEXTURE_ARRAY__
+
+#include "glew.h"
+#include "Texture.h"
+#include <memory>
+#include <vector>
+
+// Textures of the same size and format packed into the layers of one GL_TEXTURE_2D_ARRAY
+// Materials whose textures are in the same array don't need a different texture bound, as each object reads its
+// layer from its instance data (see Material::SetTextureArray), so the render queue can draw them together
+// Textures are copied in on the GPU once they're resident, so streamed ones join the array when they arrive
+// The first texture to arrive decides the size, format and number of levels, ones that don't match are left out
+class TextureArray
+{
+public:
+
+	// Storage for every layer is made when the first texture arrives, so keep maxLayers to what's needed
+	TextureArray( unsigned int maxLayers );
+	~TextureArray();
+
+	// Gives the texture a layer, it's copied in by Update once it's resident
+	// Returns the layer, or -1 if the array is full
+	int Add( const std::shared_ptr<Texture> &texture );
+
+	// Copies in textures that have arrived since the last call
+	// Call once a frame on the render thread, after TextureStreamer::Update and before anything is drawn
+	void Update();
+
+	// Whether the layer holds its texture yet
+	bool IsLayerReady( int layer ) const { return layer >= 0 && layer < (int) _layers.size() && _layers[layer].ready; }
+
+	// OpenGL handle, 0 until the first texture has arrived
+	GLuint GetHandle() const { return _texture; }
+
+	// Bytes of video memory taken by every layer, filled or not
+	size_t GetMemorySize() const { return _memorySize; }
+
+protected:
+
+	// The array can't be shared between objects
+	TextureArray( const TextureArray & );
+	TextureArray& operator=( const TextureArray & );
+
+	struct Layer
+	{
+		// Held until it has been copied in
+		std::shared_ptr<Texture> texture;
+		bool ready;
+	};
+
+	GLuint _texture;
+	unsigned int _maxLayers;
+	std::vector<Layer> _layers;
+
+	int _width, _height;
+	unsigned int _numLevels;
+	TextureFormat _format;
+	size_t _memorySize;
+};
+
+#endif
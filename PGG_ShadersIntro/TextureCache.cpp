@@ -0,0 +1,132 @@
+
+#include "TextureCache.h"
+#include "MipChain.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+
+// Bump this whenever the layout of the file or the way levels are filtered changes, so old caches get rebuilt
+static const unsigned int TEXTURE_CACHE_VERSION = 2;
+
+// Start of every .smip file, the pixels of every level follow straight after it
+struct TextureCacheHeader
+{
+	char magic[4];
+	unsigned int version;
+
+	// What the cache was built from
+	unsigned long long sourceSize;
+	unsigned long long sourceModifiedTime;
+	unsigned long long sourceHash;
+	unsigned long long settingsHash;
+
+	// Size of the top level, the rest follow from it (see MipChain::Layout)
+	unsigned int width;
+	unsigned int height;
+	unsigned int format;
+	unsigned int numLevels;
+	unsigned long long dataSize;
+};
+
+
+std::string TextureCache::GetCachePath( const std::string &sourceFilename )
+{
+	// Swap the extension, but don't mistake a dot in a folder name for one
+	size_t dot = sourceFilename.find_last_of( '.' );
+	size_t slash = sourceFilename.find_last_of( "/\\" );
+	if( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+	{
+		return sourceFilename + ".smip";
+	}
+	return sourceFilename.substr( 0, dot ) + ".smip";
+}
+
+bool TextureCache::Read( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, MappedFile &cacheFile, MipChain &chain )
+{
+	if( !cacheFile.Open( cachePath ) )
+	{
+		return false;
+	}
+
+	const char *data = cacheFile.GetData();
+	size_t size = cacheFile.GetSize();
+	if( size < sizeof( TextureCacheHeader ) )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	TextureCacheHeader header;
+	memcpy( &header, data, sizeof( header ) );
+
+	// Is this a cache we can read, made with the same settings?
+	if( memcmp( header.magic, "SMIP", 4 ) != 0 || header.version != TEXTURE_CACHE_VERSION || header.settingsHash != settingsHash
+		|| header.sourceSize != sourceFile.GetSize() || header.width == 0 || header.height == 0 || header.format >= TEXTURE_FORMAT_COUNT )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	// A matching size and time means the source almost certainly hasn't changed
+	// If only the time differs (e.g. the file was copied or checked out again) the contents might still match, so check the hash
+	if( header.sourceModifiedTime != sourceFile.GetModifiedTime()
+		&& header.sourceHash != HashBytes( sourceFile.GetData(), sourceFile.GetSize() ) )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	// Every level has to be in the file
+	if( chain.Layout( header.width, header.height, (TextureFormat) header.format, header.numLevels ) != header.dataSize || sizeof( TextureCacheHeader ) + header.dataSize > size )
+	{
+		cacheFile.Close();
+		return false;
+	}
+
+	chain.pixels.clear();
+	chain.data = (const unsigned char*) data + sizeof( TextureCacheHeader );
+	return true;
+}
+
+bool TextureCache::Write( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, const MipChain &chain )
+{
+	TextureCacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, "SMIP", 4 );
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceSize = sourceFile.GetSize();
+	header.sourceModifiedTime = sourceFile.GetModifiedTime();
+	header.sourceHash = HashBytes( sourceFile.GetData(), sourceFile.GetSize() );
+	header.settingsHash = settingsHash;
+	header.width = chain.width;
+	header.height = chain.height;
+	header.format = chain.format;
+	header.numLevels = (unsigned int) chain.levels.size();
+	header.dataSize = chain.dataSize;
+
+	// Write to a temporary file first, so a crash part way through never leaves a broken cache behind
+	std::string tempPath = cachePath + ".tmp";
+	FILE *file = fopen( tempPath.c_str(), "wb" );
+	if( file == NULL )
+	{
+		std::cerr<<"WARNING: Could not write texture cache: "<<cachePath<<std::endl;
+		return false;
+	}
+
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+	ok = ok && fwrite( chain.data, 1, chain.dataSize, file ) == chain.dataSize;
+	ok = ( fclose( file ) == 0 ) && ok;
+
+	// Replace the old cache with the new one
+	remove( cachePath.c_str() );
+	if( !ok || rename( tempPath.c_str(), cachePath.c_str() ) != 0 )
+	{
+		remove( tempPath.c_str() );
+		std::cerr<<"WARNING: Could not write texture cache: "<<cachePath<<std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,27 @@
+
+#ifndef __TEXTURE_CACHE__
+#define __TEXTURE_CACHE__
+
+#include <string>
+
+class MappedFile;
+struct MipChain;
+
+// Reads and writes .smip files, a texture's whole mip chain stored next to the source image, compressed if it was loaded that way
+// Loading one skips decoding the image, filtering the levels and compressing them, it's just a file map and an upload per level
+class TextureCache
+{
+public:
+
+	// Where the cache for a source file lives, e.g. Resources/Maxwell_Diffuse.bmp -> Resources/Maxwell_Diffuse.smip
+	static std::string GetCachePath( const std::string &sourceFilename );
+
+	// Maps the cache and checks it was made from this source file with these settings
+	// On success the chain's data points into cacheFile, so it must stay open while the data is used
+	static bool Read( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, MappedFile &cacheFile, MipChain &chain );
+
+	// Saves the chain, recording what it was made from so later reads can tell if it's out of date
+	static bool Write( const std::string &cachePath, const MappedFile &sourceFile, unsigned long long settingsHash, const MipChain &chain );
+};
+
+#endif
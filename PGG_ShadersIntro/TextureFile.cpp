@@ -0,0 +1,267 @@
+
+#include "TextureFile.h"
+#include "MipChain.h"
+#include "MappedFile.h"
+#include <cstring>
+
+
+// DDS - "DDS ", a fixed header, and for newer formats a second header naming a DXGI format
+// Levels follow largest first, packed one after another
+
+static const unsigned int DDS_PIXEL_FORMAT_FOURCC = 0x4;
+static const unsigned int DDS_HEADER_MIPMAP_COUNT = 0x20000;
+static const unsigned int DDS_CAPS2_CUBEMAP = 0x200;
+static const unsigned int DDS_CAPS2_VOLUME = 0x200000;
+
+struct DDSPixelFormat
+{
+	unsigned int size;
+	unsigned int flags;
+	char fourCC[4];
+	unsigned int rgbBitCount;
+	unsigned int bitMasks[4];
+};
+
+struct DDSHeader
+{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int height;
+	unsigned int width;
+	unsigned int pitchOrLinearSize;
+	unsigned int depth;
+	unsigned int mipMapCount;
+	unsigned int reserved1[11];
+	DDSPixelFormat pixelFormat;
+	unsigned int caps[4];
+	unsigned int reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	unsigned int dxgiFormat;
+	unsigned int resourceDimension;
+	unsigned int miscFlag;
+	unsigned int arraySize;
+	unsigned int miscFlags2;
+};
+
+// KTX2 - a fixed header, an index of where each level is, then descriptive blocks and the levels themselves
+// Levels are usually stored smallest first, so they're found through the index rather than assumed to be in order
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTX2Header
+{
+	unsigned char identifier[12];
+	unsigned int vkFormat;
+	unsigned int typeSize;
+	unsigned int pixelWidth;
+	unsigned int pixelHeight;
+	unsigned int pixelDepth;
+	unsigned int layerCount;
+	unsigned int faceCount;
+	unsigned int levelCount;
+	unsigned int supercompressionScheme;
+
+	unsigned int dfdByteOffset;
+	unsigned int dfdByteLength;
+	unsigned int kvdByteOffset;
+	unsigned int kvdByteLength;
+	unsigned long long sgdByteOffset;
+	unsigned long long sgdByteLength;
+};
+
+struct KTX2Level
+{
+	unsigned long long byteOffset;
+	unsigned long long byteLength;
+	unsigned long long uncompressedByteLength;
+};
+
+static bool FormatFromFourCC( const char *fourCC, TextureFormat &format )
+{
+	if( memcmp( fourCC, "DXT1", 4 ) == 0 )
+	{
+		format = TEXTURE_FORMAT_BC1;
+	}
+	else if( memcmp( fourCC, "DXT5", 4 ) == 0 )
+	{
+		format = TEXTURE_FORMAT_BC3;
+	}
+	else if( memcmp( fourCC, "ATI2", 4 ) == 0 || memcmp( fourCC, "BC5U", 4 ) == 0 )
+	{
+		format = TEXTURE_FORMAT_BC5;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+static bool FormatFromDXGI( unsigned int dxgiFormat, TextureFormat &format )
+{
+	switch( dxgiFormat )
+	{
+	// R8G8B8A8_UNORM and _SRGB
+	case 28: case 29: format = TEXTURE_FORMAT_RGBA8; return true;
+	// BC1_UNORM and _SRGB
+	case 71: case 72: format = TEXTURE_FORMAT_BC1; return true;
+	// BC3_UNORM and _SRGB
+	case 77: case 78: format = TEXTURE_FORMAT_BC3; return true;
+	// BC5_UNORM
+	case 83: format = TEXTURE_FORMAT_BC5; return true;
+	// BC7_UNORM and _SRGB
+	case 98: case 99: format = TEXTURE_FORMAT_BC7; return true;
+	default: return false;
+	}
+}
+
+static bool FormatFromVulkan( unsigned int vkFormat, TextureFormat &format )
+{
+	switch( vkFormat )
+	{
+	// R8G8B8A8_UNORM and _SRGB
+	case 37: case 43: format = TEXTURE_FORMAT_RGBA8; return true;
+	// BC1_RGB and BC1_RGBA, _UNORM_BLOCK and _SRGB_BLOCK
+	case 131: case 132: case 133: case 134: format = TEXTURE_FORMAT_BC1; return true;
+	// BC3_UNORM_BLOCK and _SRGB_BLOCK
+	case 137: case 138: format = TEXTURE_FORMAT_BC3; return true;
+	// BC5_UNORM_BLOCK
+	case 141: format = TEXTURE_FORMAT_BC5; return true;
+	// BC7_UNORM_BLOCK and _SRGB_BLOCK
+	case 145: case 146: format = TEXTURE_FORMAT_BC7; return true;
+	default: return false;
+	}
+}
+
+
+std::string TextureFile::GetCompressedPath( const std::string &sourceFilename, const std::string &extension )
+{
+	// Swap the extension, but don't mistake a dot in a folder name for one
+	size_t dot = sourceFilename.find_last_of( '.' );
+	size_t slash = sourceFilename.find_last_of( "/\\" );
+	if( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+	{
+		return sourceFilename + extension;
+	}
+	return sourceFilename.substr( 0, dot ) + extension;
+}
+
+bool TextureFile::Read( const std::string &filename, MappedFile &file, MipChain &chain )
+{
+	if( !file.Open( filename ) )
+	{
+		return false;
+	}
+
+	bool ok = false;
+	if( file.GetSize() >= 4 && memcmp( file.GetData(), "DDS ", 4 ) == 0 )
+	{
+		ok = ReadDDS( file.GetData(), file.GetSize(), chain );
+	}
+	else if( file.GetSize() >= sizeof( KTX2_IDENTIFIER ) && memcmp( file.GetData(), KTX2_IDENTIFIER, sizeof( KTX2_IDENTIFIER ) ) == 0 )
+	{
+		ok = ReadKTX2( file.GetData(), file.GetSize(), chain );
+	}
+
+	if( !ok )
+	{
+		file.Close();
+	}
+	return ok;
+}
+
+bool TextureFile::ReadDDS( const char *data, size_t size, MipChain &chain )
+{
+	if( size < 4 + sizeof( DDSHeader ) || memcmp( data, "DDS ", 4 ) != 0 )
+	{
+		return false;
+	}
+
+	DDSHeader header;
+	memcpy( &header, data + 4, sizeof( header ) );
+	if( header.size != sizeof( DDSHeader ) || header.width == 0 || header.height == 0
+		|| ( header.caps[1] & ( DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME ) ) != 0 || ( header.pixelFormat.flags & DDS_PIXEL_FORMAT_FOURCC ) == 0 )
+	{
+		return false;
+	}
+
+	size_t dataOffset = 4 + sizeof( DDSHeader );
+	TextureFormat format;
+	if( memcmp( header.pixelFormat.fourCC, "DX10", 4 ) == 0 )
+	{
+		if( size < dataOffset + sizeof( DDSHeaderDX10 ) )
+		{
+			return false;
+		}
+		DDSHeaderDX10 dx10Header;
+		memcpy( &dx10Header, data + dataOffset, sizeof( dx10Header ) );
+		dataOffset += sizeof( DDSHeaderDX10 );
+
+		// Only single 2D textures
+		static const unsigned int TEXTURE_2D_DIMENSION = 3;
+		if( !FormatFromDXGI( dx10Header.dxgiFormat, format ) || dx10Header.resourceDimension != TEXTURE_2D_DIMENSION || dx10Header.arraySize > 1 )
+		{
+			return false;
+		}
+	}
+	else if( !FormatFromFourCC( header.pixelFormat.fourCC, format ) )
+	{
+		return false;
+	}
+
+	unsigned int numLevels = ( header.flags & DDS_HEADER_MIPMAP_COUNT ) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+	if( dataOffset + chain.Layout( header.width, header.height, format, numLevels ) > size )
+	{
+		return false;
+	}
+	chain.pixels.clear();
+	chain.data = (const unsigned char*) data + dataOffset;
+	return true;
+}
+
+bool TextureFile::ReadKTX2( const char *data, size_t size, MipChain &chain )
+{
+	if( size < sizeof( KTX2Header ) )
+	{
+		return false;
+	}
+
+	KTX2Header header;
+	memcpy( &header, data, sizeof( header ) );
+	TextureFormat format;
+	if( memcmp( header.identifier, KTX2_IDENTIFIER, sizeof( KTX2_IDENTIFIER ) ) != 0 || !FormatFromVulkan( header.vkFormat, format )
+		|| header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1
+		|| header.supercompressionScheme != 0 )
+	{
+		return false;
+	}
+
+	// A level count of 0 asks for mipmaps to be made at load, we just use the one level there is
+	unsigned int numLevels = header.levelCount > 0 ? header.levelCount : 1;
+	if( sizeof( KTX2Header ) + (size_t) numLevels * sizeof( KTX2Level ) > size )
+	{
+		return false;
+	}
+
+	// Each level is wherever the index says, as long as it's all there
+	chain.Layout( header.pixelWidth, header.pixelHeight, format, numLevels );
+	for( size_t l = 0; l < chain.levels.size(); l++ )
+	{
+		KTX2Level level;
+		memcpy( &level, data + sizeof( KTX2Header ) + l * sizeof( KTX2Level ), sizeof( level ) );
+		// Written so a huge offset can't wrap round and look small
+		if( level.byteLength != GetTextureLevelSize( format, chain.levels[l].width, chain.levels[l].height )
+			|| level.byteOffset > size || level.byteLength > size - level.byteOffset )
+		{
+			return false;
+		}
+		chain.levels[l].offset = (size_t) level.byteOffset;
+	}
+	chain.pixels.clear();
+	chain.data = (const unsigned char*) data;
+	chain.dataSize = size;
+	return true;
+}
@@ -0,0 +1,31 @@
+
+#ifndef __TEXTURE_FILE__
+#define __TEXTURE_FILE__
+
+#include <string>
+#include <cstddef>
+
+class MappedFile;
+struct MipChain;
+
+// Reads textures that were compressed ahead of time by other tools, from .dds and .ktx2 files
+// Only 2D textures in the formats of TextureFormat are understood, with no supercompression for KTX2
+// sRGB variants are read as their plain versions, as the shaders work on colours as they're stored, the same as the BMPs
+class TextureFile
+{
+public:
+
+	// Where a compressed copy of a source image would be, e.g. Resources/Maxwell_Diffuse.bmp, ".dds" -> Resources/Maxwell_Diffuse.dds
+	static std::string GetCompressedPath( const std::string &sourceFilename, const std::string &extension );
+
+	// Maps the file and reads it as whichever of the two it turns out to be
+	// On success the chain's data points into file, so it must stay open while the data is used
+	static bool Read( const std::string &filename, MappedFile &file, MipChain &chain );
+
+	// Read a whole file's worth of bytes, however it was loaded
+	// On success the chain's data points into them
+	static bool ReadDDS( const char *data, size_t size, MipChain &chain );
+	static bool ReadKTX2( const char *data, size_t size, MipChain &chain );
+};
+
+#endif
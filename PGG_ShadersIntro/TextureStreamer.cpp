@@ -0,0 +1,347 @@
+
+#include "TextureStreamer.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+
+// Each job's space in the ring starts on a boundary this big, comfortably more than any unpack alignment
+static const size_t RING_ALIGNMENT = 256;
+
+// Mapped for writing by the workers while the GPU reads other parts of it
+// Coherent, so what they write is seen by uploads issued afterwards without flushing it by hand
+static const GLbitfield RING_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+
+TextureStreamer::TextureStreamer()
+{
+	_ringBuffer = 0;
+	_ringData = NULL;
+	_ringSize = 0;
+	_ringHead = 0;
+	_placeholder = 0;
+	_bytesPerFrame = 0;
+	_quit = false;
+	memset( &_stats, 0, sizeof( _stats ) );
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_quit = true;
+	}
+	_jobQueued.notify_all();
+	_ringFreed.notify_all();
+	for( size_t i = 0; i < _workers.size(); i++ )
+	{
+		_workers[i].join();
+	}
+
+	// Textures part way through uploading, and fences the GPU may not have reached yet
+	for( size_t i = 0; i < _ready.size(); i++ )
+	{
+		GLState::ForgetTexture( _ready[i]->storage );
+		glDeleteTextures( 1, &_ready[i]->storage );
+	}
+	for( size_t i = 0; i < _ringJobs.size(); i++ )
+	{
+		glDeleteSync( _ringJobs[i]->fence );
+	}
+
+	if( _ringBuffer != 0 )
+	{
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, _ringBuffer );
+		glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+		glDeleteBuffers( 1, &_ringBuffer );
+	}
+	GLState::ForgetTexture( _placeholder );
+	glDeleteTextures( 1, &_placeholder );
+}
+
+bool TextureStreamer::Init( size_t ringSize, size_t bytesPerFrame, unsigned int numThreads )
+{
+	if( !( GLEW_VERSION_4_4 || GLState::IsExtensionSupported( "GL_ARB_buffer_storage" ) ) || glBufferStorage == NULL )
+	{
+		std::cerr<<"WARNING: GL_ARB_buffer_storage isn't supported, textures will load without streaming"<<std::endl;
+		return false;
+	}
+
+	// The workers ask whether formats are supported, which needs the context, so make sure the answer is already known
+	Texture::IsFormatSupported( TEXTURE_FORMAT_BC1 );
+
+	// Storage that can't be resized, mapped once and left mapped
+	glGenBuffers( 1, &_ringBuffer );
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, _ringBuffer );
+	glBufferStorage( GL_PIXEL_UNPACK_BUFFER, ringSize, NULL, RING_FLAGS );
+	_ringData = (unsigned char*) glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, ringSize, RING_FLAGS );
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	if( _ringData == NULL )
+	{
+		std::cerr<<"WARNING: could not map the texture streaming buffer, textures will load without streaming"<<std::endl;
+		glDeleteBuffers( 1, &_ringBuffer );
+		_ringBuffer = 0;
+		return false;
+	}
+	_ringSize = ringSize;
+	_ringHead = 0;
+	_bytesPerFrame = bytesPerFrame;
+	_stats.ringSize = ringSize;
+
+	// White, so materials show their diffuse colour until the real texture arrives
+	static const unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures( 1, &_placeholder );
+	GLState::BindTexture( 0, GL_TEXTURE_2D, _placeholder );
+	glTexStorage2D( GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1 );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+	// Each worker runs a whole load, which spreads its own filtering and compression over every core,
+	// so a couple are enough to keep one texture decoding while another waits on the disk
+	for( unsigned int i = 0; i < std::max( numThreads, 1u ); i++ )
+	{
+		_workers.push_back( std::thread( &TextureStreamer::WorkerLoop, this ) );
+	}
+	return true;
+}
+
+void TextureStreamer::Request( const std::shared_ptr<Texture> &texture, const std::string &filename, const TextureLoadOptions &options )
+{
+	texture->SetPlaceholder( _placeholder );
+
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->texture = texture;
+	job->filename = filename;
+	job->options = options;
+	// The workers already load textures side by side, a thread pool each would only fight them for the cores
+	job->options.numThreads = 1;
+	job->failed = false;
+	job->inRing = false;
+	job->ringOffset = 0;
+	job->ringBytes = 0;
+	job->storage = 0;
+	job->nextLevel = 0;
+	job->fence = 0;
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_queued.push_back( job );
+	}
+	_stats.pending++;
+	_jobQueued.notify_one();
+}
+
+void TextureStreamer::Update()
+{
+	RetireFinished();
+	UploadReady();
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	_stats.ringBytesInUse = 0;
+	for( size_t i = 0; i < _ringJobs.size(); i++ )
+	{
+		_stats.ringBytesInUse += _ringJobs[i]->ringBytes;
+	}
+}
+
+void TextureStreamer::WorkerLoop()
+{
+	while( true )
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock( _mutex );
+			_jobQueued.wait( lock, [this]() { return _quit || !_queued.empty(); } );
+			if( _quit )
+			{
+				return;
+			}
+			job = _queued.front();
+			_queued.pop_front();
+		}
+
+		// Nothing to do for a texture that was let go before we got to it, Update drops it
+		if( !job->texture.expired() )
+		{
+			job->failed = !Texture::LoadData( job->filename, job->options, job->data );
+		}
+
+		// Anything that fits goes into the ring, waiting for the GPU to finish with older textures if it's full
+		const MipChain &chain = job->data.chain;
+		size_t ringBytes = ( chain.dataSize + RING_ALIGNMENT - 1 ) / RING_ALIGNMENT * RING_ALIGNMENT;
+		if( !job->failed && chain.data != NULL && ringBytes <= _ringSize )
+		{
+			{
+				std::unique_lock<std::mutex> lock( _mutex );
+				_ringFreed.wait( lock, [&]() { return _quit || AllocateRing( ringBytes, job->ringOffset ); } );
+				if( _quit )
+				{
+					return;
+				}
+				job->inRing = true;
+				job->ringBytes = ringBytes;
+				_ringJobs.push_back( job );
+			}
+
+			// The space is ours now, so the copy doesn't need the lock
+			memcpy( _ringData + job->ringOffset, chain.data, chain.dataSize );
+
+			// Only the level sizes are needed from here on, so let go of the pixels or file early
+			job->data.file.Close();
+			std::vector<unsigned char>().swap( job->data.chain.pixels );
+			job->data.chain.data = NULL;
+		}
+
+		std::lock_guard<std::mutex> lock( _mutex );
+		_ready.push_back( job );
+	}
+}
+
+bool TextureStreamer::AllocateRing( size_t bytes, size_t &offset )
+{
+	if( _ringJobs.empty() )
+	{
+		_ringHead = 0;
+	}
+	else
+	{
+		// Free space runs from the head up to the oldest job, which is either further on or back round at the start
+		size_t tail = _ringJobs.front()->ringOffset;
+		if( _ringHead > tail )
+		{
+			if( _ringHead + bytes > _ringSize )
+			{
+				// The end is too small, skip it and try the start
+				if( bytes > tail )
+				{
+					return false;
+				}
+				_ringHead = 0;
+			}
+		}
+		else if( _ringHead + bytes > tail )
+		{
+			return false;
+		}
+	}
+	offset = _ringHead;
+	_ringHead += bytes;
+	return true;
+}
+
+void TextureStreamer::UploadReady()
+{
+	size_t bytes = 0;
+	bool boundRing = false;
+	while( bytes < _bytesPerFrame || bytes == 0 )
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			if( _ready.empty() )
+			{
+				break;
+			}
+			job = _ready.front();
+		}
+
+		// The worker is done with it, so its messages can go out now without getting mixed up with anyone else's
+		std::cout<<job->data.log.str();
+		job->data.log.str( "" );
+
+		std::shared_ptr<Texture> texture = job->texture.lock();
+		if( texture && !job->failed )
+		{
+			const MipChain &chain = job->data.chain;
+			if( job->storage == 0 )
+			{
+				job->storage = Texture::CreateStorage( chain );
+			}
+			else
+			{
+				GLState::BindTexture( 0, GL_TEXTURE_2D, job->storage );
+			}
+
+			// From the ring the pixels are an offset into the bound buffer, otherwise they come straight from memory
+			if( job->inRing != boundRing )
+			{
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, job->inRing ? _ringBuffer : 0 );
+				boundRing = job->inRing;
+			}
+			while( job->nextLevel < chain.levels.size() && ( bytes < _bytesPerFrame || bytes == 0 ) )
+			{
+				const MipLevel &level = chain.levels[job->nextLevel];
+				const void *pixels = job->inRing ? (const void*)(size_t) ( job->ringOffset + level.offset ) : chain.GetLevelData( job->nextLevel );
+				Texture::UploadLevel( chain, job->nextLevel, pixels );
+				bytes += GetTextureLevelSize( chain.format, level.width, level.height );
+				job->nextLevel++;
+			}
+			if( job->nextLevel < chain.levels.size() )
+			{
+				// Out of budget, carry on from here next frame
+				break;
+			}
+
+			// Every level is in, so draws from here on can use it
+			texture->Adopt( job->storage, chain );
+			job->storage = 0;
+			_stats.resident++;
+		}
+		else
+		{
+			// Failed to load, or nobody wants it any more
+			// One that failed draws the way it would have if it had been loaded straight away, with no texture at all
+			if( texture )
+			{
+				texture->SetPlaceholder( 0 );
+				_stats.failed++;
+			}
+			// GLState still has it bound to unit 0 from CreateStorage, and the name will be handed out again
+			GLState::ForgetTexture( job->storage );
+			glDeleteTextures( 1, &job->storage );
+			job->storage = 0;
+		}
+
+		// The ring space can be reused once the GPU is past the uploads from it
+		if( job->inRing )
+		{
+			job->fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		}
+		_stats.pending--;
+
+		std::lock_guard<std::mutex> lock( _mutex );
+		_ready.pop_front();
+	}
+
+	if( boundRing )
+	{
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	}
+	_stats.bytesLastFrame = bytes;
+}
+
+void TextureStreamer::RetireFinished()
+{
+	bool freed = false;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		while( !_ringJobs.empty() && _ringJobs.front()->fence != 0 )
+		{
+			GLenum result = glClientWaitSync( _ringJobs.front()->fence, 0, 0 );
+			if( result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED )
+			{
+				break;
+			}
+			glDeleteSync( _ringJobs.front()->fence );
+			_ringJobs.pop_front();
+			freed = true;
+		}
+	}
+	if( freed )
+	{
+		_ringFreed.notify_all();
+	}
+}
@@ -0,0 +1,129 @@
+
+#ifndef __TEXTURE_STREAMER__
+#define __TEXTURE_STREAMER__
+
+#include "glew.h"
+#include "Texture.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the streamer is up to, for showing on screen
+struct TextureStreamStats
+{
+	// Asked for and not drawn with their own levels yet, whether loading, waiting for ring space or uploading
+	unsigned int pending;
+	// Made it all the way, and the ones that failed to load
+	unsigned int resident;
+	unsigned int failed;
+	// Bytes copied into textures by the last Update
+	size_t bytesLastFrame;
+	// Bytes of the ring holding levels the GPU may still be reading
+	size_t ringBytesInUse;
+	size_t ringSize;
+};
+
+// Loads textures in the background, so the first frames don't wait for every image to be decoded, filtered and compressed
+// Worker threads do everything Texture::Load does short of calling OpenGL, then copy the levels into a ring buffer that
+// stays mapped the whole time. Once a frame, the render thread copies levels from the ring into their textures, up to
+// a budget of bytes so a big texture is spread over a few frames instead of causing a hitch. A fence after each texture's
+// last level tells us when the GPU has finished reading its part of the ring, so that part can be handed out again.
+// Until then every streamed texture hands out a 1x1 white placeholder from GetHandle
+class TextureStreamer
+{
+public:
+
+	TextureStreamer();
+	~TextureStreamer();
+
+	// Makes the ring and placeholder and starts the workers, call on the render thread
+	// Keeping the ring mapped needs GL_ARB_buffer_storage (core from OpenGL 4.4), returns false without it
+	// Textures should then be loaded straight away as before
+	bool Init( size_t ringSize = 32 << 20, size_t bytesPerFrame = 4 << 20, unsigned int numThreads = 2 );
+
+	// Shows the placeholder on the texture and queues it to be loaded from the file in the background
+	// The streamer only keeps a weak reference, so a texture freed before it arrives is simply dropped
+	void Request( const std::shared_ptr<Texture> &texture, const std::string &filename, const TextureLoadOptions &options );
+
+	// Uploads what the workers have finished, within the budget, and frees ring space the GPU is done with
+	// Call once a frame on the render thread, before drawing
+	void Update();
+
+	// Most bytes Update uploads in one frame, it always does at least one level so nothing waits forever
+	void SetBytesPerFrame( size_t bytesPerFrame ) { _bytesPerFrame = bytesPerFrame; }
+	size_t GetBytesPerFrame() const { return _bytesPerFrame; }
+
+	const TextureStreamStats& GetStats() const { return _stats; }
+
+protected:
+
+	// One texture on its way from file to GPU
+	struct Job
+	{
+		std::weak_ptr<Texture> texture;
+		std::string filename;
+		TextureLoadOptions options;
+
+		// Filled in by a worker
+		TextureData data;
+		bool failed;
+
+		// Where the levels were copied to in the ring
+		// Too big for the ring, they're uploaded from data instead
+		bool inRing;
+		size_t ringOffset, ringBytes;
+
+		// Texture being filled on the render thread, and the next level to go into it
+		GLuint storage;
+		unsigned int nextLevel;
+
+		// Signalled once the GPU has read the last level out of the ring
+		GLsync fence;
+	};
+
+	// The ring and the thread can't be shared between streamers
+	TextureStreamer( const TextureStreamer & );
+	TextureStreamer& operator=( const TextureStreamer & );
+
+	void WorkerLoop();
+
+	// Finds room for the given bytes after the newest job in the ring, wrapping round to the start if the end is too small
+	// Call with the mutex held, returns false if there isn't room until older jobs have been retired
+	bool AllocateRing( size_t bytes, size_t &offset );
+
+	// Copies as many levels as the budget allows, for jobs in the order they were finished
+	void UploadReady();
+
+	// Frees ring space from the oldest jobs the GPU has finished with
+	void RetireFinished();
+
+	GLuint _ringBuffer;
+	unsigned char *_ringData;
+	size_t _ringSize;
+	// Where the next allocation starts, the oldest one in use is the front of _ringJobs
+	size_t _ringHead;
+
+	GLuint _placeholder;
+	size_t _bytesPerFrame;
+
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _jobQueued;
+	std::condition_variable _ringFreed;
+	bool _quit;
+
+	// Waiting for a worker
+	std::deque< std::shared_ptr<Job> > _queued;
+	// Loaded and copied, waiting for the render thread to upload them
+	std::deque< std::shared_ptr<Job> > _ready;
+	// Holding ring space, in the order it was handed out
+	std::deque< std::shared_ptr<Job> > _ringJobs;
+
+	TextureStreamStats _stats;
+};
+
+#endif
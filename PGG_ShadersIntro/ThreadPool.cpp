@@ -0,0 +1,102 @@
+
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool( unsigned int numThreads )
+{
+	_task = NULL;
+	_taskCount = 0;
+	_nextTask = 0;
+	_tasksRemaining = 0;
+	_generation = 0;
+	_quit = false;
+
+	if( numThreads == 0 )
+	{
+		numThreads = std::thread::hardware_concurrency();
+	}
+
+	// The thread calling ParallelFor is one of the workers
+	for( unsigned int i = 1; i < numThreads; i++ )
+	{
+		_workers.push_back( std::thread( &ThreadPool::WorkerLoop, this ) );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_quit = true;
+	}
+	_workReady.notify_all();
+
+	for( size_t i = 0; i < _workers.size(); i++ )
+	{
+		_workers[i].join();
+	}
+}
+
+void ThreadPool::ParallelFor( unsigned int count, const std::function<void( unsigned int )> &task )
+{
+	if( count == 0 )
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_task = &task;
+		_taskCount = count;
+		_nextTask = 0;
+		_tasksRemaining = count;
+		_generation++;
+	}
+	_workReady.notify_all();
+
+	RunTasks();
+
+	// Wait for the other threads to finish what they picked up
+	std::unique_lock<std::mutex> lock( _mutex );
+	_workDone.wait( lock, [this]{ return _tasksRemaining == 0; } );
+	_task = NULL;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	unsigned int lastGeneration = 0;
+	while( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( _mutex );
+			_workReady.wait( lock, [&]{ return _quit || _generation != lastGeneration; } );
+			if( _quit )
+			{
+				return;
+			}
+			lastGeneration = _generation;
+		}
+
+		RunTasks();
+	}
+}
+
+void ThreadPool::RunTasks()
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	while( _task != NULL && _nextTask < _taskCount )
+	{
+		unsigned int index = _nextTask++;
+		const std::function<void( unsigned int )> &task = *_task;
+
+		lock.unlock();
+		task( index );
+		lock.lock();
+
+		_tasksRemaining--;
+		if( _tasksRemaining == 0 )
+		{
+			_workDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,55 @@
+
+#ifndef __THREAD_POOL__
+#define __THREAD_POOL__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// A fixed set of worker threads for splitting a loop across cores
+// The calling thread joins in with the work, so a pool of 1 runs everything in place with no threads at all
+class ThreadPool
+{
+public:
+
+	// 0 means use one thread per hardware core
+	ThreadPool( unsigned int numThreads = 0 );
+	~ThreadPool();
+
+	unsigned int GetNumThreads() const { return (unsigned int) _workers.size() + 1; }
+
+	// Calls task(i) for every i in [0, count), spread over the threads
+	// Returns once all of them have finished
+	void ParallelFor( unsigned int count, const std::function<void( unsigned int )> &task );
+
+protected:
+
+	// Pool can't be copied
+	ThreadPool( const ThreadPool & );
+	ThreadPool& operator=( const ThreadPool & );
+
+	void WorkerLoop();
+
+	// Takes loop indices until there are none left
+	void RunTasks();
+
+	std::vector<std::thread> _workers;
+
+	std::mutex _mutex;
+	std::condition_variable _workReady;
+	std::condition_variable _workDone;
+
+	// The loop currently being run
+	const std::function<void( unsigned int )> *_task;
+	unsigned int _taskCount;
+	unsigned int _nextTask;
+	unsigned int _tasksRemaining;
+
+	// Bumped for every ParallelFor so sleeping workers can tell there's new work
+	unsigned int _generation;
+	bool _quit;
+};
+
+#endif
@@ -0,0 +1,40 @@
+
+#include "UniformBuffer.h"
+
+
+UniformBuffer::UniformBuffer()
+{
+	_buffer = 0;
+	_size = 0;
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers( 1, &_buffer );
+}
+
+void UniformBuffer::Create( GLuint binding, size_t size )
+{
+	glDeleteBuffers( 1, &_buffer );
+	glGenBuffers( 1, &_buffer );
+	_size = size;
+
+	// GL_DYNAMIC_DRAW because it's rewritten every frame
+	glBindBuffer( GL_UNIFORM_BUFFER, _buffer );
+	glBufferData( GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+	// Every program with a block at this binding point now reads from this buffer
+	glBindBufferBase( GL_UNIFORM_BUFFER, binding, _buffer );
+}
+
+void UniformBuffer::Update( const void *data, size_t size )
+{
+	if( _buffer == 0 || size > _size )
+	{
+		return;
+	}
+	glBindBuffer( GL_UNIFORM_BUFFER, _buffer );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, size, data );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
@@ -0,0 +1,63 @@
+
+#ifndef __UNIFORM_BUFFER__
+#define __UNIFORM_BUFFER__
+
+#include "glew.h"
+#include <GLM/glm.hpp>
+#include <cstddef>
+
+// Binding points for the uniform blocks in Resources/uniformBlocks.txt
+// The shaders pick these with layout(binding = N), so the two must match
+enum UniformBlockBinding
+{
+	FRAME_BLOCK_BINDING = 0,
+	LIGHT_BLOCK_BINDING = 1
+};
+
+// The FrameData block, the same for every object drawn in a frame
+// std140 lays a mat4 out as four vec4s, the same as glm, so this can be copied straight in
+struct FrameBlock
+{
+	glm::mat4 viewMat;
+	glm::mat4 projMat;
+	// The light's projection * view, used by the shadow pass and for shadow map lookups
+	glm::mat4 lightSpaceMatrix;
+};
+
+// The LightData block
+// In std140 a vec3 takes up 16 bytes unless a float follows it, hence the padding
+struct LightBlock
+{
+	glm::vec4 worldSpaceLightPos;
+	glm::vec3 lightColour;
+	float padding;
+};
+
+// A buffer of uniform values that every program reading the same block shares
+// Setting a value here once replaces setting it in each program for each object
+class UniformBuffer
+{
+public:
+
+	UniformBuffer();
+	~UniformBuffer();
+
+	// Makes a buffer of the given size, attached to a binding point for good
+	void Create( GLuint binding, size_t size );
+
+	// Replaces the whole contents of the buffer
+	void Update( const void *data, size_t size );
+
+	GLuint GetHandle() const { return _buffer; }
+
+protected:
+
+	// Buffers can't be shared between objects
+	UniformBuffer( const UniformBuffer & );
+	UniformBuffer& operator=( const UniformBuffer & );
+
+	GLuint _buffer;
+	size_t _size;
+};
+
+#endif
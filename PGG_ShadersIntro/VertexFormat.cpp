@@ -0,0 +1,255 @@
+
+#include "VertexFormat.h"
+#include "MeshData.h"
+#include "VertexQuantization.h"
+#include <cstring>
+#include <algorithm>
+
+
+// Buffer of 0, 1, 2... behind every VAO's instance index attribute, and how far it counts
+static GLuint instanceIndexBuffer = 0;
+static unsigned int numInstanceIndices = 0;
+// Enough for a scene of a few thousand objects before it needs to grow
+static const unsigned int MIN_INSTANCE_INDICES = 4096;
+
+// Size in bytes of one component of the given GL type
+static unsigned int ComponentSize( GLenum type )
+{
+	switch( type )
+	{
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+
+VertexFormat::VertexFormat()
+{
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		_strides[i] = 0;
+	}
+}
+
+VertexFormat VertexFormat::Standard( bool hasNormals, bool hasUVs, bool separatePositions )
+{
+	VertexFormat format;
+	format.AddAttribute( VERTEX_POSITION, 3, GL_FLOAT, GL_FALSE, separatePositions ? VERTEX_STREAM_POSITION : VERTEX_STREAM_MAIN );
+	if( hasNormals )
+	{
+		format.AddAttribute( VERTEX_NORMAL, 3, GL_FLOAT, GL_FALSE, VERTEX_STREAM_MAIN );
+	}
+	if( hasUVs )
+	{
+		format.AddAttribute( VERTEX_UV, 2, GL_FLOAT, GL_FALSE, VERTEX_STREAM_MAIN );
+	}
+	return format;
+}
+
+VertexFormat VertexFormat::Quantized( bool hasNormals, bool hasUVs, bool separatePositions )
+{
+	// Three shorts are padded out to eight bytes, so positions are 8 bytes rather than 12
+	VertexFormat format;
+	format.AddAttribute( VERTEX_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE, separatePositions ? VERTEX_STREAM_POSITION : VERTEX_STREAM_MAIN );
+	if( hasNormals )
+	{
+		format.AddAttribute( VERTEX_NORMAL, 2, GL_SHORT, GL_TRUE, VERTEX_STREAM_MAIN );
+	}
+	if( hasUVs )
+	{
+		format.AddAttribute( VERTEX_UV, 2, GL_UNSIGNED_SHORT, GL_TRUE, VERTEX_STREAM_MAIN );
+	}
+	return format;
+}
+
+bool VertexFormat::IsQuantized() const
+{
+	for( size_t a = 0; a < _attributes.size(); a++ )
+	{
+		if( _attributes[a].type != GL_FLOAT )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool VertexFormat::operator==( const VertexFormat &other ) const
+{
+	if( _attributes.size() != other._attributes.size() )
+	{
+		return false;
+	}
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		if( _strides[i] != other._strides[i] )
+		{
+			return false;
+		}
+	}
+	for( size_t a = 0; a < _attributes.size(); a++ )
+	{
+		const VertexAttribute &mine = _attributes[a];
+		const VertexAttribute &theirs = other._attributes[a];
+		if( mine.location != theirs.location || mine.components != theirs.components || mine.type != theirs.type
+			|| mine.normalized != theirs.normalized || mine.stream != theirs.stream || mine.offset != theirs.offset )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void VertexFormat::AddAttribute( GLuint location, GLint components, GLenum type, GLboolean normalized, VertexStream stream )
+{
+	VertexAttribute attribute;
+	attribute.location = location;
+	attribute.components = components;
+	attribute.type = type;
+	attribute.normalized = normalized;
+	attribute.stream = stream;
+	attribute.offset = _strides[stream];
+
+	// Keep every attribute 4-byte aligned, which GPUs prefer
+	_strides[stream] += ( components * ComponentSize( type ) + 3 ) & ~3u;
+
+	_attributes.push_back( attribute );
+}
+
+void VertexFormat::Pack( const MeshData &meshData, const VertexDecode &decode, std::vector<unsigned char> streams[VERTEX_STREAM_COUNT] ) const
+{
+	size_t numVertices = meshData.positions.size();
+	for( unsigned int i = 0; i < VERTEX_STREAM_COUNT; i++ )
+	{
+		streams[i].assign( numVertices * _strides[i], 0 );
+	}
+
+	for( size_t a = 0; a < _attributes.size(); a++ )
+	{
+		const VertexAttribute &attribute = _attributes[a];
+
+		// Find the source data for this attribute, and the range 16-bit values are stored relative to
+		const float *source = NULL;
+		unsigned int sourceComponents = 0;
+		const float *rangeOffset = NULL;
+		const float *rangeScale = NULL;
+		if( attribute.location == VERTEX_POSITION && !meshData.positions.empty() )
+		{
+			source = &meshData.positions[0].x;
+			sourceComponents = 3;
+			rangeOffset = &decode.positionOffset.x;
+			rangeScale = &decode.positionScale.x;
+		}
+		else if( attribute.location == VERTEX_NORMAL && !meshData.normals.empty() )
+		{
+			source = &meshData.normals[0].x;
+			sourceComponents = 3;
+		}
+		else if( attribute.location == VERTEX_UV && !meshData.uvs.empty() )
+		{
+			source = &meshData.uvs[0].x;
+			sourceComponents = 2;
+			rangeOffset = &decode.uvOffset.x;
+			rangeScale = &decode.uvScale.x;
+		}
+		if( source == NULL )
+		{
+			continue;
+		}
+
+		// Copy it into its slot in every vertex
+		unsigned int stride = _strides[attribute.stream];
+		unsigned int numCopied = ( (unsigned int) attribute.components < sourceComponents ? attribute.components : sourceComponents );
+		unsigned char *destination = &streams[attribute.stream][attribute.offset];
+		for( size_t v = 0; v < numVertices; v++ )
+		{
+			const float *values = source + v * sourceComponents;
+
+			if( attribute.type == GL_FLOAT )
+			{
+				memcpy( destination, values, numCopied * sizeof( float ) );
+			}
+			else if( attribute.location == VERTEX_NORMAL && decode.octNormals && attribute.type == GL_SHORT )
+			{
+				short encoded[2];
+				EncodeOctNormal( glm::vec3( values[0], values[1], values[2] ), encoded );
+				memcpy( destination, encoded, sizeof( encoded ) );
+			}
+			else if( attribute.type == GL_UNSIGNED_SHORT && rangeOffset != NULL )
+			{
+				unsigned short encoded[3];
+				for( unsigned int i = 0; i < numCopied; i++ )
+				{
+					encoded[i] = EncodeRange16( values[i], rangeOffset[i], rangeScale[i] );
+				}
+				memcpy( destination, encoded, numCopied * sizeof( unsigned short ) );
+			}
+			destination += stride;
+		}
+	}
+}
+
+void VertexFormat::Apply( const GLuint buffers[VERTEX_STREAM_COUNT], bool positionsOnly ) const
+{
+	for( size_t a = 0; a < _attributes.size(); a++ )
+	{
+		const VertexAttribute &attribute = _attributes[a];
+		if( positionsOnly && attribute.location != VERTEX_POSITION )
+		{
+			continue;
+		}
+
+		// Attribute pointers read from whichever buffer is bound when they're set
+		glBindBuffer( GL_ARRAY_BUFFER, buffers[attribute.stream] );
+		glVertexAttribPointer( attribute.location, attribute.components, attribute.type, attribute.normalized,
+			_strides[attribute.stream], (const void*)(size_t) attribute.offset );
+		glEnableVertexAttribArray( attribute.location );
+	}
+
+	// The divisor makes it step once per instance rather than per vertex
+	// The buffer only ever grows in place, so VAOs set up now keep reading the right one
+	ReserveInstanceIndices( MIN_INSTANCE_INDICES );
+	glBindBuffer( GL_ARRAY_BUFFER, instanceIndexBuffer );
+	glVertexAttribIPointer( VERTEX_INSTANCE_INDEX, 1, GL_UNSIGNED_INT, 0, NULL );
+	glVertexAttribDivisor( VERTEX_INSTANCE_INDEX, 1 );
+	glEnableVertexAttribArray( VERTEX_INSTANCE_INDEX );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void VertexFormat::ReserveInstanceIndices( unsigned int count )
+{
+	if( count <= numInstanceIndices )
+	{
+		return;
+	}
+	// Double it, so a growing scene doesn't refill it every frame
+	numInstanceIndices = std::max( count, numInstanceIndices * 2 );
+	std::vector<GLuint> indices( numInstanceIndices );
+	for( unsigned int i = 0; i < numInstanceIndices; i++ )
+	{
+		indices[i] = i;
+	}
+
+	if( instanceIndexBuffer == 0 )
+	{
+		glGenBuffers( 1, &instanceIndexBuffer );
+	}
+	// A new store under the same name, VAOs refer to buffers by name so they see the bigger one
+	glBindBuffer( GL_ARRAY_BUFFER, instanceIndexBuffer );
+	glBufferData( GL_ARRAY_BUFFER, numInstanceIndices * sizeof( GLuint ), &indices[0], GL_STATIC_DRAW );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void VertexFormat::ReleaseInstanceIndices()
+{
+	glDeleteBuffers( 1, &instanceIndexBuffer );
+	instanceIndexBuffer = 0;
+	numInstanceIndices = 0;
+}
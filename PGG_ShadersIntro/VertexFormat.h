@@ -0,0 +1,102 @@
+
+#ifndef __VERTEX_FORMAT__
+#define __VERTEX_FORMAT__
+
+#include "glew.h"
+#include <vector>
+
+struct MeshData;
+struct VertexDecode;
+
+// Attribute locations, these must match the layout(location = N) inputs of the vertex shaders
+enum VertexAttributeLocation
+{
+	VERTEX_POSITION = 0,
+	VERTEX_NORMAL = 1,
+	VERTEX_UV = 2,
+	// Each instance's index into the render queue's instance buffer, see ReserveInstanceIndices
+	VERTEX_INSTANCE_INDEX = 3
+};
+
+// Which buffer an attribute lives in
+// Everything is interleaved in the main stream unless positions are split out into their own stream
+enum VertexStream
+{
+	VERTEX_STREAM_MAIN = 0,
+	VERTEX_STREAM_POSITION = 1,
+	VERTEX_STREAM_COUNT = 2
+};
+
+// How one attribute is stored in a vertex
+struct VertexAttribute
+{
+	GLuint location;
+	GLint components;
+	GLenum type;
+	GLboolean normalized;
+
+	VertexStream stream;
+	// Bytes from the start of the vertex in its stream
+	unsigned int offset;
+};
+
+// Describes the layout of a mesh's vertex buffers
+// It packs MeshData into those buffers and tells OpenGL how to read them back
+class VertexFormat
+{
+public:
+
+	VertexFormat();
+
+	// Standard layout of 32-bit float position, normal and uv, all interleaved into one buffer
+	// With separatePositions, positions get their own tightly packed buffer instead,
+	// so passes that only need positions (like the shadow pass) fetch 12 bytes per vertex
+	static VertexFormat Standard( bool hasNormals, bool hasUVs, bool separatePositions );
+
+	// Compressed layout, half the size of Standard
+	// 16-bit positions and uvs as fractions of their range, and normals octahedron-encoded into two 16-bit values
+	// The vertex shader needs the mesh's VertexDecode to turn them back into the real values
+	static VertexFormat Quantized( bool hasNormals, bool hasUVs, bool separatePositions );
+
+	// Appends an attribute to the end of the vertex in the given stream
+	void AddAttribute( GLuint location, GLint components, GLenum type, GLboolean normalized, VertexStream stream );
+
+	const std::vector<VertexAttribute>& GetAttributes() const { return _attributes; }
+
+	// Size in bytes of one vertex in the stream, 0 if nothing uses it
+	unsigned int GetStride( VertexStream stream ) const { return _strides[stream]; }
+
+	bool HasSeparatePositions() const { return _strides[VERTEX_STREAM_POSITION] > 0; }
+
+	// Writes the vertices into one byte array per stream
+	// 16-bit attributes are stored relative to the ranges in decode (see VertexQuantization.h)
+	void Pack( const MeshData &meshData, const VertexDecode &decode, std::vector<unsigned char> streams[VERTEX_STREAM_COUNT] ) const;
+
+	// True if any attribute is stored as something other than 32-bit floats
+	bool IsQuantized() const;
+
+	// Same attributes in the same places, so meshes with either can share buffers (see GeometryPool)
+	bool operator==( const VertexFormat &other ) const;
+
+	// Sets up the attribute pointers of the currently bound VAO
+	// buffers are the GL buffers holding each stream
+	// positionsOnly skips everything except the position, for depth-only passes
+	// The instance index attribute is always set up as well
+	void Apply( const GLuint buffers[VERTEX_STREAM_COUNT], bool positionsOnly ) const;
+
+	// Makes sure the instance index buffer counts up to at least count
+	// It holds 0, 1, 2... and is read once per instance, so an instance's index is its draw's baseInstance plus gl_InstanceID
+	// That lets each command of a glMultiDrawElementsIndirect find its own objects, without needing gl_BaseInstance from GL 4.6
+	static void ReserveInstanceIndices( unsigned int count );
+
+	// Deletes the instance index buffer, the render queue does this when it goes as it's the one keeping it big enough
+	// Every VAO set up so far reads it, so only call this once nothing is going to be drawn again
+	static void ReleaseInstanceIndices();
+
+protected:
+
+	std::vector<VertexAttribute> _attributes;
+	unsigned int _strides[VERTEX_STREAM_COUNT];
+};
+
+#endif
@@ -0,0 +1,169 @@
+
+#include "VertexQuantization.h"
+#include "MeshData.h"
+#include <cmath>
+#include <algorithm>
+
+
+VertexDecode ComputeQuantizedDecode( const MeshData &meshData )
+{
+	VertexDecode decode;
+	decode.octNormals = !meshData.normals.empty();
+
+	if( !meshData.positions.empty() )
+	{
+		glm::vec3 boundsMin = meshData.positions[0], boundsMax = meshData.positions[0];
+		for( size_t v = 1; v < meshData.positions.size(); v++ )
+		{
+			boundsMin = glm::min( boundsMin, meshData.positions[v] );
+			boundsMax = glm::max( boundsMax, meshData.positions[v] );
+		}
+		decode.positionOffset = boundsMin;
+		decode.positionScale = boundsMax - boundsMin;
+	}
+
+	// UVs are often outside 0-1 when textures repeat, so they get a range too
+	if( !meshData.uvs.empty() )
+	{
+		glm::vec2 uvMin = meshData.uvs[0], uvMax = meshData.uvs[0];
+		for( size_t v = 1; v < meshData.uvs.size(); v++ )
+		{
+			uvMin = glm::min( uvMin, meshData.uvs[v] );
+			uvMax = glm::max( uvMax, meshData.uvs[v] );
+		}
+		decode.uvOffset = uvMin;
+		decode.uvScale = uvMax - uvMin;
+	}
+	return decode;
+}
+
+
+unsigned short EncodeUnorm16( float value )
+{
+	value = std::min( std::max( value, 0.0f ), 1.0f );
+	return (unsigned short) ( value * 65535.0f + 0.5f );
+}
+
+float DecodeUnorm16( unsigned short value )
+{
+	return value / 65535.0f;
+}
+
+unsigned short EncodeRange16( float value, float offset, float scale )
+{
+	// A flat range (e.g. a mesh with no depth) only has the one value, which is the offset
+	return EncodeUnorm16( scale > 0.0f ? ( value - offset ) / scale : 0.0f );
+}
+
+short EncodeSnorm16( float value )
+{
+	value = std::min( std::max( value, -1.0f ), 1.0f );
+	return (short) std::floor( value * 32767.0f + 0.5f );
+}
+
+float DecodeSnorm16( short value )
+{
+	return std::max( value / 32767.0f, -1.0f );
+}
+
+
+void EncodeOctNormal( const glm::vec3 &normal, short encoded[2] )
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1
+	float sum = std::abs( normal.x ) + std::abs( normal.y ) + std::abs( normal.z );
+	glm::vec2 octahedron( 0.0f, 0.0f );
+	if( sum > 0.0f )
+	{
+		octahedron = glm::vec2( normal.x, normal.y ) / sum;
+
+		// Fold the bottom half out over the corners of the square
+		if( normal.z < 0.0f )
+		{
+			glm::vec2 folded( ( 1.0f - std::abs( octahedron.y ) ) * ( octahedron.x >= 0.0f ? 1.0f : -1.0f ),
+				( 1.0f - std::abs( octahedron.x ) ) * ( octahedron.y >= 0.0f ? 1.0f : -1.0f ) );
+			octahedron = folded;
+		}
+	}
+
+	// Rounding each component on its own isn't always closest once decoded, so try all four neighbours
+	glm::vec3 target = sum > 0.0f ? glm::normalize( normal ) : glm::vec3( 0.0f, 0.0f, 1.0f );
+	float x = std::floor( std::min( std::max( octahedron.x, -1.0f ), 1.0f ) * 32767.0f );
+	float y = std::floor( std::min( std::max( octahedron.y, -1.0f ), 1.0f ) * 32767.0f );
+	encoded[0] = (short) x;
+	encoded[1] = (short) y;
+	float bestDot = -2.0f;
+	for( int i = 0; i < 4; i++ )
+	{
+		short candidate[2];
+		candidate[0] = (short) std::min( std::max( x + ( i & 1 ), -32767.0f ), 32767.0f );
+		candidate[1] = (short) std::min( std::max( y + ( i >> 1 ), -32767.0f ), 32767.0f );
+
+		float dot = glm::dot( DecodeOctNormal( candidate ), target );
+		if( dot > bestDot )
+		{
+			bestDot = dot;
+			encoded[0] = candidate[0];
+			encoded[1] = candidate[1];
+		}
+	}
+}
+
+glm::vec3 DecodeOctNormal( const short encoded[2] )
+{
+	// This must match OctDecode in the vertex shaders
+	glm::vec2 octahedron( DecodeSnorm16( encoded[0] ), DecodeSnorm16( encoded[1] ) );
+	glm::vec3 normal( octahedron.x, octahedron.y, 1.0f - std::abs( octahedron.x ) - std::abs( octahedron.y ) );
+	float fold = std::max( -normal.z, 0.0f );
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize( normal );
+}
+
+
+QuantizationError MeasureQuantizationError( const MeshData &meshData, const VertexDecode &decode )
+{
+	QuantizationError error;
+
+	for( size_t v = 0; v < meshData.positions.size(); v++ )
+	{
+		const glm::vec3 &position = meshData.positions[v];
+		glm::vec3 decoded;
+		for( int i = 0; i < 3; i++ )
+		{
+			unsigned short stored = EncodeRange16( position[i], decode.positionOffset[i], decode.positionScale[i] );
+			decoded[i] = DecodeUnorm16( stored ) * decode.positionScale[i] + decode.positionOffset[i];
+		}
+		error.position = std::max( error.position, glm::length( decoded - position ) );
+	}
+	float diagonal = glm::length( decode.positionScale );
+	error.positionRelative = diagonal > 0.0f ? error.position / diagonal : 0.0f;
+
+	if( decode.octNormals )
+	{
+		for( size_t v = 0; v < meshData.normals.size(); v++ )
+		{
+			float length = glm::length( meshData.normals[v] );
+			if( length <= 0.0f )
+			{
+				continue;
+			}
+
+			short stored[2];
+			EncodeOctNormal( meshData.normals[v], stored );
+			float cosAngle = glm::dot( DecodeOctNormal( stored ), meshData.normals[v] / length );
+			float degrees = std::acos( std::min( std::max( cosAngle, -1.0f ), 1.0f ) ) * 57.2957795f;
+			error.normalDegrees = std::max( error.normalDegrees, degrees );
+		}
+	}
+
+	for( size_t v = 0; v < meshData.uvs.size(); v++ )
+	{
+		for( int i = 0; i < 2; i++ )
+		{
+			unsigned short stored = EncodeRange16( meshData.uvs[v][i], decode.uvOffset[i], decode.uvScale[i] );
+			float decoded = DecodeUnorm16( stored ) * decode.uvScale[i] + decode.uvOffset[i];
+			error.uv = std::max( error.uv, std::abs( decoded - meshData.uvs[v][i] ) );
+		}
+	}
+	return error;
+}
@@ -0,0 +1,63 @@
+
+#ifndef __VERTEX_QUANTIZATION__
+#define __VERTEX_QUANTIZATION__
+
+#include <GLM/glm.hpp>
+
+struct MeshData;
+
+// How the vertex shader turns a mesh's stored attributes back into model space values
+// Quantized meshes store positions and uvs as 16-bit fractions of their range, and normals octahedron-encoded
+// A mesh stored as plain floats just uses the defaults, which leave everything unchanged
+struct VertexDecode
+{
+	VertexDecode() : positionScale( 1.0f ), positionOffset( 0.0f ), uvScale( 1.0f ), uvOffset( 0.0f ), octNormals( false ) {}
+
+	// position = stored * positionScale + positionOffset
+	glm::vec3 positionScale;
+	glm::vec3 positionOffset;
+
+	// uv = stored * uvScale + uvOffset
+	glm::vec2 uvScale;
+	glm::vec2 uvOffset;
+
+	// Normals are two components on the octahedron rather than three
+	bool octNormals;
+};
+
+// Largest difference between a mesh and its quantized copy
+struct QuantizationError
+{
+	QuantizationError() : position( 0.0f ), positionRelative( 0.0f ), normalDegrees( 0.0f ), uv( 0.0f ) {}
+
+	// Model space distance, and the same as a fraction of the bounding box diagonal
+	float position;
+	float positionRelative;
+
+	// Angle between the original and decoded normal
+	float normalDegrees;
+
+	float uv;
+};
+
+// Works out the ranges positions and uvs get stored relative to, so that they use the full 16 bits
+VertexDecode ComputeQuantizedDecode( const MeshData &meshData );
+
+// Conversions to and from the 16-bit values OpenGL reads as normalized (see "Conversion from Normalized Fixed-Point" in the GL spec)
+unsigned short EncodeUnorm16( float value );
+float DecodeUnorm16( unsigned short value );
+short EncodeSnorm16( float value );
+
+// Stores value as a 16-bit fraction of the range starting at offset, which is scale long
+unsigned short EncodeRange16( float value, float offset, float scale );
+float DecodeSnorm16( short value );
+
+// Maps a unit vector onto the octahedron and unfolds that into a square, giving two components in [-1,1]
+// The encoding tries the nearest four 16-bit values and keeps whichever decodes closest to the original
+void EncodeOctNormal( const glm::vec3 &normal, short encoded[2] );
+glm::vec3 DecodeOctNormal( const short encoded[2] );
+
+// Quantizes every vertex the same way VertexFormat::Pack does and measures how far each attribute moves
+QuantizationError MeasureQuantizationError( const MeshData &meshData, const VertexDecode &decode );
+
+#endif
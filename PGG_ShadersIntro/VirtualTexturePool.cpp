@@ -0,0 +1,692 @@
+
+#include "VirtualTexturePool.h"
+#include "GLState.h"
+#include "TextureFile.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+
+// Bump this whenever the layout of the file or the way tiles are cut changes, so old files get rebuilt
+static const unsigned int VIRTUAL_TEXTURE_VERSION = 1;
+
+// Texels along each side of a page, a tile with its border all round
+static const unsigned int PAGE_SIZE = VIRTUAL_TILE_SIZE + 2 * VIRTUAL_TILE_BORDER;
+
+// Start of every .svt file, every tile follows straight after it, each level's row by row
+struct VirtualTextureHeader
+{
+	char magic[4];
+	unsigned int version;
+
+	// What the tiles were cut from
+	unsigned long long sourceSize;
+	unsigned long long sourceModifiedTime;
+	unsigned long long sourceHash;
+	unsigned long long settingsHash;
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int format;
+	unsigned int numLevels;
+	unsigned int tileSize;
+	unsigned int tileBorder;
+	unsigned int numTiles;
+	unsigned int padding;
+};
+
+// Start of the texture sizes buffer, see VirtualTextures in Resources/virtualTexture.txt
+struct VirtualTextureBufferHeader
+{
+	GLint feedbackPixel;
+	GLint padding[3];
+};
+
+// One texture's entry in the texture sizes buffer
+struct VirtualTextureInfo
+{
+	GLint width, height, numLevels, firstTile;
+};
+
+
+// Tiles across and down one level
+static void GetTileCounts( unsigned int width, unsigned int height, unsigned int level, unsigned int &tilesX, unsigned int &tilesY )
+{
+	unsigned int levelWidth = std::max( width >> level, 1u );
+	unsigned int levelHeight = std::max( height >> level, 1u );
+	tilesX = ( levelWidth + VIRTUAL_TILE_SIZE - 1 ) / VIRTUAL_TILE_SIZE;
+	tilesY = ( levelHeight + VIRTUAL_TILE_SIZE - 1 ) / VIRTUAL_TILE_SIZE;
+}
+
+// How many tiles all of a texture's levels come to
+static unsigned int CountTiles( unsigned int width, unsigned int height, unsigned int numLevels )
+{
+	unsigned int numTiles = 0;
+	for( unsigned int level = 0; level < numLevels; level++ )
+	{
+		unsigned int tilesX, tilesY;
+		GetTileCounts( width, height, level, tilesX, tilesY );
+		numTiles += tilesX * tilesY;
+	}
+	return numTiles;
+}
+
+// Copies one tile and its border out of a level, wrapping round at the edges as the texture repeats
+// Compressed levels are copied a whole block at a time, which is why the border is a multiple of 4
+static void CutTile( const MipChain &chain, unsigned int level, unsigned int tileX, unsigned int tileY, unsigned char *tile )
+{
+	const MipLevel &mipLevel = chain.levels[level];
+	int unitSize = chain.format == TEXTURE_FORMAT_RGBA8 ? 1 : 4;
+	size_t unitBytes = GetTextureLevelSize( chain.format, 1, 1 );
+	int levelUnitsX = ( mipLevel.width + unitSize - 1 ) / unitSize;
+	int levelUnitsY = ( mipLevel.height + unitSize - 1 ) / unitSize;
+	int pageUnits = PAGE_SIZE / unitSize;
+	int originX = (int) ( tileX * VIRTUAL_TILE_SIZE - VIRTUAL_TILE_BORDER ) / unitSize;
+	int originY = (int) ( tileY * VIRTUAL_TILE_SIZE - VIRTUAL_TILE_BORDER ) / unitSize;
+
+	const unsigned char *levelData = chain.GetLevelData( level );
+	for( int y = 0; y < pageUnits; y++ )
+	{
+		int sourceY = ( ( originY + y ) % levelUnitsY + levelUnitsY ) % levelUnitsY;
+		for( int x = 0; x < pageUnits; x++ )
+		{
+			int sourceX = ( ( originX + x ) % levelUnitsX + levelUnitsX ) % levelUnitsX;
+			memcpy( tile + ( (size_t) y * pageUnits + x ) * unitBytes, levelData + ( (size_t) sourceY * levelUnitsX + sourceX ) * unitBytes, unitBytes );
+		}
+	}
+}
+
+
+VirtualTexturePool::VirtualTexturePool()
+{
+	_format = TEXTURE_FORMAT_RGBA8;
+	_tileBytes = 0;
+	_pagesPerSide = 0;
+	_maxTiles = 0;
+	_tilesPerFrame = 16;
+	_memorySize = 0;
+	_atlas = 0;
+	_textureBuffer = 0;
+	_pageTableBuffer = 0;
+	for( unsigned int i = 0; i < NUM_FEEDBACK_BUFFERS; i++ )
+	{
+		_feedbackBuffers[i] = 0;
+		_feedbackFences[i] = 0;
+	}
+	_frame = 0;
+	_quit = false;
+	memset( &_stats, 0, sizeof( _stats ) );
+}
+
+VirtualTexturePool::~VirtualTexturePool()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_quit = true;
+	}
+	_tileQueued.notify_all();
+	for( size_t i = 0; i < _workers.size(); i++ )
+	{
+		_workers[i].join();
+	}
+
+	for( unsigned int i = 0; i < NUM_FEEDBACK_BUFFERS; i++ )
+	{
+		glDeleteSync( _feedbackFences[i] );
+	}
+	glDeleteBuffers( NUM_FEEDBACK_BUFFERS, _feedbackBuffers );
+	glDeleteBuffers( 1, &_pageTableBuffer );
+	glDeleteBuffers( 1, &_textureBuffer );
+	GLState::ForgetTexture( _atlas );
+	glDeleteTextures( 1, &_atlas );
+}
+
+bool VirtualTexturePool::Init( unsigned int pagesPerSide, unsigned int maxTiles, unsigned int numThreads )
+{
+	// Page coordinates are packed into 8 bits each in the page table
+	_pagesPerSide = std::min( pagesPerSide, 256u );
+	_maxTiles = maxTiles;
+	_format = Texture::IsFormatSupported( TEXTURE_FORMAT_BC1 ) ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_RGBA8;
+	_tileBytes = GetTextureLevelSize( _format, PAGE_SIZE, PAGE_SIZE );
+
+	// One level, the tiles bring their own levels with them
+	// Linear filtering reads the border at a tile's edge rather than the next page
+	glGenTextures( 1, &_atlas );
+	GLState::BindTexture( 0, GL_TEXTURE_2D, _atlas );
+	glTexStorage2D( GL_TEXTURE_2D, 1, Texture::GetInternalFormat( _format ), _pagesPerSide * PAGE_SIZE, _pagesPerSide * PAGE_SIZE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+
+	// Sizes of up to as many textures as there are pages, as each needs at least one
+	unsigned int numPages = _pagesPerSide * _pagesPerSide;
+	size_t textureBufferSize = sizeof( VirtualTextureBufferHeader ) + numPages * sizeof( VirtualTextureInfo );
+	glGenBuffers( 1, &_textureBuffer );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _textureBuffer );
+	glBufferData( GL_SHADER_STORAGE_BUFFER, textureBufferSize, NULL, GL_DYNAMIC_DRAW );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, VIRTUAL_TEXTURE_BUFFER_BINDING, _textureBuffer );
+
+	glGenBuffers( 1, &_pageTableBuffer );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _pageTableBuffer );
+	glBufferData( GL_SHADER_STORAGE_BUFFER, _maxTiles * sizeof( GLuint ), NULL, GL_DYNAMIC_DRAW );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, VIRTUAL_PAGE_TABLE_BUFFER_BINDING, _pageTableBuffer );
+
+	// A bit for every tile
+	size_t feedbackSize = ( _maxTiles + 31 ) / 32 * sizeof( GLuint );
+	glGenBuffers( NUM_FEEDBACK_BUFFERS, _feedbackBuffers );
+	for( unsigned int i = 0; i < NUM_FEEDBACK_BUFFERS; i++ )
+	{
+		glBindBuffer( GL_SHADER_STORAGE_BUFFER, _feedbackBuffers[i] );
+		glBufferData( GL_SHADER_STORAGE_BUFFER, feedbackSize, NULL, GL_DYNAMIC_READ );
+		glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL );
+	}
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, VIRTUAL_FEEDBACK_BUFFER_BINDING, _feedbackBuffers[0] );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	_memorySize = (size_t) numPages * _tileBytes + textureBufferSize + _maxTiles * sizeof( GLuint ) + NUM_FEEDBACK_BUFFERS * feedbackSize;
+
+	_pages.resize( numPages );
+	_freePages.clear();
+	for( unsigned int i = 0; i < numPages; i++ )
+	{
+		_pages[i].tile = -1;
+		_pages[i].lastUsed = 0;
+		_pages[i].pinned = false;
+		// Handed out from the back, so the first page goes first
+		_freePages.push_back( numPages - 1 - i );
+	}
+	_stats.numPages = numPages;
+
+	for( unsigned int i = 0; i < std::max( numThreads, 1u ); i++ )
+	{
+		_workers.push_back( std::thread( &VirtualTexturePool::WorkerLoop, this ) );
+	}
+
+	std::cout<<"INFO: Virtual texture atlas of "<<numPages<<" "<<GetTextureFormatName( _format )<<" pages ("<<_memorySize / 1024<<" KB in all)"<<std::endl;
+	return glGetError() == GL_NO_ERROR;
+}
+
+int VirtualTexturePool::Load( const std::string &filename )
+{
+	if( _atlas == 0 )
+	{
+		return -1;
+	}
+
+	MappedFile sourceFile;
+	if( !sourceFile.Open( filename ) )
+	{
+		std::cerr<<"WARNING: could not load virtual texture: "<<filename<<std::endl;
+		return -1;
+	}
+
+	// Every texture has to be in the atlas's format
+	TextureLoadOptions options;
+	options.compression = _format;
+	unsigned long long settingsHash = options.GetSettingsHash();
+
+	std::unique_ptr<VirtualTexture> texture( new VirtualTexture );
+	std::string tilePath = TextureFile::GetCompressedPath( filename, ".svt" );
+	if( !ReadTileFile( tilePath, sourceFile, settingsHash, *texture ) )
+	{
+		TextureData data;
+		bool loaded = Texture::LoadData( filename, options, data );
+		std::cout<<data.log.str();
+		if( !loaded )
+		{
+			return -1;
+		}
+		if( data.chain.format != _format )
+		{
+			std::cerr<<"WARNING: "<<filename<<" is "<<GetTextureFormatName( data.chain.format )<<" but virtual textures are "<<GetTextureFormatName( _format )<<std::endl;
+			return -1;
+		}
+		if( !WriteTileFile( tilePath, sourceFile, settingsHash, data.chain ) || !ReadTileFile( tilePath, sourceFile, settingsHash, *texture ) )
+		{
+			return -1;
+		}
+	}
+
+	// Each texture pins a page for every tile of its smallest level
+	// That's normally one, but compressed tiles stop at the last 4x4 level, which for a long thin texture can be several
+	unsigned int coarsestX, coarsestY;
+	GetTileCounts( texture->width, texture->height, texture->numLevels - 1, coarsestX, coarsestY );
+	unsigned int numCoarsest = coarsestX * coarsestY;
+	if( _tiles.size() + texture->numTiles > _maxTiles || _textures.size() >= _pages.size() || _freePages.size() < numCoarsest )
+	{
+		std::cerr<<"WARNING: no room left for virtual texture: "<<filename<<std::endl;
+		return -1;
+	}
+
+	int id = (int) _textures.size();
+	texture->firstTile = (unsigned int) _tiles.size();
+	texture->dirty = true;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		for( unsigned int level = 0; level < texture->numLevels; level++ )
+		{
+			unsigned int tilesX, tilesY;
+			GetTileCounts( texture->width, texture->height, level, tilesX, tilesY );
+			for( unsigned int y = 0; y < tilesY; y++ )
+			{
+				for( unsigned int x = 0; x < tilesX; x++ )
+				{
+					Tile tile;
+					tile.texture = id;
+					tile.level = level;
+					tile.x = x;
+					tile.y = y;
+					tile.page = -1;
+					tile.requested = false;
+					_tiles.push_back( tile );
+				}
+			}
+		}
+		_textures.push_back( std::move( texture ) );
+	}
+	const VirtualTexture &added = *_textures.back();
+
+	VirtualTextureInfo info;
+	info.width = added.width;
+	info.height = added.height;
+	info.numLevels = added.numLevels;
+	info.firstTile = added.firstTile;
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _textureBuffer );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, sizeof( VirtualTextureBufferHeader ) + id * sizeof( VirtualTextureInfo ), sizeof( info ), &info );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	// The smallest level's tiles are the last ones, they go in now and stay
+	for( unsigned int t = added.numTiles - numCoarsest; t < added.numTiles; t++ )
+	{
+		unsigned int tile = added.firstTile + t;
+		int page = _freePages.back();
+		_freePages.pop_back();
+		UploadTile( page, added.tiles + (size_t) t * _tileBytes );
+		_pages[page].tile = tile;
+		_pages[page].pinned = true;
+		_tiles[tile].page = page;
+	}
+	WritePageTable( added );
+
+	_stats.numTextures = (unsigned int) _textures.size();
+	_stats.numTiles = (unsigned int) _tiles.size();
+	std::cout<<"INFO: Loaded virtual texture "<<filename<<" from "<<tilePath<<" ("<<added.width<<"x"<<added.height<<", "<<added.numTiles<<" tiles)"<<std::endl;
+	return id;
+}
+
+bool VirtualTexturePool::ReadTileFile( const std::string &tilePath, const MappedFile &sourceFile, unsigned long long settingsHash, VirtualTexture &texture )
+{
+	if( !texture.file.Open( tilePath ) )
+	{
+		return false;
+	}
+
+	const char *data = texture.file.GetData();
+	size_t size = texture.file.GetSize();
+	VirtualTextureHeader header;
+	if( size < sizeof( header ) )
+	{
+		texture.file.Close();
+		return false;
+	}
+	memcpy( &header, data, sizeof( header ) );
+
+	// Is this a file we can read, cut the same way from the same image?
+	if( memcmp( header.magic, "SVTX", 4 ) != 0 || header.version != VIRTUAL_TEXTURE_VERSION || header.settingsHash != settingsHash
+		|| header.sourceSize != sourceFile.GetSize() || header.format != (unsigned int) _format
+		|| header.tileSize != VIRTUAL_TILE_SIZE || header.tileBorder != VIRTUAL_TILE_BORDER || header.width == 0 || header.height == 0
+		|| header.numLevels == 0 || header.numTiles != CountTiles( header.width, header.height, header.numLevels )
+		|| sizeof( header ) + (size_t) header.numTiles * _tileBytes > size )
+	{
+		texture.file.Close();
+		return false;
+	}
+
+	// Same check as the texture cache, the hash is only worked out if the time has changed
+	if( header.sourceModifiedTime != sourceFile.GetModifiedTime()
+		&& header.sourceHash != HashBytes( sourceFile.GetData(), sourceFile.GetSize() ) )
+	{
+		texture.file.Close();
+		return false;
+	}
+
+	texture.width = header.width;
+	texture.height = header.height;
+	texture.numLevels = header.numLevels;
+	texture.numTiles = header.numTiles;
+	texture.tiles = (const unsigned char*) data + sizeof( header );
+	return true;
+}
+
+bool VirtualTexturePool::WriteTileFile( const std::string &tilePath, const MappedFile &sourceFile, unsigned long long settingsHash, const MipChain &chain )
+{
+	VirtualTextureHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, "SVTX", 4 );
+	header.version = VIRTUAL_TEXTURE_VERSION;
+	header.sourceSize = sourceFile.GetSize();
+	header.sourceModifiedTime = sourceFile.GetModifiedTime();
+	header.sourceHash = HashBytes( sourceFile.GetData(), sourceFile.GetSize() );
+	header.settingsHash = settingsHash;
+	header.width = chain.width;
+	header.height = chain.height;
+	header.format = chain.format;
+	// Compressed levels smaller than a block can't be wrapped a block at a time, so the tiles stop at the last 4x4 level
+	unsigned int minSize = chain.format == TEXTURE_FORMAT_RGBA8 ? 1 : 4;
+	while( header.numLevels < chain.levels.size() && chain.levels[header.numLevels].width >= minSize && chain.levels[header.numLevels].height >= minSize )
+	{
+		header.numLevels++;
+	}
+	if( header.numLevels == 0 )
+	{
+		std::cerr<<"WARNING: "<<tilePath<<" is too small for a virtual texture"<<std::endl;
+		return false;
+	}
+	header.tileSize = VIRTUAL_TILE_SIZE;
+	header.tileBorder = VIRTUAL_TILE_BORDER;
+	header.numTiles = CountTiles( header.width, header.height, header.numLevels );
+
+	// Write to a temporary file first, so a crash part way through never leaves a broken one behind
+	std::string tempPath = tilePath + ".tmp";
+	FILE *file = fopen( tempPath.c_str(), "wb" );
+	if( file == NULL )
+	{
+		std::cerr<<"WARNING: Could not write virtual texture tiles: "<<tilePath<<std::endl;
+		return false;
+	}
+
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+	std::vector<unsigned char> tile( _tileBytes );
+	for( unsigned int level = 0; level < header.numLevels && ok; level++ )
+	{
+		unsigned int tilesX, tilesY;
+		GetTileCounts( header.width, header.height, level, tilesX, tilesY );
+		for( unsigned int y = 0; y < tilesY && ok; y++ )
+		{
+			for( unsigned int x = 0; x < tilesX && ok; x++ )
+			{
+				CutTile( chain, level, x, y, &tile[0] );
+				ok = fwrite( &tile[0], 1, _tileBytes, file ) == _tileBytes;
+			}
+		}
+	}
+	ok = ( fclose( file ) == 0 ) && ok;
+
+	remove( tilePath.c_str() );
+	if( !ok || rename( tempPath.c_str(), tilePath.c_str() ) != 0 )
+	{
+		remove( tempPath.c_str() );
+		std::cerr<<"WARNING: Could not write virtual texture tiles: "<<tilePath<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+void VirtualTexturePool::Update()
+{
+	_frame++;
+	_stats.tilesLoaded = 0;
+	_stats.tilesEvicted = 0;
+	if( _atlas == 0 )
+	{
+		return;
+	}
+
+	// Last frame's draws are all in, so its feedback is done once the GPU gets past here
+	unsigned int lastSlot = ( _frame - 1 ) % NUM_FEEDBACK_BUFFERS;
+	glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );
+	glDeleteSync( _feedbackFences[lastSlot] );
+	_feedbackFences[lastSlot] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	// This frame writes into the oldest buffer, so read what's in it first
+	unsigned int slot = _frame % NUM_FEEDBACK_BUFFERS;
+	ReadFeedback( slot );
+	UploadTiles();
+	for( size_t t = 0; t < _textures.size(); t++ )
+	{
+		if( _textures[t]->dirty )
+		{
+			WritePageTable( *_textures[t] );
+		}
+	}
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _feedbackBuffers[slot] );
+	glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, VIRTUAL_FEEDBACK_BUFFER_BINDING, _feedbackBuffers[slot] );
+
+	// A different pixel of every 4x4 block writes feedback each frame, so over 16 frames every pixel has had a say
+	// Stepping by 7 rather than 1 spreads them over the block instead of sweeping along a row
+	VirtualTextureBufferHeader header;
+	header.feedbackPixel = ( _frame * 7 ) % 16;
+	header.padding[0] = header.padding[1] = header.padding[2] = 0;
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _textureBuffer );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, sizeof( header ), &header );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	unsigned int residentPages = 0;
+	for( size_t p = 0; p < _pages.size(); p++ )
+	{
+		residentPages += _pages[p].tile >= 0 ? 1 : 0;
+	}
+	_stats.residentPages = residentPages;
+}
+
+void VirtualTexturePool::ReadFeedback( unsigned int slot )
+{
+	if( _feedbackFences[slot] == 0 )
+	{
+		return;
+	}
+	// If the GPU is that far behind this frame's feedback is skipped
+	GLenum result = glClientWaitSync( _feedbackFences[slot], 0, 0 );
+	glDeleteSync( _feedbackFences[slot] );
+	_feedbackFences[slot] = 0;
+	if( ( result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED ) || _tiles.empty() )
+	{
+		return;
+	}
+
+	_feedback.resize( ( _tiles.size() + 31 ) / 32 );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _feedbackBuffers[slot] );
+	glGetBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, _feedback.size() * sizeof( GLuint ), &_feedback[0] );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	std::vector<unsigned int> requests;
+	for( size_t word = 0; word < _feedback.size(); word++ )
+	{
+		if( _feedback[word] == 0 )
+		{
+			continue;
+		}
+		// The last word can have bits past the end of the tiles, the shader never sets them but the buffer could hold anything
+		for( unsigned int bit = 0; bit < 32; bit++ )
+		{
+			unsigned int t = (unsigned int) word * 32 + bit;
+			if( ( ( _feedback[word] >> bit ) & 1 ) == 0 || t >= _tiles.size() )
+			{
+				continue;
+			}
+			Tile &tile = _tiles[t];
+			if( tile.page >= 0 )
+			{
+				_pages[tile.page].lastUsed = _frame;
+			}
+			else if( !tile.requested )
+			{
+				tile.requested = true;
+				requests.push_back( t );
+			}
+		}
+	}
+	if( requests.empty() )
+	{
+		return;
+	}
+
+	// Coarse tiles first, they cover more of the screen and the finer ones make little sense without them
+	std::stable_sort( requests.begin(), requests.end(), [this]( unsigned int a, unsigned int b ) { return _tiles[a].level > _tiles[b].level; } );
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_queued.insert( _queued.end(), requests.begin(), requests.end() );
+		_stats.pendingTiles = (unsigned int) ( _queued.size() + _loaded.size() );
+	}
+	_tileQueued.notify_all();
+}
+
+void VirtualTexturePool::WorkerLoop()
+{
+	while( true )
+	{
+		TileLoad load;
+		const unsigned char *source = NULL;
+		{
+			std::unique_lock<std::mutex> lock( _mutex );
+			_tileQueued.wait( lock, [this]() { return _quit || !_queued.empty(); } );
+			if( _quit )
+			{
+				return;
+			}
+			load.tile = _queued.front();
+			_queued.pop_front();
+			const Tile &tile = _tiles[load.tile];
+			const VirtualTexture &texture = *_textures[tile.texture];
+			source = texture.tiles + (size_t) ( load.tile - texture.firstTile ) * _tileBytes;
+		}
+
+		// The file is mapped, so this copy is where the tile is actually read from disk, which is why it's done here
+		load.data.assign( source, source + _tileBytes );
+
+		std::lock_guard<std::mutex> lock( _mutex );
+		_loaded.push_back( std::move( load ) );
+	}
+}
+
+void VirtualTexturePool::UploadTiles()
+{
+	for( unsigned int uploaded = 0; uploaded < _tilesPerFrame; uploaded++ )
+	{
+		TileLoad load;
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			if( _loaded.empty() )
+			{
+				break;
+			}
+			load = std::move( _loaded.front() );
+			_loaded.pop_front();
+		}
+
+		Tile &tile = _tiles[load.tile];
+		tile.requested = false;
+		int page = AllocatePage();
+		if( page < 0 )
+		{
+			// Everything in the atlas is on screen, it'll be asked for again if it's still wanted once something isn't
+			continue;
+		}
+		UploadTile( page, &load.data[0] );
+		_pages[page].tile = load.tile;
+		_pages[page].lastUsed = _frame;
+		tile.page = page;
+		_textures[tile.texture]->dirty = true;
+		_stats.tilesLoaded++;
+	}
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	_stats.pendingTiles = (unsigned int) ( _queued.size() + _loaded.size() );
+}
+
+int VirtualTexturePool::AllocatePage()
+{
+	if( !_freePages.empty() )
+	{
+		int page = _freePages.back();
+		_freePages.pop_back();
+		return page;
+	}
+
+	// Feedback comes back a few frames late, so anything used since then might still be on screen
+	int oldest = -1;
+	for( size_t p = 0; p < _pages.size(); p++ )
+	{
+		const Page &page = _pages[p];
+		if( !page.pinned && page.lastUsed + NUM_FEEDBACK_BUFFERS < _frame && ( oldest < 0 || page.lastUsed < _pages[oldest].lastUsed ) )
+		{
+			oldest = (int) p;
+		}
+	}
+	if( oldest < 0 )
+	{
+		return -1;
+	}
+
+	Tile &evicted = _tiles[_pages[oldest].tile];
+	evicted.page = -1;
+	_textures[evicted.texture]->dirty = true;
+	_pages[oldest].tile = -1;
+	_stats.tilesEvicted++;
+	return oldest;
+}
+
+void VirtualTexturePool::UploadTile( int page, const unsigned char *data )
+{
+	GLint x = ( page % _pagesPerSide ) * PAGE_SIZE;
+	GLint y = ( page / _pagesPerSide ) * PAGE_SIZE;
+	GLState::BindTexture( 0, GL_TEXTURE_2D, _atlas );
+	if( _format == TEXTURE_FORMAT_RGBA8 )
+	{
+		glTexSubImage2D( GL_TEXTURE_2D, 0, x, y, PAGE_SIZE, PAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, data );
+	}
+	else
+	{
+		glCompressedTexSubImage2D( GL_TEXTURE_2D, 0, x, y, PAGE_SIZE, PAGE_SIZE, Texture::GetInternalFormat( _format ), (GLsizei) _tileBytes, data );
+	}
+}
+
+void VirtualTexturePool::WritePageTable( const VirtualTexture &texture )
+{
+	// Entries are page x | page y << 8 | level << 16, the level being the one the page's tile is from
+	// Working up from the smallest level, a tile that isn't in takes its parent's entry, so it's drawn from the finest copy there is
+	std::vector<GLuint> entries( texture.numTiles );
+	unsigned int levelStart = texture.numTiles;
+	unsigned int parentStart = 0, parentTilesX = 0, parentTilesY = 0;
+	for( int level = (int) texture.numLevels - 1; level >= 0; level-- )
+	{
+		unsigned int tilesX, tilesY;
+		GetTileCounts( texture.width, texture.height, level, tilesX, tilesY );
+		levelStart -= tilesX * tilesY;
+		for( unsigned int y = 0; y < tilesY; y++ )
+		{
+			for( unsigned int x = 0; x < tilesX; x++ )
+			{
+				unsigned int index = levelStart + y * tilesX + x;
+				const Tile &tile = _tiles[texture.firstTile + index];
+				if( tile.page >= 0 )
+				{
+					entries[index] = ( tile.page % _pagesPerSide ) | ( ( tile.page / _pagesPerSide ) << 8 ) | ( level << 16 );
+				}
+				else if( parentTilesX > 0 )
+				{
+					// The smallest level's tiles are pinned, so there's always a parent to fall back on
+					unsigned int parentX = std::min( x / 2, parentTilesX - 1 );
+					unsigned int parentY = std::min( y / 2, parentTilesY - 1 );
+					entries[index] = entries[parentStart + parentY * parentTilesX + parentX];
+				}
+			}
+		}
+		parentStart = levelStart;
+		parentTilesX = tilesX;
+		parentTilesY = tilesY;
+	}
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, _pageTableBuffer );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, texture.firstTile * sizeof( GLuint ), entries.size() * sizeof( GLuint ), &entries[0] );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	// Only the render thread touches the flag
+	const_cast<VirtualTexture&>( texture ).dirty = false;
+}
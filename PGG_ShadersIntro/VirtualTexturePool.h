@@ -0,0 +1,184 @@
+
+#ifndef __VIRTUAL_TEXTURE_POOL__
+#define __VIRTUAL_TEXTURE_POOL__
+
+#include "glew.h"
+#include "Texture.h"
+#include "MappedFile.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Shader storage binding points of the texture sizes, the page table and the feedback, see Resources/virtualTexture.txt
+const GLuint VIRTUAL_TEXTURE_BUFFER_BINDING = 5;
+const GLuint VIRTUAL_PAGE_TABLE_BUFFER_BINDING = 6;
+const GLuint VIRTUAL_FEEDBACK_BUFFER_BINDING = 7;
+
+// Texels along each side of a tile, and the texels from around it kept with it so filtering at its edges doesn't need its neighbours
+// These must match Resources/virtualTexture.txt
+const unsigned int VIRTUAL_TILE_SIZE = 128;
+const unsigned int VIRTUAL_TILE_BORDER = 4;
+
+// What the pool is up to, for showing on screen
+struct VirtualTextureStats
+{
+	unsigned int numTextures;
+	unsigned int numTiles;
+	// Pages of the atlas holding a tile, out of how many there are
+	unsigned int residentPages;
+	unsigned int numPages;
+	// Asked for by the GPU and not in the atlas yet
+	unsigned int pendingTiles;
+	// Uploaded by the last Update, and pushed out to make room for them
+	unsigned int tilesLoaded;
+	unsigned int tilesEvicted;
+};
+
+// Virtual texturing: textures are cut into 128x128 tiles, and only the tiles something on screen uses are kept on the GPU
+// Every texture's tiles share one atlas of pages, so video memory stays the same however much texture there is
+//
+// - Tiles are cut once from the texture's levels and kept in a .svt file next to the image, which workers read them from
+// - The page table says, for every tile of every texture, which page holds it, or holds the nearest coarser tile when it isn't in
+// - Shaders with VIRTUAL_TEXTURE look tiles up there, and set a bit for each tile they wanted (one pixel in 16 does, each frame
+//   a different one). That's read back a couple of frames later, so the GPU is never waited on
+// - Missing tiles are read by the workers, coarsest first, and uploaded a few a frame. When the atlas is full they replace
+//   the tile that was least recently asked for
+// - Each texture's smallest level is loaded straight away and never replaced, so there's always something to draw
+class VirtualTexturePool
+{
+public:
+
+	VirtualTexturePool();
+	~VirtualTexturePool();
+
+	// Makes an atlas of pagesPerSide x pagesPerSide pages and room in the page table for maxTiles tiles, and starts the workers
+	// Tiles are BC1 when the driver can sample it, RGBA8 otherwise
+	// Returns false if something couldn't be made
+	bool Init( unsigned int pagesPerSide = 16, unsigned int maxTiles = 16384, unsigned int numThreads = 1 );
+
+	// Adds a texture, reading its tiles from the .svt file next to the image or cutting them from the image first
+	// Returns the texture's id for Material::SetVirtualTexture, or -1 if it couldn't be loaded
+	int Load( const std::string &filename );
+
+	// Reads back the tiles wanted a couple of frames ago and queues the missing ones, uploads what the workers have read
+	// and updates the page table
+	// Call once a frame on the render thread, before anything is drawn
+	void Update();
+
+	// Most tiles Update uploads in a frame
+	void SetTilesPerFrame( unsigned int tilesPerFrame ) { _tilesPerFrame = tilesPerFrame; }
+
+	// The physical pages, sampled by shaders with VIRTUAL_TEXTURE
+	GLuint GetAtlas() const { return _atlas; }
+
+	// Bytes of video memory taken by the atlas and buffers, fixed by Init
+	size_t GetMemorySize() const { return _memorySize; }
+
+	const VirtualTextureStats& GetStats() const { return _stats; }
+
+protected:
+
+	// One texture's tiles, every level's one after another
+	struct VirtualTexture
+	{
+		unsigned int width, height, numLevels;
+		unsigned int firstTile, numTiles;
+		// The .svt file, tiles are read straight out of it
+		MappedFile file;
+		const unsigned char *tiles;
+		// The page table needs writing again
+		bool dirty;
+	};
+
+	struct Tile
+	{
+		unsigned int texture;
+		unsigned int level, x, y;
+		// Page holding it, -1 if it isn't in the atlas
+		int page;
+		// Waiting for a worker or to be uploaded, so it isn't asked for twice
+		bool requested;
+	};
+
+	struct Page
+	{
+		// Tile it holds, -1 if free
+		int tile;
+		// Last frame the feedback said the tile was used
+		unsigned int lastUsed;
+		// The smallest level of a texture, never replaced
+		bool pinned;
+	};
+
+	// A tile read by a worker, waiting to be uploaded
+	struct TileLoad
+	{
+		unsigned int tile;
+		std::vector<unsigned char> data;
+	};
+
+	// The atlas and workers can't be shared between pools
+	VirtualTexturePool( const VirtualTexturePool & );
+	VirtualTexturePool& operator=( const VirtualTexturePool & );
+
+	void WorkerLoop();
+
+	// Maps a .svt file made from the same image with the same settings, false if there isn't one
+	bool ReadTileFile( const std::string &tilePath, const MappedFile &sourceFile, unsigned long long settingsHash, VirtualTexture &texture );
+
+	// Cuts every level of the chain into tiles and saves them
+	bool WriteTileFile( const std::string &tilePath, const MappedFile &sourceFile, unsigned long long settingsHash, const MipChain &chain );
+
+	// Sets bits for the tiles wanted in a frame's feedback, marks the ones in the atlas as used and queues the rest
+	void ReadFeedback( unsigned int slot );
+
+	// Uploads tiles the workers have read, up to the budget
+	void UploadTiles();
+
+	// A free page, or the least recently used one that nothing has asked for in a few frames, -1 if there isn't one
+	int AllocatePage();
+
+	void UploadTile( int page, const unsigned char *data );
+
+	// Points every tile of the texture at the finest copy of it in the atlas
+	void WritePageTable( const VirtualTexture &texture );
+
+	TextureFormat _format;
+	size_t _tileBytes;
+	unsigned int _pagesPerSide;
+	unsigned int _maxTiles;
+	unsigned int _tilesPerFrame;
+	size_t _memorySize;
+
+	GLuint _atlas;
+	GLuint _textureBuffer;
+	GLuint _pageTableBuffer;
+
+	// Frames take turns with these, so the one being read back is the one the GPU finished with longest ago
+	static const unsigned int NUM_FEEDBACK_BUFFERS = 3;
+	GLuint _feedbackBuffers[NUM_FEEDBACK_BUFFERS];
+	GLsync _feedbackFences[NUM_FEEDBACK_BUFFERS];
+	std::vector<GLuint> _feedback;
+	unsigned int _frame;
+
+	std::vector< std::unique_ptr<VirtualTexture> > _textures;
+	std::vector<Tile> _tiles;
+	std::vector<Page> _pages;
+	std::vector<int> _freePages;
+
+	// The workers read textures and tiles, so they're only added to with the mutex held
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _tileQueued;
+	bool _quit;
+	std::deque<unsigned int> _queued;
+	std::deque<TileLoad> _loaded;
+
+	VirtualTextureStats _stats;
+};
+
+#endif